@@ -38,6 +38,8 @@ DocumentItem::DocumentItem(QObject *parent)
     m_document = new Okular::Document(0);
     m_tocModel = new TOCModel(m_document, this);
 
+    connect(m_document, SIGNAL(openDocumentFinished(Okular::Document::OpenResult)),
+            this, SLOT(documentOpened()));
     connect(m_document, SIGNAL(searchFinished(int,Okular::Document::SearchStatus)),
             this, SLOT(searchFinished(int,Okular::Document::SearchStatus)));
     connect(m_document->bookmarkManager(), SIGNAL(bookmarksChanged(KUrl)),
@@ -56,8 +58,12 @@ void DocumentItem::setPath(const QString &path)
 {
     //TODO: remote urls
     //TODO: password
-    m_document->openDocument(path, KUrl(path), KMimeType::findByUrl(KUrl(path)));
+    // big documents are loaded in background, documentOpened() goes on
+    m_document->openDocumentAsynchronously(path, KUrl(path), KMimeType::findByUrl(KUrl(path)));
+}
 
+void DocumentItem::documentOpened()
+{
     m_tocModel->fill(m_document->documentSynopsis());
     m_tocModel->setCurrentViewport(m_document->viewport());
 
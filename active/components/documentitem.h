@@ -153,6 +153,7 @@ Q_SIGNALS:
     void windowTitleForDocumentChanged();
 
 private Q_SLOTS:
+    void documentOpened();
     void searchFinished(int id, Okular::Document::SearchStatus endStatus);
 
 private:
@@ -79,6 +79,7 @@ class OKULAR_EXPORT AudioPlayer : public QObject
         friend class AudioPlayerPrivate;
         AudioPlayerPrivate * const d;
         friend class Document;
+        friend class DocumentPrivate;
 
         Q_DISABLE_COPY( AudioPlayer )
         Q_PRIVATE_SLOT( d, void finished( int ) )
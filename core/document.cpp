@@ -24,16 +24,21 @@
 
 // qt/kde/system includes
 #include <QtCore/QtAlgorithms>
+#include <QtCore/QCryptographicHash>
 #include <QtCore/QDir>
 #include <QtCore/QFile>
 #include <QtCore/QFileInfo>
 #include <QtCore/QMap>
 #include <QtCore/QTextStream>
+#include <QtCore/QThread>
 #include <QtCore/QTimer>
+#include <QtCore/QXmlStreamReader>
+#include <QtCore/QXmlStreamWriter>
 #include <QtGui/QApplication>
 #include <QtGui/QLabel>
 #include <QtGui/QPrinter>
 #include <QtGui/QPrintDialog>
+#include <QtGui/QPixmap>
 #include <QStack>
 #include <QUndoCommand>
 
@@ -49,6 +54,7 @@
 #include <kmimetypetrader.h>
 #include <kprocess.h>
 #include <krun.h>
+#include <ksavefile.h>
 #include <kshell.h>
 #include <kstandarddirs.h>
 #include <ktemporaryfile.h>
@@ -69,6 +75,7 @@
 #include "interfaces/guiinterface.h"
 #include "interfaces/printinterface.h"
 #include "interfaces/saveinterface.h"
+#include "mappedfile_p.h"
 #include "observer.h"
 #include "misc.h"
 #include "page.h"
@@ -107,11 +114,14 @@ struct AllocatedPixmap
 struct ArchiveData
 {
     ArchiveData()
+        : referencesDocument( false )
     {
     }
 
     KTemporaryFile document;
     KTemporaryFile metadataFile;
+    // the archive only references the document, which is opened in place
+    bool referencesDocument;
 };
 
 struct RunningSearch
@@ -619,87 +629,96 @@ void DocumentPrivate::loadDocumentInfo()
     loadDocumentInfo( infoFile );
 }
 
+// reads the current element of @p reader, with all its children, into
+// an element of @p document
+static QDomElement readDomElement( QXmlStreamReader &reader, QDomDocument &document )
+{
+    QDomElement element = document.createElement( reader.name().toString() );
+    foreach ( const QXmlStreamAttribute &attribute, reader.attributes() )
+        element.setAttribute( attribute.name().toString(), attribute.value().toString() );
+
+    while ( !reader.atEnd() )
+    {
+        reader.readNext();
+        if ( reader.isStartElement() )
+            element.appendChild( readDomElement( reader, document ) );
+        else if ( reader.isCharacters() && !reader.isWhitespace() )
+            element.appendChild( document.createTextNode( reader.text().toString() ) );
+        else if ( reader.isEndElement() )
+            break;
+    }
+    return element;
+}
+
 void DocumentPrivate::loadDocumentInfo( QFile &infoFile )
 {
     if ( !infoFile.exists() || !infoFile.open( QIODevice::ReadOnly ) )
         return;
 
-    // Load DOM from XML file
-    QDomDocument doc( "documentInfo" );
-    if ( !doc.setContent( &infoFile ) )
+    // Stream the XML file, only the contents of each page are read into
+    // a (small) DOM, as that is what annotations are restored from
+    QXmlStreamReader reader( &infoFile );
+    if ( !reader.readNextStartElement() || reader.name() != "documentInfo" )
     {
-        kDebug(OkularDebug) << "Can't load XML pair! Check for broken xml.";
         infoFile.close();
         return;
     }
-    infoFile.close();
-
-    QDomElement root = doc.documentElement();
-    if ( root.tagName() != "documentInfo" )
-        return;
-
-    KUrl documentUrl( root.attribute( "url" ) );
+    if ( reader.attributes().value( "externalAnnotations" ) == "true" )
+        m_containsExternalAnnotations = true;
 
-    // Parse the DOM tree
-    QDomNode topLevelNode = root.firstChild();
-    while ( topLevelNode.isElement() )
+    while ( reader.readNextStartElement() )
     {
-        QString catName = topLevelNode.toElement().tagName();
-
-        // Restore page attributes (bookmark, annotations, ...) from the DOM
-        if ( catName == "pageList" )
+        // Restore page attributes (bookmark, annotations, ...)
+        if ( reader.name() == "pageList" )
         {
-            QDomNode pageNode = topLevelNode.firstChild();
-            while ( pageNode.isElement() )
+            while ( reader.readNextStartElement() )
             {
-                QDomElement pageElement = pageNode.toElement();
-                if ( pageElement.hasAttribute( "number" ) )
-                {
-                    // get page number (node's attribute)
-                    bool ok;
-                    int pageNumber = pageElement.attribute( "number" ).toInt( &ok );
+                // get page number (node's attribute)
+                bool ok = false;
+                const int pageNumber = reader.attributes().value( "number" ).toString().toInt( &ok );
 
-                    // pass the domElement to the right page, to read config data from
-                    if ( ok && pageNumber >= 0 && pageNumber < (int)m_pagesVector.count() )
-                        m_pagesVector[ pageNumber ]->d->restoreLocalContents( pageElement );
+                // pass the page element to the right page, to read config data from
+                if ( ok && pageNumber >= 0 && pageNumber < (int)m_pagesVector.count() )
+                {
+                    QDomDocument pageDocument;
+                    const QDomElement pageElement = readDomElement( reader, pageDocument );
+                    m_pagesVector[ pageNumber ]->d->restoreLocalContents( pageElement );
+                }
+                else
+                {
+                    reader.skipCurrentElement();
                 }
-                pageNode = pageNode.nextSibling();
             }
         }
 
-        // Restore 'general info' from the DOM
-        else if ( catName == "generalInfo" )
+        // Restore 'general info'
+        else if ( reader.name() == "generalInfo" )
         {
-            QDomNode infoNode = topLevelNode.firstChild();
-            while ( infoNode.isElement() )
+            while ( reader.readNextStartElement() )
             {
-                QDomElement infoElement = infoNode.toElement();
-
                 // restore viewports history
-                if ( infoElement.tagName() == "history" )
+                if ( reader.name() == "history" )
                 {
                     // clear history
                     m_viewportHistory.clear();
                     // append old viewports
-                    QDomNode historyNode = infoNode.firstChild();
-                    while ( historyNode.isElement() )
+                    while ( reader.readNextStartElement() )
                     {
-                        QDomElement historyElement = historyNode.toElement();
-                        if ( historyElement.hasAttribute( "viewport" ) )
+                        if ( reader.attributes().hasAttribute( "viewport" ) )
                         {
-                            QString vpString = historyElement.attribute( "viewport" );
+                            QString vpString = reader.attributes().value( "viewport" ).toString();
                             m_viewportIterator = m_viewportHistory.insert( m_viewportHistory.end(),
                                     DocumentViewport( vpString ) );
                         }
-                        historyNode = historyNode.nextSibling();
+                        reader.skipCurrentElement();
                     }
                     // consistancy check
                     if ( m_viewportHistory.isEmpty() )
                         m_viewportIterator = m_viewportHistory.insert( m_viewportHistory.end(), DocumentViewport() );
                 }
-                else if ( infoElement.tagName() == "rotation" )
+                else if ( reader.name() == "rotation" )
                 {
-                    QString str = infoElement.text();
+                    QString str = reader.readElementText();
                     bool ok = true;
                     int newrotation = !str.isEmpty() ? ( str.toInt( &ok ) % 4 ) : 0;
                     if ( ok && newrotation != 0 )
@@ -707,33 +726,45 @@ void DocumentPrivate::loadDocumentInfo( QFile &infoFile )
                         setRotationInternal( newrotation, false );
                     }
                 }
-                else if ( infoElement.tagName() == "views" )
+                else if ( reader.name() == "views" )
                 {
-                    QDomNode viewNode = infoNode.firstChild();
-                    while ( viewNode.isElement() )
+                    while ( reader.readNextStartElement() )
                     {
-                        QDomElement viewElement = viewNode.toElement();
-                        if ( viewElement.tagName() == "view" )
+                        if ( reader.name() != "view" )
                         {
-                            const QString viewName = viewElement.attribute( "name" );
-                            Q_FOREACH ( View * view, m_views )
+                            reader.skipCurrentElement();
+                            continue;
+                        }
+
+                        QDomDocument viewDocument;
+                        const QDomElement viewElement = readDomElement( reader, viewDocument );
+                        const QString viewName = viewElement.attribute( "name" );
+                        Q_FOREACH ( View * view, m_views )
+                        {
+                            if ( view->name() == viewName )
                             {
-                                if ( view->name() == viewName )
-                                {
-                                    loadViewsInfo( view, viewElement );
-                                    break;
-                                }
+                                loadViewsInfo( view, viewElement );
+                                break;
                             }
                         }
-                        viewNode = viewNode.nextSibling();
                     }
                 }
-                infoNode = infoNode.nextSibling();
+                else
+                {
+                    reader.skipCurrentElement();
+                }
             }
         }
 
-        topLevelNode = topLevelNode.nextSibling();
+        else
+        {
+            reader.skipCurrentElement();
+        }
     } // </documentInfo>
+
+    if ( reader.hasError() )
+        kDebug(OkularDebug) << "Can't load XML pair! Check for broken xml:" << reader.errorString();
+    infoFile.close();
 }
 
 void DocumentPrivate::loadViewsInfo( View *view, const QDomElement &e )
@@ -769,25 +800,24 @@ void DocumentPrivate::loadViewsInfo( View *view, const QDomElement &e )
     }
 }
 
-void DocumentPrivate::saveViewsInfo( View *view, QDomElement &e ) const
+void DocumentPrivate::saveViewsInfo( View *view, QXmlStreamWriter &writer ) const
 {
     if ( view->supportsCapability( View::Zoom )
          && ( view->capabilityFlags( View::Zoom ) & ( View::CapabilityRead | View::CapabilitySerializable ) )
          && view->supportsCapability( View::ZoomModality )
          && ( view->capabilityFlags( View::ZoomModality ) & ( View::CapabilityRead | View::CapabilitySerializable ) ) )
     {
-        QDomElement zoomEl = e.ownerDocument().createElement( "zoom" );
-        e.appendChild( zoomEl );
+        writer.writeEmptyElement( "zoom" );
         bool ok = true;
         const double zoom = view->capability( View::Zoom ).toDouble( &ok );
         if ( ok && zoom != 0 )
         {
-            zoomEl.setAttribute( "value", QString::number(zoom) );
+            writer.writeAttribute( "value", QString::number(zoom) );
         }
         const int mode = view->capability( View::ZoomModality ).toInt( &ok );
         if ( ok )
         {
-            zoomEl.setAttribute( "mode", mode );
+            writer.writeAttribute( "mode", QString::number( mode ) );
         }
     }
 }
@@ -905,30 +935,29 @@ SaveInterface* DocumentPrivate::generatorSave( GeneratorInfo& info )
     return info.save;
 }
 
-Document::OpenResult DocumentPrivate::openDocumentInternal( const KService::Ptr& offer, bool isstdin, const QString& docFile, const QByteArray& filedata, const QString& password )
+Document::OpenResult DocumentPrivate::openDocumentInternal( DocumentOpening &opening )
 {
-    QString propName = offer->name();
+    QString propName = opening.offer->name();
     QHash< QString, GeneratorInfo >::const_iterator genIt = m_loadedGenerators.constFind( propName );
-    QString catalogName;
     m_walletGenerator = 0;
     if ( genIt != m_loadedGenerators.constEnd() )
     {
         m_generator = genIt.value().generator;
-        catalogName = genIt.value().catalogName;
+        opening.catalogName = genIt.value().catalogName;
     }
     else
     {
-        m_generator = loadGeneratorLibrary( offer );
+        m_generator = loadGeneratorLibrary( opening.offer );
         if ( !m_generator )
             return Document::OpenError;
         genIt = m_loadedGenerators.constFind( propName );
         Q_ASSERT( genIt != m_loadedGenerators.constEnd() );
-        catalogName = genIt.value().catalogName;
+        opening.catalogName = genIt.value().catalogName;
     }
     Q_ASSERT_X( m_generator, "Document::load()", "null generator?!" );
 
-    if ( !catalogName.isEmpty() )
-        KGlobal::locale()->insertCatalog( catalogName );
+    if ( !opening.catalogName.isEmpty() )
+        KGlobal::locale()->insertCatalog( opening.catalogName );
 
     m_generator->d_func()->m_document = this;
 
@@ -937,22 +966,24 @@ Document::OpenResult DocumentPrivate::openDocumentInternal( const KService::Ptr&
     QObject::connect( m_generator, SIGNAL(warning(QString,int)), m_parent, SIGNAL(warning(QString,int)) );
     QObject::connect( m_generator, SIGNAL(notice(QString,int)), m_parent, SIGNAL(notice(QString,int)) );
 
-    QApplication::setOverrideCursor( Qt::WaitCursor );
+    const bool threaded = opening.asynchronous && m_generator->hasFeature( Generator::ThreadedLoading );
+    if ( !threaded )
+        QApplication::setOverrideCursor( Qt::WaitCursor );
 
     const QSizeF dpi = Utils::realDpi(m_widget);
     kDebug() << "Output DPI:" << dpi;
     m_generator->setDPI(dpi);
 
     Document::OpenResult openResult = Document::OpenError;
-    if ( !isstdin )
+    if ( !opening.isstdin )
     {
-        openResult = m_generator->loadDocumentWithPassword( docFile, m_pagesVector, password );
+        openResult = loadDocumentWithGenerator( opening, opening.docFile, QByteArray() );
     }
-    else if ( !filedata.isEmpty() )
+    else if ( !opening.fileData.isEmpty() )
     {
         if ( m_generator->hasFeature( Generator::ReadRawData ) )
         {
-            openResult = m_generator->loadDocumentFromDataWithPassword( filedata, m_pagesVector, password );
+            openResult = loadDocumentWithGenerator( opening, QString(), opening.fileData );
         }
         else
         {
@@ -964,19 +995,29 @@ Document::OpenResult DocumentPrivate::openDocumentInternal( const KService::Ptr&
             }
             else
             {
-                m_tempFile->write( filedata );
+                m_tempFile->write( opening.fileData );
                 QString tmpFileName = m_tempFile->fileName();
                 m_tempFile->close();
-                openResult = m_generator->loadDocumentWithPassword( tmpFileName, m_pagesVector, password );
+                openResult = loadDocumentWithGenerator( opening, tmpFileName, QByteArray() );
             }
         }
     }
 
-    QApplication::restoreOverrideCursor();
+    // the loading goes on in a thread, see loadingThreadFinished()
+    if ( m_loadingThread )
+        return openResult;
+
+    if ( !threaded )
+        QApplication::restoreOverrideCursor();
+    return generatorLoadingDone( opening, openResult );
+}
+
+Document::OpenResult DocumentPrivate::generatorLoadingDone( const DocumentOpening &opening, Document::OpenResult openResult )
+{
     if ( openResult != Document::OpenSuccess || m_pagesVector.size() <= 0 )
     {
-        if ( !catalogName.isEmpty() )
-            KGlobal::locale()->removeCatalog( catalogName );
+        if ( !opening.catalogName.isEmpty() )
+            KGlobal::locale()->removeCatalog( opening.catalogName );
 
         m_generator->d_func()->m_document = 0;
         QObject::disconnect( m_generator, 0, m_parent, 0 );
@@ -1001,32 +1042,142 @@ Document::OpenResult DocumentPrivate::openDocumentInternal( const KService::Ptr&
     return openResult;
 }
 
+/**
+ * Runs the loading of a document in a thread, for the generators that
+ * support it, so the GUI keeps running while big files are parsed.
+ */
+class DocumentLoadingThread : public QThread
+{
+    public:
+        DocumentLoadingThread( Document *document, int serial, Generator *generator, const QString &fileName, const QByteArray &fileData, const DocumentOpening &opening )
+            : m_document( document ), m_serial( serial ), m_generator( generator ),
+              m_fileName( fileName ), m_fileData( fileData ), m_opening( opening ),
+              m_result( Document::OpenError )
+        {
+        }
+
+        Generator *generator() const { return m_generator; }
+        const DocumentOpening &opening() const { return m_opening; }
+        Document::OpenResult result() const { return m_result; }
+        QVector< Page * > pages() const { return m_pages; }
+
+    protected:
+        void run()
+        {
+            if ( m_fileData.isEmpty() )
+                m_result = m_generator->loadDocumentWithPassword( m_fileName, m_pages, m_opening.password );
+            else
+                m_result = m_generator->loadDocumentFromDataWithPassword( m_fileData, m_pages, m_opening.password );
+
+            // by serial, a cancelled loading must not be taken for a newer one
+            QMetaObject::invokeMethod( m_document, "loadingThreadFinished", Qt::QueuedConnection, Q_ARG( int, m_serial ) );
+        }
+
+    private:
+        Document *m_document;
+        int m_serial;
+        Generator *m_generator;
+        QString m_fileName;
+        QByteArray m_fileData;
+        DocumentOpening m_opening;
+        QVector< Page * > m_pages;
+        Document::OpenResult m_result;
+};
+
+Document::OpenResult DocumentPrivate::loadDocumentWithGenerator( const DocumentOpening &opening, const QString& fileName, const QByteArray& fileData )
+{
+    if ( !opening.asynchronous || !m_generator->hasFeature( Generator::ThreadedLoading ) )
+    {
+        if ( fileData.isEmpty() )
+            return m_generator->loadDocumentWithPassword( fileName, m_pagesVector, opening.password );
+        return m_generator->loadDocumentFromDataWithPassword( fileData, m_pagesVector, opening.password );
+    }
+
+    // the pages are built in a vector of the thread and handed over only at
+    // the end; until then the document has no generator, so nothing else
+    // uses it while it is busy
+    m_loadingThread = new DocumentLoadingThread( m_parent, ++m_loadingSerial, m_generator, fileName, fileData, opening );
+    m_generator = 0;
+    m_loadingThread->start();
+    return Document::OpenSuccess;
+}
+
+void DocumentPrivate::loadingThreadFinished( int serial )
+{
+    if ( !m_loadingThread || serial != m_loadingSerial )
+        return;
+
+    DocumentLoadingThread *thread = m_loadingThread;
+    m_loadingThread = 0;
+    thread->wait();
+    m_generator = thread->generator();
+    m_pagesVector = thread->pages();
+    DocumentOpening opening = thread->opening();
+    Document::OpenResult openResult = thread->result();
+    delete thread;
+
+    openResult = generatorLoadingDone( opening, openResult );
+    openResult = openDocumentLoaded( opening, openResult );
+    // unless it is loading again, with the mimetype found by content
+    if ( !m_loadingThread )
+        emit m_parent->openDocumentFinished( openResult );
+}
+
+void DocumentPrivate::cancelLoading()
+{
+    if ( !m_loadingThread )
+        return;
+
+    // the generator can't be interrupted, wait for it and drop what it loaded
+    DocumentLoadingThread *thread = m_loadingThread;
+    m_loadingThread = 0;
+    thread->wait();
+    m_generator = thread->generator();
+    m_pagesVector = thread->pages();
+    const DocumentOpening opening = thread->opening();
+    if ( thread->result() == Document::OpenSuccess )
+        m_generator->closeDocument();
+    delete thread;
+
+    generatorLoadingDone( opening, Document::OpenError );
+}
+
+KMimeType::Ptr DocumentPrivate::mimeTypeFromFileContent( const QString& fileName )
+{
+    // opening a file may go through this more than once (e.g. when the part
+    // retries with another mimetype), so remember the last answer
+    const QFileInfo fileInfo( fileName );
+    if ( !m_contentMime || m_contentMimeFileName != fileName || m_contentMimeFileTime != fileInfo.lastModified() )
+    {
+        m_contentMime = KMimeType::findByFileContent( fileName );
+        m_contentMimeFileName = fileName;
+        m_contentMimeFileTime = fileInfo.lastModified();
+    }
+    return m_contentMime;
+}
+
 bool DocumentPrivate::savePageDocumentInfo( KTemporaryFile *infoFile, int what ) const
 {
     if ( infoFile->open() )
     {
-        // 1. Create DOM
-        QDomDocument doc( "documentInfo" );
-        QDomProcessingInstruction xmlPi = doc.createProcessingInstruction(
-                QString::fromLatin1( "xml" ), QString::fromLatin1( "version=\"1.0\" encoding=\"utf-8\"" ) );
-        doc.appendChild( xmlPi );
-        QDomElement root = doc.createElement( "documentInfo" );
-        doc.appendChild( root );
-
-        // 2.1. Save page attributes (bookmark state, annotations, ... ) to DOM
-        QDomElement pageList = doc.createElement( "pageList" );
-        root.appendChild( pageList );
+        // 1. Start the XML stream
+        QXmlStreamWriter writer( infoFile );
+        writer.setAutoFormatting( true );
+        writer.writeStartDocument();
+        writer.writeDTD( "<!DOCTYPE documentInfo>" );
+        writer.writeStartElement( "documentInfo" );
+
+        // 2.1. Save page attributes (bookmark state, annotations, ... )
+        writer.writeStartElement( "pageList" );
         // <page list><page number='x'>.... </page> save pages that hold data
         QVector< Page * >::const_iterator pIt = m_pagesVector.constBegin(), pEnd = m_pagesVector.constEnd();
         for ( ; pIt != pEnd; ++pIt )
-            (*pIt)->d->saveLocalContents( pageList, doc, PageItems( what ) );
+            (*pIt)->d->saveLocalContents( writer, PageItems( what ) );
+        writer.writeEndElement();
 
-        // 3. Save DOM to XML file
-        QString xml = doc.toString();
-        QTextStream os( infoFile );
-        os.setCodec( "UTF-8" );
-        os << xml;
-        return true;
+        // 3. Close the XML stream
+        writer.writeEndDocument();
+        return !writer.hasError();
     }
     return false;
 }
@@ -1151,6 +1302,9 @@ void DocumentPrivate::performModifyPageAnnotation( int page, Annotation * annota
         proxy->notifyModification( annotation, page, appearanceChanged );
     }
 
+    // the saved annotations of the page are outdated
+    kp->d->m_annotationsXmlValid = false;
+
     // notify observers about the change
     notifyAnnotationChanges( page );
     if ( appearanceChanged && (annotation->flags() & Annotation::ExternallyDrawn) )
@@ -1220,88 +1374,95 @@ void DocumentPrivate::saveDocumentInfo() const
     if ( m_xmlFileName.isEmpty() )
         return;
 
-    QFile infoFile( m_xmlFileName );
-    if (infoFile.open( QIODevice::WriteOnly | QIODevice::Truncate) )
-    {
-        // 1. Create DOM
-        QDomDocument doc( "documentInfo" );
-        QDomProcessingInstruction xmlPi = doc.createProcessingInstruction(
-                QString::fromLatin1( "xml" ), QString::fromLatin1( "version=\"1.0\" encoding=\"utf-8\"" ) );
-        doc.appendChild( xmlPi );
-        QDomElement root = doc.createElement( "documentInfo" );
-        root.setAttribute( "url", m_url.pathOrUrl() );
-        doc.appendChild( root );
-
-        // 2.1. Save page attributes (bookmark state, annotations, ... ) to DOM
-        QDomElement pageList = doc.createElement( "pageList" );
-        root.appendChild( pageList );
-        PageItems saveWhat = AllPageItems;
-        if ( m_annotationsNeedSaveAs )
-        {
-            /* In this case, if the user makes a modification, he's requested to
-             * save to a new document. Therefore, if there are existing local
-             * annotations, we save them back unmodified in the original
-             * document's metadata, so that it appears that it was not changed */
-            saveWhat |= OriginalAnnotationPageItems;
-        }
-        // <page list><page number='x'>.... </page> save pages that hold data
-        QVector< Page * >::const_iterator pIt = m_pagesVector.constBegin(), pEnd = m_pagesVector.constEnd();
-        for ( ; pIt != pEnd; ++pIt )
-            (*pIt)->d->saveLocalContents( pageList, doc, saveWhat );
+    // the data is written to a temporary file which replaces the old one
+    // only once complete, so a crash while saving does not lose anything
+    KSaveFile infoFile( m_xmlFileName );
+    if ( !infoFile.open( QIODevice::WriteOnly ) )
+        return;
 
-        // 2.2. Save document info (current viewport, history, ... ) to DOM
-        QDomElement generalInfo = doc.createElement( "generalInfo" );
-        root.appendChild( generalInfo );
-        // create rotation node
-        if ( m_rotation != Rotation0 )
-        {
-            QDomElement rotationNode = doc.createElement( "rotation" );
-            generalInfo.appendChild( rotationNode );
-            rotationNode.appendChild( doc.createTextNode( QString::number( (int)m_rotation ) ) );
-        }
-        // <general info><history> ... </history> save history up to OKULAR_HISTORY_SAVEDSTEPS viewports
-        QLinkedList< DocumentViewport >::const_iterator backIterator = m_viewportIterator;
-        if ( backIterator != m_viewportHistory.constEnd() )
-        {
-            // go back up to OKULAR_HISTORY_SAVEDSTEPS steps from the current viewportIterator
-            int backSteps = OKULAR_HISTORY_SAVEDSTEPS;
-            while ( backSteps-- && backIterator != m_viewportHistory.constBegin() )
-                --backIterator;
-
-            // create history root node
-            QDomElement historyNode = doc.createElement( "history" );
-            generalInfo.appendChild( historyNode );
-
-            // add old[backIterator] and present[viewportIterator] items
-            QLinkedList< DocumentViewport >::const_iterator endIt = m_viewportIterator;
-            ++endIt;
-            while ( backIterator != endIt )
-            {
-                QString name = (backIterator == m_viewportIterator) ? "current" : "oldPage";
-                QDomElement historyEntry = doc.createElement( name );
-                historyEntry.setAttribute( "viewport", (*backIterator).toString() );
-                historyNode.appendChild( historyEntry );
-                ++backIterator;
-            }
-        }
-        // create views root node
-        QDomElement viewsNode = doc.createElement( "views" );
-        generalInfo.appendChild( viewsNode );
-        Q_FOREACH ( View * view, m_views )
+    // 1. Start the XML stream
+    QXmlStreamWriter writer( &infoFile );
+    writer.setAutoFormatting( true );
+    writer.writeStartDocument();
+    writer.writeDTD( "<!DOCTYPE documentInfo>" );
+    writer.writeStartElement( "documentInfo" );
+    writer.writeAttribute( "url", m_url.pathOrUrl() );
+    if ( m_containsExternalAnnotations )
+        writer.writeAttribute( "externalAnnotations", "true" );
+
+    // 2.1. Save page attributes (bookmark state, annotations, ... )
+    writer.writeStartElement( "pageList" );
+    PageItems saveWhat = AllPageItems;
+    // the bounding boxes are only worth keeping for Trim Margins
+    if ( !m_boundingBoxesNeeded )
+        saveWhat &= ~BoundingBoxPageItems;
+    if ( m_annotationsNeedSaveAs )
+    {
+        /* In this case, if the user makes a modification, he's requested to
+         * save to a new document. Therefore, if there are existing local
+         * annotations, we save them back unmodified in the original
+         * document's metadata, so that it appears that it was not changed */
+        saveWhat |= OriginalAnnotationPageItems;
+    }
+    // <page list><page number='x'>.... </page> save pages that hold data;
+    // the pages not modified since the last save reuse their serialized data
+    QVector< Page * >::const_iterator pIt = m_pagesVector.constBegin(), pEnd = m_pagesVector.constEnd();
+    for ( ; pIt != pEnd; ++pIt )
+        (*pIt)->d->saveLocalContents( writer, saveWhat );
+    writer.writeEndElement();
+
+    // 2.2. Save document info (current viewport, history, ... )
+    writer.writeStartElement( "generalInfo" );
+    // create rotation node
+    if ( m_rotation != Rotation0 )
+    {
+        writer.writeTextElement( "rotation", QString::number( (int)m_rotation ) );
+    }
+    // <general info><history> ... </history> save history up to OKULAR_HISTORY_SAVEDSTEPS viewports
+    QLinkedList< DocumentViewport >::const_iterator backIterator = m_viewportIterator;
+    if ( backIterator != m_viewportHistory.constEnd() )
+    {
+        // go back up to OKULAR_HISTORY_SAVEDSTEPS steps from the current viewportIterator
+        int backSteps = OKULAR_HISTORY_SAVEDSTEPS;
+        while ( backSteps-- && backIterator != m_viewportHistory.constBegin() )
+            --backIterator;
+
+        // create history root node
+        writer.writeStartElement( "history" );
+
+        // add old[backIterator] and present[viewportIterator] items
+        QLinkedList< DocumentViewport >::const_iterator endIt = m_viewportIterator;
+        ++endIt;
+        while ( backIterator != endIt )
         {
-            QDomElement viewEntry = doc.createElement( "view" );
-            viewEntry.setAttribute( "name", view->name() );
-            viewsNode.appendChild( viewEntry );
-            saveViewsInfo( view, viewEntry );
+            QString name = (backIterator == m_viewportIterator) ? "current" : "oldPage";
+            writer.writeEmptyElement( name );
+            writer.writeAttribute( "viewport", (*backIterator).toString() );
+            ++backIterator;
         }
+        writer.writeEndElement();
+    }
+    // create views root node
+    writer.writeStartElement( "views" );
+    Q_FOREACH ( View * view, m_views )
+    {
+        writer.writeStartElement( "view" );
+        writer.writeAttribute( "name", view->name() );
+        saveViewsInfo( view, writer );
+        writer.writeEndElement();
+    }
+    writer.writeEndElement();
+    writer.writeEndElement();
 
-        // 3. Save DOM to XML file
-        QString xml = doc.toString();
-        QTextStream os( &infoFile );
-        os.setCodec( "UTF-8" );
-        os << xml;
+    // 3. Close the XML stream, and replace the old file
+    writer.writeEndDocument();
+    if ( writer.hasError() )
+    {
+        kWarning(OkularDebug) << "Could not write the document info file" << m_xmlFileName;
+        infoFile.abort();
+        return;
     }
-    infoFile.close();
+    infoFile.finalize();
 }
 
 void DocumentPrivate::slotTimedMemoryCheck()
@@ -1312,8 +1473,103 @@ void DocumentPrivate::slotTimedMemoryCheck()
         cleanupPixmapMemory();
 }
 
+void DocumentPrivate::promoteLowPriorityRequests()
+{
+    // the low priority requests are handled only when the generator has
+    // nothing else to do, so they can reuse what was rendered in the meantime
+    QLinkedList< PixmapRequest * > batch;
+    m_pixmapRequestsMutex.lock();
+    if ( m_pixmapRequestsStack.isEmpty() && m_executingPixmapRequests.isEmpty() )
+    {
+        batch = m_lowPriorityPixmapRequests;
+        m_lowPriorityPixmapRequests.clear();
+    }
+    m_pixmapRequestsMutex.unlock();
+
+    if ( batch.isEmpty() )
+        return;
+
+    QLinkedList< PixmapRequest * > toGenerate;
+    QLinkedList< PixmapRequest * >::const_iterator bIt = batch.constBegin(), bEnd = batch.constEnd();
+    for ( ; bIt != bEnd; ++bIt )
+    {
+        if ( reuseLargerPixmap( *bIt ) )
+            delete *bIt;
+        else
+            toGenerate.append( *bIt );
+    }
+
+    // add the remaining ones to the stack, sorted by priority
+    m_pixmapRequestsMutex.lock();
+    QLinkedList< PixmapRequest * >::const_iterator rIt = toGenerate.constBegin(), rEnd = toGenerate.constEnd();
+    for ( ; rIt != rEnd; ++rIt )
+    {
+        QLinkedList< PixmapRequest * >::iterator sIt = m_pixmapRequestsStack.begin(), sEnd = m_pixmapRequestsStack.end();
+        while ( sIt != sEnd && (*sIt)->priority() > (*rIt)->priority() )
+            ++sIt;
+        m_pixmapRequestsStack.insert( sIt, *rIt );
+    }
+    m_pixmapRequestsMutex.unlock();
+}
+
+bool DocumentPrivate::reuseLargerPixmap( PixmapRequest *request )
+{
+    Page *page = request->page();
+    DocumentObserver *observer = request->observer();
+    if ( !page || !m_observers.contains( observer ) || page->d->tilesManager( observer ) )
+        return false;
+
+    if ( page->hasPixmap( observer, request->width(), request->height() ) )
+        return true;
+
+    // find the smallest pixmap of another observer that is not smaller than
+    // the requested one; pixmaps are stored already rotated, so skip the ones
+    // still waiting for their rotation
+    const PagePrivate::PixmapObject *source = 0;
+    QMap< DocumentObserver*, PagePrivate::PixmapObject >::const_iterator it = page->d->m_pixmaps.constBegin(), end = page->d->m_pixmaps.constEnd();
+    for ( ; it != end; ++it )
+    {
+        const QSize size = it.value().size();
+        if ( it.key() == observer || it.value().m_rotation != page->d->m_rotation )
+            continue;
+        if ( size.width() < request->width() || size.height() < request->height() )
+            continue;
+        if ( !source || size.width() < source->size().width() )
+            source = &it.value();
+    }
+    if ( !source )
+        return false;
+
+    const QImage scaled = source->image().scaled( request->width(), request->height(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation );
+    QMap< DocumentObserver*, PagePrivate::PixmapObject >::iterator own = page->d->m_pixmaps.find( observer );
+    if ( own == page->d->m_pixmaps.end() )
+        own = page->d->m_pixmaps.insert( observer, PagePrivate::PixmapObject() );
+    own.value().setImage( scaled );
+    own.value().m_rotation = page->d->m_rotation;
+
+    // [MEM] replace the allocation descriptor of the page
+    QLinkedList< AllocatedPixmap * >::iterator aIt = m_allocatedPixmaps.begin(), aEnd = m_allocatedPixmaps.end();
+    for ( ; aIt != aEnd; ++aIt )
+        if ( (*aIt)->page == request->pageNumber() && (*aIt)->observer == observer )
+        {
+            AllocatedPixmap * p = *aIt;
+            m_allocatedPixmaps.erase( aIt );
+            m_allocatedPixmapsTotalMemory -= p->memory;
+            delete p;
+            break;
+        }
+    const qulonglong memoryBytes = 4 * request->width() * request->height();
+    m_allocatedPixmaps.append( new AllocatedPixmap( observer, request->pageNumber(), memoryBytes ) );
+    m_allocatedPixmapsTotalMemory += memoryBytes;
+
+    observer->notifyPageChanged( request->pageNumber(), DocumentObserver::Pixmap );
+    return true;
+}
+
 void DocumentPrivate::sendGeneratorPixmapRequest()
 {
+    promoteLowPriorityRequests();
+
     /* If the pixmap cache will have to be cleaned in order to make room for the
      * next request, get the distance from the current viewport of the page
      * whose pixmap will be removed. We will ignore preload requests for pages
@@ -1376,11 +1632,12 @@ void DocumentPrivate::sendGeneratorPixmapRequest()
                 << " (" << r->width() << "x" << r->height() << " px);";
 
             // fill the tiles manager with the last rendered pixmap
-            const QPixmap *pixmap = r->page()->_o_nearestPixmap( r->observer(), r->width(), r->height() );
-            if ( pixmap )
+            const QImage image = r->page()->_o_nearestImage( r->observer(), r->width(), r->height() );
+            if ( !image.isNull() )
             {
-                tilesManager = new TilesManager( r->pageNumber(), pixmap->width(), pixmap->height(), r->page()->rotation() );
-                tilesManager->setPixmap( pixmap, NormalizedRect( 0, 0, 1, 1 ) );
+                const QPixmap pixmap = QPixmap::fromImage( image );
+                tilesManager = new TilesManager( r->pageNumber(), pixmap.width(), pixmap.height(), r->page()->rotation() );
+                tilesManager->setPixmap( &pixmap, NormalizedRect( 0, 0, 1, 1 ) );
                 tilesManager->setSize( r->width(), r->height() );
             }
             else
@@ -1457,7 +1714,11 @@ void DocumentPrivate::sendGeneratorPixmapRequest()
     // if no request found (or already generated), return
     if ( !request )
     {
+        const bool idle = m_executingPixmapRequests.isEmpty();
         m_pixmapRequestsMutex.unlock();
+        // nothing to render for the observers, use the time for the bounding boxes
+        if ( idle )
+            sendBoundingBoxRequest();
         return;
     }
 
@@ -1494,7 +1755,15 @@ void DocumentPrivate::sendGeneratorPixmapRequest()
         // we can not really know if the generator can do async requests
         m_executingPixmapRequests.push_back( request );
         m_pixmapRequestsMutex.unlock();
+        const bool asynchronous = request->asynchronous();
         m_generator->generatePixmap( request );
+
+        // a generator rendering several pages at once can take the next one
+        m_pixmapRequestsMutex.lock();
+        const bool hasPixmaps = !m_pixmapRequestsStack.isEmpty();
+        m_pixmapRequestsMutex.unlock();
+        if ( asynchronous && hasPixmaps && m_generator->canGeneratePixmap() )
+            QTimer::singleShot( 0, m_parent, SLOT(sendGeneratorPixmapRequest()) );
     }
     else
     {
@@ -1504,6 +1773,34 @@ void DocumentPrivate::sendGeneratorPixmapRequest()
     }
 }
 
+void DocumentPrivate::sendBoundingBoxRequest()
+{
+    // only the threaded generators can do this without blocking the user
+    if ( !m_boundingBoxesNeeded || !m_generator || !m_generator->hasFeature( Generator::Threaded )
+         || !m_generator->canGeneratePixmap() )
+        return;
+
+    const int pageCount = m_pagesVector.count();
+    while ( m_nextBoundingBoxPage < pageCount && m_pagesVector[ m_nextBoundingBoxPage ]->isBoundingBoxKnown() )
+        ++m_nextBoundingBoxPage;
+    if ( m_nextBoundingBoxPage >= pageCount )
+        return;
+
+    // a small rendering is enough, the crop gets expanded anyway
+    Page *page = m_pagesVector[ m_nextBoundingBoxPage++ ];
+    const int width = 200;
+    const int height = qMax( 1, qRound( width * page->ratio() ) );
+    PixmapRequest *request = new PixmapRequest( 0, page->number(), width, height, 0, PixmapRequest::Asynchronous );
+    request->d->mPage = page;
+    if ( (int)m_rotation % 2 )
+        request->d->swap();
+
+    m_pixmapRequestsMutex.lock();
+    m_executingPixmapRequests.push_back( request );
+    m_pixmapRequestsMutex.unlock();
+    m_generator->generatePixmap( request );
+}
+
 void DocumentPrivate::rotationFinished( int page, Okular::Page *okularPage )
 {
     Okular::Page *wantedPage = m_pagesVector.value( page, 0 );
@@ -1585,7 +1882,7 @@ void DocumentPrivate::refreshPixmaps( int pageNumber )
     QMap< DocumentObserver*, PagePrivate::PixmapObject >::ConstIterator it = page->d->m_pixmaps.constBegin(), itEnd = page->d->m_pixmaps.constEnd();
     for ( ; it != itEnd; ++it )
     {
-        QSize size = (*it).m_pixmap->size();
+        QSize size = (*it).size();
         PixmapRequest * p = new PixmapRequest( it.key(), pageNumber, size.width(), size.height(), 1, PixmapRequest::Asynchronous );
         p->d->mForce = true;
         requestedPixmaps.push_back( p );
@@ -2067,11 +2364,11 @@ struct pdfsyncpoint
     int page;
 };
 
-void DocumentPrivate::loadSyncFile( const QString & filePath )
+static QList< pdfsyncpoint > readSyncFile( const QString & filePath )
 {
     QFile f( filePath + QLatin1String( "sync" ) );
     if ( !f.open( QIODevice::ReadOnly ) )
-        return;
+        return QList< pdfsyncpoint >();
 
     QTextStream ts( &f );
     // first row: core name of the pdf output
@@ -2081,7 +2378,7 @@ void DocumentPrivate::loadSyncFile( const QString & filePath )
     QRegExp versionre( "Version (\\d+)" );
     versionre.setCaseSensitivity( Qt::CaseInsensitive );
     if ( !versionre.exactMatch( versionstr ) )
-        return;
+        return QList< pdfsyncpoint >();
 
     QHash<int, pdfsyncpoint> points;
     QStack<QString> fileStack;
@@ -2091,8 +2388,6 @@ void DocumentPrivate::loadSyncFile( const QString & filePath )
 
     fileStack.push( coreName + texStr );
 
-    const QSizeF dpi = m_generator->dpi();
-
     QString line;
     while ( !ts.atEnd() )
     {
@@ -2162,6 +2457,81 @@ void DocumentPrivate::loadSyncFile( const QString & filePath )
 
     }
 
+    return points.values();
+}
+
+/**
+ * Looks for the SyncTeX (or else the pdfsync) data of a document and parses
+ * it in a thread, as that can take seconds for big documents.
+ */
+class Okular::SourceReferencesLoadingThread : public QThread
+{
+    public:
+        SourceReferencesLoadingThread( const QString &docFile )
+            : m_docFile( docFile ), m_scanner( 0 )
+        {
+        }
+
+        ~SourceReferencesLoadingThread()
+        {
+            if ( m_scanner )
+                synctex_scanner_free( m_scanner );
+        }
+
+        synctex_scanner_t takeScanner()
+        {
+            synctex_scanner_t scanner = m_scanner;
+            m_scanner = 0;
+            return scanner;
+        }
+
+        QList< pdfsyncpoint > syncPoints() const { return m_syncPoints; }
+
+    protected:
+        void run()
+        {
+            // no need to check for the existence of a synctex file, no parser will be
+            // created if none exists
+            m_scanner = synctex_scanner_new_with_output_file( QFile::encodeName( m_docFile ), 0, 1 );
+            if ( !m_scanner && QFile::exists( m_docFile + QLatin1String( "sync" ) ) )
+                m_syncPoints = readSyncFile( m_docFile );
+        }
+
+    private:
+        QString m_docFile;
+        synctex_scanner_t m_scanner;
+        QList< pdfsyncpoint > m_syncPoints;
+};
+
+void DocumentPrivate::sourceReferencesLoaded()
+{
+    // also called for a thread of a document closed meanwhile
+    if ( !m_sourceReferencesThread || !m_sourceReferencesThread->isFinished() )
+        return;
+
+    m_sourceReferencesThread->wait();
+    m_synctex_scanner = m_sourceReferencesThread->takeScanner();
+    const QList< pdfsyncpoint > points = m_sourceReferencesThread->syncPoints();
+    delete m_sourceReferencesThread;
+    m_sourceReferencesThread = 0;
+
+    // a forward search asked while loading
+    if ( !m_pendingSourceDestination.isEmpty() )
+    {
+        const QString destination = m_pendingSourceDestination;
+        m_pendingSourceDestination.clear();
+        const DocumentViewport vp( m_parent->metaData( "NamedViewport", destination ).toString() );
+        if ( vp.isValid() )
+        {
+            m_parent->setViewport( vp, 0, true );
+            emit m_parent->pendingSourceLocationShown( vp );
+        }
+    }
+
+    if ( points.isEmpty() )
+        return;
+
+    const QSizeF dpi = m_generator->dpi();
     QVector< QLinkedList< Okular::SourceRefObjectRect * > > refRects( m_pagesVector.size() );
     foreach ( const pdfsyncpoint& pt, points )
     {
@@ -2183,6 +2553,75 @@ void DocumentPrivate::loadSyncFile( const QString & filePath )
             m_pagesVector[i]->setSourceReferences( refRects.at(i) );
 }
 
+void DocumentPrivate::keepPageContents()
+{
+    // the contents are kept as shown, so they would need to be rotated back
+    if ( m_rotation != Rotation0 )
+        return;
+
+    foreach ( Page *page, m_pagesVector )
+    {
+        const QByteArray fingerprint = m_generator->metaData( "PageFingerprint", page->number() ).toByteArray();
+        if ( fingerprint.isEmpty() )
+            continue;
+
+        Page *kept = new Page( page->number(), page->width(), page->height(), page->orientation() );
+        PagePrivate::moveContents( page->d, kept->d );
+        m_keptPages.insert( fingerprint, kept );
+    }
+    m_keptPagesFileName = m_docFileName;
+}
+
+void DocumentPrivate::reusePageContents()
+{
+    if ( m_keptPagesFileName == m_docFileName )
+    {
+        foreach ( Page *page, m_pagesVector )
+        {
+            if ( m_keptPages.isEmpty() )
+                break;
+
+            const QByteArray fingerprint = m_generator->metaData( "PageFingerprint", page->number() ).toByteArray();
+            if ( fingerprint.isEmpty() )
+                continue;
+
+            Page *kept = m_keptPages.take( fingerprint );
+            if ( !kept )
+                continue;
+
+            if ( kept->width() == page->width() && kept->height() == page->height()
+                 && kept->orientation() == page->orientation() )
+            {
+                PagePrivate::moveContents( kept->d, page->d );
+
+                // [MEM] account what the page got
+                QMap< DocumentObserver*, PagePrivate::PixmapObject >::const_iterator it = page->d->m_pixmaps.constBegin(), itEnd = page->d->m_pixmaps.constEnd();
+                for ( ; it != itEnd; ++it )
+                {
+                    const QSize size = it.value().size();
+                    const qulonglong memoryBytes = 4 * size.width() * size.height();
+                    m_allocatedPixmaps.append( new AllocatedPixmap( it.key(), page->number(), memoryBytes ) );
+                    m_allocatedPixmapsTotalMemory += memoryBytes;
+                }
+                QMap< const DocumentObserver*, TilesManager * >::const_iterator tIt = page->d->m_tilesManagers.constBegin(), tEnd = page->d->m_tilesManagers.constEnd();
+                for ( ; tIt != tEnd; ++tIt )
+                {
+                    const qulonglong memoryBytes = tIt.value()->totalMemory();
+                    m_allocatedPixmaps.append( new AllocatedPixmap( const_cast< DocumentObserver * >( tIt.key() ), page->number(), memoryBytes ) );
+                    m_allocatedPixmapsTotalMemory += memoryBytes;
+                }
+                if ( page->hasTextPage() )
+                    textGenerationDone( page );
+            }
+            delete kept;
+        }
+    }
+
+    qDeleteAll( m_keptPages );
+    m_keptPages.clear();
+    m_keptPagesFileName.clear();
+}
+
 Document::Document( QWidget *widget )
     : QObject( 0 ), d( new DocumentPrivate( this ) )
 {
@@ -2202,6 +2641,9 @@ Document::~Document()
 {
     // delete generator, pages, and related stuff
     closeDocument();
+    // and what was kept for a reload that did not happen
+    qDeleteAll( d->m_keptPages );
+    delete d->m_stdinData;
 
     QSet< View * >::const_iterator viewIt = d->m_views.constBegin(), viewEnd = d->m_views.constEnd();
     for ( ; viewIt != viewEnd; ++viewIt )
@@ -2262,6 +2704,9 @@ QString DocumentPrivate::docDataFileName(const KUrl &url, qint64 document_size)
 
 Document::OpenResult Document::openDocument( const QString & docFile, const KUrl& url, const KMimeType::Ptr &_mime, const QString & password )
 {
+    // a document still being loaded is given up
+    d->cancelLoading();
+
     KMimeType::Ptr mime = _mime;
     QByteArray filedata;
     qint64 document_size = -1;
@@ -2290,9 +2735,11 @@ Document::OpenResult Document::openDocument( const QString & docFile, const KUrl
     }
     else
     {
-        QFile qstdin;
-        qstdin.open( stdin, QIODevice::ReadOnly );
-        filedata = qstdin.readAll();
+        // mapped if stdin is a regular file, kept until the document is closed
+        delete d->m_stdinData;
+        d->m_stdinData = new MappedFile();
+        d->m_stdinData->load( stdin );
+        filedata = d->m_stdinData->data();
         mime = KMimeType::findByContent( filedata );
         if ( !mime || mime->name() == QLatin1String( "application/octet-stream" ) )
             return OpenError;
@@ -2306,7 +2753,7 @@ Document::OpenResult Document::openDocument( const QString & docFile, const KUrl
     KService::List offers = KMimeTypeTrader::self()->query(mime->name(),"okular/Generator",constraint);
     if ( offers.isEmpty() && !triedMimeFromFileContent )
     {
-        KMimeType::Ptr newmime = KMimeType::findByFileContent( docFile );
+        KMimeType::Ptr newmime = d->mimeTypeFromFileContent( docFile );
         triedMimeFromFileContent = true;
         if ( newmime->name() != mime->name() )
         {
@@ -2357,125 +2804,169 @@ Document::OpenResult Document::openDocument( const QString & docFile, const KUrl
         }
     }
 
-    KService::Ptr offer = offers.at( hRank );
+    DocumentOpening opening;
+    opening.offer = offers.at( hRank );
+    opening.mime = mime;
+    opening.docFile = docFile;
+    opening.fileData = filedata;
+    opening.password = password;
+    opening.documentSize = document_size;
+    opening.isstdin = isstdin;
+    opening.triedMimeFromFileContent = triedMimeFromFileContent;
+    opening.asynchronous = d->m_openAsynchronously;
+
     // 1. load Document
-    OpenResult openResult = d->openDocumentInternal( offer, isstdin, docFile, filedata, password );
-    if ( openResult == OpenError && !triedMimeFromFileContent )
+    const OpenResult openResult = d->openDocumentInternal( opening );
+    // when loading in a thread, loadingThreadFinished() goes on from here
+    if ( d->m_loadingThread )
+        return openResult;
+    return d->openDocumentLoaded( opening, openResult );
+}
+
+void Document::openDocumentAsynchronously( const QString & docFile, const KUrl & url, const KMimeType::Ptr &mime, const QString &password )
+{
+    d->m_openAsynchronously = true;
+    const OpenResult openResult = openDocument( docFile, url, mime, password );
+    d->m_openAsynchronously = false;
+    if ( !d->m_loadingThread )
+        emit openDocumentFinished( openResult );
+}
+
+bool Document::isLoading() const
+{
+    return d->m_loadingThread;
+}
+
+Document::OpenResult DocumentPrivate::openDocumentLoaded( DocumentOpening &opening, Document::OpenResult openResult )
+{
+    if ( openResult == Document::OpenError && !opening.triedMimeFromFileContent )
     {
-        KMimeType::Ptr newmime = KMimeType::findByFileContent( docFile );
-        triedMimeFromFileContent = true;
-        if ( newmime->name() != mime->name() )
+        KMimeType::Ptr newmime = mimeTypeFromFileContent( opening.docFile );
+        opening.triedMimeFromFileContent = true;
+        if ( newmime->name() != opening.mime->name() )
         {
-            mime = newmime;
-            offers = KMimeTypeTrader::self()->query( mime->name(), "okular/Generator", constraint );
+            opening.mime = newmime;
+            QString constraint("([X-KDE-Priority] > 0) and (exist Library)") ;
+            const KService::List offers = KMimeTypeTrader::self()->query( opening.mime->name(), "okular/Generator", constraint );
             if ( !offers.isEmpty() )
             {
-                offer = offers.first();
-                openResult = d->openDocumentInternal( offer, isstdin, docFile, filedata, password );
+                opening.offer = offers.first();
+                openResult = openDocumentInternal( opening );
+                if ( m_loadingThread )
+                    return openResult;
             }
         }
     }
-    if ( openResult != OpenSuccess )
+    if ( openResult != Document::OpenSuccess )
     {
         return openResult;
     }
 
-    // no need to check for the existence of a synctex file, no parser will be
-    // created if none exists
-    d->m_synctex_scanner = synctex_scanner_new_with_output_file( QFile::encodeName( docFile ), 0, 1);
-    if ( !d->m_synctex_scanner && QFile::exists(docFile + QLatin1String( "sync" ) ) )
-    {
-        d->loadSyncFile(docFile);
-    }
+    // the SyncTeX file can be big, look for it (and parse it) in background
+    m_sourceReferencesThread = new SourceReferencesLoadingThread( opening.docFile );
+    QObject::connect( m_sourceReferencesThread, SIGNAL(finished()), m_parent, SLOT(sourceReferencesLoaded()) );
+    m_sourceReferencesThread->start( QThread::LowPriority );
 
-    d->m_generatorName = offer->name();
-    d->m_pageController = new PageController();
-    connect( d->m_pageController, SIGNAL(rotationFinished(int,Okular::Page*)),
-             this, SLOT(rotationFinished(int,Okular::Page*)) );
+    m_generatorName = opening.offer->name();
+    m_pageController = new PageController();
+    QObject::connect( m_pageController, SIGNAL(rotationFinished(int,Okular::Page*)),
+             m_parent, SLOT(rotationFinished(int,Okular::Page*)) );
 
-    bool containsExternalAnnotations = false;
-    foreach ( Page * p, d->m_pagesVector )
+    m_containsExternalAnnotations = false;
+    foreach ( Page * p, m_pagesVector )
     {
-        p->d->m_doc = d;
+        p->d->m_doc = this;
         if ( !p->annotations().empty() )
-            containsExternalAnnotations = true;
+            m_containsExternalAnnotations = true;
     }
 
+    // take what was kept of the pages that did not change since the last time
+    reusePageContents();
+    m_keepPagesForReload = false;
+
+    // the generator sets up in the GUI thread what it needs once loaded (like
+    // its annotation proxy), and starts what it loads in background
+    m_generator->pagesLoaded();
+
     // Be quiet while restoring local annotations
-    d->m_showWarningLimitedAnnotSupport = false;
-    d->m_annotationsNeedSaveAs = false;
+    m_showWarningLimitedAnnotSupport = false;
+    m_annotationsNeedSaveAs = false;
 
     // 2. load Additional Data (bookmarks, local annotations and metadata) about the document
-    if ( d->m_archiveData )
+    if ( m_archiveData )
     {
-        d->loadDocumentInfo( d->m_archiveData->metadataFile );
-        d->m_annotationsNeedSaveAs = true;
+        loadDocumentInfo( m_archiveData->metadataFile );
+        m_annotationsNeedSaveAs = true;
     }
     else
     {
-        d->loadDocumentInfo();
-        d->m_annotationsNeedSaveAs = ( d->canAddAnnotationsNatively() && containsExternalAnnotations );
+        loadDocumentInfo();
+        // the annotations of the pages loaded lazily by the generator are
+        // not there yet, the docdata tells whether the file has some
+        m_annotationsNeedSaveAs = ( canAddAnnotationsNatively() && m_containsExternalAnnotations );
     }
 
-    d->m_showWarningLimitedAnnotSupport = true;
-    d->m_bookmarkManager->setUrl( d->m_url );
+    m_showWarningLimitedAnnotSupport = true;
+    m_bookmarkManager->setUrl( m_url );
 
     // 3. setup observers inernal lists and data
-    foreachObserver( notifySetup( d->m_pagesVector, DocumentObserver::DocumentChanged ) );
+    foreachObserverD( notifySetup( m_pagesVector, DocumentObserver::DocumentChanged ) );
 
     // 4. set initial page (restoring the page saved in xml if loaded)
-    DocumentViewport loadedViewport = (*d->m_viewportIterator);
+    DocumentViewport loadedViewport = (*m_viewportIterator);
     if ( loadedViewport.isValid() )
     {
-        (*d->m_viewportIterator) = DocumentViewport();
-        if ( loadedViewport.pageNumber >= (int)d->m_pagesVector.size() )
-            loadedViewport.pageNumber = d->m_pagesVector.size() - 1;
+        (*m_viewportIterator) = DocumentViewport();
+        if ( loadedViewport.pageNumber >= (int)m_pagesVector.size() )
+            loadedViewport.pageNumber = m_pagesVector.size() - 1;
     }
     else
         loadedViewport.pageNumber = 0;
-    setViewport( loadedViewport );
+    m_parent->setViewport( loadedViewport );
 
     // start bookmark saver timer
-    if ( !d->m_saveBookmarksTimer )
+    if ( !m_saveBookmarksTimer )
     {
-        d->m_saveBookmarksTimer = new QTimer( this );
-        connect( d->m_saveBookmarksTimer, SIGNAL(timeout()), this, SLOT(saveDocumentInfo()) );
+        m_saveBookmarksTimer = new QTimer( m_parent );
+        QObject::connect( m_saveBookmarksTimer, SIGNAL(timeout()), m_parent, SLOT(saveDocumentInfo()) );
     }
-    d->m_saveBookmarksTimer->start( 5 * 60 * 1000 );
+    m_saveBookmarksTimer->start( 5 * 60 * 1000 );
 
     // start memory check timer
-    if ( !d->m_memCheckTimer )
+    if ( !m_memCheckTimer )
     {
-        d->m_memCheckTimer = new QTimer( this );
-        connect( d->m_memCheckTimer, SIGNAL(timeout()), this, SLOT(slotTimedMemoryCheck()) );
+        m_memCheckTimer = new QTimer( m_parent );
+        QObject::connect( m_memCheckTimer, SIGNAL(timeout()), m_parent, SLOT(slotTimedMemoryCheck()) );
     }
-    d->m_memCheckTimer->start( 2000 );
+    m_memCheckTimer->start( 2000 );
 
-    const DocumentViewport nextViewport = d->nextDocumentViewport();
+    const DocumentViewport nextViewport = nextDocumentViewport();
     if ( nextViewport.isValid() )
     {
-        setViewport( nextViewport );
-        d->m_nextDocumentViewport = DocumentViewport();
-        d->m_nextDocumentDestination = QString();
+        m_parent->setViewport( nextViewport );
+        m_nextDocumentViewport = DocumentViewport();
+        m_nextDocumentDestination = QString();
     }
 
-    AudioPlayer::instance()->d->m_currentDocument = isstdin ? KUrl() : d->m_url;
-    d->m_docSize = document_size;
+    AudioPlayer::instance()->d->m_currentDocument = opening.isstdin ? KUrl() : m_url;
+    m_docSize = opening.documentSize;
 
-    const QStringList docScripts = d->m_generator->metaData( "DocumentScripts", "JavaScript" ).toStringList();
+    const QStringList docScripts = m_generator->metaData( "DocumentScripts", "JavaScript" ).toStringList();
     if ( !docScripts.isEmpty() )
     {
-        d->m_scripter = new Scripter( d );
+        m_scripter = new Scripter( this );
         Q_FOREACH ( const QString &docscript, docScripts )
         {
-            d->m_scripter->execute( JavaScript, docscript );
+            m_scripter->execute( JavaScript, docscript );
         }
     }
 
-    return OpenSuccess;
+    return Document::OpenSuccess;
 }
 
 
+
+
 KXMLGUIClient* Document::guiClient()
 {
     if ( d->m_generator )
@@ -2489,6 +2980,9 @@ KXMLGUIClient* Document::guiClient()
 
 void Document::closeDocument()
 {
+    // a document still being loaded is given up
+    d->cancelLoading();
+
     // check if there's anything to close...
     if ( !d->m_generator )
         return;
@@ -2506,7 +3000,10 @@ void Document::closeDocument()
     for ( ; sIt != sEnd; ++sIt )
         delete *sIt;
     d->m_pixmapRequestsStack.clear();
+    qDeleteAll( d->m_lowPriorityPixmapRequests );
+    d->m_lowPriorityPixmapRequests.clear();
     d->m_pixmapRequestsMutex.unlock();
+    d->m_nextBoundingBoxPage = 0;
 
     QEventLoop loop;
     bool startEventLoop = false;
@@ -2535,13 +3032,32 @@ void Document::closeDocument()
     // stop any audio playback
     AudioPlayer::instance()->stopPlaybacks();
 
+    // keep the contents of the pages, if asked, while the generator can still tell their fingerprints
+    qDeleteAll( d->m_keptPages );
+    d->m_keptPages.clear();
+    if ( d->m_keepPagesForReload )
+    {
+        d->keepPageContents();
+        d->m_keepPagesForReload = false;
+    }
+
     // close the current document and save document info if a document is still opened
     if ( d->m_generator && d->m_pagesVector.size() > 0 )
     {
         d->saveDocumentInfo();
         d->m_generator->closeDocument();
     }
+    // the generator could use the data read from stdin up to now
+    delete d->m_stdinData;
+    d->m_stdinData = 0;
 
+    if ( d->m_sourceReferencesThread )
+    {
+        d->m_sourceReferencesThread->wait();
+        delete d->m_sourceReferencesThread;
+        d->m_sourceReferencesThread = 0;
+    }
+    d->m_pendingSourceDestination.clear();
     if ( d->m_synctex_scanner )
     {
         synctex_scanner_free( d->m_synctex_scanner );
@@ -2964,7 +3480,15 @@ QVariant Document::metaData( const QString & key, const QVariant & option ) cons
     // source reference
     if ( key == "NamedViewport"
          && option.toString().startsWith( "src:", Qt::CaseInsensitive )
-         && d->m_synctex_scanner)
+         && d->m_sourceReferencesThread )
+    {
+        // not loaded yet, go there once it is
+        d->m_pendingSourceDestination = option.toString();
+        return QVariant();
+    }
+    if ( key == "NamedViewport"
+         && option.toString().startsWith( "src:", Qt::CaseInsensitive )
+         && d->m_synctex_scanner )
     {
         const QString reference = option.toString();
 
@@ -3105,6 +3629,19 @@ void Document::requestPixmaps( const QLinkedList< PixmapRequest * > & requests,
         else
             ++sIt;
     }
+    sIt = d->m_lowPriorityPixmapRequests.begin();
+    sEnd = d->m_lowPriorityPixmapRequests.end();
+    while ( sIt != sEnd )
+    {
+        if ( (*sIt)->observer() == requesterObserver
+             && ( removeAllPrevious || requestedPages.contains( (*sIt)->pageNumber() ) ) )
+        {
+            delete *sIt;
+            sIt = d->m_lowPriorityPixmapRequests.erase( sIt );
+        }
+        else
+            ++sIt;
+    }
 
     // 2. [ADD TO STACK] add requests to stack
     QLinkedList< PixmapRequest * >::const_iterator rIt = requests.constBegin(), rEnd = requests.constEnd();
@@ -3149,6 +3686,13 @@ void Document::requestPixmaps( const QLinkedList< PixmapRequest * > & requests,
         if ( !request->asynchronous() )
             request->d->mPriority = 0;
 
+        // low priority requests wait in their own queue, see promoteLowPriorityRequests()
+        if ( request->reuseLargerPixmap() && request->asynchronous() && !request->isTile() )
+        {
+            d->m_lowPriorityPixmapRequests.append( request );
+            continue;
+        }
+
         // add request to the 'stack' at the right place
         if ( !request->priority() )
             // add priority zero requests to the top of the stack
@@ -4077,6 +4621,7 @@ void Document::processSourceReference( const SourceReference * ref )
 
 const SourceReference * Document::dynamicSourceReference( int pageNr, double absX, double absY )
 {
+    // nothing until the SyncTeX file is loaded
     if  ( !d->m_synctex_scanner )
         return 0;
 
@@ -4357,6 +4902,132 @@ QByteArray Document::fontData(const FontInfo &font) const
     return result;
 }
 
+// size of the chunks documents are copied in and out of archives with
+static const qint64 archiveCopyChunkSize = 1024 * 1024;
+
+// whether it is worth deflating @p file, judging from a sample of it: most
+// documents (PDF streams, images, ...) are compressed already
+static bool isWorthDeflating( QFile &file )
+{
+    const QByteArray sample = file.read( 256 * 1024 );
+    file.seek( 0 );
+    if ( sample.size() < 4096 )
+        return true;
+
+    return qCompress( sample, 1 ).size() < sample.size() * 9 / 10;
+}
+
+// copies the local file @p localFile to the @p name entry of @p archive
+static bool addLocalFileToArchive( KZip &archive, const QString &localFile, const QString &name,
+                                   const QString &user, const QString &group )
+{
+    QFile file( localFile );
+    if ( !file.open( QIODevice::ReadOnly ) )
+        return false;
+
+    const qint64 size = file.size();
+    archive.setCompression( isWorthDeflating( file ) ? KZip::DeflateCompression : KZip::NoCompression );
+    if ( !archive.prepareWriting( name, user, group, size ) )
+    {
+        archive.setCompression( KZip::DeflateCompression );
+        return false;
+    }
+
+    bool ok = true;
+    MappedFile mapped;
+    if ( size > 0 && mapped.load( localFile ) && mapped.isMapped() && mapped.size() == size )
+    {
+        const char *data = mapped.data().constData();
+        for ( qint64 offset = 0; ok && offset < size; offset += archiveCopyChunkSize )
+            ok = archive.writeData( data + offset, qMin( archiveCopyChunkSize, size - offset ) );
+    }
+    else
+    {
+        QByteArray buffer( archiveCopyChunkSize, '\0' );
+        qint64 read = 0;
+        while ( ok && ( read = file.read( buffer.data(), buffer.size() ) ) > 0 )
+            ok = archive.writeData( buffer.constData(), read );
+    }
+    ok = archive.finishWriting( size ) && ok;
+    archive.setCompression( KZip::DeflateCompression );
+    return ok;
+}
+
+// extracts @p entry of the archive @p archiveFile to @p to
+static void extractArchiveEntry( const QString &archiveFile, const KZipFileEntry *entry, QIODevice *to )
+{
+    // stored entries are copied straight out of a mapping of the archive
+    if ( entry->encoding() == 0 && entry->compressedSize() > 0 )
+    {
+        MappedFile archive;
+        const qint64 size = entry->compressedSize();
+        const QByteArray data = archive.load( archiveFile ) && archive.isMapped() ? archive.data( entry->position(), size ) : QByteArray();
+        if ( data.size() == size )
+        {
+            for ( qint64 offset = 0; offset < size; offset += archiveCopyChunkSize )
+            {
+                const qint64 chunk = qMin( archiveCopyChunkSize, size - offset );
+                if ( to->write( data.constData() + offset, chunk ) != chunk )
+                    break;
+            }
+            return;
+        }
+    }
+
+    std::auto_ptr< QIODevice > entryDevice( entry->createDevice() );
+    copyQIODevice( entryDevice.get(), to );
+}
+
+// the SHA-1 hash of the contents of @p fileName, or an empty array on failure
+static QByteArray fileSha1( const QString &fileName )
+{
+    QFile file( fileName );
+    if ( !file.open( QIODevice::ReadOnly ) )
+        return QByteArray();
+
+    QCryptographicHash hash( QCryptographicHash::Sha1 );
+    const qint64 size = file.size();
+    MappedFile mapped;
+    if ( size > 0 && mapped.load( fileName ) && mapped.isMapped() && mapped.size() == size )
+    {
+        const char *data = mapped.data().constData();
+        for ( qint64 offset = 0; offset < size; offset += archiveCopyChunkSize )
+            hash.addData( data + offset, qMin( archiveCopyChunkSize, size - offset ) );
+    }
+    else
+    {
+        QByteArray buffer( archiveCopyChunkSize, '\0' );
+        qint64 read = 0;
+        while ( ( read = file.read( buffer.data(), buffer.size() ) ) > 0 )
+            hash.addData( buffer.constData(), read );
+        if ( read < 0 )
+            return QByteArray();
+    }
+    return hash.result().toHex();
+}
+
+// looks for the document referenced by @p referenceEl, first at its original
+// path and then next to the archive @p archiveFile
+static QString findReferencedDocument( const QDomElement &referenceEl, const QString &archiveFile, const QString &documentFileName )
+{
+    bool ok = false;
+    const qint64 size = referenceEl.attribute( "size" ).toLongLong( &ok );
+    const QByteArray sha1 = referenceEl.attribute( "sha1" ).toLatin1();
+    if ( !ok || sha1.isEmpty() )
+        return QString();
+
+    QStringList candidates;
+    candidates << referenceEl.attribute( "path" );
+    candidates << QFileInfo( archiveFile ).absoluteDir().filePath( documentFileName );
+    foreach ( const QString &candidate, candidates )
+    {
+        const QFileInfo fi( candidate );
+        if ( !candidate.isEmpty() && fi.isFile() && fi.size() == size && fileSha1( candidate ) == sha1 )
+            return fi.absoluteFilePath();
+    }
+    return QString();
+}
+
 Document::OpenResult Document::openDocumentArchive( const QString & docFile, const KUrl & url, const QString & password )
 {
     const KMimeType::Ptr mime = KMimeType::findByPath( docFile, 0, false /* content too */ );
@@ -4384,6 +5055,7 @@ Document::OpenResult Document::openDocumentArchive( const QString & docFile, con
 
     QString documentFileName;
     QString metadataFileName;
+    QDomElement documentReferenceEl;
     QDomElement el = root.firstChild().toElement();
     for ( ; !el.isNull(); el = el.nextSibling().toElement() )
     {
@@ -4396,38 +5068,49 @@ Document::OpenResult Document::openDocumentArchive( const QString & docFile, con
                     documentFileName = fileEl.text();
                 else if ( fileEl.tagName() == "MetadataFileName" )
                     metadataFileName = fileEl.text();
+                else if ( fileEl.tagName() == "DocumentReference" )
+                    documentReferenceEl = fileEl;
             }
         }
     }
     if ( documentFileName.isEmpty() )
         return OpenError;
 
-    const KArchiveEntry * docEntry = mainDir->entry( documentFileName );
-    if ( !docEntry || !docEntry->isFile() )
-        return OpenError;
-
     std::auto_ptr< ArchiveData > archiveData( new ArchiveData() );
-    const int dotPos = documentFileName.indexOf( '.' );
-    if ( dotPos != -1 )
-        archiveData->document.setSuffix( documentFileName.mid( dotPos ) );
-    if ( !archiveData->document.open() )
-        return OpenError;
+    QString tempFileName;
+    const KArchiveEntry * docEntry = mainDir->entry( documentFileName );
+    if ( docEntry && docEntry->isFile() )
+    {
+        const int dotPos = documentFileName.indexOf( '.' );
+        if ( dotPos != -1 )
+            archiveData->document.setSuffix( documentFileName.mid( dotPos ) );
+        if ( !archiveData->document.open() )
+            return OpenError;
 
-    QString tempFileName = archiveData->document.fileName();
+        tempFileName = archiveData->document.fileName();
+        extractArchiveEntry( docFile, static_cast< const KZipFileEntry * >( docEntry ), &archiveData->document );
+        archiveData->document.close();
+    }
+    else if ( !documentReferenceEl.isNull() )
+    {
+        // metadata-only archive: open the referenced document in place
+        tempFileName = findReferencedDocument( documentReferenceEl, docFile, documentFileName );
+        if ( tempFileName.isEmpty() )
+            return OpenError;
+        archiveData->referencesDocument = true;
+    }
+    else
     {
-    std::auto_ptr< QIODevice > docEntryDevice( static_cast< const KZipFileEntry * >( docEntry )->createDevice() );
-    copyQIODevice( docEntryDevice.get(), &archiveData->document );
-    archiveData->document.close();
+        return OpenError;
     }
 
     const KArchiveEntry * metadataEntry = mainDir->entry( metadataFileName );
     if ( metadataEntry && metadataEntry->isFile() )
     {
-        std::auto_ptr< QIODevice > metadataEntryDevice( static_cast< const KZipFileEntry * >( metadataEntry )->createDevice() );
         archiveData->metadataFile.setSuffix( ".xml" );
         if ( archiveData->metadataFile.open() )
         {
-            copyQIODevice( metadataEntryDevice.get(), &archiveData->metadataFile );
+            extractArchiveEntry( docFile, static_cast< const KZipFileEntry * >( metadataEntry ), &archiveData->metadataFile );
             archiveData->metadataFile.close();
         }
     }
@@ -4450,6 +5133,11 @@ Document::OpenResult Document::openDocumentArchive( const QString & docFile, con
 }
 
 bool Document::saveDocumentArchive( const QString &fileName )
+{
+    return saveDocumentArchive( fileName, ArchiveWithDocument );
+}
+
+bool Document::saveDocumentArchive( const QString &fileName, ArchiveContents contents )
 {
     if ( !d->m_generator )
         return false;
@@ -4465,10 +5153,22 @@ bool Document::saveDocumentArchive( const QString &fileName )
     if ( fi.isSymLink() )
         docPath = fi.symLinkTarget();
 
-    KZip okularArchive( fileName );
-    if ( !okularArchive.open( QIODevice::WriteOnly ) )
+    // a reference makes sense only to a document that stays where it is,
+    // not to a temporary copy (extracted from an archive, or downloaded)
+    const bool withReference = contents == ArchiveWithReference;
+    if ( withReference && ( d->m_archiveData ? !d->m_archiveData->referencesDocument : !d->m_url.isLocalFile() ) )
         return false;
 
+    // everything that can fail goes before opening the archive: that
+    // truncates the file, and a failure would leave it broken
+    QByteArray sha1;
+    if ( withReference )
+    {
+        sha1 = fileSha1( docPath );
+        if ( sha1.isEmpty() )
+            return false;
+    }
+
     const KUser user;
 #ifndef Q_OS_WIN
     const KUserGroup userGroup( user.gid() );
@@ -4490,14 +5190,24 @@ bool Document::saveDocumentArchive( const QString &fileName )
     filesNode.appendChild( fileNameNode );
     fileNameNode.appendChild( contentDoc.createTextNode( docFileName ) );
 
+    if ( withReference )
+    {
+        QDomElement referenceNode = contentDoc.createElement( "DocumentReference" );
+        filesNode.appendChild( referenceNode );
+        referenceNode.setAttribute( "path", QFileInfo( docPath ).absoluteFilePath() );
+        referenceNode.setAttribute( "size", QString::number( QFileInfo( docPath ).size() ) );
+        referenceNode.setAttribute( "sha1", QString::fromLatin1( sha1 ) );
+    }
+
     QDomElement metadataFileNameNode = contentDoc.createElement( "MetadataFileName" );
     filesNode.appendChild( metadataFileNameNode );
     metadataFileNameNode.appendChild( contentDoc.createTextNode( "metadata.xml" ) );
 
-    // If the generator can save annotations natively, do it
+    // If the generator can save annotations natively, do it (unless the
+    // document is only referenced, so it has to stay unchanged)
     KTemporaryFile modifiedFile;
     bool annotationsSavedNatively = false;
-    if ( d->canAddAnnotationsNatively() )
+    if ( !withReference && d->canAddAnnotationsNatively() )
     {
         if ( !modifiedFile.open() )
             return false;
@@ -4522,11 +5232,19 @@ bool Document::saveDocumentArchive( const QString &fileName )
     if ( !d->savePageDocumentInfo( &metadataFile, saveWhat ) )
         return false;
 
+    if ( !withReference && !QFileInfo( docPath ).isReadable() )
+        return false;
+
+    KZip okularArchive( fileName );
+    if ( !okularArchive.open( QIODevice::WriteOnly ) )
+        return false;
+
     const QByteArray contentDocXml = contentDoc.toByteArray();
     okularArchive.writeFile( "content.xml", user.loginName(), userGroup.name(),
                              contentDocXml.constData(), contentDocXml.length() );
 
-    okularArchive.addLocalFile( docPath, docFileName );
+    if ( !withReference && !addLocalFileToArchive( okularArchive, docPath, docFileName, user.loginName(), userGroup.name() ) )
+        return false;
     okularArchive.addLocalFile( metadataFile.fileName(), "metadata.xml" );
 
     if ( !okularArchive.close() )
@@ -4563,6 +5281,14 @@ void Document::setAnnotationEditingEnabled( bool enable )
     foreachObserver( notifySetup( d->m_pagesVector, 0 ) );
 }
 
+QString Document::cacheFileName( const QString &extension ) const
+{
+    if ( !d->m_xmlFileName.endsWith( QLatin1String( ".xml" ) ) )
+        return QString();
+
+    return d->m_xmlFileName.left( d->m_xmlFileName.length() - 4 ) + extension;
+}
+
 void Document::walletDataForFile( const QString &fileName, QString *walletName, QString *walletFolder, QString *walletKey ) const
 {
     if (d->m_generator) {
@@ -4577,6 +5303,21 @@ QAbstractItemModel * Document::layersModel() const
     return d->m_generator ? d->m_generator->layersModel() : NULL;
 }
 
+void Document::keepPagesForReload( bool keep )
+{
+    d->m_keepPagesForReload = keep;
+}
+
+void Document::setBoundingBoxesNeeded( bool needed )
+{
+    if ( d->m_boundingBoxesNeeded == needed )
+        return;
+
+    d->m_boundingBoxesNeeded = needed;
+    if ( needed && d->m_generator )
+        d->sendGeneratorPixmapRequest();
+}
+
 void DocumentPrivate::requestDone( PixmapRequest * req )
 {
     if ( !req )
@@ -4598,6 +5339,17 @@ void DocumentPrivate::requestDone( PixmapRequest * req )
         kDebug(OkularDebug) << "requestDone with generator not in READY state.";
 #endif
 
+    // the bounding box requests (without observer) leave no pixmap behind
+    if ( !req->observer() )
+    {
+        m_pixmapRequestsMutex.lock();
+        m_executingPixmapRequests.removeAll( req );
+        m_pixmapRequestsMutex.unlock();
+        delete req;
+        sendGeneratorPixmapRequest();
+        return;
+    }
+
     // [MEM] 1.1 find and remove a previous entry for the same page and id
     QLinkedList< AllocatedPixmap * >::iterator aIt = m_allocatedPixmaps.begin();
     QLinkedList< AllocatedPixmap * >::iterator aEnd = m_allocatedPixmaps.end();
@@ -4642,32 +5394,77 @@ void DocumentPrivate::requestDone( PixmapRequest * req )
 
     // 4. start a new generation if some is pending
     m_pixmapRequestsMutex.lock();
-    bool hasPixmaps = !m_pixmapRequestsStack.isEmpty();
+    bool hasPixmaps = !m_pixmapRequestsStack.isEmpty() || !m_lowPriorityPixmapRequests.isEmpty();
     m_pixmapRequestsMutex.unlock();
-    if ( hasPixmaps )
+    if ( hasPixmaps || m_boundingBoxesNeeded )
         sendGeneratorPixmapRequest();
 }
 
-void DocumentPrivate::setPageBoundingBox( int page, const NormalizedRect& boundingBox )
+void DocumentPrivate::setPageBoundingBox( int page, const NormalizedRect& boundingBox, int resolution )
 {
     Page * kp = m_pagesVector[ page ];
     if ( !m_generator || !kp )
         return;
 
-    if ( kp->boundingBox() == boundingBox )
-        return;
+    bool changed = !kp->isBoundingBoxKnown() || !( kp->boundingBox() == boundingBox );
+    const int oldResolution = kp->d->m_boundingBoxResolution;
+    if ( changed && kp->isBoundingBoxKnown() && oldResolution > 0 && resolution > oldResolution )
+    {
+        // found again on a larger rendering, the box moves by the rounding
+        // of the smaller one: not worth relayouting the view
+        const NormalizedRect oldBoundingBox = kp->boundingBox();
+        const double tolerance = 2.0 / oldResolution;
+        changed = qAbs( boundingBox.left - oldBoundingBox.left ) > tolerance
+                  || qAbs( boundingBox.top - oldBoundingBox.top ) > tolerance
+                  || qAbs( boundingBox.right - oldBoundingBox.right ) > tolerance
+                  || qAbs( boundingBox.bottom - oldBoundingBox.bottom ) > tolerance;
+    }
     kp->setBoundingBox( boundingBox );
+    kp->d->m_boundingBoxResolution = resolution;
+    if ( !changed )
+        return;
 
     // notify observers about the change
     foreachObserverD( notifyPageChanged( page, DocumentObserver::BoundingBox ) );
 
-    // TODO: For generators that generate the bbox by pixmap scanning, if the first generated pixmap is very small, the bounding box will forever be inaccurate.
     // TODO: Crop computation should also consider annotations, actions, etc. to make sure they're not cropped away.
     // TODO: Help compute bounding box for generators that create a QPixmap without a QImage, like text and plucker.
-    // TODO: Don't compute the bounding box if no one needs it (e.g., Trim Borders is off).
 
 }
 
+bool DocumentPrivate::needsBoundingBox( PixmapRequest *request ) const
+{
+    // only Trim Margins uses them, and the tiles do not cover whole pages
+    return m_boundingBoxesNeeded && !request->isTile()
+           && request->page()->d->needsBoundingBox( qMax( request->width(), request->height() ) );
+}
+
+void DocumentPrivate::pageAnnotationsLoaded( int page )
+{
+    Page * kp = m_pagesVector.value( page );
+    if ( !m_generator || !kp )
+        return;
+
+    // a file without annotations in the docdata can still have some in
+    // the pages loaded now: the local annotations then need "save as"
+    if ( !m_containsExternalAnnotations )
+    {
+        foreach ( const Annotation * annotation, kp->annotations() )
+        {
+            if ( annotation->flags() & Annotation::External )
+            {
+                m_containsExternalAnnotations = true;
+                break;
+            }
+        }
+        if ( m_containsExternalAnnotations && !m_archiveData )
+            m_annotationsNeedSaveAs = canAddAnnotationsNatively();
+    }
+
+    // notify observers about the change
+    foreachObserverD( notifyPageChanged( page, DocumentObserver::Annotations ) );
+}
+
 void DocumentPrivate::calculateMaxTextPages()
 {
     int multipliers = qMax(1, qRound(getTotalMemory() / 536870912.0)); // 512 MB
@@ -4720,6 +5517,29 @@ void DocumentPrivate::setRotationInternal( int r, bool notify )
     if ( !m_generator || ( m_rotation == rotation ) )
 	return;
 
+    // rotating the pixmaps of the pages far from the visible ones is not
+    // worth it, they get rendered again when needed
+    QSet< int > nearPages;
+    const int currentViewportPage = (*m_viewportIterator).pageNumber;
+    nearPages << currentViewportPage - 1 << currentViewportPage << currentViewportPage + 1;
+    QVector< Okular::VisiblePageRect * >::const_iterator vIt = m_pageRects.constBegin(), vEnd = m_pageRects.constEnd();
+    for ( ; vIt != vEnd; ++vIt )
+        nearPages << (*vIt)->pageNumber - 1 << (*vIt)->pageNumber << (*vIt)->pageNumber + 1;
+    QLinkedList< AllocatedPixmap * >::iterator aIt = m_allocatedPixmaps.begin();
+    while ( aIt != m_allocatedPixmaps.end() )
+    {
+        AllocatedPixmap * p = *aIt;
+        if ( nearPages.contains( p->page ) || !p->observer->canUnloadPixmap( p->page ) )
+        {
+            ++aIt;
+            continue;
+        }
+        m_allocatedPixmapsTotalMemory -= p->memory;
+        m_pagesVector.at( p->page )->deletePixmap( p->observer );
+        aIt = m_allocatedPixmaps.erase( aIt );
+        delete p;
+    }
+
     // tell the pages to rotate
     QVector< Okular::Page * >::const_iterator pIt = m_pagesVector.constBegin();
     QVector< Okular::Page * >::const_iterator pEnd = m_pagesVector.constEnd();
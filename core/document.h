@@ -218,6 +218,28 @@ class OKULAR_EXPORT Document : public QObject
          */
         OpenResult openDocument( const QString & docFile, const KUrl & url, const KMimeType::Ptr &mime, const QString &password = QString() );
 
+        /**
+         * Opens the document like openDocument(), but without waiting for
+         * the generators that can load it in a thread (see
+         * Generator::ThreadedLoading): the document is set up and
+         * openDocumentFinished() is emitted once they are done. With the
+         * other generators, the signal is emitted before returning.
+         *
+         * Closing the document, or opening another one, in the meantime
+         * cancels the opening, and openDocumentFinished() is not emitted.
+         *
+         * @since 0.25
+         */
+        void openDocumentAsynchronously( const QString & docFile, const KUrl & url, const KMimeType::Ptr &mime, const QString &password = QString() );
+
+        /**
+         * Returns whether a document is being loaded in a thread, after
+         * openDocumentAsynchronously().
+         *
+         * @since 0.25
+         */
+        bool isLoading() const;
+
         /**
          * Closes the document.
          */
@@ -808,6 +830,28 @@ class OKULAR_EXPORT Document : public QObject
          */
         bool saveDocumentArchive( const QString &fileName );
 
+        /**
+         * What a document archive contains.
+         *
+         * @since 0.25
+         */
+        enum ArchiveContents
+        {
+            ArchiveWithDocument,     ///< The document and its metadata
+            ArchiveWithReference     ///< Only the metadata and a reference (path, size and hash) to the document
+        };
+
+        /**
+         * Saves a document archive with the specified @p contents.
+         *
+         * An archive with a reference can be opened only as long as the
+         * referenced document is found unchanged, either at its original
+         * path or next to the archive.
+         *
+         * @since 0.25
+         */
+        bool saveDocumentArchive( const QString &fileName, ArchiveContents contents );
+
         /**
          * Asks the generator to dynamically generate a SourceReference for a given
          * page number and absolute X and Y position on this page.
@@ -850,6 +894,45 @@ class OKULAR_EXPORT Document : public QObject
         */
         QAbstractItemModel * layersModel() const;
 
+        /**
+         * Sets whether the bounding boxes of all the pages are @p needed, e.g.
+         * to trim their margins. When they are, the bounding boxes not known
+         * yet are computed at low resolution while there is nothing else to
+         * render, and notified with DocumentObserver::BoundingBox.
+         *
+         * Only the generators with the Generator::Threaded feature compute
+         * them in background.
+         *
+         * @since 0.25
+         */
+        void setBoundingBoxesNeeded( bool needed );
+
+        /**
+         * Keeps what was rendered or extracted for the pages (pixmaps, text,
+         * bounding boxes, links) when the document is closed next, so that
+         * opening the same file again, e.g. after it changed on disk, has to
+         * render only the pages that changed.
+         *
+         * The pages are matched through the fingerprints returned by the
+         * generator for the "PageFingerprint" metadata: nothing is kept
+         * for the generators that do not provide them, nor for a rotated
+         * document. Passing false for @p keep cancels a former call, e.g.
+         * when the document was not closed after all.
+         *
+         * @since 0.25
+         */
+        void keepPagesForReload( bool keep = true );
+
+        /**
+         * Returns the name of a file where data about the current document
+         * can be cached, next to the data Okular keeps for it; the name ends
+         * with @p extension. An empty string is returned when there is no
+         * such data, e.g. for a remote document.
+         *
+         * @since 0.25
+         */
+        QString cacheFileName( const QString &extension ) const;
+
     public Q_SLOTS:
         /**
          * This slot is called whenever the user changes the @p rotation of
@@ -1099,6 +1182,24 @@ class OKULAR_EXPORT Document : public QObject
          * @since 0.17 (KDE 4.11)
          */
         void formButtonsChangedByUndoRedo( int page, const QList< Okular::FormFieldButton* > & formButtons );
+
+        /**
+         * This signal is emitted when the opening started by
+         * openDocumentAsynchronously() is finished, with its @p result.
+         *
+         * @since 0.25
+         */
+        void openDocumentFinished( Okular::Document::OpenResult result );
+
+        /**
+         * This signal is emitted when a source reference ("src:") destination,
+         * asked while the source references were still loading, has been
+         * shown at @p viewport once they are loaded.
+         *
+         * @since 0.25
+         */
+        void pendingSourceLocationShown( const Okular::DocumentViewport &viewport );
+
     private:
         /// @cond PRIVATE
         friend class DocumentPrivate;
@@ -1117,6 +1218,8 @@ class OKULAR_EXPORT Document : public QObject
         Q_PRIVATE_SLOT( d, void slotTimedMemoryCheck() )
         Q_PRIVATE_SLOT( d, void sendGeneratorPixmapRequest() )
         Q_PRIVATE_SLOT( d, void rotationFinished( int page, Okular::Page *okularPage ) )
+        Q_PRIVATE_SLOT( d, void sourceReferencesLoaded() )
+        Q_PRIVATE_SLOT( d, void loadingThreadFinished( int ) )
         Q_PRIVATE_SLOT( d, void fontReadingProgress( int page ) )
         Q_PRIVATE_SLOT( d, void fontReadingGotFont( const Okular::FontInfo& font ) )
         Q_PRIVATE_SLOT( d, void slotGeneratorConfigChanged( const QString& ) )
@@ -16,6 +16,7 @@
 #include "synctex/synctex_parser.h"
 
 // qt/kde/system includes
+#include <QtCore/QDateTime>
 #include <QtCore/QHash>
 #include <QtCore/QLinkedList>
 #include <QtCore/QMap>
@@ -33,6 +34,7 @@ class QUndoStack;
 class QEventLoop;
 class QFile;
 class QTimer;
+class QXmlStreamWriter;
 class KTemporaryFile;
 
 struct AllocatedPixmap;
@@ -66,7 +68,26 @@ struct GeneratorInfo
 
 namespace Okular {
 
+class DocumentLoadingThread;
 class FontExtractionThread;
+class MappedFile;
+class SourceReferencesLoadingThread;
+
+// what opening a document needs to go on once the generator has loaded
+// it, which happens later when the loading runs in a thread
+struct DocumentOpening
+{
+    KService::Ptr offer;
+    KMimeType::Ptr mime;
+    QString docFile;
+    QByteArray fileData;
+    QString password;
+    QString catalogName;
+    qint64 documentSize;
+    bool isstdin;
+    bool triedMimeFromFileContent;
+    bool asynchronous;
+};
 
 struct DoContinueDirectionMatchSearchStruct
 {
@@ -96,11 +117,20 @@ class DocumentPrivate
             m_generatorsLoaded( false ),
             m_pageController( 0 ),
             m_closingLoop( 0 ),
+            m_loadingThread( 0 ),
+            m_loadingSerial( 0 ),
+            m_openAsynchronously( false ),
+            m_boundingBoxesNeeded( false ),
+            m_nextBoundingBoxPage( 0 ),
+            m_keepPagesForReload( false ),
             m_scripter( 0 ),
             m_archiveData( 0 ),
             m_fontsCached( false ),
             m_annotationEditingEnabled ( true ),
+            m_containsExternalAnnotations( false ),
             m_annotationBeingMoved( false ),
+            m_stdinData( 0 ),
+            m_sourceReferencesThread( 0 ),
             m_synctex_scanner( 0 )
         {
             calculateMaxTextPages();
@@ -120,7 +150,7 @@ class DocumentPrivate
         void loadDocumentInfo();
         void loadDocumentInfo( QFile &infoFile );
         void loadViewsInfo( View *view, const QDomElement &e );
-        void saveViewsInfo( View *view, QDomElement &e ) const;
+        void saveViewsInfo( View *view, QXmlStreamWriter &writer ) const;
         QString giveAbsolutePath( const QString & fileName ) const;
         bool openRelativeFile( const QString & fileName );
         Generator * loadGeneratorLibrary( const KService::Ptr &service );
@@ -131,7 +161,12 @@ class DocumentPrivate
         void setRotationInternal( int r, bool notify );
         ConfigInterface* generatorConfig( GeneratorInfo& info );
         SaveInterface* generatorSave( GeneratorInfo& info );
-        Document::OpenResult openDocumentInternal( const KService::Ptr& offer, bool isstdin, const QString& docFile, const QByteArray& filedata, const QString& password );
+        Document::OpenResult openDocumentInternal( DocumentOpening &opening );
+        Document::OpenResult loadDocumentWithGenerator( const DocumentOpening &opening, const QString& fileName, const QByteArray& fileData );
+        Document::OpenResult generatorLoadingDone( const DocumentOpening &opening, Document::OpenResult openResult );
+        Document::OpenResult openDocumentLoaded( DocumentOpening &opening, Document::OpenResult openResult );
+        void cancelLoading();
+        KMimeType::Ptr mimeTypeFromFileContent( const QString& fileName );
         bool savePageDocumentInfo( KTemporaryFile *infoFile, int what ) const;
         DocumentViewport nextDocumentViewport() const;
         void notifyAnnotationChanges( int page );
@@ -151,7 +186,12 @@ class DocumentPrivate
         void saveDocumentInfo() const;
         void slotTimedMemoryCheck();
         void sendGeneratorPixmapRequest();
+        void sendBoundingBoxRequest();
+        void promoteLowPriorityRequests();
+        bool reuseLargerPixmap( PixmapRequest *request );
         void rotationFinished( int page, Okular::Page *okularPage );
+        void sourceReferencesLoaded();
+        void loadingThreadFinished( int serial );
         void fontReadingProgress( int page );
         void fontReadingGotFont( const Okular::FontInfo& font );
         void slotGeneratorConfigChanged( const QString& );
@@ -171,9 +211,16 @@ class DocumentPrivate
         void requestDone( PixmapRequest * request );
         void textGenerationDone( Page *page );
         /**
-         * Sets the bounding box of the given @p page (in terms of upright orientation, i.e., Rotation0).
+         * Sets the bounding box of the given @p page (in terms of upright orientation, i.e., Rotation0),
+         * found on a rendering whose larger side is @p resolution pixels.
          */
-        void setPageBoundingBox( int page, const NormalizedRect& boundingBox );
+        void setPageBoundingBox( int page, const NormalizedRect& boundingBox, int resolution = 0 );
+        /**
+         * Returns whether the bounding box of the page of @p request is to be
+         * found on the rendering it asks for.
+         */
+        bool needsBoundingBox( PixmapRequest *request ) const;
+        void pageAnnotationsLoaded( int page );
         /**
          * Request a particular metadata of the Document itself (ie, not something
          * depending on the document type/backend).
@@ -186,8 +233,17 @@ class DocumentPrivate
          */
         bool isNormalizedRectangleFullyVisible( const Okular::NormalizedRect & rectOfInterest, int rectPage );
 
-        // For sync files
-        void loadSyncFile( const QString & filePath );
+        /**
+         * Moves the contents of the pages that have a fingerprint to
+         * m_keptPages, before the document is closed.
+         */
+        void keepPageContents();
+
+        /**
+         * Moves the kept contents to the pages of the document just opened
+         * that have the same fingerprint, and drops the rest.
+         */
+        void reusePageContents();
 
         // member variables
         Document *m_parent;
@@ -217,6 +273,7 @@ class DocumentPrivate
         QSet< DocumentObserver * > m_observers;
         QLinkedList< PixmapRequest * > m_pixmapRequestsStack;
         QLinkedList< PixmapRequest * > m_executingPixmapRequests;
+        QLinkedList< PixmapRequest * > m_lowPriorityPixmapRequests;
         QMutex m_pixmapRequestsMutex;
         QLinkedList< AllocatedPixmap * > m_allocatedPixmaps;
         qulonglong m_allocatedPixmapsTotalMemory;
@@ -257,6 +314,23 @@ class DocumentPrivate
 
         PageController *m_pageController;
         QEventLoop *m_closingLoop;
+        DocumentLoadingThread *m_loadingThread;
+        int m_loadingSerial;
+        bool m_openAsynchronously;
+
+        // background computation of the page bounding boxes
+        bool m_boundingBoxesNeeded;
+        int m_nextBoundingBoxPage;
+
+        // contents of the pages kept for a reload, by fingerprint
+        bool m_keepPagesForReload;
+        QString m_keptPagesFileName;
+        QMultiHash< QByteArray, Page * > m_keptPages;
+
+        // the last mimetype found by content, sniffing files is slow
+        QString m_contentMimeFileName;
+        QDateTime m_contentMimeFileTime;
+        KMimeType::Ptr m_contentMime;
 
         Scripter *m_scripter;
 
@@ -273,12 +347,18 @@ class DocumentPrivate
 
         bool m_annotationEditingEnabled;
         bool m_annotationsNeedSaveAs;
+        bool m_containsExternalAnnotations; // also of the pages not loaded yet, as known from the docdata
         bool m_annotationBeingMoved; // is an annotation currently being moved?
         bool m_showWarningLimitedAnnotSupport;
 
         QUndoStack *m_undoStack;
         QDomNode m_prevPropsOfAnnotBeingModified;
 
+        MappedFile *m_stdinData;
+
+        SourceReferencesLoadingThread *m_sourceReferencesThread;
+        // a "src:" destination asked before the SyncTeX file was loaded
+        QString m_pendingSourceDestination;
         synctex_scanner_t m_synctex_scanner;
 };
 
@@ -19,6 +19,7 @@
 #include <kicon.h>
 #include <klocale.h>
 #include <kwallet.h>
+#include <threadweaver/ThreadWeaver.h>
 
 #include "document.h"
 #include "document_p.h"
@@ -34,7 +35,7 @@ GeneratorPrivate::GeneratorPrivate()
       mPixmapGenerationThread( 0 ), mTextPageGenerationThread( 0 ),
       m_mutex( 0 ), m_threadsMutex( 0 ), mPixmapReady( true ), mTextPageReady( true ),
       m_closing( false ), m_closingLoop( 0 ),
-      m_dpi(72.0, 72.0)
+      m_dpi(72.0, 72.0), m_boundingBoxSerial( 0 )
 {
 }
 
@@ -103,14 +104,23 @@ void GeneratorPrivate::pixmapGenerationFinished()
     }
 
     const QImage& img = mPixmapGenerationThread->image();
-    request->page()->setPixmap( request->observer(), new QPixmap( QPixmap::fromImage( img ) ), request->normalizedRect() );
+    // the requests without observer are only for the bounding box
+    if ( request->observer() )
+        request->page()->setImage( request->observer(), img, request->normalizedRect() );
     const int pageNumber = request->page()->number();
 
-    if ( mPixmapGenerationThread->calcBoundingBox() )
-        q->updatePageBoundingBox( pageNumber, mPixmapGenerationThread->boundingBox() );
+    if ( mPixmapGenerationThread->calcBoundingBox() && m_document )
+        m_document->setPageBoundingBox( pageNumber, mPixmapGenerationThread->boundingBox(), qMax( img.width(), img.height() ) );
     q->signalPixmapRequestDone( request );
 }
 
+void GeneratorPrivate::boundingBoxComputed( ThreadWeaver::Job *job )
+{
+    BoundingBoxJob *bboxJob = static_cast< BoundingBoxJob * >( job );
+    if ( bboxJob->serial() == m_boundingBoxSerial && m_document )
+        m_document->setPageBoundingBox( bboxJob->page(), bboxJob->boundingBox(), bboxJob->resolution() );
+}
+
 void GeneratorPrivate::textpageGenerationFinished()
 {
     Q_Q( Generator );
@@ -222,6 +232,7 @@ bool Generator::closeDocument()
     bool ret = doCloseDocument();
 
     d->m_closing = false;
+    ++d->m_boundingBoxSerial;
 
     return ret;
 }
@@ -237,7 +248,7 @@ void Generator::generatePixmap( PixmapRequest *request )
     Q_D( Generator );
     d->mPixmapReady = false;
 
-    const bool calcBoundingBox = !request->isTile() && !request->page()->isBoundingBoxKnown();
+    const bool calcBoundingBox = d->m_document && d->m_document->needsBoundingBox( request );
 
     if ( request->asynchronous() && hasFeature( Threaded ) )
     {
@@ -247,7 +258,7 @@ void Generator::generatePixmap( PixmapRequest *request )
          * We create the text page for every page that is visible to the
          * user, so he can use the text extraction tools without a delay.
          */
-        if ( hasFeature( TextExtraction ) && !request->page()->hasTextPage() && canGenerateTextPage() && !d->m_closing ) {
+        if ( hasFeature( TextExtraction ) && request->observer() && !request->page()->hasTextPage() && canGenerateTextPage() && !d->m_closing ) {
             d->mTextPageReady = false;
             d->textPageGenerationThread()->startGeneration( request->page() );
         }
@@ -256,14 +267,15 @@ void Generator::generatePixmap( PixmapRequest *request )
     }
 
     const QImage& img = image( request );
-    request->page()->setPixmap( request->observer(), new QPixmap( QPixmap::fromImage( img ) ), request->normalizedRect() );
+    if ( request->observer() )
+        request->page()->setImage( request->observer(), img, request->normalizedRect() );
     const int pageNumber = request->page()->number();
 
     d->mPixmapReady = true;
 
     signalPixmapRequestDone( request );
     if ( calcBoundingBox )
-        updatePageBoundingBox( pageNumber, Utils::imageBoundingBox( &img ) );
+        computePageBoundingBox( pageNumber, img );
 }
 
 bool Generator::canGenerateTextPage() const
@@ -290,6 +302,10 @@ TextPage* Generator::textPage( Page* )
     return 0;
 }
 
+void Generator::pagesLoaded()
+{
+}
+
 DocumentInfo Generator::generateDocumentInfo(const QSet<DocumentInfo::Key> &keys) const
 {
     return DocumentInfo();
@@ -392,6 +408,13 @@ void Generator::signalTextGenerationDone( Page *page, TextPage *textPage )
         delete textPage;
 }
 
+void Generator::signalPageAnnotationsLoaded( int page )
+{
+    Q_D( Generator );
+    if ( d->m_document ) // still connected to document?
+        d->m_document->pageAnnotationsLoaded( page );
+}
+
 const Document * Generator::document() const
 {
     Q_D( const Generator );
@@ -437,6 +460,16 @@ void Generator::updatePageBoundingBox( int page, const NormalizedRect & bounding
         d->m_document->setPageBoundingBox( page, boundingBox );
 }
 
+void Generator::computePageBoundingBox( int page, const QImage &image )
+{
+    Q_D( Generator );
+    BoundingBoxJob *job = new BoundingBoxJob( image, page, d->m_boundingBoxSerial );
+    connect( job, SIGNAL(done(ThreadWeaver::Job*)),
+             this, SLOT(boundingBoxComputed(ThreadWeaver::Job*)) );
+    connect( job, SIGNAL(done(ThreadWeaver::Job*)), job, SLOT(deleteLater()) );
+    ThreadWeaver::Weaver::instance()->enqueue( job );
+}
+
 void Generator::requestFontData(const Okular::FontInfo & /*font*/, QByteArray * /*data*/)
 {
 
@@ -513,6 +546,11 @@ bool PixmapRequest::preload() const
     return d->mFeatures & Preload;
 }
 
+bool PixmapRequest::reuseLargerPixmap() const
+{
+    return d->mFeatures & ReuseLargerPixmap;
+}
+
 Page* PixmapRequest::page() const
 {
     return d->mPage;
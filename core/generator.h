@@ -39,6 +39,10 @@ class QPrinter;
 class QPrintDialog;
 class KIcon;
 
+namespace ThreadWeaver {
+    class Job;
+}
+
 namespace Okular {
 
 class DocumentFonts;
@@ -207,7 +211,8 @@ class OKULAR_EXPORT Generator : public QObject
             PrintNative,       ///< Whether the Generator supports native cross-platform printing (QPainter-based).
             PrintPostscript,   ///< Whether the Generator supports postscript-based file printing.
             PrintToFile,       ///< Whether the Generator supports export to PDF & PS through the Print Dialog
-            TiledRendering     ///< Whether the Generator can render tiles @since 0.16 (KDE 4.10)
+            TiledRendering,    ///< Whether the Generator can render tiles @since 0.16 (KDE 4.10)
+            ThreadedLoading    ///< Whether the Generator can load documents in a thread other than the GUI one @since 0.25
         };
 
         /**
@@ -238,6 +243,10 @@ class OKULAR_EXPORT Generator : public QObject
          *
          * @note the Generator has to have the feature @ref ReadRawData enabled
          *
+         * @note @p fileData can be a mapping of the document (since 0.25):
+         * it can be kept (and sliced with QByteArray::fromRawData()) without
+         * copying it until the document is closed, but not used after that.
+         *
          * @returns true on success, false otherwise.
          */
         virtual bool loadDocumentFromData( const QByteArray & fileData, QVector< Page * > & pagesVector );
@@ -399,6 +408,11 @@ class OKULAR_EXPORT Generator : public QObject
         /**
          * This method returns the meta data of the given @p key with the given @p option
          * of the document.
+         *
+         * For the "PageFingerprint" key, with the page number as @p option, a generator
+         * can return a QByteArray that changes whenever the content of the page changes
+         * (e.g. a hash of its data in the file), so that a reload keeps the pages that
+         * did not change (see Document::keepPagesForReload()). @since 0.25
          */
         virtual QVariant metaData( const QString &key, const QVariant &option ) const;
 
@@ -477,6 +491,15 @@ class OKULAR_EXPORT Generator : public QObject
          */
         void signalTextGenerationDone( Page *page, TextPage *textPage );
 
+        /**
+         * This method must be called when annotations have been added to the
+         * @p page after it was handed to the Document (e.g. by generators
+         * loading them lazily), so that the observers get notified.
+         *
+         * @since 0.25
+         */
+        void signalPageAnnotationsLoaded( int page );
+
         /**
          * This method is called when the document is closed and not used
          * any longer.
@@ -502,6 +525,17 @@ class OKULAR_EXPORT Generator : public QObject
          */
         virtual TextPage* textPage( Page *page );
 
+        /**
+         * This method is called in the GUI thread once the pages have been
+         * handed to the Document, before the observers are set up, also when
+         * the document was loaded in another thread (see ThreadedLoading).
+         * Create here the objects used in the GUI thread, like the annotation
+         * proxy, and start what goes on loading in background, like timers.
+         *
+         * @since 0.25
+         */
+        virtual void pagesLoaded();
+
         /**
          * Returns a pointer to the document.
          */
@@ -532,6 +566,16 @@ class OKULAR_EXPORT Generator : public QObject
          */
         void updatePageBoundingBox( int page, const NormalizedRect & boundingBox );
 
+        /**
+         * Computes in a thread the bounding box of the page @p page from the
+         * @p image rendered for the whole page, then sets it like
+         * updatePageBoundingBox(). Call this instead of computing it with
+         * Utils::imageBoundingBox() in the GUI thread.
+         *
+         * @since 0.25
+         */
+        void computePageBoundingBox( int page, const QImage &image );
+
         /**
          * Returns DPI, previously set via setDPI()
          * @since 0.19 (KDE 4.13)
@@ -567,6 +611,7 @@ class OKULAR_EXPORT Generator : public QObject
 
         Q_PRIVATE_SLOT( d_func(), void pixmapGenerationFinished() )
         Q_PRIVATE_SLOT( d_func(), void textpageGenerationFinished() )
+        Q_PRIVATE_SLOT( d_func(), void boundingBoxComputed( ThreadWeaver::Job* ) )
 };
 
 /**
@@ -582,7 +627,15 @@ class OKULAR_EXPORT PixmapRequest
         {
             NoFeature = 0,
             Asynchronous = 1,
-            Preload = 2
+            Preload = 2,
+            /**
+             * The request has a low priority (e.g. thumbnails): it is queued
+             * until no other request is pending, and it is satisfied by
+             * downscaling a larger pixmap of the page rendered for another
+             * observer when there is one.
+             * @since 0.25
+             */
+            ReuseLargerPixmap = 4
         };
         Q_DECLARE_FLAGS( PixmapRequestFeatures, PixmapRequestFeature )
 
@@ -644,6 +697,14 @@ class OKULAR_EXPORT PixmapRequest
          */
         bool preload() const;
 
+        /**
+         * Returns whether the request may be satisfied by downscaling a larger
+         * pixmap of the page rendered for another observer.
+         *
+         * @since 0.25
+         */
+        bool reuseLargerPixmap() const;
+
         /**
          * Returns a pointer to the page where the pixmap shall be generated for.
          */
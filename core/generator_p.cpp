@@ -62,12 +62,46 @@ void PixmapGenerationThread::run()
     if ( mRequest )
     {
         mImage = mGenerator->image( mRequest );
+        // convert here rather than on each painting in the GUI thread
+        if ( mImage.format() != QImage::Format_RGB32 && mImage.format() != QImage::Format_ARGB32_Premultiplied && !mImage.isNull() )
+            mImage = mImage.convertToFormat( QImage::Format_ARGB32_Premultiplied );
         if ( mCalcBoundingBox )
             mBoundingBox = Utils::imageBoundingBox( &mImage );
     }
 }
 
 
+BoundingBoxJob::BoundingBoxJob( const QImage &image, int page, int serial )
+    : mImage( image ), mPage( page ), mSerial( serial )
+{
+}
+
+int BoundingBoxJob::page() const
+{
+    return mPage;
+}
+
+int BoundingBoxJob::serial() const
+{
+    return mSerial;
+}
+
+NormalizedRect BoundingBoxJob::boundingBox() const
+{
+    return mBoundingBox;
+}
+
+int BoundingBoxJob::resolution() const
+{
+    return qMax( mImage.width(), mImage.height() );
+}
+
+void BoundingBoxJob::run()
+{
+    mBoundingBox = Utils::imageBoundingBox( &mImage );
+}
+
+
 TextPageGenerationThread::TextPageGenerationThread( Generator *generator )
     : mGenerator( generator ), mPage( 0 )
 {
@@ -16,6 +16,8 @@
 #include <QtCore/QThread>
 #include <QtGui/QImage>
 
+#include <threadweaver/Job.h>
+
 class QEventLoop;
 class QMutex;
 
@@ -47,6 +49,7 @@ class GeneratorPrivate
 
         void pixmapGenerationFinished();
         void textpageGenerationFinished();
+        void boundingBoxComputed( ThreadWeaver::Job *job );
 
         QMutex* threadsLock();
 
@@ -66,6 +69,8 @@ class GeneratorPrivate
         bool m_closing : 1;
         QEventLoop *m_closingLoop;
         QSizeF m_dpi;
+        // changes with each closed document, to drop the late bounding boxes
+        int m_boundingBoxSerial;
 };
 
 
@@ -141,6 +146,30 @@ class TextPageGenerationThread : public QThread
         TextPage *mTextPage;
 };
 
+/* Computes the bounding box of a page image in the pool of ThreadWeaver,
+ * for the generators rendering in the GUI thread */
+class BoundingBoxJob : public ThreadWeaver::Job
+{
+    Q_OBJECT
+
+    public:
+        BoundingBoxJob( const QImage &image, int page, int serial );
+
+        int page() const;
+        int serial() const;
+        NormalizedRect boundingBox() const;
+        int resolution() const;
+
+    protected:
+        virtual void run();
+
+    private:
+        const QImage mImage;
+        int mPage;
+        int mSerial;
+        NormalizedRect mBoundingBox;
+};
+
 class FontExtractionThread : public QThread
 {
     Q_OBJECT
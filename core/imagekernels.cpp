@@ -0,0 +1,363 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "imagekernels_p.h"
+
+#include <QtCore/QRect>
+#include <QtGui/QImage>
+#include <QtGui/QTransform>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define OKULAR_IMAGEKERNELS_SSE2 1
+#endif
+
+using namespace Okular;
+
+// from Arthur - qt4
+static inline uint qt_div_255( uint x ) { return ( x + ( x >> 8 ) + 0x80 ) >> 8; }
+
+#ifdef OKULAR_IMAGEKERNELS_SSE2
+// qt_div_255() on 8 unsigned 16 bit lanes; all the inputs are <= 255 * 255
+static inline __m128i div255_epu16( __m128i x )
+{
+    x = _mm_add_epi16( x, _mm_srli_epi16( x, 8 ) );
+    x = _mm_add_epi16( x, _mm_set1_epi16( 0x80 ) );
+    return _mm_srli_epi16( x, 8 );
+}
+#endif
+
+static inline QRgb premultiply( QRgb color )
+{
+    const uint a = qAlpha( color );
+    return qRgba( qt_div_255( qRed( color ) * a ), qt_div_255( qGreen( color ) * a ),
+                  qt_div_255( qBlue( color ) * a ), a );
+}
+
+void ImageKernels::multiplyRgb( quint32 *pixels, int count, QRgb color, bool blackAsWhite )
+{
+    const uint rh = qRed( color ), gh = qGreen( color ), bh = qBlue( color );
+    int i = 0;
+
+#ifdef OKULAR_IMAGEKERNELS_SSE2
+    // the 16 bit lanes of an unpacked pixel are B, G, R, A
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i factors = _mm_set_epi16( 255, rh, gh, bh, 255, rh, gh, bh );
+    const __m128i rgbMask = _mm_set1_epi32( 0x00ffffff );
+    const __m128i alphaMask = _mm_set1_epi32( int( 0xff000000 ) );
+    for ( ; i + 4 <= count; i += 4 )
+    {
+        __m128i px = _mm_loadu_si128( reinterpret_cast< const __m128i * >( pixels + i ) );
+        if ( blackAsWhite )
+        {
+            const __m128i isBlack = _mm_cmpeq_epi32( _mm_and_si128( px, rgbMask ), zero );
+            px = _mm_or_si128( px, _mm_and_si128( isBlack, rgbMask ) );
+        }
+        __m128i lo = _mm_mullo_epi16( _mm_unpacklo_epi8( px, zero ), factors );
+        __m128i hi = _mm_mullo_epi16( _mm_unpackhi_epi8( px, zero ), factors );
+        px = _mm_packus_epi16( div255_epu16( lo ), div255_epu16( hi ) );
+        _mm_storeu_si128( reinterpret_cast< __m128i * >( pixels + i ), _mm_or_si128( px, alphaMask ) );
+    }
+#endif
+
+    for ( ; i < count; ++i )
+    {
+        uint val = pixels[ i ];
+        if ( blackAsWhite && ( val & 0x00ffffff ) == 0 )
+            val |= 0x00ffffff;
+        pixels[ i ] = qRgba( qt_div_255( qRed( val ) * rh ),
+                             qt_div_255( qGreen( val ) * gh ),
+                             qt_div_255( qBlue( val ) * bh ), 255 );
+    }
+}
+
+void ImageKernels::scaleAlpha( quint32 *pixels, int count, uint alpha )
+{
+    int i = 0;
+
+#ifdef OKULAR_IMAGEKERNELS_SSE2
+    // the alpha is moved to the low 16 bits of each 32 bit lane, so the
+    // 16 bit multiplication cannot overflow (the high halves stay zero)
+    const __m128i factor = _mm_set1_epi32( alpha );
+    const __m128i rounding = _mm_set1_epi32( 0x80 );
+    const __m128i rgbMask = _mm_set1_epi32( 0x00ffffff );
+    for ( ; i + 4 <= count; i += 4 )
+    {
+        const __m128i px = _mm_loadu_si128( reinterpret_cast< const __m128i * >( pixels + i ) );
+        __m128i a = _mm_mullo_epi16( _mm_srli_epi32( px, 24 ), factor );
+        a = _mm_add_epi32( _mm_add_epi32( a, _mm_srli_epi32( a, 8 ) ), rounding );
+        a = _mm_slli_epi32( _mm_srli_epi32( a, 8 ), 24 );
+        _mm_storeu_si128( reinterpret_cast< __m128i * >( pixels + i ), _mm_or_si128( _mm_and_si128( px, rgbMask ), a ) );
+    }
+#endif
+
+    for ( ; i < count; ++i )
+    {
+        const uint val = pixels[ i ];
+        pixels[ i ] = ( val & 0x00ffffff ) | ( qt_div_255( qAlpha( val ) * alpha ) << 24 );
+    }
+}
+
+void ImageKernels::setOpaque( quint32 *pixels, int count )
+{
+    int i = 0;
+
+#ifdef OKULAR_IMAGEKERNELS_SSE2
+    const __m128i alphaMask = _mm_set1_epi32( int( 0xff000000 ) );
+    for ( ; i + 4 <= count; i += 4 )
+    {
+        const __m128i px = _mm_loadu_si128( reinterpret_cast< const __m128i * >( pixels + i ) );
+        _mm_storeu_si128( reinterpret_cast< __m128i * >( pixels + i ), _mm_or_si128( px, alphaMask ) );
+    }
+#endif
+
+    for ( ; i < count; ++i )
+        pixels[ i ] |= 0xff000000;
+}
+
+void ImageKernels::multiplyFill( quint32 *pixels, int count, QRgb color )
+{
+    // per channel: div255( s * d + s * (255 - da) + d * (255 - sa) ); for the
+    // alpha channel this is the usual sa + da - sa * da (within rounding)
+    const uint sa = qAlpha( color ), sr = qRed( color ), sg = qGreen( color ), sb = qBlue( color );
+    int i = 0;
+
+#ifdef OKULAR_IMAGEKERNELS_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i full = _mm_set1_epi16( 255 );
+    const __m128i src = _mm_set_epi16( sa, sr, sg, sb, sa, sr, sg, sb );
+    const __m128i invSrcAlpha = _mm_set1_epi16( 255 - sa );
+    for ( ; i + 4 <= count; i += 4 )
+    {
+        const __m128i px = _mm_loadu_si128( reinterpret_cast< const __m128i * >( pixels + i ) );
+        __m128i halves[ 2 ] = { _mm_unpacklo_epi8( px, zero ), _mm_unpackhi_epi8( px, zero ) };
+        for ( int h = 0; h < 2; ++h )
+        {
+            const __m128i d = halves[ h ];
+            __m128i invDstAlpha = _mm_shufflelo_epi16( d, _MM_SHUFFLE( 3, 3, 3, 3 ) );
+            invDstAlpha = _mm_sub_epi16( full, _mm_shufflehi_epi16( invDstAlpha, _MM_SHUFFLE( 3, 3, 3, 3 ) ) );
+            __m128i sum = _mm_mullo_epi16( d, src );
+            sum = _mm_add_epi16( sum, _mm_mullo_epi16( src, invDstAlpha ) );
+            sum = _mm_add_epi16( sum, _mm_mullo_epi16( d, invSrcAlpha ) );
+            halves[ h ] = div255_epu16( sum );
+        }
+        _mm_storeu_si128( reinterpret_cast< __m128i * >( pixels + i ), _mm_packus_epi16( halves[ 0 ], halves[ 1 ] ) );
+    }
+#endif
+
+    for ( ; i < count; ++i )
+    {
+        const uint val = pixels[ i ];
+        const uint invDa = 255 - qAlpha( val ), invSa = 255 - sa;
+        pixels[ i ] = qRgba( qt_div_255( sr * qRed( val ) + sr * invDa + qRed( val ) * invSa ),
+                             qt_div_255( sg * qGreen( val ) + sg * invDa + qGreen( val ) * invSa ),
+                             qt_div_255( sb * qBlue( val ) + sb * invDa + qBlue( val ) * invSa ),
+                             qt_div_255( sa * qAlpha( val ) + sa * invDa + qAlpha( val ) * invSa ) );
+    }
+}
+
+void ImageKernels::blend( quint32 *dest, const quint32 *from, const quint32 *to, int count, uint t )
+{
+    const uint invT = 255 - t;
+    int i = 0;
+
+#ifdef OKULAR_IMAGEKERNELS_SSE2
+    // from * (255 - t) + to * t is at most 255 * 255, so it fits the 16 bit lanes
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i fromFactor = _mm_set1_epi16( invT );
+    const __m128i toFactor = _mm_set1_epi16( t );
+    for ( ; i + 4 <= count; i += 4 )
+    {
+        const __m128i a = _mm_loadu_si128( reinterpret_cast< const __m128i * >( from + i ) );
+        const __m128i b = _mm_loadu_si128( reinterpret_cast< const __m128i * >( to + i ) );
+        __m128i lo = _mm_add_epi16( _mm_mullo_epi16( _mm_unpacklo_epi8( a, zero ), fromFactor ),
+                                    _mm_mullo_epi16( _mm_unpacklo_epi8( b, zero ), toFactor ) );
+        __m128i hi = _mm_add_epi16( _mm_mullo_epi16( _mm_unpackhi_epi8( a, zero ), fromFactor ),
+                                    _mm_mullo_epi16( _mm_unpackhi_epi8( b, zero ), toFactor ) );
+        _mm_storeu_si128( reinterpret_cast< __m128i * >( dest + i ), _mm_packus_epi16( div255_epu16( lo ), div255_epu16( hi ) ) );
+    }
+#endif
+
+    for ( ; i < count; ++i )
+    {
+        const uint a = from[ i ], b = to[ i ];
+        dest[ i ] = qRgba( qt_div_255( qRed( a ) * invT + qRed( b ) * t ),
+                           qt_div_255( qGreen( a ) * invT + qGreen( b ) * t ),
+                           qt_div_255( qBlue( a ) * invT + qBlue( b ) * t ),
+                           qt_div_255( qAlpha( a ) * invT + qAlpha( b ) * t ) );
+    }
+}
+
+int ImageKernels::findFirstNotRgb( const quint32 *pixels, int count, QRgb color )
+{
+    const uint rgb = color & 0x00ffffff;
+    int i = 0;
+
+#ifdef OKULAR_IMAGEKERNELS_SSE2
+    // skip 4 pixels at a time, the plain loop finds which one differs
+    const __m128i rgbMask = _mm_set1_epi32( 0x00ffffff );
+    const __m128i reference = _mm_set1_epi32( rgb );
+    for ( ; i + 4 <= count; i += 4 )
+    {
+        const __m128i px = _mm_and_si128( _mm_loadu_si128( reinterpret_cast< const __m128i * >( pixels + i ) ), rgbMask );
+        if ( _mm_movemask_epi8( _mm_cmpeq_epi32( px, reference ) ) != 0xffff )
+            break;
+    }
+#endif
+
+    for ( ; i < count; ++i )
+        if ( ( pixels[ i ] & 0x00ffffff ) != rgb )
+            return i;
+    return count;
+}
+
+int ImageKernels::findLastNotRgb( const quint32 *pixels, int count, QRgb color )
+{
+    const uint rgb = color & 0x00ffffff;
+    int i = count;
+
+#ifdef OKULAR_IMAGEKERNELS_SSE2
+    const __m128i rgbMask = _mm_set1_epi32( 0x00ffffff );
+    const __m128i reference = _mm_set1_epi32( rgb );
+    for ( ; i >= 4; i -= 4 )
+    {
+        const __m128i px = _mm_and_si128( _mm_loadu_si128( reinterpret_cast< const __m128i * >( pixels + i - 4 ) ), rgbMask );
+        if ( _mm_movemask_epi8( _mm_cmpeq_epi32( px, reference ) ) != 0xffff )
+            break;
+    }
+#endif
+
+    while ( i > 0 )
+    {
+        --i;
+        if ( ( pixels[ i ] & 0x00ffffff ) != rgb )
+            return i;
+    }
+    return -1;
+}
+
+QImage ImageKernels::rotatedImage( const QImage &image, int degrees )
+{
+    degrees = ( ( degrees % 360 ) + 360 ) % 360;
+    if ( degrees == 0 || image.isNull() )
+        return image;
+
+    if ( image.depth() != 32 || degrees % 90 != 0 )
+    {
+        QTransform matrix;
+        matrix.rotate( degrees );
+        return image.transformed( matrix );
+    }
+
+    const int width = image.width();
+    const int height = image.height();
+    QImage rotated = degrees == 180 ? QImage( width, height, image.format() ) : QImage( height, width, image.format() );
+    if ( rotated.isNull() )
+        return rotated;
+
+    const quint32 *src = reinterpret_cast< const quint32 * >( image.constBits() );
+    const int srcStride = image.bytesPerLine() / 4;
+    quint32 *dst = reinterpret_cast< quint32 * >( rotated.bits() );
+    const int dstStride = rotated.bytesPerLine() / 4;
+
+    if ( degrees == 180 )
+    {
+        // ( x, y ) -> ( width - 1 - x, height - 1 - y ), one line at a time
+        for ( int y = 0; y < height; ++y )
+        {
+            const quint32 *s = src + y * srcStride;
+            quint32 *d = dst + ( height - 1 - y ) * dstStride + width - 1;
+            for ( int x = 0; x < width; ++x )
+                *d-- = s[ x ];
+        }
+        return rotated;
+    }
+
+    // a tile of 32x32 pixels is 4 KiB for both the source and the destination
+    static const int TileSize = 32;
+    for ( int ty = 0; ty < height; ty += TileSize )
+    {
+        const int yEnd = qMin( ty + TileSize, height );
+        for ( int tx = 0; tx < width; tx += TileSize )
+        {
+            const int xEnd = qMin( tx + TileSize, width );
+            for ( int y = ty; y < yEnd; ++y )
+            {
+                const quint32 *s = src + y * srcStride;
+                if ( degrees == 90 )
+                {
+                    // ( x, y ) -> ( height - 1 - y, x )
+                    quint32 *d = dst + height - 1 - y;
+                    for ( int x = tx; x < xEnd; ++x )
+                        d[ x * dstStride ] = s[ x ];
+                }
+                else
+                {
+                    // ( x, y ) -> ( y, width - 1 - x )
+                    quint32 *d = dst + y;
+                    for ( int x = tx; x < xEnd; ++x )
+                        d[ ( width - 1 - x ) * dstStride ] = s[ x ];
+                }
+            }
+        }
+    }
+    return rotated;
+}
+
+void ImageKernels::multiplyRect( QImage &image, const QRect &rect, const QColor &color, bool blackAsWhite )
+{
+    const QRect r = rect.intersected( image.rect() );
+    if ( r.isEmpty() )
+        return;
+
+    const QRgb rgb = color.rgb();
+    for ( int y = r.top(); y <= r.bottom(); ++y )
+        multiplyRgb( reinterpret_cast< quint32 * >( image.scanLine( y ) ) + r.left(), r.width(), rgb, blackAsWhite );
+}
+
+void ImageKernels::scaleImageAlpha( QImage &image, uint alpha )
+{
+    const int width = image.width();
+    const int height = image.height();
+    for ( int y = 0; y < height; ++y )
+        scaleAlpha( reinterpret_cast< quint32 * >( image.scanLine( y ) ), width, alpha );
+}
+
+void ImageKernels::multiplyFillRect( QImage &image, const QRect &rect, const QColor &color )
+{
+    Q_ASSERT( image.format() == QImage::Format_ARGB32_Premultiplied );
+
+    const QRect r = rect.intersected( image.rect() );
+    if ( r.isEmpty() )
+        return;
+
+    const QRgb premultiplied = premultiply( color.rgba() );
+    for ( int y = r.top(); y <= r.bottom(); ++y )
+        multiplyFill( reinterpret_cast< quint32 * >( image.scanLine( y ) ) + r.left(), r.width(), premultiplied );
+}
+
+void ImageKernels::blendRect( QImage &dest, const QImage &from, const QImage &to, const QRect &rect, uint t )
+{
+    Q_ASSERT( dest.size() == from.size() && dest.size() == to.size() );
+    Q_ASSERT( dest.depth() == 32 && from.depth() == 32 && to.depth() == 32 );
+
+    const QRect r = rect.intersected( dest.rect() );
+    if ( r.isEmpty() )
+        return;
+
+    for ( int y = r.top(); y <= r.bottom(); ++y )
+    {
+        blend( reinterpret_cast< quint32 * >( dest.scanLine( y ) ) + r.left(),
+               reinterpret_cast< const quint32 * >( from.constScanLine( y ) ) + r.left(),
+               reinterpret_cast< const quint32 * >( to.constScanLine( y ) ) + r.left(),
+               r.width(), t );
+    }
+}
+
+/* kate: replace-tabs on; indent-width 4; */
@@ -0,0 +1,115 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef _OKULAR_IMAGEKERNELS_P_H_
+#define _OKULAR_IMAGEKERNELS_P_H_
+
+#include <QtGui/QColor>
+
+#include "okular_export.h"
+
+class QImage;
+class QRect;
+
+namespace Okular
+{
+
+/**
+ * Small pixel kernels working on 32 bit (A)RGB pixel spans.
+ *
+ * Each kernel has a SSE2 implementation when the compiler targets it and a
+ * plain C++ fallback; both produce the very same results. The span functions
+ * work on raw pixel pointers, so they can be run on single scanlines, the
+ * QImage wrappers take care of clipping and of the image stride.
+ */
+namespace ImageKernels
+{
+    /**
+     * Multiplies the RGB channels of @p count pixels with @p color and makes
+     * the result opaque. If @p blackAsWhite is set, pixels whose RGB channels
+     * are all zero (e.g. the transparent background of text documents) are
+     * treated as white.
+     */
+    OKULAR_EXPORT void multiplyRgb( quint32 *pixels, int count, QRgb color, bool blackAsWhite );
+
+    /**
+     * Scales the alpha channel of @p count pixels by @p alpha (0 - 255),
+     * leaving the color channels untouched.
+     */
+    OKULAR_EXPORT void scaleAlpha( quint32 *pixels, int count, uint alpha );
+
+    /**
+     * Sets the alpha channel of @p count pixels to 255, as QImage expects
+     * from the pixels of a QImage::Format_RGB32 image.
+     */
+    OKULAR_EXPORT void setOpaque( quint32 *pixels, int count );
+
+    /**
+     * Blends the premultiplied @p color over @p count premultiplied pixels
+     * with the same math as QPainter::CompositionMode_Multiply.
+     */
+    OKULAR_EXPORT void multiplyFill( quint32 *pixels, int count, QRgb color );
+
+    /**
+     * Cross-fades @p count pixels: each channel of @p dest is set to
+     * ( @p from * ( 255 - @p t ) + @p to * @p t ) / 255, @p t being 0 - 255.
+     * @p dest may be the same span as @p from or @p to.
+     */
+    OKULAR_EXPORT void blend( quint32 *dest, const quint32 *from, const quint32 *to, int count, uint t );
+
+    /**
+     * Returns the index of the first of @p count pixels whose RGB channels
+     * differ from the ones of @p color, or @p count if there is none.
+     * Utils::imageBoundingBox() uses it to skip the paper colored spans.
+     */
+    OKULAR_EXPORT int findFirstNotRgb( const quint32 *pixels, int count, QRgb color );
+
+    /**
+     * Returns the index of the last of @p count pixels whose RGB channels
+     * differ from the ones of @p color, or -1 if there is none.
+     */
+    OKULAR_EXPORT int findLastNotRgb( const quint32 *pixels, int count, QRgb color );
+
+    /**
+     * Returns @p image rotated clockwise by @p degrees (90, 180 or 270), as
+     * QImage::transformed() would do. The 32 bit images are transposed a
+     * tile at a time, so both the source and the destination lines stay in
+     * cache; the other formats go through QImage::transformed().
+     */
+    OKULAR_EXPORT QImage rotatedImage( const QImage &image, int degrees );
+
+    /**
+     * Applies multiplyRgb() to the @p rect area of @p image.
+     */
+    OKULAR_EXPORT void multiplyRect( QImage &image, const QRect &rect, const QColor &color, bool blackAsWhite );
+
+    /**
+     * Applies scaleAlpha() to the whole @p image.
+     */
+    OKULAR_EXPORT void scaleImageAlpha( QImage &image, uint alpha );
+
+    /**
+     * Applies multiplyFill() with @p color to the @p rect area of @p image,
+     * which has to be in the QImage::Format_ARGB32_Premultiplied format.
+     */
+    OKULAR_EXPORT void multiplyFillRect( QImage &image, const QRect &rect, const QColor &color );
+
+    /**
+     * Applies blend() to the @p rect area of @p dest, taking the pixels from
+     * the same area of @p from and @p to. The three images must have the same
+     * size and a 32 bit format.
+     */
+    OKULAR_EXPORT void blendRect( QImage &dest, const QImage &from, const QImage &to, const QRect &rect, uint t );
+}
+
+}
+
+#endif
+
+/* kate: replace-tabs on; indent-width 4; */
@@ -0,0 +1,128 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "mappedfile_p.h"
+
+#include <limits.h>
+
+#include <QtCore/QFile>
+
+#include <kzip.h>
+
+using namespace Okular;
+
+class MappedFile::Private
+{
+    public:
+        Private()
+            : map( 0 )
+        {
+        }
+
+        bool mapOrRead();
+
+        QFile file;
+        uchar *map;
+        QByteArray data;
+};
+
+bool MappedFile::Private::mapOrRead()
+{
+    // QByteArray cannot hold more
+    const qint64 size = file.size();
+    if ( !file.isSequential() && size > 0 && size <= INT_MAX )
+    {
+        map = file.map( 0, size );
+        if ( map )
+        {
+            data = QByteArray::fromRawData( reinterpret_cast< const char * >( map ), size );
+            return true;
+        }
+    }
+
+    data = file.readAll();
+    file.close();
+    return !data.isEmpty();
+}
+
+MappedFile::MappedFile()
+    : d( new Private )
+{
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+    delete d;
+}
+
+bool MappedFile::load( const QString &fileName )
+{
+    close();
+    d->file.setFileName( fileName );
+    if ( !d->file.open( QIODevice::ReadOnly ) )
+        return false;
+    return d->mapOrRead();
+}
+
+bool MappedFile::load( FILE *handle )
+{
+    close();
+    if ( !d->file.open( handle, QIODevice::ReadOnly ) )
+        return false;
+    return d->mapOrRead();
+}
+
+void MappedFile::close()
+{
+    d->data.clear();
+    if ( d->map )
+    {
+        d->file.unmap( d->map );
+        d->map = 0;
+    }
+    d->file.close();
+}
+
+bool MappedFile::isMapped() const
+{
+    return d->map;
+}
+
+qint64 MappedFile::size() const
+{
+    return d->data.size();
+}
+
+QByteArray MappedFile::data() const
+{
+    return d->data;
+}
+
+QByteArray MappedFile::data( qint64 offset, qint64 length ) const
+{
+    if ( offset < 0 || length < 0 || offset + length > d->data.size() )
+        return QByteArray();
+
+    return QByteArray::fromRawData( d->data.constData() + offset, length );
+}
+
+QByteArray MappedFile::zipEntryData( const KZipFileEntry *entry ) const
+{
+    // the position of a zip entry is the one of its data
+    if ( entry->encoding() == 0 )
+    {
+        const QByteArray stored = data( entry->position(), entry->size() );
+        if ( stored.size() == entry->size() )
+            return stored;
+    }
+    return entry->data();
+}
+
+/* kate: replace-tabs on; indent-width 4; */
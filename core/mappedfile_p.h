@@ -0,0 +1,113 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef _OKULAR_MAPPEDFILE_P_H_
+#define _OKULAR_MAPPEDFILE_P_H_
+
+#include "okular_export.h"
+
+#include <stdio.h>
+
+#include <QtCore/QByteArray>
+
+class QString;
+class KZipFileEntry;
+
+namespace Okular {
+
+/**
+ * @short The read-only contents of a file, mapped in memory.
+ *
+ * The contents of a regular file are mapped in memory, so they are read
+ * only when (and if) used, and their memory is shared with the cache of
+ * the system instead of being copied; the files that cannot be mapped
+ * (e.g. a pipe) are read in memory.
+ *
+ * data() returns the contents without copying them, and so do its
+ * copies as long as they are not modified: they must not be used after
+ * the file is closed.
+ *
+ * As with any mapping, the file must not be truncated while it is mapped:
+ * reading its pages past the new end would raise SIGBUS.
+ *
+ * Not installed: it is shared by the core library and the generators
+ * built with it only.
+ */
+class OKULAR_EXPORT MappedFile
+{
+    public:
+        MappedFile();
+
+        /**
+         * Closes the file.
+         */
+        ~MappedFile();
+
+        /**
+         * Maps the contents of the file @p fileName.
+         *
+         * Returns false if the file cannot be read or is empty.
+         */
+        bool load( const QString &fileName );
+
+        /**
+         * Maps the contents of the file open as @p handle (e.g. stdin),
+         * from its current position if it cannot be mapped.
+         *
+         * Returns false if the file cannot be read or is empty.
+         */
+        bool load( FILE *handle );
+
+        /**
+         * Releases the contents of the file.
+         */
+        void close();
+
+        /**
+         * Returns whether the contents are mapped, rather than read in
+         * memory.
+         */
+        bool isMapped() const;
+
+        /**
+         * Returns the size of the contents.
+         */
+        qint64 size() const;
+
+        /**
+         * Returns the contents of the file, without copying them.
+         */
+        QByteArray data() const;
+
+        /**
+         * Returns the @p length bytes from @p offset of the contents of the
+         * file, without copying them, or an empty array if they are not all
+         * in the file.
+         */
+        QByteArray data( qint64 offset, qint64 length ) const;
+
+        /**
+         * Returns the uncompressed data of the @p entry of the zip archive
+         * which is this file: the entries stored without compression (as the
+         * images usually are) are not copied, the others are uncompressed.
+         */
+        QByteArray zipEntryData( const KZipFileEntry *entry ) const;
+
+    private:
+        Q_DISABLE_COPY( MappedFile )
+
+        class Private;
+        Private * const d;
+};
+
+}
+
+#endif
+
+/* kate: replace-tabs on; indent-width 4; */
@@ -15,6 +15,8 @@
 #include <QtCore/QString>
 #include <QtCore/QVariant>
 #include <QtCore/QUuid>
+#include <QtCore/QIODevice>
+#include <QtCore/QXmlStreamWriter>
 #include <QtGui/QPixmap>
 #include <QtXml/QDomDocument>
 #include <QtXml/QDomElement>
@@ -68,10 +70,10 @@ static void deleteObjectRects( QLinkedList< ObjectRect * >& rects, const QSet<Ob
 PagePrivate::PagePrivate( Page *page, uint n, double w, double h, Rotation o )
     : m_page( page ), m_number( n ), m_orientation( o ),
       m_width( w ), m_height( h ), m_doc( 0 ), m_boundingBox( 0, 0, 1, 1 ),
-      m_rotation( Rotation0 ),
+      m_boundingBoxResolution( 0 ), m_rotation( Rotation0 ),
       m_text( 0 ), m_transition( 0 ), m_textSelections( 0 ),
       m_openingAction( 0 ), m_closingAction( 0 ), m_duration( -1 ),
-      m_isBoundingBoxKnown( false )
+      m_isBoundingBoxKnown( false ), m_annotationsXmlValid( false )
 {
     // avoid Division-By-Zero problems in the program
     if ( m_width <= 0 )
@@ -91,6 +93,26 @@ PagePrivate::~PagePrivate()
 }
 
 
+PagePrivate::PixmapObject::PixmapObject()
+    : m_rotation( Rotation0 )
+{
+}
+
+QSize PagePrivate::PixmapObject::size() const
+{
+    return m_image.size();
+}
+
+QImage PagePrivate::PixmapObject::image() const
+{
+    return m_image;
+}
+
+void PagePrivate::PixmapObject::setImage( const QImage &image )
+{
+    m_image = image;
+}
+
 void PagePrivate::imageRotationDone( RotationJob * job )
 {
     TilesManager *tm = tilesManager( job->observer() );
@@ -103,18 +125,25 @@ void PagePrivate::imageRotationDone( RotationJob * job )
     }
 
     QMap< DocumentObserver*, PixmapObject >::iterator it = m_pixmaps.find( job->observer() );
-    if ( it != m_pixmaps.end() )
-    {
-        PixmapObject &object = it.value();
-        (*object.m_pixmap) = QPixmap::fromImage( job->image() );
-        object.m_rotation = job->rotation();
-    } else {
-        PixmapObject object;
-        object.m_pixmap = new QPixmap( QPixmap::fromImage( job->image() ) );
-        object.m_rotation = job->rotation();
+    if ( it == m_pixmaps.end() )
+        it = m_pixmaps.insert( job->observer(), PixmapObject() );
+    it.value().setImage( job->image() );
+    it.value().m_rotation = job->rotation();
+}
 
-        m_pixmaps.insert( job->observer(), object );
-    }
+void PagePrivate::rotateImage( DocumentObserver *observer, const QImage &image, const NormalizedRect &rect )
+{
+    RotationJob *job = new RotationJob( image, Rotation0, m_rotation, observer );
+    job->setPage( this );
+    job->setRect( TilesManager::toRotatedRect( rect, m_rotation ) );
+    job->setPriority( rotationJobPriority() );
+    m_doc->m_pageController->addRotationJob(job);
+}
+
+int PagePrivate::rotationJobPriority() const
+{
+    // the pages closer to the current one are rotated first
+    return -qAbs( m_number - (*m_doc->m_viewportIterator).pageNumber );
 }
 
 QTransform PagePrivate::rotationMatrix() const
@@ -188,6 +217,7 @@ bool Page::isBoundingBoxKnown() const
 
 void Page::setBoundingBox( const NormalizedRect& bbox )
 {
+    d->m_boundingBoxResolution = 0;
     if ( d->m_isBoundingBoxKnown && d->m_boundingBox == bbox )
         return;
 
@@ -220,9 +250,7 @@ bool Page::hasPixmap( DocumentObserver *observer, int width, int height, const N
     if ( width == -1 || height == -1 )
         return true;
 
-    const QPixmap *pixmap = it.value().m_pixmap;
-
-    return (pixmap->width() == width && pixmap->height() == height);
+    return it.value().size() == QSize( width, height );
 }
 
 bool Page::hasTextPage() const
@@ -371,8 +399,9 @@ void PagePrivate::rotateAt( Rotation orientation )
 
         const PagePrivate::PixmapObject &object = it.value();
 
-        RotationJob *job = new RotationJob( object.m_pixmap->toImage(), object.m_rotation, m_rotation, it.key() );
+        RotationJob *job = new RotationJob( object.image(), object.m_rotation, m_rotation, it.key() );
         job->setPage( this );
+        job->setPriority( rotationJobPriority() );
         m_doc->m_pageController->addRotationJob(job);
     }
 
@@ -505,34 +534,33 @@ QLinkedList< FormField * > Page::formFields() const
 }
 
 void Page::setPixmap( DocumentObserver *observer, QPixmap *pixmap, const NormalizedRect &rect )
+{
+    TilesManager *tm = d->tilesManager( observer );
+    if ( tm && d->m_rotation == Rotation0 )
+        tm->setPixmap( pixmap, rect );
+    else
+        setImage( observer, pixmap->toImage(), rect );
+    delete pixmap;
+}
+
+void Page::setImage( DocumentObserver *observer, const QImage &image, const NormalizedRect &rect )
 {
     if ( d->m_rotation == Rotation0 ) {
         TilesManager *tm = d->tilesManager( observer );
         if ( tm )
         {
-            tm->setPixmap( pixmap, rect );
-            delete pixmap;
+            const QPixmap pixmap = QPixmap::fromImage( image );
+            tm->setPixmap( &pixmap, rect );
             return;
         }
 
         QMap< DocumentObserver*, PagePrivate::PixmapObject >::iterator it = d->m_pixmaps.find( observer );
-        if ( it != d->m_pixmaps.end() )
-        {
-            delete it.value().m_pixmap;
-        }
-        else
-        {
+        if ( it == d->m_pixmaps.end() )
             it = d->m_pixmaps.insert( observer, PagePrivate::PixmapObject() );
-        }
-        it.value().m_pixmap = pixmap;
+        it.value().setImage( image );
         it.value().m_rotation = d->m_rotation;
     } else {
-        RotationJob *job = new RotationJob( pixmap->toImage(), Rotation0, d->m_rotation, observer );
-        job->setPage( d );
-        job->setRect( TilesManager::toRotatedRect( rect, d->m_rotation ) );
-        d->m_doc->m_pageController->addRotationJob(job);
-
-        delete pixmap;
+        d->rotateImage( observer, image, rect );
     }
 }
 
@@ -638,6 +666,7 @@ void Page::addAnnotation( Annotation * annotation )
     }
     annotation->d_ptr->m_page = d;
     m_annotations.append( annotation );
+    d->m_annotationsXmlValid = false;
 
     AnnotationObjectRect *rect = new AnnotationObjectRect( annotation );
 
@@ -670,6 +699,7 @@ bool Page::removeAnnotation( Annotation * annotation )
             kDebug(OkularDebug) << "removed annotation:" << annotation->uniqueName();
             annotation->d_ptr->m_page = 0;
             m_annotations.erase( aIt );
+            d->m_annotationsXmlValid = false;
             break;
         }
     }
@@ -719,19 +749,12 @@ void Page::deletePixmap( DocumentObserver *observer )
     }
     else
     {
-        PagePrivate::PixmapObject object = d->m_pixmaps.take( observer );
-        delete object.m_pixmap;
+        d->m_pixmaps.remove( observer );
     }
 }
 
 void Page::deletePixmaps()
 {
-    QMapIterator< DocumentObserver*, PagePrivate::PixmapObject > it( d->m_pixmaps );
-    while ( it.hasNext() ) {
-        it.next();
-        delete it.value().m_pixmap;
-    }
-
     d->m_pixmaps.clear();
 
     qDeleteAll(d->m_tilesManagers);
@@ -783,6 +806,7 @@ void Page::deleteAnnotations()
     for ( ; aIt != aEnd; ++aIt )
         delete *aIt;
     m_annotations.clear();
+    d->m_annotationsXmlValid = false;
 }
 
 void PagePrivate::restoreLocalContents( const QDomNode & pageNode )
@@ -866,15 +890,35 @@ void PagePrivate::restoreLocalContents( const QDomNode & pageNode )
                 (*wantedIt)->d_ptr->setValue( value );
             }
         }
+        // parse boundingBox child element
+        else if ( childElement.tagName() == "boundingBox" )
+        {
+            const NormalizedRect bbox( childElement.attribute( "l" ).toDouble(), childElement.attribute( "t" ).toDouble(),
+                                       childElement.attribute( "r" ).toDouble(), childElement.attribute( "b" ).toDouble() );
+            m_page->setBoundingBox( bbox );
+            // recompute the boxes saved without their resolution
+            bool ok = false;
+            m_boundingBoxResolution = childElement.attribute( "resolution" ).toInt( &ok );
+            if ( !ok )
+                m_boundingBoxResolution = 1;
+        }
     }
 }
 
-void PagePrivate::saveLocalContents( QDomNode & parentNode, QDomDocument & document, PageItems what ) const
+// copies the serialized XML @p xml (without the XML declaration) to @p writer;
+// it comes from QDomDocument::toByteArray(), so it is well formed and in UTF-8,
+// the encoding of the writer, and is written as is instead of being parsed again
+static void copyXmlFragment( QXmlStreamWriter & writer, const QByteArray & xml )
 {
-    // create the page node and set the 'number' attribute
-    QDomElement pageElement = document.createElement( "page" );
-    pageElement.setAttribute( "number", m_number );
+    // writing no characters still closes the pending start tag
+    writer.writeCharacters( QString() );
+    QIODevice *device = writer.device();
+    if ( device->write( xml ) != xml.size() )
+        kWarning(OkularDebug) << "Could not write the annotations:" << device->errorString();
+}
 
+void PagePrivate::saveLocalContents( QXmlStreamWriter & writer, PageItems what ) const
+{
 #if 0
     // add bookmark info if is bookmarked
     if ( d->m_bookmarked )
@@ -888,106 +932,150 @@ void PagePrivate::saveLocalContents( QDomNode & parentNode, QDomDocument & docum
     }
 #endif
 
-    // add annotations info if has got any
+    // get the annotations info, if has got any
+    QByteArray annotationsXml;
     if ( ( what & AnnotationPageItems ) && ( what & OriginalAnnotationPageItems ) )
     {
-        const QDomElement savedDocRoot = restoredLocalAnnotationList.documentElement();
-        if ( !savedDocRoot.isNull() )
-        {
-            // Import and append node in target document
-            const QDomNode importedNode = document.importNode( savedDocRoot, true );
-            pageElement.appendChild( importedNode );
-        }
+        if ( !restoredLocalAnnotationList.documentElement().isNull() )
+            annotationsXml = restoredLocalAnnotationList.toByteArray( -1 );
     }
-    else if ( ( what & AnnotationPageItems ) && !m_page->m_annotations.isEmpty() )
+    else if ( what & AnnotationPageItems )
     {
-        // create the annotationList
-        QDomElement annotListElement = document.createElement( "annotationList" );
-
-        // add every annotation to the annotationList
-        QLinkedList< Annotation * >::const_iterator aIt = m_page->m_annotations.constBegin(), aEnd = m_page->m_annotations.constEnd();
-        for ( ; aIt != aEnd; ++aIt )
+        // serialize the annotations only if they changed since the last time
+        if ( !m_annotationsXmlValid )
         {
-            // get annotation
-            const Annotation * a = *aIt;
-            // only save okular annotations (not the embedded in file ones)
-            if ( !(a->flags() & Annotation::External) )
+            m_annotationsXml.clear();
+
+            // create the annotationList
+            QDomDocument document;
+            QDomElement annotListElement = document.createElement( "annotationList" );
+
+            // add every annotation to the annotationList
+            QLinkedList< Annotation * >::const_iterator aIt = m_page->m_annotations.constBegin(), aEnd = m_page->m_annotations.constEnd();
+            for ( ; aIt != aEnd; ++aIt )
             {
-                // append an filled-up element called 'annotation' to the list
-                QDomElement annElement = document.createElement( "annotation" );
-                AnnotationUtils::storeAnnotation( a, annElement, document );
-                annotListElement.appendChild( annElement );
-                kDebug(OkularDebug) << "save annotation:" << a->uniqueName();
+                // get annotation
+                const Annotation * a = *aIt;
+                // only save okular annotations (not the embedded in file ones)
+                if ( !(a->flags() & Annotation::External) )
+                {
+                    // append an filled-up element called 'annotation' to the list
+                    QDomElement annElement = document.createElement( "annotation" );
+                    AnnotationUtils::storeAnnotation( a, annElement, document );
+                    annotListElement.appendChild( annElement );
+                    kDebug(OkularDebug) << "save annotation:" << a->uniqueName();
+                }
             }
-        }
 
-        // append the annotationList element if annotations have been set
-        if ( annotListElement.hasChildNodes() )
-            pageElement.appendChild( annotListElement );
+            // keep the annotationList only if annotations have been set
+            if ( annotListElement.hasChildNodes() )
+            {
+                document.appendChild( annotListElement );
+                m_annotationsXml = document.toByteArray( -1 );
+            }
+            m_annotationsXmlValid = true;
+        }
+        annotationsXml = m_annotationsXml;
     }
 
-    // add forms info if has got any
-    if ( ( what & FormFieldPageItems ) && !formfields.isEmpty() )
+    // get the forms info, if has got any
+    QList< const FormField * > changedForms;
+    if ( what & FormFieldPageItems )
     {
-        // create the formList
-        QDomElement formListElement = document.createElement( "forms" );
-
-        // add every form data to the formList
         QLinkedList< FormField * >::const_iterator fIt = formfields.constBegin(), fItEnd = formfields.constEnd();
         for ( ; fIt != fItEnd; ++fIt )
         {
-            // get the form field
-            const FormField * f = *fIt;
+            if ( (*fIt)->d_ptr->m_default != (*fIt)->d_ptr->value() )
+                changedForms.append( *fIt );
+        }
+    }
 
-            QString newvalue = f->d_ptr->value();
-            if ( f->d_ptr->m_default == newvalue )
-                continue;
+    // the bounding box is saved so it has not to be computed again
+    const bool saveBoundingBox = ( what & BoundingBoxPageItems ) && m_isBoundingBoxKnown;
+
+    // write the page element only if has children
+    if ( annotationsXml.isEmpty() && changedForms.isEmpty() && !saveBoundingBox )
+        return;
+
+    // create the page element and set the 'number' attribute
+    writer.writeStartElement( "page" );
+    writer.writeAttribute( "number", QString::number( m_number ) );
 
-            // append an filled-up element called 'annotation' to the list
-            QDomElement formElement = document.createElement( "form" );
-            formElement.setAttribute( "id", f->id() );
-            formElement.setAttribute( "value", newvalue );
-            formListElement.appendChild( formElement );
+    if ( !annotationsXml.isEmpty() )
+        copyXmlFragment( writer, annotationsXml );
+
+    if ( !changedForms.isEmpty() )
+    {
+        // add every form data to the formList
+        writer.writeStartElement( "forms" );
+        foreach ( const FormField * f, changedForms )
+        {
+            writer.writeEmptyElement( "form" );
+            writer.writeAttribute( "id", QString::number( f->id() ) );
+            writer.writeAttribute( "value", f->d_ptr->value() );
         }
+        writer.writeEndElement();
+    }
 
-        // append the annotationList element if annotations have been set
-        if ( formListElement.hasChildNodes() )
-            pageElement.appendChild( formListElement );
+    if ( saveBoundingBox )
+    {
+        writer.writeEmptyElement( "boundingBox" );
+        writer.writeAttribute( "l", QString::number( m_boundingBox.left ) );
+        writer.writeAttribute( "t", QString::number( m_boundingBox.top ) );
+        writer.writeAttribute( "r", QString::number( m_boundingBox.right ) );
+        writer.writeAttribute( "b", QString::number( m_boundingBox.bottom ) );
+        writer.writeAttribute( "resolution", QString::number( m_boundingBoxResolution ) );
     }
 
-    // append the page element only if has children
-    if ( pageElement.hasChildNodes() )
-        parentNode.appendChild( pageElement );
+    writer.writeEndElement();
 }
 
-const QPixmap * Page::_o_nearestPixmap( DocumentObserver *observer, int w, int h ) const
+bool PagePrivate::needsBoundingBox( int resolution ) const
 {
-    Q_UNUSED( h )
+    if ( !m_isBoundingBoxKnown )
+        return true;
 
-    const QPixmap * pixmap = 0;
+    // a rendering a bit larger gives almost the same box, and each change
+    // relayouts the view
+    return m_boundingBoxResolution > 0 && m_boundingBoxResolution * 3 / 2 < resolution;
+}
 
+PagePrivate *PagePrivate::get( Page *page )
+{
+    return page->d;
+}
+
+const PagePrivate::PixmapObject * PagePrivate::nearestPixmapObject( DocumentObserver *observer, int w ) const
+{
     // if a pixmap is present for given id, use it
-    QMap< DocumentObserver*, PagePrivate::PixmapObject >::const_iterator itPixmap = d->m_pixmaps.constFind( observer );
-    if ( itPixmap != d->m_pixmaps.constEnd() )
-        pixmap = itPixmap.value().m_pixmap;
+    QMap< DocumentObserver*, PixmapObject >::const_iterator itPixmap = m_pixmaps.constFind( observer );
+    if ( itPixmap != m_pixmaps.constEnd() )
+        return &itPixmap.value();
+
     // else find the closest match using pixmaps of other IDs (great optim!)
-    else if ( !d->m_pixmaps.isEmpty() )
+    const PixmapObject * object = 0;
+    int minDistance = -1;
+    QMap< DocumentObserver*, PixmapObject >::const_iterator it = m_pixmaps.constBegin(), end = m_pixmaps.constEnd();
+    for ( ; it != end; ++it )
     {
-        int minDistance = -1;
-        QMap< DocumentObserver*, PagePrivate::PixmapObject >::const_iterator it = d->m_pixmaps.constBegin(), end = d->m_pixmaps.constEnd();
-        for ( ; it != end; ++it )
+        int pixWidth = (*it).size().width(),
+            distance = pixWidth > w ? pixWidth - w : w - pixWidth;
+        if ( minDistance == -1 || distance < minDistance )
         {
-            int pixWidth = (*it).m_pixmap->width(),
-                distance = pixWidth > w ? pixWidth - w : w - pixWidth;
-            if ( minDistance == -1 || distance < minDistance )
-            {
-                pixmap = (*it).m_pixmap;
-                minDistance = distance;
-            }
+            object = &(*it);
+            minDistance = distance;
         }
     }
 
-    return pixmap;
+    return object;
+}
+
+QImage Page::_o_nearestImage( DocumentObserver *observer, int w, int h ) const
+{
+    Q_UNUSED( h )
+
+    const PagePrivate::PixmapObject * object = d->nearestPixmapObject( observer, w );
+    return object ? object->image() : QImage();
 }
 
 bool Page::hasTilesManager( const DocumentObserver *observer ) const
@@ -1016,3 +1104,58 @@ void PagePrivate::setTilesManager( const DocumentObserver *observer, TilesManage
 
     m_tilesManagers.insert(observer, tm);
 }
+
+void PagePrivate::moveContents( PagePrivate *from, PagePrivate *to )
+{
+    to->m_page->deletePixmaps();
+    QMap< DocumentObserver*, PixmapObject >::iterator it = from->m_pixmaps.begin(), itEnd = from->m_pixmaps.end();
+    for ( ; it != itEnd; ++it )
+    {
+        // a pixmap still waiting for its rotation is of no use
+        if ( it.value().m_rotation == from->m_rotation )
+            to->m_pixmaps.insert( it.key(), it.value() );
+    }
+    from->m_pixmaps.clear();
+
+    // the tiles managers know their page, for the priority of the tiles
+    if ( from->m_number == to->m_number )
+        to->m_tilesManagers = from->m_tilesManagers;
+    else
+        qDeleteAll( from->m_tilesManagers );
+    from->m_tilesManagers.clear();
+
+    if ( from->m_text )
+    {
+        delete to->m_text;
+        to->m_text = from->m_text;
+        to->m_text->d->m_page = to;
+        from->m_text = 0;
+    }
+
+    if ( from->m_isBoundingBoxKnown )
+    {
+        to->m_page->setBoundingBox( from->m_boundingBox );
+        to->m_boundingBoxResolution = from->m_boundingBoxResolution;
+    }
+
+    // the links and images, unless the generator already gave them at loading
+    QSet<ObjectRect::ObjectType> which;
+    which << ObjectRect::Action << ObjectRect::Image;
+    bool hasRects = false;
+    foreach ( ObjectRect *rect, to->m_page->m_rects )
+        hasRects |= which.contains( rect->objectType() );
+    if ( !hasRects )
+    {
+        QLinkedList< ObjectRect * >::iterator rIt = from->m_page->m_rects.begin(), rEnd = from->m_page->m_rects.end();
+        while ( rIt != rEnd )
+        {
+            if ( which.contains( (*rIt)->objectType() ) )
+            {
+                to->m_page->m_rects.append( *rIt );
+                rIt = from->m_page->m_rects.erase( rIt );
+            }
+            else
+                ++rIt;
+        }
+    }
+}
@@ -17,6 +17,7 @@
 #include "global.h"
 #include "textpage.h"
 
+class QImage;
 class QPixmap;
 
 class PagePainter;
@@ -265,9 +266,22 @@ class OKULAR_EXPORT Page
          * given @p observer.
          * If @p rect is not set (default) the @p pixmap is set to the entire
          * page.
+         *
+         * The page keeps it as an image, so setImage() spares a conversion.
          */
         void setPixmap( DocumentObserver *observer, QPixmap *pixmap, const NormalizedRect &rect = NormalizedRect() );
 
+        /**
+         * Sets the region described by @p rect with @p image for the
+         * given @p observer, like setPixmap().
+         *
+         * The image is shared, not copied; it is converted to a native
+         * pixmap only as it is drawn.
+         *
+         * @since 0.25
+         */
+        void setImage( DocumentObserver *observer, const QImage &image, const NormalizedRect &rect = NormalizedRect() );
+
         /**
          * Sets the @p text page.
          */
@@ -400,7 +414,7 @@ class OKULAR_EXPORT Page
         friend class ::PagePainter;
         /// @endcond
 
-        const QPixmap * _o_nearestPixmap( DocumentObserver *, int, int ) const;
+        QImage _o_nearestImage( DocumentObserver *, int, int ) const;
 
         QLinkedList< ObjectRect* > m_rects;
         QLinkedList< HighlightAreaRect* > m_highlights;
@@ -13,6 +13,7 @@
 
 // qt/kde includes
 #include <qlinkedlist.h>
+#include <qimage.h>
 #include <qmap.h>
 #include <qtransform.h>
 #include <qstring.h>
@@ -23,6 +24,7 @@
 #include "area.h"
 
 class QColor;
+class QXmlStreamWriter;
 
 namespace Okular {
 
@@ -44,6 +46,7 @@ enum PageItem
     None = 0,
     AnnotationPageItems = 0x01,
     FormFieldPageItems = 0x02,
+    BoundingBoxPageItems = 0x04,
     AllPageItems = 0xff,
 
     /* If set along with AnnotationPageItems, tells saveLocalContents to save
@@ -59,6 +62,7 @@ class PagePrivate
         ~PagePrivate();
 
         void imageRotationDone( RotationJob * job );
+        int rotationJobPriority() const;
         QTransform rotationMatrix() const;
 
         /**
@@ -68,8 +72,11 @@ class PagePrivate
 
         /**
          * Saves the local contents (e.g. annotations) of the page.
+         *
+         * The serialized annotations are kept until they change (see
+         * m_annotationsXmlValid), so saving an unmodified page is cheap.
          */
-        void saveLocalContents( QDomNode & parentNode, QDomDocument & document, PageItems what = AllPageItems ) const;
+        void saveLocalContents( QXmlStreamWriter & writer, PageItems what = AllPageItems ) const;
 
         /**
          * Rotates the image and object rects of the page to the given @p orientation.
@@ -104,6 +111,13 @@ class PagePrivate
          */
         void deleteTextSelections();
 
+        /**
+         * Returns whether the bounding box has to be found on a rendering of
+         * the page whose larger side is @p resolution pixels: when it is not
+         * known yet, or when it was found on a much smaller rendering.
+         */
+        OKULAR_EXPORT bool needsBoundingBox( int resolution ) const;
+
         /**
          * Get the tiles manager for the tiled @observer
          */
@@ -114,13 +128,47 @@ class PagePrivate
          */
         void setTilesManager( const DocumentObserver *observer, TilesManager *tm );
 
+        /**
+         * Moves what the generator rendered or extracted for the page @p from
+         * (pixmaps, text, bounding box, links) to the page @p to, which has
+         * the same content and is not rotated either.
+         */
+        static void moveContents( PagePrivate *from, PagePrivate *to );
+
+        OKULAR_EXPORT static PagePrivate *get( Page *page );
+
+        /**
+         * Queues the rotation of the unrotated @p image of @p rect of the page,
+         * rendered for @p observer, to the rotation of the page.
+         */
+        void rotateImage( DocumentObserver *observer, const QImage &image, const NormalizedRect &rect );
+
+        /**
+         * The contents rendered for an observer, as the image given by the
+         * generator and shared with it. QPainter converts it to a native
+         * pixmap only when (and as much as) it is drawn, so no second copy
+         * of the page is kept.
+         */
         class PixmapObject
         {
             public:
-                QPixmap *m_pixmap;
+                PixmapObject();
+
+                QSize size() const;
+                QImage image() const;
+
+                void setImage( const QImage &image );
+
+                QImage m_image;
                 Rotation m_rotation;
         };
         QMap< DocumentObserver*, PixmapObject > m_pixmaps;
+
+        /**
+         * Returns the contents for @p observer, or else the ones for another
+         * observer closest to the width @p w, or 0.
+         */
+        const PixmapObject * nearestPixmapObject( DocumentObserver *observer, int w ) const;
         QMap< const DocumentObserver*, TilesManager *> m_tilesManagers;
 
         Page *m_page;
@@ -129,6 +177,9 @@ class PagePrivate
         double m_width, m_height;
         DocumentPrivate *m_doc;
         NormalizedRect m_boundingBox;
+        // larger side of the rendering the bounding box was found on,
+        // 0 when it was given by the generator
+        int m_boundingBoxResolution;
         Rotation m_rotation;
 
         TextPage * m_text;
@@ -141,7 +192,9 @@ class PagePrivate
         QString m_label;
 
         bool m_isBoundingBoxKnown : 1;
+        mutable bool m_annotationsXmlValid : 1;
         QDomDocument restoredLocalAnnotationList; // <annotationList>...</annotationList>
+        mutable QByteArray m_annotationsXml; // the saved <annotationList>, if m_annotationsXmlValid
 };
 
 }
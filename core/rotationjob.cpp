@@ -11,11 +11,13 @@
 
 #include <QtGui/QTransform>
 
+#include "imagekernels_p.h"
+
 using namespace Okular;
 
 RotationJob::RotationJob( const QImage &image, Rotation oldRotation, Rotation newRotation, DocumentObserver *observer )
     : mImage( image ), mOldRotation( oldRotation ), mNewRotation( newRotation ), mObserver( observer ), m_pd( 0 )
-    , mRect( NormalizedRect() )
+    , mRect( NormalizedRect() ), mPriority( 0 )
 {
 }
 
@@ -29,6 +31,11 @@ void RotationJob::setRect( const NormalizedRect &rect )
     mRect = rect;
 }
 
+void RotationJob::setPriority( int priority )
+{
+    mPriority = priority;
+}
+
 QImage RotationJob::image() const
 {
     return mRotatedImage;
@@ -54,6 +61,11 @@ NormalizedRect RotationJob::rect() const
     return mRect;
 }
 
+int RotationJob::priority() const
+{
+    return mPriority;
+}
+
 void RotationJob::run()
 {
     if ( mOldRotation == mNewRotation ) {
@@ -61,9 +73,9 @@ void RotationJob::run()
         return;
     }
 
-    QTransform matrix = rotationMatrix( mOldRotation, mNewRotation );
-
-    mRotatedImage = mImage.transformed( matrix );
+    // the same rotation as rotationMatrix(), without the general transform path
+    const int degrees = ( ( (int)mNewRotation - (int)mOldRotation + 4 ) % 4 ) * 90;
+    mRotatedImage = ImageKernels::rotatedImage( mImage, degrees );
 }
 
 QTransform RotationJob::rotationMatrix( Rotation from, Rotation to )
@@ -32,6 +32,7 @@ class RotationJob : public ThreadWeaver::Job
 
         void setPage( PagePrivate * pd );
         void setRect( const NormalizedRect &rect );
+        void setPriority( int priority );
 
         QImage image() const;
         Rotation rotation() const;
@@ -39,6 +40,9 @@ class RotationJob : public ThreadWeaver::Job
         PagePrivate * page() const;
         NormalizedRect rect() const;
 
+        // the jobs with higher priority are run first
+        virtual int priority() const;
+
         static QTransform rotationMatrix( Rotation from, Rotation to );
 
     protected:
@@ -52,6 +56,7 @@ class RotationJob : public ThreadWeaver::Job
         QImage mRotatedImage;
         PagePrivate * m_pd;
         NormalizedRect mRect;
+        int mPriority;
 };
 
 }
@@ -14,21 +14,27 @@
 #include <QtCore/QMutex>
 #include <QtCore/QStack>
 #include <QtCore/QTextStream>
+#include <QtCore/QThread>
 #include <QtCore/QVector>
 #include <QtGui/QFontDatabase>
 #include <QtGui/QImage>
 #include <QtGui/QPainter>
+#include <QtGui/QPicture>
 #include <QtGui/QPrinter>
 #if QT_VERSION >= 0x040500
 #include <QtGui/QTextDocumentWriter>
 #endif
 
+#include <threadweaver/ThreadWeaver.h>
+
 #include "action.h"
 #include "annotations.h"
 #include "page.h"
 #include "textpage.h"
+#include "utils.h"
 
 #include "document.h"
+#include "document_p.h"
 
 using namespace Okular;
 
@@ -95,22 +101,76 @@ Okular::TextPage* TextDocumentGeneratorPrivate::createTextPage( int pageNumber )
 #endif
     TextDocumentUtils::calculatePositions( mDocument, pageNumber, start, end );
 
-    {
-    QTextCursor cursor( mDocument );
-    for ( int i = start; i < end - 1; ++i ) {
-        cursor.setPosition( i );
-        cursor.setPosition( i + 1, QTextCursor::KeepAnchor );
-
-        QString text = cursor.selectedText();
-        if ( text.length() == 1 ) {
-            QRectF rect;
-            TextDocumentUtils::calculateBoundingRect( mDocument, i, i + 1, rect, pageNumber );
-            if ( pageNumber == -1 )
-                text = "\n";
-
-            textPage->append( text, new Okular::NormalizedRect( rect.left(), rect.top(), rect.right(), rect.bottom() ) );
+    /**
+     * Walk the laid out lines instead of asking the layout about each
+     * character: the geometry of each block and line is looked up once,
+     * and the right edge of a character is the left edge of the next one.
+     */
+    const QSizeF pageSize = mDocument->pageSize();
+    const int pageHeight = qRound( pageSize.height() );
+    const QAbstractTextDocumentLayout *layout = mDocument->documentLayout();
+    QTextBlock block = mDocument->findBlock( start );
+    QRectF blockRect = layout->blockBoundingRect( block );
+    while ( block.isValid() && block.position() < end - 1 ) {
+        const QTextBlock nextBlock = block.next();
+        const QRectF nextBlockRect = nextBlock.isValid() ? layout->blockBoundingRect( nextBlock ) : QRectF();
+        const QTextLayout *blockLayout = block.layout();
+        if ( !blockLayout || blockLayout->lineCount() == 0 ) {
+            block = nextBlock;
+            blockRect = nextBlockRect;
+            continue;
         }
-    }
+
+        const QString blockText = block.text();
+        const int blockPosition = block.position();
+        for ( int l = 0; l < blockLayout->lineCount(); ++l ) {
+            const QTextLine line = blockLayout->lineAt( l );
+            const bool lastLine = l == blockLayout->lineCount() - 1;
+            // the last line ends with the block separator
+            const int lineEnd = line.textStart() + line.textLength() + ( lastLine ? 1 : 0 );
+            const int from = qMax( line.textStart(), start - blockPosition );
+            const int to = qMin( lineEnd, end - 1 - blockPosition );
+            if ( from >= to )
+                continue;
+
+            const double y = blockRect.y() + line.y();
+            const double b = y + line.height();
+            const int offset = qRound( y ) % pageHeight;
+            double x = blockRect.x() + line.cursorToX( from );
+            for ( int i = from; i < to; ++i ) {
+                // the next position may be on the next line (or block), the
+                // character then goes down to its bottom
+                const bool wraps = i + 1 == lineEnd;
+                double r = x;
+                double endBottom = b;
+                if ( !wraps ) {
+                    r = blockRect.x() + line.cursorToX( i + 1 );
+                } else if ( !lastLine ) {
+                    const QTextLine nextLine = blockLayout->lineAt( l + 1 );
+                    r = blockRect.x() + nextLine.cursorToX( i + 1 );
+                    endBottom = blockRect.y() + nextLine.y() + nextLine.height();
+                } else if ( nextBlock.isValid() && nextBlock.layout() && nextBlock.layout()->lineCount() > 0 ) {
+                    const QTextLine nextLine = nextBlock.layout()->lineAt( 0 );
+                    r = nextBlockRect.x() + nextLine.cursorToX( 0 );
+                    endBottom = nextBlockRect.y() + nextLine.y() + nextLine.height();
+                }
+
+                if ( x > r ) {
+                    // line break, so a pseudo character on the start line
+                    textPage->append( "\n", new Okular::NormalizedRect( x / pageSize.width(), offset / pageSize.height(),
+                                                                        ( x + 3 ) / pageSize.width(), ( offset + line.height() ) / pageSize.height() ) );
+                } else {
+                    // the end of a block is its separator, as a cursor selects it
+                    const QString text = wraps && lastLine ? QString( QChar::ParagraphSeparator ) : blockText.mid( i, 1 );
+                    textPage->append( text, new Okular::NormalizedRect( x / pageSize.width(), offset / pageSize.height(),
+                                                                        r / pageSize.width(), ( offset + endBottom - y ) / pageSize.height() ) );
+                }
+                x = r;
+            }
+        }
+
+        block = nextBlock;
+        blockRect = nextBlockRect;
     }
 #ifdef OKULAR_TEXTDOCUMENT_THREADED_RENDERING
     q->userMutex()->unlock();
@@ -318,6 +378,8 @@ Document::OpenResult TextDocumentGenerator::loadDocumentWithPassword( const QStr
         return openResult;
     }
     d->mDocument = d->mConverter->document();
+    // before anything looks at the layout, which the font changes
+    d->mDocument->setDefaultFont( d->mFont );
 
     d->generateTitleInfos();
     d->generateLinkInfos();
@@ -373,6 +435,7 @@ bool TextDocumentGenerator::doCloseDocument()
     d->mLinkInfos.clear();
     d->mAnnotationPositions.clear();
     d->mAnnotationInfos.clear();
+    d->mPageDisplayLists.clear();
     // do not use clear() for the following two, otherwise they change type
     d->mDocumentInfo = Okular::DocumentInfo();
     d->mDocumentSynopsis = Okular::DocumentSynopsis();
@@ -382,43 +445,89 @@ bool TextDocumentGenerator::doCloseDocument()
 
 bool TextDocumentGenerator::canGeneratePixmap() const
 {
-    return Generator::canGeneratePixmap();
+    Q_D( const TextDocumentGenerator );
+    return Generator::canGeneratePixmap() && d->mRunningPageJobs < QThread::idealThreadCount();
 }
 
 void TextDocumentGenerator::generatePixmap( Okular::PixmapRequest * request )
 {
-    Generator::generatePixmap( request );
+    Q_D( TextDocumentGenerator );
+    if ( !request->asynchronous() || !d->mDocument || !QFontDatabase::supportsThreadedFontRendering() )
+    {
+        Generator::generatePixmap( request );
+        return;
+    }
+
+    /**
+     * Only the recording of the page needs the layout; the rasterization
+     * replays it in the pool of ThreadWeaver, for several pages at once.
+     */
+#ifdef OKULAR_TEXTDOCUMENT_THREADED_RENDERING
+    userMutex()->lock();
+#endif
+    const QSize size = d->mDocument->pageSize().toSize();
+    QByteArray displayList;
+    const bool recorded = d->pageDisplayList( request->pageNumber(), &displayList );
+#ifdef OKULAR_TEXTDOCUMENT_THREADED_RENDERING
+    userMutex()->unlock();
+#endif
+    if ( !recorded )
+    {
+        Generator::generatePixmap( request );
+        return;
+    }
+
+    const bool calcBoundingBox = d->m_document && d->m_document->needsBoundingBox( request );
+    TextDocumentPageJob *job = new TextDocumentPageJob( displayList, size, request, calcBoundingBox );
+    connect( job, SIGNAL(done(ThreadWeaver::Job*)),
+             this, SLOT(pageJobDone(ThreadWeaver::Job*)) );
+    connect( job, SIGNAL(done(ThreadWeaver::Job*)), job, SLOT(deleteLater()) );
+    ++d->mRunningPageJobs;
+    ThreadWeaver::Weaver::instance()->enqueue( job );
 }
 
-QImage TextDocumentGeneratorPrivate::image( PixmapRequest * request )
+void TextDocumentGeneratorPrivate::pageJobDone( ThreadWeaver::Job *job )
 {
-    if ( !mDocument )
-        return QImage();
-
-#ifdef OKULAR_TEXTDOCUMENT_THREADED_RENDERING
     Q_Q( TextDocumentGenerator );
-#endif
+    TextDocumentPageJob *pageJob = static_cast< TextDocumentPageJob * >( job );
+    PixmapRequest *request = pageJob->request();
+    --mRunningPageJobs;
 
-    QImage image( request->width(), request->height(), QImage::Format_ARGB32 );
-    image.fill( Qt::white );
+    const QImage image = pageJob->image();
+    // the requests without observer are only for the bounding box
+    if ( request->observer() )
+        request->page()->setImage( request->observer(), image, request->normalizedRect() );
+    if ( pageJob->calcBoundingBox() && m_document )
+        m_document->setPageBoundingBox( request->page()->number(), pageJob->boundingBox(), qMax( image.width(), image.height() ) );
+    q->signalPixmapRequestDone( request );
+}
 
-    QPainter p;
-    p.begin( &image );
+bool TextDocumentGeneratorPrivate::pageHasImages( int page ) const
+{
+    int start, end;
+    TextDocumentUtils::calculatePositions( mDocument, page, start, end );
+    if ( end < 0 )
+        end = mDocument->characterCount();
 
-    qreal width = request->width();
-    qreal height = request->height();
+    QTextBlock block = mDocument->findBlock( qMax( start, 0 ) );
+    for ( ; block.isValid() && block.position() <= end; block = block.next() )
+    {
+        for ( QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it )
+        {
+            if ( it.fragment().charFormat().isImageFormat() )
+                return true;
+        }
+    }
+    return false;
+}
 
+void TextDocumentGeneratorPrivate::drawPage( QPainter *painter, int page ) const
+{
     const QSize size = mDocument->pageSize().toSize();
+    const QRect rect( 0, page * size.height(), size.width(), size.height() );
 
-    p.scale( width / (qreal)size.width(), height / (qreal)size.height() );
-
-    QRect rect;
-    rect = QRect( 0, request->pageNumber() * size.height(), size.width(), size.height() );
-    p.translate( QPoint( 0, request->pageNumber() * size.height() * -1 ) );
-    p.setClipRect( rect );
-#ifdef OKULAR_TEXTDOCUMENT_THREADED_RENDERING
-    q->userMutex()->lock();
-#endif
+    painter->translate( QPoint( 0, page * size.height() * -1 ) );
+    painter->setClipRect( rect );
     QAbstractTextDocumentLayout::PaintContext context;
     context.palette.setColor( QPalette::Text, Qt::black );
 //  FIXME Fix Qt, this doesn't work, we have horrible hacks
@@ -426,14 +535,126 @@ QImage TextDocumentGeneratorPrivate::image( PixmapRequest * request )
 //        if Qt ever gets fixed
 //     context.palette.setColor( QPalette::Link, Qt::blue );
     context.clip = rect;
-    mDocument->setDefaultFont( mFont );
-    mDocument->documentLayout()->draw( &p, context );
+    mDocument->documentLayout()->draw( painter, context );
+}
+
+bool TextDocumentGeneratorPrivate::pageDisplayList( int page, QByteArray *displayList )
+{
+    if ( const QByteArray *cached = mPageDisplayLists.object( page ) )
+    {
+        *displayList = *cached;
+        return true;
+    }
+
+    // a QPicture would keep a copy of each image, and copy it again at
+    // each replay: these pages are drawn from the layout instead
+    if ( pageHasImages( page ) )
+        return false;
+
+    QPicture picture;
+    QPainter p;
+    p.begin( &picture );
+    drawPage( &p, page );
+    p.end();
+
+    *displayList = QByteArray( picture.data(), picture.size() );
+    mPageDisplayLists.insert( page, new QByteArray( *displayList ), displayList->size() );
+    return true;
+}
+
+QImage TextDocumentGeneratorPrivate::replayDisplayList( const QByteArray &displayList, const QSize &pageSize, int width, int height )
+{
+    QImage image( width, height, QImage::Format_ARGB32 );
+    image.fill( Qt::white );
+
+    // a QPicture reads its data through a buffer of its own, so each
+    // rendering replays a separate copy
+    QPicture picture;
+    picture.setData( displayList.constData(), displayList.size() );
+
+    QPainter p;
+    p.begin( &image );
+    p.scale( width / (qreal)pageSize.width(), height / (qreal)pageSize.height() );
+    p.drawPicture( 0, 0, picture );
+    p.end();
+
+    return image;
+}
+
+QImage TextDocumentGeneratorPrivate::image( PixmapRequest * request )
+{
+    if ( !mDocument )
+        return QImage();
+
+#ifdef OKULAR_TEXTDOCUMENT_THREADED_RENDERING
+    Q_Q( TextDocumentGenerator );
+#endif
+
+    /**
+     * The layout is only walked the first time a page is rendered, to record
+     * its painting commands: the later renderings (at another zoom, or of
+     * the thumbnail) just replay them, and do not need the document.
+     */
+#ifdef OKULAR_TEXTDOCUMENT_THREADED_RENDERING
+    q->userMutex()->lock();
+#endif
+    const QSize size = mDocument->pageSize().toSize();
+    QByteArray displayList;
+    if ( !pageDisplayList( request->pageNumber(), &displayList ) )
+    {
+        // a page with images
+        QImage image( request->width(), request->height(), QImage::Format_ARGB32 );
+        image.fill( Qt::white );
+
+        QPainter p;
+        p.begin( &image );
+        p.scale( request->width() / (qreal)size.width(), request->height() / (qreal)size.height() );
+        drawPage( &p, request->pageNumber() );
+        p.end();
+#ifdef OKULAR_TEXTDOCUMENT_THREADED_RENDERING
+        q->userMutex()->unlock();
+#endif
+        return image;
+    }
 #ifdef OKULAR_TEXTDOCUMENT_THREADED_RENDERING
     q->userMutex()->unlock();
 #endif
-    p.end();
 
-    return image;
+    return replayDisplayList( displayList, size, request->width(), request->height() );
+}
+
+TextDocumentPageJob::TextDocumentPageJob( const QByteArray &displayList, const QSize &pageSize, PixmapRequest *request, bool calcBoundingBox )
+    : mDisplayList( displayList ), mPageSize( pageSize ), mRequest( request ), mCalcBoundingBox( calcBoundingBox )
+{
+}
+
+PixmapRequest *TextDocumentPageJob::request() const
+{
+    return mRequest;
+}
+
+QImage TextDocumentPageJob::image() const
+{
+    return mImage;
+}
+
+bool TextDocumentPageJob::calcBoundingBox() const
+{
+    return mCalcBoundingBox;
+}
+
+NormalizedRect TextDocumentPageJob::boundingBox() const
+{
+    return mBoundingBox;
+}
+
+void TextDocumentPageJob::run()
+{
+    mImage = TextDocumentGeneratorPrivate::replayDisplayList( mDisplayList, mPageSize, mRequest->width(), mRequest->height() );
+    // convert here rather than on each painting in the GUI thread
+    mImage = mImage.convertToFormat( QImage::Format_ARGB32_Premultiplied );
+    if ( mCalcBoundingBox )
+        mBoundingBox = Utils::imageBoundingBox( &mImage );
 }
 
 Okular::TextPage* TextDocumentGenerator::textPage( Okular::Page * page )
@@ -544,6 +765,12 @@ bool TextDocumentGenerator::reparseConfig()
 
     if ( newFont != d->mFont ) {
         d->mFont = newFont;
+        // lay the document out again once, and drop what was recorded with
+        // the old layout
+        QMutexLocker locker( userMutex() );
+        if ( d->mDocument )
+            d->mDocument->setDefaultFont( d->mFont );
+        d->mPageDisplayLists.clear();
         return true;
     }
 
@@ -564,4 +791,5 @@ TextDocumentSettings* TextDocumentGenerator::generalSettings()
 }
 
 #include "textdocumentgenerator.moc"
+#include "textdocumentgenerator_p.moc"
 
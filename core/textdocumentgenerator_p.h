@@ -10,10 +10,13 @@
 #ifndef _OKULAR_TEXTDOCUMENTGENERATOR_P_H_
 #define _OKULAR_TEXTDOCUMENTGENERATOR_P_H_
 
+#include <QtCore/QCache>
 #include <QtGui/QAbstractTextDocumentLayout>
 #include <QtGui/QTextBlock>
 #include <QtGui/QTextDocument>
 
+#include <threadweaver/Job.h>
+
 #include "action.h"
 #include "document.h"
 #include "generator_p.h"
@@ -115,7 +118,8 @@ class TextDocumentGeneratorPrivate : public GeneratorPrivate
 
     public:
         TextDocumentGeneratorPrivate( TextDocumentConverter *converter )
-            : mConverter( converter ), mDocument( 0 ), mGeneralSettings( 0 )
+            : mConverter( converter ), mDocument( 0 ), mPageDisplayLists( 16 * 1024 * 1024 ), mRunningPageJobs( 0 ),
+              mGeneralSettings( 0 )
         {
         }
 
@@ -135,6 +139,11 @@ class TextDocumentGeneratorPrivate : public GeneratorPrivate
         void calculateBoundingRect( int startPosition, int endPosition, QRectF &rect, int &page ) const;
         void calculatePositions( int page, int &start, int &end ) const;
         Okular::TextPage* createTextPage( int ) const;
+        bool pageHasImages( int page ) const;
+        void drawPage( QPainter *painter, int page ) const;
+        bool pageDisplayList( int page, QByteArray *displayList );
+        static QImage replayDisplayList( const QByteArray &displayList, const QSize &pageSize, int width, int height );
+        void pageJobDone( ThreadWeaver::Job *job );
 
         void addAction( Action *action, int cursorBegin, int cursorEnd );
         void addAnnotation( Annotation *annotation, int cursorBegin, int cursorEnd );
@@ -192,11 +201,46 @@ class TextDocumentGeneratorPrivate : public GeneratorPrivate
         };
         QList<AnnotationInfo> mAnnotationInfos;
 
+        // the painting commands of the pages already rendered, as QPicture
+        // data, costing their size; guarded by the user mutex
+        QCache<int, QByteArray> mPageDisplayLists;
+        // the pages being rasterized in the pool of ThreadWeaver
+        int mRunningPageJobs;
+
         TextDocumentSettings *mGeneralSettings;
 
         QFont mFont;
 };
 
+/**
+ * Rasterizes a page of a text document from its recorded painting commands,
+ * in the pool of ThreadWeaver: the jobs need neither the document nor its
+ * mutex, so several pages are rasterized at once.
+ */
+class TextDocumentPageJob : public ThreadWeaver::Job
+{
+    Q_OBJECT
+
+    public:
+        TextDocumentPageJob( const QByteArray &displayList, const QSize &pageSize, PixmapRequest *request, bool calcBoundingBox );
+
+        PixmapRequest *request() const;
+        QImage image() const;
+        bool calcBoundingBox() const;
+        NormalizedRect boundingBox() const;
+
+    protected:
+        virtual void run();
+
+    private:
+        const QByteArray mDisplayList;
+        const QSize mPageSize;
+        PixmapRequest *mRequest;
+        bool mCalcBoundingBox;
+        QImage mImage;
+        NormalizedRect mBoundingBox;
+};
+
 }
 
 #endif
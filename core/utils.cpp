@@ -12,6 +12,7 @@
 #include "utils_p.h"
 
 #include "settings_core.h"
+#include "imagekernels_p.h"
 
 #include <QtCore/QRect>
 #include <QApplication>
@@ -306,8 +307,9 @@ QSizeF Utils::realDpi(QWidget*)
 }
 #endif
 
-inline static bool isPaperColor( QRgb argb, QRgb paperColor ) {
-    return ( argb & 0xFFFFFF ) == ( paperColor & 0xFFFFFF); // ignore alpha
+static inline const quint32 * pixelLine( const QImage &image, int y )
+{
+    return reinterpret_cast< const quint32 * >( image.constScanLine( y ) );
 }
 
 NormalizedRect Utils::imageBoundingBox( const QImage * image )
@@ -315,8 +317,10 @@ NormalizedRect Utils::imageBoundingBox( const QImage * image )
     if ( !image )
         return NormalizedRect();
 
-    const int width = image->width();
-    const int height = image->height();
+    // the scan works on the raw 32 bit pixels, a whole span at a time
+    const QImage scanned = image->depth() == 32 ? *image : image->convertToFormat( QImage::Format_RGB32 );
+    const int width = scanned.width();
+    const int height = scanned.height();
     const QRgb paperColor = SettingsCore::paperColor().rgb();
     int left, top, bottom, right, x, y;
 
@@ -325,40 +329,37 @@ NormalizedRect Utils::imageBoundingBox( const QImage * image )
     time.start();
 #endif
 
-    // Scan pixels for top non-white
+    // Scan lines for top non-white
     for ( top = 0; top < height; ++top )
-        for ( x = 0; x < width; ++x )
-            if ( !isPaperColor( image->pixel( x, top ), paperColor ) )
-                goto got_top;
-    return NormalizedRect( 0, 0, 0, 0 ); // the image is blank
-got_top:
+        if ( ( x = ImageKernels::findFirstNotRgb( pixelLine( scanned, top ), width, paperColor ) ) < width )
+            break;
+    if ( top == height )
+        return NormalizedRect( 0, 0, 0, 0 ); // the image is blank
     left = right = x;
 
-    // Scan pixels for bottom non-white
-    for ( bottom = height-1; bottom >= top; --bottom )
-        for ( x = width-1; x >= 0; --x )
-            if ( !isPaperColor( image->pixel( x, bottom ), paperColor ) )
-                goto got_bottom;
-    Q_ASSERT( 0 ); // image changed?!
-got_bottom:
+    // Scan lines for bottom non-white (the top line has some for sure)
+    bottom = height - 1;
+    while ( ( x = ImageKernels::findLastNotRgb( pixelLine( scanned, bottom ), width, paperColor ) ) < 0 )
+        --bottom;
     if ( x < left )
         left = x;
     if ( x > right )
         right = x;
 
     // Scan for leftmost and rightmost (we already found some bounds on these):
-    for ( y = top; y <= bottom && ( left > 0 || right < width-1 ); ++y )
+    for ( y = top; y <= bottom && ( left > 0 || right < width - 1 ); ++y )
     {
-        for ( x = 0; x < left; ++x )
-            if ( !isPaperColor( image->pixel( x, y ), paperColor ) )
-                left = x;
-        for ( x = width-1; x > right+1; --x )
-            if ( !isPaperColor( image->pixel( x, y ), paperColor ) )
-                right = x;
+        const quint32 *line = pixelLine( scanned, y );
+        x = ImageKernels::findFirstNotRgb( line, left, paperColor );
+        if ( x < left )
+            left = x;
+        x = ImageKernels::findLastNotRgb( line + right + 1, width - right - 1, paperColor );
+        if ( x >= 0 )
+            right += x + 1;
     }
 
     NormalizedRect bbox( QRect( left, top, ( right - left + 1), ( bottom - top + 1 ) ),
-                         image->width(), image->height() );
+                         width, height );
 
 #ifdef BBOX_DEBUG
     kDebug() << "Computed bounding box" << bbox << "in" << time.elapsed() << "ms";
@@ -369,7 +370,7 @@ got_bottom:
 
 void Okular::copyQIODevice( QIODevice *from, QIODevice *to )
 {
-    QByteArray buffer( 65536, '\0' );
+    QByteArray buffer( 1024 * 1024, '\0' );
     qint64 read = 0;
     qint64 written = 0;
     while ( ( read = from->read( buffer.data(), buffer.size() ) ) > 0 )
@@ -26,8 +26,8 @@
 
 #include <core/action.h>
 #include <core/page.h>
+#include <core/page_p.h>
 #include <core/textpage.h>
-#include <core/utils.h>
 
 static KAboutData createAboutData()
 {
@@ -225,9 +225,9 @@ void CHMGenerator::slotCompleted()
     Okular::PixmapRequest *req = m_request;
     m_request = 0;
 
-    if ( !req->page()->isBoundingBoxKnown() )
-        updatePageBoundingBox( req->page()->number(), Okular::Utils::imageBoundingBox( &image ) );
-    req->page()->setPixmap( req->observer(), new QPixmap( QPixmap::fromImage( image ) ) );
+    if ( Okular::PagePrivate::get( req->page() )->needsBoundingBox( qMax( req->width(), req->height() ) ) )
+        computePageBoundingBox( req->page()->number(), image );
+    req->page()->setImage( req->observer(), image );
     signalPixmapRequestDone( req );
 }
 
@@ -9,6 +9,7 @@
 
 #include "document.h"
 
+#include <QtCore/QBuffer>
 #include <QtCore/QScopedPointer>
 #include <QtGui/QImage>
 #include <QtGui/QImageReader>
@@ -65,6 +66,9 @@ bool Document::open( const QString &fileName )
         if ( !processArchive() ) {
             return false;
         }
+
+        // the images are usually stored without compression, read them in place
+        mZipFile.load( fileName );
     /**
      * We have a TAR archive
      */
@@ -131,6 +135,7 @@ void Document::close()
     mDirectory = 0;
     delete mUnrar;
     mUnrar = 0;
+    mZipFile.close();
     mPageMap.clear();
     mEntries.clear();
 }
@@ -158,6 +163,17 @@ bool Document::processArchive() {
     return true;
 }
 
+QIODevice *Document::createArchiveDevice( const KArchiveFile *entry ) const
+{
+    if ( mZipFile.size() > 0 ) {
+        QBuffer *buffer = new QBuffer();
+        buffer->setData( mZipFile.zipEntryData( static_cast<const KZipFileEntry*>( entry ) ) );
+        buffer->open( QIODevice::ReadOnly );
+        return buffer;
+    }
+    return entry->createDevice();
+}
+
 void Document::pages( QVector<Okular::Page*> * pagesVector )
 {
     qSort( mEntries.begin(), mEntries.end(), caseSensitiveNaturalOrderLessThen );
@@ -171,7 +187,7 @@ void Document::pages( QVector<Okular::Page*> * pagesVector )
         if ( mArchive ) {
             const KArchiveFile *entry = static_cast<const KArchiveFile*>( mArchiveDir->entry( file ) );
             if ( entry ) {
-                dev.reset( entry->createDevice() );
+                dev.reset( createArchiveDevice( entry ) );
             }
         } else if ( mDirectory ) {
             dev.reset( mDirectory->createDevice( file ) );
@@ -211,8 +227,10 @@ QImage Document::pageImage( int page ) const
 {
     if ( mArchive ) {
         const KArchiveFile *entry = static_cast<const KArchiveFile*>( mArchiveDir->entry( mPageMap[ page ] ) );
-        if ( entry )
-            return QImage::fromData( entry->data() );
+        if ( entry ) {
+            QScopedPointer< QIODevice > dev( createArchiveDevice( entry ) );
+            return QImageReader( dev.data() ).read();
+        }
     } else if ( mDirectory ) {
         return QImage( mPageMap[ page ] );
     } else {
@@ -12,8 +12,12 @@
 
 #include <QtCore/QStringList>
 
+#include <core/mappedfile_p.h>
+
 class KArchiveDirectory;
 class KArchive;
+class KArchiveFile;
+class QIODevice;
 class QImage;
 class QSize;
 class Unrar;
@@ -43,12 +47,14 @@ class Document
 
     private:
         bool processArchive();
+        QIODevice *createArchiveDevice( const KArchiveFile *entry ) const;
 
         QStringList mPageMap;
         Directory *mDirectory;
         Unrar *mUnrar;
         KArchive *mArchive;
         KArchiveDirectory *mArchiveDir;
+        Okular::MappedFile mZipFile;
         QString mLastErrorString;
         QStringList mEntries;
 };
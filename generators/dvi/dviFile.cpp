@@ -54,12 +54,14 @@
 
 #include "dviFile.h"
 #include "dvi.h"
+#include "dviPageFingerprint.h"
 #include "fontpool.h"
 #include "kvs_debug.h"
 #include "pageSize.h"
 
 #include <klocale.h>
 
+#include <QCryptographicHash>
 #include <QProcess>
 #include <QSysInfo>
 #include <QTemporaryFile>
@@ -180,6 +182,7 @@ void dvifile::read_postamble()
   total_pages  = readUINT16();
 
   // As a next step, read the font definitions.
+  beginning_of_font_definitions = command_pointer - dvi_Data();
   quint8 cmnd = readUINT8();
   while (cmnd >= FNTDEF1 && cmnd <= FNTDEF4) {
     quint32 TeXnumber = readUINT(cmnd-FNTDEF1+1);
@@ -222,6 +225,7 @@ void dvifile::read_postamble()
     errorMsg = i18n("The postamble contained a command other than FNTDEF.");
     return;
   }
+  end_of_font_definitions = command_pointer - dvi_Data() - 1;
 
   // Now we remove all those fonts from the memory which are no longer
   // in use.
@@ -230,6 +234,26 @@ void dvifile::read_postamble()
 }
 
 
+QByteArray dvifile::pageFingerprint(int page, QStringList *links, QStringList *files) const
+{
+  if (page < 0 || page + 1 >= page_offset.size())
+    return QByteArray();
+
+  const quint8 *data = dviData.constData();
+  QCryptographicHash hash(QCryptographicHash::Md5);
+  // numerator, denominator and magnification of the preamble
+  hash.addData((const char *)data + 2, 12);
+  hash.addData((const char *)data + beginning_of_font_definitions,
+               end_of_font_definitions - beginning_of_font_definitions);
+
+  // skip the BOP command, with the ten \count registers and the
+  // pointer to the previous page
+  hashDVIPageCommands(&hash, data + page_offset[page] + 45, data + page_offset[page + 1], links, files);
+
+  return hash.result();
+}
+
+
 void dvifile::prepare_pages()
 {
 #ifdef DEBUG_DVIFILE
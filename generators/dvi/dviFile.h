@@ -15,6 +15,7 @@
 
 #include <QHash>
 #include <QMap>
+#include <QStringList>
 #include <QVector>
 
 
@@ -91,6 +92,19 @@ class dvifile : public bigEndianByteReader
       with care. */
   void           setNewData(const QVector<quint8>& newData) {dviData = newData;}
 
+  /** Returns a hash of what the page @p page (counting from 0)
+      draws, which is the same for a page that did not change when the
+      document is compiled again: the page numbers recorded by TeX,
+      the position of the page in the file and the source specials
+      (whose line numbers move with any edit before them) are left
+      out, while the units and the font definitions of the file are
+      taken into account. If @p links is given, it gets the targets of
+      the hyperlinks of the page, whose positions are not part of the
+      hash. If @p files is given, it gets the names of the graphics and
+      PostScript headers included by the page, whose contents are not
+      part of the hash either. */
+  QByteArray     pageFingerprint(int page, QStringList *links = 0, QStringList *files = 0) const;
+
   /** Page numbers that appear in a DVI document need not be
       ordered. Worse, page numbers need not be unique. This method
       renumbers the pages. */
@@ -130,6 +144,11 @@ class dvifile : public bigEndianByteReader
 
   /** Offset in DVI file of last page, set in read_postamble(). */
   quint32       last_page_offset;
+
+  /** Range of the font definitions in the postamble, set in
+      read_postamble(). */
+  quint32       beginning_of_font_definitions;
+  quint32       end_of_font_definitions;
   quint32       _magnification;
 
   double         cmPerDVIunit;
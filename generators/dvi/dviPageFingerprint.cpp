@@ -0,0 +1,100 @@
+// -*- Mode: C++; c-basic-offset: 2; indent-tabs-mode: nil; c-brace-offset: 0; -*-
+//
+// Part of Okular
+//
+// Distributed under the GPL.
+
+#include "dviPageFingerprint.h"
+#include "dvi.h"
+
+#include <QCryptographicHash>
+#include <QStringList>
+
+
+// Reads the big endian number of n bytes at p.
+static quint32 readNumber(const quint8 *p, int n)
+{
+  quint32 value = 0;
+  for (int i = 0; i < n; i++)
+    value = (value << 8) | p[i];
+  return value;
+}
+
+
+void hashDVIPageCommands(QCryptographicHash *hash, const quint8 *begin, const quint8 *end,
+                         QStringList *links, QStringList *files)
+{
+  const quint8 *ptr = begin;
+  const quint8 *chunk = ptr;
+  while (ptr < end) {
+    const quint8 cmnd = *ptr;
+    qint64 length;
+    if (cmnd < SET1 || cmnd == NOP || cmnd == EOP || cmnd == PUSH || cmnd == POP
+        || cmnd == W0 || cmnd == X0 || cmnd == Y0 || cmnd == Z0
+        || (cmnd >= FNTNUM0 && cmnd < FNT1))
+      length = 1;
+    else if (cmnd == SETRULE || cmnd == PUTRULE)
+      length = 9;
+    else if (cmnd >= SET1 && cmnd < SETRULE)
+      length = 1 + cmnd - SET1 + 1;
+    else if (cmnd >= PUT1 && cmnd < PUTRULE)
+      length = 1 + cmnd - PUT1 + 1;
+    else if (cmnd >= RIGHT1 && cmnd <= RIGHT4)
+      length = 1 + cmnd - RIGHT1 + 1;
+    else if (cmnd >= W1 && cmnd <= W4)
+      length = 1 + cmnd - W1 + 1;
+    else if (cmnd >= X1 && cmnd <= X4)
+      length = 1 + cmnd - X1 + 1;
+    else if (cmnd >= DOWN1 && cmnd <= DOWN4)
+      length = 1 + cmnd - DOWN1 + 1;
+    else if (cmnd >= Y1 && cmnd <= Y4)
+      length = 1 + cmnd - Y1 + 1;
+    else if (cmnd >= Z1 && cmnd <= Z4)
+      length = 1 + cmnd - Z1 + 1;
+    else if (cmnd >= FNT1 && cmnd <= FNT4)
+      length = 1 + cmnd - FNT1 + 1;
+    else if (cmnd >= XXX1 && cmnd <= XXX4 && end - ptr >= 1 + cmnd - XXX1 + 1) {
+      const int k = cmnd - XXX1 + 1;
+      const quint32 size = readNumber(ptr + 1, k);
+      length = 1 + k + qint64(size);
+      const bool complete = end - ptr >= length;
+      const char *special = (const char *)ptr + 1 + k;
+      if (complete && size >= 4 && qstrncmp(special, "src:", 4) == 0) {
+        hash->addData((const char *)chunk, ptr - chunk);
+        chunk = ptr + length;
+      }
+      else if (links && complete && size >= 14 && qstrnicmp(special, "html:<A href=", 13) == 0) {
+        // as dviRenderer::html_href_special() reads it
+        QString link = QString::fromLatin1(special + 14, size - 14);
+        link.truncate(link.indexOf('"'));
+        links->append(link);
+      }
+      else if (files && complete && size >= 7
+               && (qstrnicmp(special, "PSfile=", 7) == 0 || qstrnicmp(special, "header=", 7) == 0)) {
+        // as dviRenderer::prescan_ParsePSFileSpecial() and
+        // prescan_ParsePSHeaderSpecial() read them
+        QString file = QString::fromLocal8Bit(special + 7, size - 7);
+        if (qstrnicmp(special, "PSfile=", 7) == 0) {
+          file = file.simplified();
+          if (file.indexOf(' ') >= 0)
+            file.truncate(file.indexOf(' '));
+          if (file.length() >= 2 && file.startsWith('"') && file.endsWith('"'))
+            file = file.mid(1, file.length() - 2);
+        }
+        files->append(file);
+      }
+    }
+    else if (cmnd >= FNTDEF1 && cmnd <= FNTDEF4 && end - ptr >= 1 + cmnd - FNTDEF1 + 1 + 14) {
+      const int k = cmnd - FNTDEF1 + 1;
+      length = 1 + k + 14 + ptr[1 + k + 12] + ptr[1 + k + 13];
+    }
+    else
+      // not a page command, hash the rest as it is
+      break;
+    if (end - ptr < length)
+      break;
+    ptr += length;
+  }
+  if (end > chunk)
+    hash->addData((const char *)chunk, end - chunk);
+}
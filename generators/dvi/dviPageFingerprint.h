@@ -0,0 +1,24 @@
+// -*- Mode: C++; c-basic-offset: 2; indent-tabs-mode: nil; c-brace-offset: 0; -*-
+//
+// Part of Okular
+//
+// Distributed under the GPL.
+
+#ifndef _DVIPAGEFINGERPRINT_H_
+#define _DVIPAGEFINGERPRINT_H_
+
+#include <QtGlobal>
+
+class QCryptographicHash;
+class QStringList;
+
+/** Adds to @p hash the commands of a DVI page, from @p begin (just
+    after the BOP command and its parameters) to @p end, leaving out
+    the source specials, whose line numbers move with any edit before
+    them. If @p links is given, it gets the targets of the hyperlinks
+    of the page; if @p files is given, it gets the names of the
+    graphics and PostScript headers the page includes. */
+void hashDVIPageCommands(QCryptographicHash *hash, const quint8 *begin, const quint8 *end,
+                         QStringList *links = 0, QStringList *files = 0);
+
+#endif
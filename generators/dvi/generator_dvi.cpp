@@ -23,6 +23,9 @@
 #include "TeXFont.h"
 
 #include <qapplication.h>
+#include <qcryptographichash.h>
+#include <qdir.h>
+#include <qfileinfo.h>
 #include <qstring.h>
 #include <qurl.h>
 #include <qvector.h>
@@ -595,6 +598,38 @@ QVariant DviGenerator::metaData( const QString & key, const QVariant & option )
             }
         }
     }
+    else if ( key == "PageFingerprint" && m_dviRenderer && m_dviRenderer->dviFile )
+    {
+        QMutexLocker lock( userMutex() );
+        QStringList links, files;
+        const QByteArray pageHash = m_dviRenderer->dviFile->pageFingerprint( option.toInt(), &links, &files );
+        if ( pageHash.isEmpty() )
+            return QVariant();
+
+        // the links of the page point to where their targets are now
+        QCryptographicHash hash( QCryptographicHash::Md5 );
+        hash.addData( pageHash );
+        foreach ( const QString &link, links )
+        {
+            const Anchor anchor = m_dviRenderer->findAnchor( link.startsWith( '#' ) ? link.mid( 1 ) : link );
+            hash.addData( QByteArray::number( quint16( anchor.page ) ) + ' '
+                          + QByteArray::number( anchor.distance_from_top.getLength_in_mm() ) + ' ' );
+        }
+
+        // the included files can change without the DVI file; the ones
+        // kpsewhich would find elsewhere are not checked, so the page
+        // is rendered again
+        const QDir dviDir = QFileInfo( m_dviRenderer->dviFile->filename ).dir();
+        foreach ( const QString &file, files )
+        {
+            const QFileInfo info( dviDir, file );
+            if ( !info.exists() )
+                return QVariant();
+            hash.addData( QByteArray::number( info.size() ) + ' '
+                          + QByteArray::number( info.lastModified().toMSecsSinceEpoch() ) + ' ' );
+        }
+        return hash.result();
+    }
     return QVariant();
 }
 
@@ -228,12 +228,13 @@ QTextDocument* Converter::convert( const QString &fileName )
               QString lnk = images.at(i).toElement().attribute("xlink:href");
               int ht = images.at(i).toElement().attribute("height").toInt();
               int wd = images.at(i).toElement().attribute("width").toInt();
-              QImage img = mTextDocument->loadResource(QTextDocument::ImageResource,QUrl(lnk)).value<QImage>();
-              if(ht == 0) ht = img.height();
-              if(wd == 0) wd = img.width();
+              if(ht == 0 || wd == 0) {
+                const QImage img = mTextDocument->loadResource(QTextDocument::ImageResource,QUrl(lnk)).value<QImage>();
+                if(ht == 0) ht = img.height();
+                if(wd == 0) wd = img.width();
+              }
               if(ht > maxHeight) ht = maxHeight;
               if(wd > maxWidth) wd = maxWidth;
-              mTextDocument->addResource(QTextDocument::ImageResource,QUrl(lnk),img);
               QDomDocument newDoc;
               newDoc.setContent(QString("<img src=\"%1\" height=\"%2\" width=\"%3\" />").arg(lnk).arg(ht).arg(wd));
               imgNodes.append(newDoc.documentElement());
@@ -282,6 +283,14 @@ QTextDocument* Converter::convert( const QString &fileName )
           tempDoc.setContent(QString("<pre>&lt;audio&gt;&lt;/audio&gt;</pre>"));
           audioTags.at(0).parentNode().replaceChild(tempDoc.documentElement(),audioTags.at(0));
         }
+        // the images are loaded again when painted, once the current sub
+        // document is another one, so refer to them from the archive root
+        QDomNodeList imgs = dom.elementsByTagName("img");
+        for (uint i = 0; i < imgs.length(); ++i) {
+          QDomElement img = imgs.at(i).toElement();
+          img.setAttribute("src", mTextDocument->resourcePath(img.attribute("src")));
+        }
+
         htmlContent = dom.toString();
       }
 
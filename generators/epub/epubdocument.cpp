@@ -8,6 +8,7 @@
  ***************************************************************************/
 
 #include "epubdocument.h"
+#include "epubimage.h"
 #include <QTemporaryFile>
 #include <QDir>
 
@@ -30,7 +31,7 @@ QString resourceUrl(const KUrl &baseUrl, const QString &u)
 }
 
 EpubDocument::EpubDocument(const QString &fileName) : QTextDocument(),
-    padding(20)
+    mImageCache(32 * 1024 * 1024), padding(20)
 {
   mEpub = epub_open(qPrintable(fileName), 3);
 
@@ -60,6 +61,13 @@ void EpubDocument::setCurrentSubDocument(const QString &doc)
   mCurrentSubDocument = KUrl::fromPath("/" + doc);
 }
 
+// The path of the resource @p name of the current sub document, from the root
+// of the archive: it refers to the same resource from any sub document
+QString EpubDocument::resourcePath(const QString &name) const
+{
+  return '/' + resourceUrl(mCurrentSubDocument, name);
+}
+
 int EpubDocument::maxContentHeight() const
 {
   return pageSize().height() - (2 * padding);
@@ -78,24 +86,30 @@ void EpubDocument::checkCSS(QString &css)
 
 QVariant EpubDocument::loadResource(int type, const QUrl &name)
 {
+  const QString path = resourceUrl(mCurrentSubDocument, name.toString());
+
+  // the images are not added to the document, which would keep all of them
+  // until it is closed: they are kept in a bounded cache, and decoded again
+  // when painted after leaving it
+  if (type == QTextDocument::ImageResource) {
+    if (const QImage *img = mImageCache.object(path))
+      return *img;
+  }
+
   int size;
   char *data;
 
   // Get the data from the epub file
-  size = epub_get_data(mEpub, resourceUrl(mCurrentSubDocument, name.toString()).toUtf8(), &data);
+  size = epub_get_data(mEpub, path.toUtf8(), &data);
 
   QVariant resource;
 
   if (data) {
     switch(type) {
     case QTextDocument::ImageResource:{
-      QImage img = QImage::fromData((unsigned char *)data, size);
-      const int maxHeight = maxContentHeight();
-      const int maxWidth = maxContentWidth();
-      if(img.height() > maxHeight)
-        img = img.scaledToHeight(maxHeight);
-      if(img.width() > maxWidth)
-        img = img.scaledToWidth(maxWidth);
+      const QImage img = loadImage(QByteArray::fromRawData(data, size),
+                                    QSize(maxContentWidth(), maxContentHeight()));
+      mImageCache.insert(path, new QImage(img), qMax(img.byteCount(), 1));
       resource.setValue(img);
       break;
     }
@@ -127,7 +141,8 @@ QVariant EpubDocument::loadResource(int type, const QUrl &name)
   }
 
   // add to cache
-  addResource(type, name, resource); 
+  if (type != QTextDocument::ImageResource)
+    addResource(type, name, resource);
 
   return resource;
 }
@@ -10,6 +10,7 @@
 #ifndef EPUB_DOCUMENT_H
 #define EPUB_DOCUMENT_H
 
+#include <QCache>
 #include <QTextDocument>
 #include <QUrl>
 #include <QVariant>
@@ -27,6 +28,7 @@ namespace Epub {
     ~EpubDocument();
     struct epub *getEpub();
     void setCurrentSubDocument(const QString &doc);
+    QString resourcePath(const QString &name) const;
     int maxContentHeight() const;
     int maxContentWidth() const;
     enum Multimedia { MovieResource = 4, AudioResource = 5 };
@@ -39,6 +41,7 @@ namespace Epub {
 
     struct epub *mEpub;
     KUrl mCurrentSubDocument;
+    QCache<QString, QImage> mImageCache;
 
     int padding;
 
@@ -0,0 +1,38 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "epubimage.h"
+#include <QBuffer>
+#include <QImageReader>
+
+static bool isLarger(const QSize &size, const QSize &maxSize)
+{
+  return size.width() > maxSize.width() || size.height() > maxSize.height();
+}
+
+QImage Epub::loadImage(const QByteArray &data, const QSize &maxSize)
+{
+  QByteArray bytes = data;
+  QBuffer buffer(&bytes);
+  QImageReader reader(&buffer);
+
+  // let the formats that can (like JPEG) decode directly at the smaller size
+  QSize size = reader.size();
+  if (size.isValid() && isLarger(size, maxSize)) {
+    size.scale(maxSize, Qt::KeepAspectRatio);
+    reader.setScaledSize(size);
+  }
+
+  // the others tell their size only once decoded
+  QImage image = reader.read();
+  if (isLarger(image.size(), maxSize))
+    image = image.scaled(maxSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+
+  return image;
+}
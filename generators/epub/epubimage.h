@@ -0,0 +1,23 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef EPUB_IMAGE_H
+#define EPUB_IMAGE_H
+
+#include <QByteArray>
+#include <QImage>
+#include <QSize>
+
+namespace Epub {
+
+  // Decodes the image @p data, at most as large as @p maxSize
+  QImage loadImage(const QByteArray &data, const QSize &maxSize);
+
+}
+#endif
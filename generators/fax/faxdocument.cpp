@@ -7,9 +7,14 @@
  *   (at your option) any later version.                                   *
  ***************************************************************************/
 
+#include <limits.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include <QtCore/QCache>
 #include <QtCore/QFile>
+#include <QtCore/QMutex>
+#include <QtCore/QVector>
 
 #include "faxexpand.h"
 #include "faxdocument.h"
@@ -58,13 +63,18 @@ static void normalize( struct pagenode *pn, int revbits, int swapbytes, size_t l
 static bool new_image( pagenode *pn, int width, int height )
 {
     pn->image = QImage( width, height, QImage::Format_MonoLSB );
+    if ( pn->image.isNull() )
+        return false;
+
     pn->image.setColor( 0, qRgb( 255, 255, 255 ) );
     pn->image.setColor( 1, qRgb( 0, 0, 0 ) );
+    // the lines the expander does not reach stay white
+    pn->image.fill( 0 );
     pn->bytes_per_line = pn->image.bytesPerLine();
     pn->dpi = FAX_DPI_FINE;
-    pn->imageData = new uchar[ width * height ];
+    pn->imageData = pn->image.bits();
 
-    return !pn->image.isNull();
+    return true;
 }
 
 /* get compressed data into memory */
@@ -94,14 +104,14 @@ static unsigned char* getstrip( pagenode *pn, int strip )
     else
         return 0;
 
-    /* round size to full boundary plus t32bits */
-    roundup = (pn->length + 7) & ~3;
+    /* round size to full boundary plus 4 t32bits */
+    roundup = ((pn->length + 3) & ~3) + 4 * sizeof( t32bits );
 
     data = new uchar[ roundup ];
-    /* clear the last 2 t32bits, to force the expander to terminate
-       even if the file ends in the middle of a fax line  */
-    *((t32bits *) data + roundup/4 - 2) = 0;
-    *((t32bits *) data + roundup/4 - 1) = 0;
+    /* clear everything past the data: NeedBits() loads 2 words at a time
+       without checking for the end, and the zeros force the expander to
+       terminate even if the file ends in the middle of a fax line  */
+    memset( data + pn->length, 0, roundup - pn->length );
 
     /* we expect to get it in one gulp... */
     if ( !file.seek(offset) || (size_t) file.read( (char *)data, pn->length ) != pn->length )
@@ -123,18 +133,6 @@ static unsigned char* getstrip( pagenode *pn, int strip )
     }
 
     normalize( pn, !pn->lsbfirst, ShortOrder, roundup );
-    if ( pn->size.height() == 0 )
-        pn->size.setHeight( G3count( pn, pn->expander == g32expand ) );
-
-    if ( pn->size.height() == 0 )
-    {
-        delete [] data;
-        pn->data = 0;
-        return 0;
-    }
-
-    if ( pn->strips == 0 )
-        pn->rowsperstrip = pn->size.height();
 
     pn->dataOrig = (t16bits *)data;
 
@@ -143,7 +141,8 @@ static unsigned char* getstrip( pagenode *pn, int strip )
 
 static void draw_line( pixnum *run, int lineNum, pagenode *pn )
 {
-    t32bits *p, *p1;  /* p - current line, p1 - low-res duplicate */
+    t32bits *line;    /* start of the current line */
+    t32bits *p;       /* current word of the line */
     pixnum *r;        /* pointer to run-lengths */
     t32bits pix;      /* current pixel value */
     t32bits acc;      /* pixel accumulator */
@@ -155,9 +154,12 @@ static void draw_line( pixnum *run, int lineNum, pagenode *pn )
     if ( lineNum >= pn->size.height() )
         return;
 
-    p = (t32bits *)(pn->imageData + lineNum*(2-pn->vres)*pn->bytes_per_line);
-    p1 =(t32bits *)(pn->vres ? 0 : p + pn->bytes_per_line/sizeof(*p));
+    line = (t32bits *)(pn->imageData + lineNum*(2-pn->vres)*pn->bytes_per_line);
+    p = line;
 
+    /* the pixels are put lsb-first in the words, which is the layout of
+       QImage::Format_MonoLSB on little endian hosts, and the full words of
+       a run are filled at once */
     r = run;
     acc = 0;
     nacc = 0;
@@ -171,9 +173,9 @@ static void draw_line( pixnum *run, int lineNum, pagenode *pn )
         if ( tot > pn->size.width() )
             break;
         if ( pix )
-            acc |= (~(t32bits)0 >> nacc);
+            acc |= (~(t32bits)0 << nacc);
         else if ( nacc )
-            acc &= (~(t32bits)0 << (32 - nacc));
+            acc &= (~(t32bits)0 >> (32 - nacc));
         else
             acc = 0;
         if ( nacc + n < 32 )
@@ -183,56 +185,158 @@ static void draw_line( pixnum *run, int lineNum, pagenode *pn )
             continue;
         }
         *p++ = acc;
-        if ( p1 )
-            *p1++ = acc;
         n -= 32 - nacc;
-        while ( n >= 32 )
-        {
-            n -= 32;
-            *p++ = pix;
-            if ( p1 )
-                *p1++ = pix;
-        }
+        const int words = n / 32;
+        memset( p, pix ? 0xff : 0, words * sizeof( *p ) );
+        p += words;
         acc = pix;
-        nacc = n;
+        nacc = n % 32;
         pix = ~pix;
     }
     if ( nacc )
-    {
         *p++ = acc;
-        if ( p1 )
-            *p1++ = acc;
-    }
+
+    /* the low resolution lines are shown twice */
+    if ( !pn->vres )
+        memcpy( line + pn->bytes_per_line/sizeof(*line), line, pn->bytes_per_line );
 }
 
-static bool get_image( struct pagenode *pn )
+/* the lines of the G4 data are only counted */
+static void count_line( pixnum *, int lineNum, pagenode *pn )
 {
-    unsigned char *data = getstrip( pn, 0 );
-    if ( !data )
-        return false;
+    pn->size.setHeight( lineNum + 1 );
+}
 
-    if ( !new_image( pn, pn->size.width(), (pn->vres ? 1 : 2) * pn->size.height() ) )
-        return false;
+/* a page of the data: where it starts, how long it is and its lines */
+struct FaxPage
+{
+    FaxPage( t16bits *_data = 0, size_t _length = 0, int _height = 0 )
+        : data( _data ), length( _length ), height( _height )
+    {
+    }
 
-    (*pn->expander)( pn, draw_line );
+    t16bits *data;
+    size_t length;
+    int height;
+};
 
-    return true;
+/* split G3 data in pages, each one ending with an RTC (six consecutive
+   EOLs); a page starts at the word after the previous RTC, or at the
+   word where the RTC ends when the first EOL of the page begins there
+   too (the expander skips the end of the RTC before that EOL) */
+static QVector<FaxPage> find_g3_pages( pagenode *pn, int twoD )
+{
+    QVector<FaxPage> pages;
+    t16bits *start = pn->data;
+    t16bits *end = pn->data + pn->length/sizeof(*pn->data);
+    int lines = 0;      /* lines of the page so far */
+    int zeros = 0;      /* number of consecutive zero bits seen */
+    int EOLcnt = 0;     /* number of consecutive EOLs seen */
+    bool empty = true;  /* nothing since the last EOL */
+    bool tag = false;   /* the next bit tells the coding of a 2-D line */
+
+    for ( t16bits *p = pn->data; p < end; p++ )
+    {
+        if ( *p == 0 && !tag )
+        {
+            zeros += 16;
+            continue;
+        }
+        t16bits bits = *p;
+        for ( int i = 0; i < 16; i++, bits >>= 1 )
+        {
+            if ( tag )
+                tag = false;
+            else if ( !(bits & 1) )
+                zeros++;
+            else if ( zeros < 11 )
+            {
+                zeros = 0;
+                empty = false;
+            }
+            else
+            {
+                zeros = 0;
+                tag = twoD;
+                if ( !empty )
+                {
+                    lines++;
+                    EOLcnt = 1;
+                }
+                else if ( lines )
+                    EOLcnt++;
+                empty = true;
+                if ( EOLcnt == 6 )
+                {
+                    pages.append( FaxPage( start, (p + 1 - start) * sizeof(*p), lines ) );
+                    const bool nextInWord = ( bits >> 1 ) != 0 || ( p + 1 < end && ( p[1] & 0x7ff ) != 0 );
+                    start = nextInWord ? p : p + 1;
+                    lines = 0;
+                    EOLcnt = 0;
+                }
+            }
+        }
+    }
+    /* the data may end without an RTC */
+    if ( lines )
+        pages.append( FaxPage( start, (end - start) * sizeof(*end), lines ) );
+
+    return pages;
+}
+
+/* G4 data has no EOLs, so a single page is found by expanding it */
+static QVector<FaxPage> find_g4_pages( pagenode *pn )
+{
+    QVector<FaxPage> pages;
+    pn->size.setHeight( 0 );
+    pn->rowsperstrip = INT_MAX;
+    (*pn->expander)( pn, count_line );
+    if ( pn->size.height() )
+        pages.append( FaxPage( pn->data, pn->length, pn->size.height() ) );
+
+    return pages;
 }
 
 class FaxDocument::Private
 {
     public:
         Private( FaxDocument *parent )
-            : mParent( parent )
+            : mParent( parent ), mPageImages( 16 * 1024 * 1024 )
         {
             mPageNode.size = QSize( 1728, 0 );
         }
 
+        QImage decodePage( int page );
+
         FaxDocument *mParent;
         struct pagenode mPageNode;
         FaxDocument::DocumentType mType;
+        QVector<FaxPage> mPages;
+        QCache<int, QImage> mPageImages;
+        QMutex mMutex;
 };
 
+QImage FaxDocument::Private::decodePage( int page )
+{
+    const FaxPage &faxPage = mPages.at( page );
+    pagenode *pn = &mPageNode;
+    pn->data = faxPage.data;
+    pn->length = faxPage.length;
+    pn->size.setHeight( faxPage.height );
+    pn->rowsperstrip = faxPage.height;
+
+    if ( !new_image( pn, pn->size.width(), (pn->vres ? 1 : 2) * faxPage.height ) )
+        return QImage();
+
+    (*pn->expander)( pn, draw_line );
+
+    const QImage image = pn->image;
+    pn->image = QImage();
+    pn->imageData = 0;
+
+    return image;
+}
+
 FaxDocument::FaxDocument( const QString &fileName, DocumentType type )
     : d( new Private( this ) )
 {
@@ -256,7 +360,6 @@ FaxDocument::FaxDocument( const QString &fileName, DocumentType type )
 FaxDocument::~FaxDocument()
 {
     delete [] d->mPageNode.dataOrig;
-    delete [] d->mPageNode.imageData;
     delete d;
 }
 
@@ -264,46 +367,103 @@ bool FaxDocument::load()
 {
     fax_init_tables();
 
-    bool ok = get_image( &(d->mPageNode) );
-    if ( !ok )
+    // the whole file, split in pages
+    if ( !getstrip( &(d->mPageNode), 0 ) )
         return false;
 
-    // byte-swapping the image
-    int height = d->mPageNode.size.height();
-    int bytes_per_line = d->mPageNode.size.width()/8;
+    if ( d->mPageNode.expander == g4expand )
+        d->mPages = find_g4_pages( &(d->mPageNode) );
+    else
+        d->mPages = find_g3_pages( &(d->mPageNode), d->mPageNode.expander == g32expand );
+
+    return !d->mPages.isEmpty();
+}
+
+int FaxDocument::pageCount() const
+{
+    return d->mPages.count();
+}
+
+QSize FaxDocument::pageSize( int page ) const
+{
+    if ( page < 0 || page >= d->mPages.count() )
+        return QSize();
+
+    return QSize( d->mPageNode.size.width(), int( (d->mPageNode.vres ? 1 : 2) * d->mPages.at( page ).height * 1.5 ) );
+}
+
+QImage FaxDocument::pageImage( int page ) const
+{
+    if ( page < 0 || page >= d->mPages.count() )
+        return QImage();
+
+    QMutexLocker locker( &d->mMutex );
+    if ( const QImage *image = d->mPageImages.object( page ) )
+        return *image;
+
+    const QImage image = d->decodePage( page );
+    if ( !image.isNull() )
+        d->mPageImages.insert( page, new QImage( image ), image.byteCount() );
+
+    return image;
+}
+
+QImage FaxDocument::scaledImage( const QImage &image, int width, int height )
+{
+    if ( image.isNull() || width <= 0 || height <= 0 )
+        return QImage();
+
+    QImage scaled( width, height, QImage::Format_RGB32 );
+    if ( scaled.isNull() )
+        return scaled;
+
+    const int imageWidth = image.width();
+    const int imageHeight = image.height();
+
+    // the first column of image of each column of scaled
+    QVector<int> left( width + 1 );
+    for ( int x = 0; x <= width; ++x )
+        left[ x ] = qint64( x ) * imageWidth / width;
 
-    QByteArray bytes( height * bytes_per_line, 0 );
-    for ( int y= height - 1; y >= 0; --y )
+    // the black pixels of the rows of image covered by a row of scaled,
+    // per column, and their running sums
+    QVector<int> counts( imageWidth );
+    QVector<int> sums( imageWidth + 1 );
+
+    for ( int y = 0; y < height; ++y )
     {
-        quint32 offset  = y * bytes_per_line;
-        quint32 *source = (quint32 *) (d->mPageNode.imageData + offset);
-        quint32 *dest   = (quint32 *) (bytes.data() + offset);
-        for ( int x= (bytes_per_line/4) - 1; x >= 0; --x )
+        const int top = qint64( y ) * imageHeight / height;
+        const int bottom = qMax( int( qint64( y + 1 ) * imageHeight / height ), top + 1 );
+
+        counts.fill( 0 );
+        int *count = counts.data();
+        for ( int imageY = top; imageY < bottom; ++imageY )
         {
-            quint32 dv = 0, sv = *source;
-            for ( int bit = 32; bit > 0; --bit )
+            const uchar *line = image.constScanLine( imageY );
+            for ( int x = 0; x < imageWidth; x += 8 )
             {
-                dv <<= 1;
-                dv |= sv&1;
-                sv >>= 1;
+                // most of a fax is white; the bits past the last
+                // column are not pixels
+                uchar bits = line[ x / 8 ];
+                for ( int i = x; bits && i < imageWidth; ++i, bits >>= 1 )
+                    count[ i ] += bits & 1;
             }
-            *dest = dv;
-            ++dest;
-            ++source;
         }
-    }
 
-    // convert it into a QImage
-    QImage img( (uchar*)bytes.data(), d->mPageNode.size.width(), d->mPageNode.size.height(), QImage::Format_MonoLSB );
-    img.setColor( 0, qRgb( 255, 255, 255 ) );
-    img.setColor( 1, qRgb( 0, 0, 0 ) );
+        int *sum = sums.data();
+        sum[ 0 ] = 0;
+        for ( int x = 0; x < imageWidth; ++x )
+            sum[ x + 1 ] = sum[ x ] + count[ x ];
 
-    d->mPageNode.image = img.copy().scaled( img.width(), img.height() * 1.5 );
-
-    return true;
-}
+        QRgb *pixel = reinterpret_cast<QRgb *>( scaled.scanLine( y ) );
+        for ( int x = 0; x < width; ++x )
+        {
+            const int right = qMax( left.at( x + 1 ), left.at( x ) + 1 );
+            const int area = ( right - left.at( x ) ) * ( bottom - top );
+            const int grey = 255 - ( sum[ right ] - sum[ left.at( x ) ] ) * 255 / area;
+            pixel[ x ] = qRgb( grey, grey, grey );
+        }
+    }
 
-QImage FaxDocument::image() const
-{
-    return d->mPageNode.image;
+    return scaled;
 }
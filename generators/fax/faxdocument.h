@@ -14,7 +14,10 @@
 
 /**
  * Loads a G3/G4 fax document and provides methods
- * to convert it into a QImage.
+ * to convert its pages into QImages.
+ *
+ * Loading only finds where the pages are in the data; each page is
+ * decoded when its image is asked for.
  */
 class FaxDocument
 {
@@ -48,9 +51,30 @@ class FaxDocument
     bool load();
 
     /**
-     * Returns the document as an image.
+     * Returns the number of pages of the document.
      */
-    QImage image() const;
+    int pageCount() const;
+
+    /**
+     * Returns the size the page @p page is shown at.
+     */
+    QSize pageSize( int page ) const;
+
+    /**
+     * Returns the page @p page as a 1 bpp image (QImage::Format_MonoLSB,
+     * with 1 for black), at the resolution of the fax.
+     *
+     * The page is decoded the first time, and then kept in a bounded cache.
+     * This method is thread safe.
+     */
+    QImage pageImage( int page ) const;
+
+    /**
+     * Returns the 1 bpp @p image, as returned by pageImage(), scaled to
+     * @p width x @p height in shades of grey; each pixel is the average
+     * of the pixels of @p image it covers.
+     */
+    static QImage scaledImage( const QImage &image, int width, int height );
 
   private:
     class Private;
@@ -33,11 +33,14 @@ pagenode::pagenode()
 {
 }
 
-/* Note that NeedBits() only works for n <= 16 */
+/* Note that NeedBits() only works for n <= 16; the accumulator is
+   refilled with 32 bits at a time, so most lookups do not need to load.
+   It may read past the end of the data, which getstrip() pads with zeros */
 #define NeedBits(n) do {						\
     if (BitsAvail < (n)) {						\
-	BitAcc |= *sp++ << BitsAvail;					\
-	BitsAvail += 16;						\
+	BitAcc |= (t64bits)(sp[0] | ((t32bits)sp[1] << 16)) << BitsAvail;	\
+	sp += 2;							\
+	BitsAvail += 32;						\
     }									\
 } while (0)
 #define GetBits(n)	(BitAcc & ((1<<(n))-1))
@@ -52,7 +55,7 @@ pagenode::pagenode()
     int t;								\
     NeedBits(wid);							\
     TabEnt = tab + GetBits(wid);					\
-    printf("%08lX/%d: %s%5d\t", BitAcc, BitsAvail,			\
+    printf("%016llX/%d: %s%5d\t", (unsigned long long)BitAcc, BitsAvail,			\
 	   StateNames[TabEnt->State], TabEnt->Param);			\
     for (t = 0; t < TabEnt->Width; t++)					\
 	DEBUG_SHOW;							\
@@ -347,7 +350,7 @@ MHexpand(struct pagenode *pn, drawfunc df)
 {
     int a0;			/* reference element */
     int lastx;			/* copy line width to register */
-    t32bits BitAcc;		/* bit accumulator */
+    t64bits BitAcc;		/* bit accumulator */
     int BitsAvail;		/* # valid bits in BitAcc */
     int RunLength;		/* Length of current run */
     t16bits *sp;		/* pointer into compressed data */
@@ -400,7 +403,7 @@ g31expand(struct pagenode *pn, drawfunc df)
 {
     int a0;			/* reference element */
     int lastx;			/* copy line width to register */
-    t32bits BitAcc;		/* bit accumulator */
+    t64bits BitAcc;		/* bit accumulator */
     int BitsAvail;		/* # valid bits in BitAcc */
     int RunLength;		/* Length of current run */
     t16bits *sp;		/* pointer into compressed data */
@@ -489,7 +492,7 @@ g32expand(struct pagenode *pn, drawfunc df)
     pixnum *run0, *run1;	/* run length arrays */
     pixnum *thisrun, *pa, *pb;	/* pointers into runs */
     t16bits *sp;		/* pointer into compressed data */
-    t32bits BitAcc;		/* bit accumulator */
+    t64bits BitAcc;		/* bit accumulator */
     int BitsAvail;		/* # valid bits in BitAcc */
     int EOLcnt;			/* number of consecutive EOLs */
     int	refline = 0;		/* 1D encoded reference line */
@@ -609,7 +612,7 @@ g4expand(struct pagenode *pn, drawfunc df)
     pixnum *run0, *run1;	/* run length arrays */
     pixnum *thisrun, *pa, *pb;	/* pointers into runs */
     t16bits *sp;		/* pointer into compressed data */
-    t32bits BitAcc;		/* bit accumulator */
+    t64bits BitAcc;		/* bit accumulator */
     int BitsAvail;		/* # valid bits in BitAcc */
     int	LineNum;		/* line number */
     int EOLcnt;
@@ -26,6 +26,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA. *
 
 #include <QtGui/QImage>
 
+#define t64bits quint64
 #define t32bits quint32
 #define t16bits quint16
 
@@ -71,7 +72,7 @@ class pagenode {		/* compressed page descriptor */
     unsigned int bytes_per_line;
     QString filename;         /* The name of the file to be opened */
     QImage image;             /* The final image */
-    uchar *imageData;         /* The temporary raw image data */
+    uchar *imageData;         /* The pixels of image, as the lines are expanded */
 };
 
 /* page orientation flags */
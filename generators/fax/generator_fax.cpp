@@ -16,6 +16,7 @@
 #include <klocale.h>
 
 #include <core/document.h>
+#include <core/fileprinter.h>
 #include <core/page.h>
 
 static KAboutData createAboutData()
@@ -37,7 +38,7 @@ static KAboutData createAboutData()
 OKULAR_EXPORT_PLUGIN( FaxGenerator, createAboutData() )
 
 FaxGenerator::FaxGenerator( QObject *parent, const QVariantList &args )
-    : Generator( parent, args )
+    : Generator( parent, args ), m_document( 0 )
 {
     setFeature( Threaded );
     setFeature( PrintNative );
@@ -55,40 +56,45 @@ bool FaxGenerator::loadDocument( const QString & fileName, QVector<Okular::Page*
     else
         m_type = FaxDocument::G4;
 
-    FaxDocument faxDocument( fileName, m_type );
+    m_document = new FaxDocument( fileName, m_type );
 
-    if ( !faxDocument.load() )
+    if ( !m_document->load() )
     {
+        delete m_document;
+        m_document = 0;
         emit error( i18n( "Unable to load document" ), -1 );
         return false;
     }
 
-    m_img = faxDocument.image();
+    // the pages are only decoded when shown
+    pagesVector.resize( m_document->pageCount() );
 
-    pagesVector.resize( 1 );
-
-    Okular::Page * page = new Okular::Page( 0, m_img.width(), m_img.height(), Okular::Rotation0 );
-    pagesVector[0] = page;
+    for ( int i = 0; i < pagesVector.count(); ++i )
+    {
+        const QSize size = m_document->pageSize( i );
+        pagesVector[i] = new Okular::Page( i, size.width(), size.height(), Okular::Rotation0 );
+    }
 
     return true;
 }
 
 bool FaxGenerator::doCloseDocument()
 {
-    m_img = QImage();
+    delete m_document;
+    m_document = 0;
 
     return true;
 }
 
 QImage FaxGenerator::image( Okular::PixmapRequest * request )
 {
-    // perform a smooth scaled generation
+    // scale the 1 bpp page straight to grey
     int width = request->width();
     int height = request->height();
     if ( request->page()->rotation() % 2 == 1 )
         qSwap( width, height );
 
-    return m_img.scaled( width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation );
+    return FaxDocument::scaledImage( m_document->pageImage( request->pageNumber() ), width, height );
 }
 
 Okular::DocumentInfo FaxGenerator::generateDocumentInfo( const QSet<Okular::DocumentInfo::Key> &keys ) const
@@ -108,14 +114,23 @@ bool FaxGenerator::print( QPrinter& printer )
 {
     QPainter p( &printer );
 
-    QImage image( m_img );
+    QList<int> pageList = Okular::FilePrinter::pageList( printer, document()->pages(),
+                                                         document()->currentPage() + 1,
+                                                         document()->bookmarkedPageList() );
 
-    if ( ( image.width() > printer.width() ) || ( image.height() > printer.height() ) )
+    for ( int i = 0; i < pageList.count(); ++i ) {
 
-        image = image.scaled( printer.width(), printer.height(),
-                              Qt::KeepAspectRatio, Qt::SmoothTransformation );
+        QSize size = m_document->pageSize( pageList[i] - 1 );
 
-    p.drawImage( 0, 0, image );
+        if ( ( size.width() > printer.width() ) || ( size.height() > printer.height() ) )
+            size.scale( printer.width(), printer.height(), Qt::KeepAspectRatio );
+
+        if ( i != 0 )
+            printer.newPage();
+
+        p.drawImage( 0, 0, FaxDocument::scaledImage( m_document->pageImage( pageList[i] - 1 ),
+                                                     size.width(), size.height() ) );
+    }
 
     return true;
 }
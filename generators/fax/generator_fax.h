@@ -12,8 +12,6 @@
 
 #include <core/generator.h>
 
-#include <QtGui/QImage>
-
 #include "faxdocument.h"
 
 class FaxGenerator : public Okular::Generator
@@ -35,7 +33,7 @@ class FaxGenerator : public Okular::Generator
         QImage image( Okular::PixmapRequest * request );
 
     private:
-        QImage m_img;
+        FaxDocument *m_document;
         FaxDocument::DocumentType m_type;
 };
 
@@ -33,7 +33,6 @@ namespace Mobi {
     virtual QVariant loadResource(int type, const QUrl &name);
     
   private:
-    QString fixMobiMarkup(const QString& data);
     Mobipocket::Document *doc;
     Mobipocket::QFileStream* file;
   };
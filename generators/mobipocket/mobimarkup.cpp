@@ -0,0 +1,66 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Jakub Stachowski <qbast@go2.pl>                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+#include "mobimarkup.h"
+#include <QtCore/QMap>
+#include <QtCore/QRegExp>
+
+// starting from 'pos', find position in the string that is not inside a tag
+static int outsideTag(const QString& data, int pos)
+{
+  for (int i=pos-1;i>=0;i--) {
+    if (data[i]=='>') return pos;
+    if (data[i]=='<') return i;
+  }
+  return pos;
+}
+
+QString Mobi::fixMobiMarkup(const QString& data) 
+{
+    QMap<int,QString> anchorPositions;
+    static QRegExp anchors("<a(?: href=\"[^\"]*\"){0,1}[\\s]+filepos=['\"]{0,1}([\\d]+)[\"']{0,1}", Qt::CaseInsensitive);
+    int pos=0;
+
+    // find all link destinations
+    while ( (pos=anchors.indexIn( data, pos ))!=-1) {
+	int filepos=anchors.cap( 1 ).toUInt(  );
+	if (filepos) anchorPositions[filepos]=anchors.cap(1);
+	pos+=anchors.matchedLength();
+    }
+
+    // put HTML anchors in all link destinations; the markup is copied once
+    // with the anchors, as inserting each of them would move all the text
+    // after it, which is slow for large books with many links
+    QString ret;
+    ret.reserve(data.size()+anchorPositions.size()*32);
+    int copied=0;
+    QMapIterator<int,QString> it(anchorPositions);
+    while (it.hasNext()) {
+      it.next();
+      // link pointing outside the document, ignore
+      if (it.key() >= data.size()) continue;
+      // the positions are increasing, so are the fixed ones
+      int fixedpos=outsideTag(data, it.key());
+      ret.append(data.midRef(copied, fixedpos-copied));
+      ret+=QString("<a name=\"")+it.value()+QString("\">&nbsp;</a>");
+      copied=fixedpos;
+    }
+    ret.append(data.midRef(copied));
+
+    // replace links referencing filepos with normal internal links
+    ret.replace(anchors,"<a href=\"#\\1\"");
+    // Mobipocket uses strange variang of IMG tags: <img recindex="3232"> where recindex is number of 
+    // record containing image
+    static QRegExp imgs("<img.*recindex=\"([\\d]*)\".*>", Qt::CaseInsensitive);
+    
+    imgs.setMinimal(true);
+    ret.replace(imgs,"<img src=\"pdbrec:/\\1\">");
+    ret.replace("<mbp:pagebreak/>","<p style=\"page-break-after:always\"></p>");
+    
+    return ret;
+}
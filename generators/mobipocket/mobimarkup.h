@@ -0,0 +1,21 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Jakub Stachowski <qbast@go2.pl>                 *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+#ifndef MOBI_MARKUP_H
+#define MOBI_MARKUP_H
+
+#include <QString>
+
+namespace Mobi {
+
+  // Turns the Mobipocket HTML into the one of QTextDocument: anchors at
+  // the link destinations (filepos), images and page breaks
+  QString fixMobiMarkup(const QString& data);
+
+}
+#endif
@@ -10,6 +10,7 @@
 #include "generator_plucker.h"
 
 #include <QtCore/QFile>
+#include <QtCore/QMutex>
 #include <QtGui/QAbstractTextDocumentLayout>
 #include <QtGui/QPainter>
 #include <QtGui/QPrinter>
@@ -77,15 +78,16 @@ PluckerGenerator::~PluckerGenerator()
 
 bool PluckerGenerator::loadDocument( const QString & fileName, QVector<Okular::Page*> & pagesVector )
 {
-    QUnpluck unpluck;
-
-    if ( !unpluck.open( fileName ) )
+    // the book stays open: the images are read from it when the pages
+    // are laid out or drawn
+    if ( !mUnpluck.open( fileName ) )
         return false;
 
-    mPages = unpluck.pages();
-    mLinks = unpluck.links();
+    mUnpluck.convert();
+    mPages = mUnpluck.pages();
+    mLinks = mUnpluck.links();
 
-    const QMap<QString, QString> infos = unpluck.infos();
+    const QMap<QString, QString> infos = mUnpluck.infos();
     QMapIterator<QString, QString> it( infos );
     while ( it.hasNext() ) {
         it.next();
@@ -120,6 +122,9 @@ bool PluckerGenerator::doCloseDocument()
     qDeleteAll( mPages );
     mPages.clear();
 
+    // the pages ask it for their images
+    mUnpluck.close();
+
     // do not use clear() for the following, otherwise its type is changed
     mDocumentInfo = Okular::DocumentInfo();
 
@@ -133,6 +138,8 @@ Okular::DocumentInfo PluckerGenerator::generateDocumentInfo( const QSet<Okular::
 
 QImage PluckerGenerator::image( Okular::PixmapRequest *request )
 {
+    QMutexLocker locker( userMutex() );
+
     const QSizeF size = mPages[ request->pageNumber() ]->size();
 
     QImage image( request->width(), request->height(), QImage::Format_ARGB32_Premultiplied );
@@ -47,6 +47,7 @@ class PluckerGenerator : public Okular::Generator
         bool doCloseDocument();
 
     private:
+      QUnpluck mUnpluck;
       QList<QTextDocument*> mPages;
       QSet<int> mLinkAdded;
       Link::List mLinks;
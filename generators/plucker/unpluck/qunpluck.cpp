@@ -72,7 +72,6 @@ class Context
         QTextDocument *document;
         QTextCursor *cursor;
         QStack<QTextCharFormat> stack;
-        QList<int> images;
 
         QString linkUrl;
         int linkStart;
@@ -87,6 +86,35 @@ class RecordNode
     bool done;
 };
 
+// the uncompressed records kept between two transcribed records, and the
+// decoded images kept for the pages laid out or drawn
+static const int RecordCacheSize = 4 * 1024 * 1024;
+static const int ImageCacheSize = 16 * 1024 * 1024;
+
+// A page, whose images are decoded only when needed
+class PageDocument : public QTextDocument
+{
+    public:
+        PageDocument( QUnpluck *unpluck )
+            : mUnpluck( unpluck )
+        {
+        }
+
+    protected:
+        QVariant loadResource( int type, const QUrl &name )
+        {
+            bool ok = false;
+            const int index = name.toString().section( '.', 0, 0 ).toInt( &ok );
+            if ( type == QTextDocument::ImageResource && ok )
+                return mUnpluck->image( index );
+
+            return QTextDocument::loadResource( type, name );
+        }
+
+    private:
+        QUnpluck *mUnpluck;
+};
+
 static Okular::DocumentViewport calculateViewport( QTextDocument *document, const QTextBlock &block )
 {
     if ( !block.isValid() )
@@ -107,22 +135,18 @@ static Okular::DocumentViewport calculateViewport( QTextDocument *document, cons
 }
 
 QUnpluck::QUnpluck()
-    : mDocument( 0 )
+    : mDocument( 0 ), mNextRecord( 0 ), mAllRecordsAdded( false ), mImages( ImageCacheSize )
 {
 }
 
 QUnpluck::~QUnpluck()
 {
-    mLinks.clear();
-    mNamedTargets.clear();
-    mPages.clear();
+    close();
 }
 
 bool QUnpluck::open( const QString &fileName )
 {
-    mLinks.clear();
-    mNamedTargets.clear();
-    mPages.clear();
+    close();
 
     mDocument = plkr_OpenDBFile( QFile::encodeName( fileName ).data() );
     if ( !mDocument ) {
@@ -130,8 +154,6 @@ bool QUnpluck::open( const QString &fileName )
         return false;
     }
 
-    bool status = true;
-
     mInfo.insert( "name", plkr_GetName( mDocument ) );
     mInfo.insert( "title", plkr_GetTitle( mDocument ) );
     mInfo.insert( "author", plkr_GetAuthor( mDocument ) );
@@ -139,52 +161,73 @@ bool QUnpluck::open( const QString &fileName )
 
     AddRecord( plkr_GetHomeRecordID( mDocument ) );
 
-    int number = GetNextRecordNumber();
-    while ( number > 0 ) {
-        status = TranscribeRecord( number );
-        number = GetNextRecordNumber ();
-    }
+    return true;
+}
+
+void QUnpluck::close()
+{
+    for ( int i = 0; i < mRecords.count(); ++i )
+        delete mRecords[ i ];
 
-    // Iterate over all records again to add those which aren't linked directly
-    for ( int i = 1; i < plkr_GetRecordCount( mDocument ); ++i )
-        AddRecord( plkr_GetUidForIndex( mDocument, i ) );
+    mRecords.clear();
+    mRecordIndex.clear();
+    mNextRecord = 0;
+    mAllRecordsAdded = false;
+
+    // the pages belong to the caller
+    mPageRecords.clear();
+    mPages.clear();
+    mNamedTargets.clear();
+    mImages.clear();
+    mInfo.clear();
+    mLinks.clear();
 
-    number = GetNextRecordNumber();
-    while ( number > 0 ) {
-        status = TranscribeRecord( number );
-        number = GetNextRecordNumber ();
+    if ( mDocument ) {
+        plkr_CloseDoc( mDocument );
+        mDocument = 0;
     }
+}
+
+void QUnpluck::convert()
+{
+    if ( !mDocument )
+        return;
+
+    // no record is in use between two, so only the most recently used are
+    // kept uncompressed
+    for ( ;; ) {
+        const int number = GetNextRecordNumber();
+        if ( number > 0 ) {
+            TranscribeRecord( number );
+            plkr_TrimRecordCache( mDocument, RecordCacheSize );
+        } else if ( !mAllRecordsAdded ) {
+            // Iterate over all records again to add those which aren't linked directly
+            for ( int i = 1; i < plkr_GetRecordCount( mDocument ); ++i )
+                AddRecord( plkr_GetUidForIndex( mDocument, i ) );
+            mAllRecordsAdded = true;
+        } else {
+            break;
+        }
+    }
+
+    ResolveLinks();
+}
 
+void QUnpluck::ResolveLinks()
+{
     for ( int i = 0; i < mRecords.count(); ++i )
         delete mRecords[ i ];
 
     mRecords.clear();
-
-    plkr_CloseDoc( mDocument );
+    mRecordIndex.clear();
+    mNextRecord = 0;
 
     /**
      * Calculate hash map
      */
     QHash<int, int> pageHash;
-    for ( int i = 0; i < mContext.count(); ++i )
-        pageHash.insert( mContext[ i ]->recordId, i );
-
-    /**
-     * Convert ids
-     */
-    for ( int i = 0; i < mContext.count(); ++i ) {
-        Context *context = mContext[ i ];
-        for ( int j = 0; j < context->images.count(); ++j ) {
-            int imgNumber = context->images[ j ];
-            context->document->addResource( QTextDocument::ImageResource,
-                                            QUrl( QString( "%1.jpg" ).arg( imgNumber ) ),
-                                            mImages[ imgNumber ] );
-        }
-
-        mPages.append( context->document );
-    }
-    qDeleteAll( mContext );
-    mContext.clear();
+    for ( int i = 0; i < mPageRecords.count(); ++i )
+        pageHash.insert( mPageRecords[ i ], i );
 
     // convert record_id into page
     for ( int i = 0; i < mLinks.count(); ++i ) {
@@ -209,42 +252,54 @@ bool QUnpluck::open( const QString &fileName )
             mLinks[ i ].link = new Okular::BrowseAction( mLinks[ i ].url );
         }
     }
+}
 
-    return true;
+QImage QUnpluck::image( int index )
+{
+    if ( const QImage *cached = mImages.object( index ) )
+        return *cached;
+
+    QImage image;
+    if ( !mDocument )
+        return image;
+
+    plkr_DataRecordType type;
+    int data_len;
+    unsigned char *data = plkr_GetRecordBytes( mDocument, index, &data_len, &type );
+    if ( !data )
+        return image;
+
+    if (type == PLKR_DRTYPE_IMAGE_COMPRESSED || type == PLKR_DRTYPE_IMAGE)
+        image = TranscribeImageRecord( data );
+    else if (type == PLKR_DRTYPE_MULTIIMAGE)
+        TranscribeMultiImageRecord( mDocument, image, data );
+    plkr_TrimRecordCache( mDocument, RecordCacheSize );
+
+    mImages.insert( index, new QImage( image ), image.byteCount() );
+
+    return image;
 }
 
 int QUnpluck::GetNextRecordNumber()
 {
-    int index = 0;
+    // a record is never undone, so the ones before mNextRecord stay done
+    while ( mNextRecord < mRecords.count() && mRecords[ mNextRecord ]->done )
+        ++mNextRecord;
 
-    for ( int pos = 0; pos < mRecords.count(); ++pos ) {
-        if ( !mRecords[ pos ]->done ) {
-            index = mRecords[ pos ]->index;
-            break;
-        }
-    }
-
-    return index;
+    return mNextRecord < mRecords.count() ? mRecords[ mNextRecord ]->index : 0;
 }
 
 int QUnpluck::GetPageID( int index )
 {
-    for ( int pos = 0; pos < mRecords.count(); ++pos ) {
-        if ( mRecords[ pos ]->index == index ) {
-            return mRecords[ pos ]->page_id;
-        }
-    }
+    const RecordNode *node = mRecordIndex.value( index );
 
-    return 0;
+    return node ? node->page_id : 0;
 }
 
 void QUnpluck::AddRecord( int index )
 {
-    for ( int pos = 0; pos < mRecords.count(); ++pos ) {
-        if ( mRecords[ pos ]->index == index ) {
-            return;
-        }
-    }
+    if ( mRecordIndex.contains( index ) )
+        return;
 
     RecordNode *node = new RecordNode;
     node->done = false;
@@ -252,32 +307,19 @@ void QUnpluck::AddRecord( int index )
     node->page_id = index;
 
     mRecords.append( node );
+    mRecordIndex.insert( index, node );
 }
 
 void QUnpluck::MarkRecordDone( int index )
 {
-    for ( int pos = 0; pos < mRecords.count(); ++pos ) {
-        if ( mRecords[ pos ]->index == index ) {
-            mRecords[ pos ]->done = true;
-            return;
-        }
-    }
-
     AddRecord( index );
-    MarkRecordDone( index );
+    mRecordIndex.value( index )->done = true;
 }
 
 void QUnpluck::SetPageID( int index, int page_id )
 {
-    for ( int pos = 0; pos < mRecords.count(); ++pos ) {
-        if ( mRecords[ pos ]->index == index ) {
-            mRecords[ pos ]->page_id = page_id;
-            return;
-        }
-    }
-
     AddRecord( index );
-    SetPageID( index, page_id );
+    mRecordIndex.value( index )->page_id = page_id;
 }
 
 QString QUnpluck::MailtoURLFromBytes( unsigned char* record_data )
@@ -586,7 +628,6 @@ bool QUnpluck::TranscribeTableRecord
                                 QTextCharFormat format = context->cursor->charFormat();
                                 context->cursor->insertImage( QString( "%1.jpg" ).arg(record_id) );
                                 context->cursor->setCharFormat( format );
-                                context->images.append( record_id );
                                 AddRecord (record_id);
                             }
                             DoStyle (context, style, true);
@@ -1060,7 +1101,6 @@ bool QUnpluck::TranscribeTextRecord
                 } else if (fctype == PLKR_TFC_IMAGE || fctype == PLKR_TFC_IMAGE2) {
                     QTextCharFormat format = context->cursor->charFormat();
                     context->cursor->insertImage( QString( "%1.jpg" ).arg( (ptr[0] << 8) + ptr[1] ) );
-                    context->images.append( (ptr[0] << 8) + ptr[1] );
                     context->cursor->setCharFormat( format );
                     AddRecord ((ptr[0] << 8) + ptr[1]);
 
@@ -1159,6 +1199,14 @@ bool QUnpluck::TranscribeRecord( int index )
     int data_len;
     bool status = true;
 
+    // the images are decoded only when a page shows them, see image()
+    type = (plkr_DataRecordType)plkr_GetRecordType( mDocument, index );
+    if (type == PLKR_DRTYPE_IMAGE_COMPRESSED || type == PLKR_DRTYPE_IMAGE ||
+        type == PLKR_DRTYPE_MULTIIMAGE) {
+        MarkRecordDone( index );
+        return true;
+    }
+
     unsigned char *data = plkr_GetRecordBytes( mDocument, index, &data_len, &type);
     if ( !data ) {
         MarkRecordDone( index );
@@ -1166,7 +1214,7 @@ bool QUnpluck::TranscribeRecord( int index )
     }
 
     if (type == PLKR_DRTYPE_TEXT_COMPRESSED || type == PLKR_DRTYPE_TEXT) {
-        QTextDocument *document = new QTextDocument;
+        QTextDocument *document = new PageDocument( this );
 
         QTextFrameFormat format( document->rootFrame()->frameFormat() );
         format.setMargin( 20 );
@@ -1186,14 +1234,10 @@ bool QUnpluck::TranscribeRecord( int index )
         document->setTextWidth( 600 );
 
         delete context->cursor;
-        mContext.append( context );
-    } else if (type == PLKR_DRTYPE_IMAGE_COMPRESSED || type == PLKR_DRTYPE_IMAGE) {
-        QImage image = TranscribeImageRecord( data );
-        mImages.insert( index, image );
-    } else if (type == PLKR_DRTYPE_MULTIIMAGE) {
-        QImage image;
-        if ( TranscribeMultiImageRecord( mDocument, image, data ) )
-            mImages.insert( index, image );
+        delete context;
+
+        mPageRecords.append( index );
+        mPages.append( document );
     } else {
         status = false;
     }
@@ -12,6 +12,8 @@
 #ifndef QUNPLUCK_H
 #define QUNPLUCK_H
 
+#include <QtCore/QCache>
+#include <QtCore/QHash>
 #include <QtCore/QList>
 #include <QtCore/QMap>
 #include <QtGui/QImage>
@@ -49,13 +51,30 @@ class QUnpluck
         QUnpluck();
         ~QUnpluck();
 
+        /**
+         * Opens the document, whose pages are then converted by convert().
+         */
         bool open( const QString &fileName );
+        void close();
+
+        /**
+         * Converts the pages, in reading order from the home page, and
+         * resolves their links.
+         */
+        void convert();
+
+        /**
+         * Returns the image of the record @p index, decoded when the pages
+         * are laid out or drawn; the last ones are kept.
+         */
+        QImage image( int index );
 
         QList<QTextDocument*> pages() const { return mPages; }
         Link::List links() const { return mLinks; }
         QMap<QString, QString> infos() const { return mInfo; }
 
     private:
+        void ResolveLinks();
         int GetNextRecordNumber();
         int GetPageID( int index );
         void AddRecord( int index );
@@ -72,11 +91,14 @@ class QUnpluck
 
         plkr_Document* mDocument;
         QList<RecordNode*> mRecords;
+        QHash<int, RecordNode*> mRecordIndex;
+        int mNextRecord;
+        bool mAllRecordsAdded;
 
-        QList<Context*> mContext;
+        QList<int> mPageRecords;
         QList<QTextDocument*> mPages;
         QMap<QString, QPair<int, QTextBlock> > mNamedTargets;
-        QMap<int, QImage> mImages;
+        QCache<int, QImage> mImages;
         QMap<QString, QString> mInfo;
         QString mErrorString;
         Link::List mLinks;
@@ -49,7 +49,8 @@
 /***********************************************************************/
 /***********************************************************************/
 
-/* uncompress DOC compressed document/image */
+/* uncompress DOC compressed document/image; the data of a corrupted
+   record never goes past the end of either buffer, and is rejected */
 static unsigned int UncompressDOC
     (
     unsigned char*  src,         /* in:  compressed document */
@@ -60,44 +61,51 @@ static unsigned int UncompressDOC
                                       document in */
     )
 {
-    unsigned int  offset;
     unsigned int  src_index;
     unsigned int  dest_index;
 
     assert (src != NULL && src_len != 0 && dest != NULL && dest_len != 0);
 
-    offset = 0;
     src_index = 0;
     dest_index = 0;
-    memset (dest, 0, dest_len);
 
     while (src_index < src_len) {
         unsigned int token;
 
         token = (unsigned int) src[src_index++];
         if (0 < token && token < 9) {
-            while (token != 0) {
-                dest[dest_index++] = src[src_index++];
-                token--;
-            }
+            /* a run of literal bytes */
+            if (token > src_len - src_index || token > dest_len - dest_index)
+                return 0;
+            memcpy (dest + dest_index, src + src_index, token);
+            src_index += token;
+            dest_index += token;
         }
         else if (token < 0x80) {
+            if (dest_index >= dest_len)
+                return 0;
             dest[dest_index++] = token;
         }
         else if (0xc0 <= token) {
+            if (2 > dest_len - dest_index)
+                return 0;
             dest[dest_index++] = ' ';
             dest[dest_index++] = token ^ 0x80;
         }
         else {
-            int m;
-            int n;
+            unsigned int m;
+            unsigned int n;
 
+            if (src_index >= src_len)
+                return 0;
             token *= 256;
             token += src[src_index++];
 
+            /* a copy of what was uncompressed, the ranges may overlap */
             m = (token & 0x3fff) / 8;
-            n = token & 7;
-            n += 3;
+            n = (token & 7) + 3;
+            if (m == 0 || m > dest_index || n > dest_len - dest_index)
+                return 0;
             while (n != 0) {
                 dest[dest_index] = dest[dest_index - m];
                 dest_index++;
@@ -105,9 +113,8 @@ static unsigned int UncompressDOC
             }
         }
     }
-    assert (src_index == src_len && dest_index == dest_len);
 
-    return 1;
+    return dest_index == dest_len;
 }
 
 /* uncompress ZLib compressed document/image */
@@ -123,7 +130,7 @@ static unsigned int UncompressZLib
     )
 {
     z_stream       z;
-    unsigned int   err;
+    int            err;
     unsigned int   keylen;
     unsigned int   i;
     unsigned char  keybuf[OWNER_ID_HASH_LEN];
@@ -157,20 +164,22 @@ static unsigned int UncompressZLib
         return err;
     }
 
-    do {
-        if (z.avail_in == 0 && keylen > 0) {
+    /* the output buffer holds the whole record: without a key, all the
+       input is there too and a single call does it */
+    if (keylen > 0) {
+        err = inflate (&z, Z_SYNC_FLUSH);
+        if (err == Z_OK && z.avail_in == 0) {
             z.next_in = src + keylen;
             z.avail_in = src_len - keylen;
         }
+    }
+    if (err == Z_OK)
+        err = inflate (&z, Z_FINISH);
 
-        err = inflate (&z, Z_SYNC_FLUSH);
-
-    } while (err == Z_OK);
-
-    if (err != Z_STREAM_END)
-        return err;
-
-    assert (z.total_out == dest_len);
+    if (err != Z_STREAM_END || z.total_out != dest_len) {
+        inflateEnd (&z);
+        return (err == Z_STREAM_END || err == Z_OK) ? Z_DATA_ERROR : err;
+    }
 
     return inflateEnd (&z);
 }
@@ -1024,6 +1033,50 @@ int plkr_CopyRecordBytes
     }
 }
 
+/* the records cached by plkr_GetRecordBytes are kept in a list, the
+   most recently used first; the ones cached when the document is opened
+   (URLs, categories) are not in it, and are kept till it is closed */
+static int IsInCacheList
+    (
+    plkr_Document*    doc,
+    plkr_DataRecord*  record
+    )
+{
+    return (record == doc->lru_first || record->lru_prev != NULL);
+}
+
+static void RemoveFromCacheList
+    (
+    plkr_Document*    doc,
+    plkr_DataRecord*  record
+    )
+{
+    if (record->lru_prev != NULL)
+        record->lru_prev->lru_next = record->lru_next;
+    else
+        doc->lru_first = record->lru_next;
+    if (record->lru_next != NULL)
+        record->lru_next->lru_prev = record->lru_prev;
+    else
+        doc->lru_last = record->lru_prev;
+    record->lru_prev = NULL;
+    record->lru_next = NULL;
+}
+
+static void AddToCacheList
+    (
+    plkr_Document*    doc,
+    plkr_DataRecord*  record
+    )
+{
+    record->lru_prev = NULL;
+    record->lru_next = doc->lru_first;
+    if (doc->lru_first != NULL)
+        doc->lru_first->lru_prev = record;
+    else
+        doc->lru_last = record;
+    doc->lru_first = record;
+}
 
 unsigned char *plkr_GetRecordBytes
     (
@@ -1046,12 +1099,36 @@ unsigned char *plkr_GetRecordBytes
         if (!record->cache) {
             record->cache = buf;
             record->cached_size = *size;
+            AddToCacheList (doc, record);
+            doc->lru_size += *size;
+        }
+        else if (IsInCacheList (doc, record)) {
+            RemoveFromCacheList (doc, record);
+            AddToCacheList (doc, record);
         }
         *type = record->type;
         return buf;
     }
 }
 
+void plkr_TrimRecordCache
+    (
+    plkr_Document*  doc,
+    int             max_size
+    )
+{
+    plkr_DataRecord*  record;
+
+    while (doc->lru_last != NULL && doc->lru_size > max_size) {
+        record = doc->lru_last;
+        RemoveFromCacheList (doc, record);
+        doc->lru_size -= record->cached_size;
+        free (record->cache);
+        record->cache = NULL;
+        record->cached_size = 0;
+    }
+}
+
 int plkr_GetHomeRecordID
     (
     plkr_Document*  doc
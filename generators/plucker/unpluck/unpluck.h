@@ -204,7 +204,8 @@ int plkr_GetUidForIndex (
 
    Retrieve a static pointer to a buffer containing the uncompressed
    data of the specified record.  This causes the buffer to be cached
-   by the implementation; do not free() the returned pointer!  The
+   by the implementation, till a call to plkr_TrimRecordCache frees it;
+   do not free() the returned pointer!  The
    size of the buffer is returned through the "size" parameter; the
    type of the record is returned through the "type" parameter.
    May return NULL if the "record_index" value is out-of-range.
@@ -217,6 +218,19 @@ unsigned char *plkr_GetRecordBytes (
 );
 
 
+/* plkr_TrimRecordCache
+
+   Frees the buffers cached by plkr_GetRecordBytes, the least recently
+   used first, till they take no more than "max_size" bytes.  The
+   pointers returned for the freed records are then invalid, so this
+   should only be called when none of them is in use.
+*/
+void plkr_TrimRecordCache (
+    plkr_Document *,
+    int /* max_size */
+);
+
+
 /* plkr_GetRecordURL
 
    Retrieve a static pointer to the URL string for the specified record.
@@ -91,6 +91,8 @@ struct plkr_DataRecord_s {
     plkr_DataRecordType type;
     unsigned char *cache;       /* cache of uncompressed full record */
     int charset_mibenum;
+    plkr_DataRecord *lru_prev;  /* neighbours in the list of the records */
+    plkr_DataRecord *lru_next;  /*   cached by plkr_GetRecordBytes */
 };
 
 /* The main data structure for the document */
@@ -116,6 +118,9 @@ struct plkr_Document_s {
     int default_charset_mibenum;
     int owner_id_required;      /* 1 for yes, 0 for no */
     unsigned char owner_id_key[40];
+    plkr_DataRecord *lru_first; /* records cached by plkr_GetRecordBytes, */
+    plkr_DataRecord *lru_last;  /*   the most recently used first */
+    int lru_size;               /* bytes cached by plkr_GetRecordBytes */
 };
 
 /***********************************************************************/
@@ -20,6 +20,7 @@
 #include <qmutex.h>
 #include <qregexp.h>
 #include <qtextstream.h>
+#include <qtimer.h>
 #include <QtGui/QPrinter>
 #include <QtGui/QPainter>
 
@@ -427,7 +428,7 @@ PDFGenerator::PDFGenerator( QObject *parent, const QVariantList &args )
     : Generator( parent, args ), pdfdoc( 0 ),
     docSynopsisDirty( true ),
     docEmbeddedFilesDirty( true ), nextFontPage( 0 ),
-    annotProxy( 0 )
+    annotProxy( 0 ), pendingAnnotationsCount( 0 ), nextPendingAnnotationsPage( 0 )
 {
     setFeature( Threaded );
     setFeature( TextExtraction );
@@ -441,12 +442,17 @@ PDFGenerator::PDFGenerator( QObject *parent, const QVariantList &args )
         setFeature( PrintToFile );
     setFeature( ReadRawData );
     setFeature( TiledRendering );
+    setFeature( ThreadedLoading );
 
 #ifdef HAVE_POPPLER_0_16
     // You only need to do it once not for each of the documents but it is cheap enough
     // so doing it all the time won't hurt either
     Poppler::setDebugErrorFunction(PDFGeneratorPopplerDebugFunction, QVariant());
 #endif
+
+    annotationsTimer = new QTimer( this );
+    annotationsTimer->setSingleShot( true );
+    connect( annotationsTimer, SIGNAL(timeout()), this, SLOT(loadPendingAnnotations()) );
 }
 
 PDFGenerator::~PDFGenerator()
@@ -513,18 +519,17 @@ Okular::Document::OpenResult PDFGenerator::init(QVector<Okular::Page*> & pagesVe
 
     loadPages(pagesVector, 0, false);
 
-    // update the configuration
-    reparseConfig();
-
-    // create annotation proxy
-    annotProxy = new PopplerAnnotationProxy( pdfdoc, userMutex() );
-
     // the file has been loaded correctly
     return Okular::Document::OpenSuccess;
 }
 
 bool PDFGenerator::doCloseDocument()
 {
+    annotationsTimer->stop();
+    pendingAnnotationPages.clear();
+    pendingAnnotationsCount = 0;
+    nextPendingAnnotationsPage = 0;
+
     // remove internal objects
     userMutex()->lock();
     delete annotProxy;
@@ -548,6 +553,20 @@ void PDFGenerator::loadPages(QVector<Okular::Page*> &pagesVector, int rotation,
     // TODO XPDF 3.01 check
     const int count = pagesVector.count();
     double w = 0, h = 0;
+
+    // only what is needed to lay out the pages is read here, the
+    // annotations are fetched page by page later (see loadPendingAnnotations),
+    // as parsing them all makes opening big documents really slow
+    pendingAnnotationPages.fill( 0, count );
+    pendingAnnotationsCount = 0;
+    nextPendingAnnotationsPage = 0;
+    // the form widgets are created as soon as the pages are shown, so
+    // the form fields can't be loaded lazily
+#ifdef HAVE_POPPLER_0_22
+    const bool hasFormFields = pdfdoc->formType() != Poppler::Document::NoForm;
+#else
+    const bool hasFormFields = true;
+#endif
     for ( int i = 0; i < count ; i++ )
     {
         // get xpdf page
@@ -568,11 +587,11 @@ void PDFGenerator::loadPages(QVector<Okular::Page*> &pagesVector, int rotation,
             }
             if (rotation % 2 == 1)
             qSwap(w,h);
-            // init a Okular::page, add transition and annotation information
+            // init a Okular::page, add transition information
             page = new Okular::Page( i, w, h, orientation );
             addTransition( p, page );
-            if ( true ) //TODO real check
-            addAnnotations( p, page );
+            pendingAnnotationPages[i] = page;
+            ++pendingAnnotationsCount;
             Poppler::Link * tmplink = p->action( Poppler::Page::Opening );
             if ( tmplink )
             {
@@ -586,7 +605,8 @@ void PDFGenerator::loadPages(QVector<Okular::Page*> &pagesVector, int rotation,
             page->setDuration( p->duration() );
             page->setLabel( p->label() );
 
-            addFormFields( p, page );
+            if ( hasFormFields )
+                addFormFields( p, page );
 //        kWarning(PDFDebug).nospace() << page->width() << "x" << page->height();
 
 #ifdef PDFGENERATOR_DEBUG
@@ -606,6 +626,73 @@ void PDFGenerator::loadPages(QVector<Okular::Page*> &pagesVector, int rotation,
     }
 }
 
+void PDFGenerator::pagesLoaded()
+{
+    // the loading may have happened in a thread: the configuration, the
+    // annotation proxy and the timer are set up only now, in the GUI thread,
+    // when the pages are in the document
+    reparseConfig();
+    annotProxy = new PopplerAnnotationProxy( pdfdoc, userMutex() );
+
+    if ( pendingAnnotationsCount > 0 )
+        annotationsTimer->start( 0 );
+}
+
+bool PDFGenerator::loadPageAnnotations( int pageNumber )
+{
+    Okular::Page * page = pendingAnnotationPages.value( pageNumber );
+    if ( !page )
+        return false;
+
+    Poppler::Page * p = pdfdoc->page( pageNumber );
+    if ( p )
+    {
+        addAnnotations( p, page );
+        delete p;
+    }
+    pendingAnnotationPages[pageNumber] = 0;
+    --pendingAnnotationsCount;
+    return true;
+}
+
+void PDFGenerator::loadPendingAnnotations()
+{
+    if ( !pdfdoc || pendingAnnotationsCount == 0 )
+        return;
+
+    // don't stall the gui while a page is being rendered, just retry later
+    if ( !userMutex()->tryLock() )
+    {
+        annotationsTimer->start( 50 );
+        return;
+    }
+
+    // few pages at a time, starting from the ones around the current page
+    QList<int> loadedPages;
+    const int currentPage = document()->currentPage();
+    for ( int i = currentPage - 2; i <= currentPage + 2; ++i )
+    {
+        if ( loadPageAnnotations( i ) )
+            loadedPages.append( i );
+    }
+    const int count = pendingAnnotationPages.count();
+    while ( loadedPages.count() < 20 && nextPendingAnnotationsPage < count )
+    {
+        if ( loadPageAnnotations( nextPendingAnnotationsPage ) )
+            loadedPages.append( nextPendingAnnotationsPage );
+        ++nextPendingAnnotationsPage;
+    }
+    userMutex()->unlock();
+
+    foreach ( int page, loadedPages )
+        signalPageAnnotationsLoaded( page );
+
+    if ( pendingAnnotationsCount > 0 )
+        annotationsTimer->start( 20 );
+    else
+        pendingAnnotationPages.clear();
+}
+
 Okular::DocumentInfo PDFGenerator::generateDocumentInfo( const QSet<Okular::DocumentInfo::Key> &keys ) const
 {
     Okular::DocumentInfo docInfo;
@@ -811,6 +898,22 @@ bool PDFGenerator::isAllowed( Okular::Permission permission ) const
     return b;
 }
 
+void PDFGenerator::generatePixmap( Okular::PixmapRequest * request )
+{
+    // the page is going to be shown, so its annotations are needed now
+    const int pageNumber = request->pageNumber();
+    if ( pendingAnnotationPages.value( pageNumber ) )
+    {
+        userMutex()->lock();
+        const bool loaded = loadPageAnnotations( pageNumber );
+        userMutex()->unlock();
+        if ( loaded )
+            signalPageAnnotationsLoaded( pageNumber );
+    }
+
+    Generator::generatePixmap( request );
+}
+
 QImage PDFGenerator::image( Okular::PixmapRequest * request )
 {
     // debug requests to this (xpdf) generator
@@ -17,6 +17,7 @@
 
 #include <qbitarray.h>
 #include <qpointer.h>
+#include <qvector.h>
 
 #include <core/document.h>
 #include <core/generator.h>
@@ -31,6 +32,7 @@ class SourceReference;
 
 class PDFOptionsPage;
 class PopplerAnnotationProxy;
+class QTimer;
 
 /**
  * @short A generator that builds contents from a PDF document.
@@ -73,6 +75,7 @@ class PDFGenerator : public Okular::Generator, public Okular::ConfigInterface, p
         bool isAllowed( Okular::Permission permission ) const;
 
         // [INHERITED] perform actions on document / pages
+        void generatePixmap( Okular::PixmapRequest *request );
         QImage image( Okular::PixmapRequest *page );
 
         // [INHERITED] print page using an already configured kprinter
@@ -100,11 +103,16 @@ class PDFGenerator : public Okular::Generator, public Okular::ConfigInterface, p
     protected:
         bool doCloseDocument();
         Okular::TextPage* textPage( Okular::Page *page );
+        void pagesLoaded();
 
     protected slots:
         void requestFontData(const Okular::FontInfo &font, QByteArray *data);
         Okular::Generator::PrintError printError() const;
 
+    private slots:
+        // load the annotations of some of the pages still missing them
+        void loadPendingAnnotations();
+
     private:
         Okular::Document::OpenResult init(QVector<Okular::Page*> & pagesVector, const QString &password);
 
@@ -112,6 +120,9 @@ class PDFGenerator : public Okular::Generator, public Okular::ConfigInterface, p
         void addSynopsisChildren( QDomNode * parentSource, QDomNode * parentDestination );
         // fetch annotations from the pdf file and add they to the page
         void addAnnotations( Poppler::Page * popplerPage, Okular::Page * page );
+        // fetch the annotations of the page if they were not loaded yet,
+        // the userMutex must be locked; returns whether they were loaded now
+        bool loadPageAnnotations( int pageNumber );
         // fetch the transition information and add it to the page
         void addTransition( Poppler::Page * popplerPage, Okular::Page * page );
         // fetch the form fields and add them to the page
@@ -141,6 +152,12 @@ class PDFGenerator : public Okular::Generator, public Okular::ConfigInterface, p
 
         QBitArray rectsGenerated;
 
+        // the pages whose annotations are still to be loaded (0 when done)
+        QVector<Okular::Page*> pendingAnnotationPages;
+        int pendingAnnotationsCount;
+        int nextPendingAnnotationsPage;
+        QTimer *annotationsTimer;
+
         QPointer<PDFOptionsPage> pdfOptionsPage;
         
         PrintError lastPrintError;
@@ -25,8 +25,8 @@
 
 #include <core/document.h>
 #include <core/page.h>
+#include <core/page_p.h>
 #include <core/fileprinter.h>
-#include <core/utils.h>
 
 #include "ui_gssettingswidget.h"
 #include "gssettings.h"
@@ -58,6 +58,7 @@ GSGenerator::GSGenerator( QObject *parent, const QVariantList &args ) :
 {
     setFeature( PrintPostscript );
     setFeature( PrintToFile );
+    setFeature( TiledRendering );
 
     GSRendererThread *renderer = GSRendererThread::getCreateRenderer();
     if (!renderer->isRunning()) renderer->start();
@@ -190,13 +191,12 @@ void GSGenerator::slotImageGenerated(QImage *img, Okular::PixmapRequest *request
     // of all the generators attached to it
     if (request != m_request) return;
 
-    if ( !request->page()->isBoundingBoxKnown() )
-        updatePageBoundingBox( request->page()->number(), Okular::Utils::imageBoundingBox( img ) );
+    if ( !request->isTile() && Okular::PagePrivate::get( request->page() )->needsBoundingBox( qMax( request->width(), request->height() ) ) )
+        computePageBoundingBox( request->page()->number(), *img );
 
     m_request = 0;
-    QPixmap *pix = new QPixmap(QPixmap::fromImage(*img));
+    request->page()->setImage( request->observer(), *img, request->normalizedRect() );
     delete img;
-    request->page()->setPixmap( request->observer(), pix );
     signalPixmapRequestDone( request );
 }
 
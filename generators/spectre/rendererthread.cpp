@@ -14,6 +14,7 @@
 #include <kdebug.h>
 
 #include "core/generator.h"
+#include "core/imagekernels_p.h"
 #include "core/page.h"
 #include "core/utils.h"
 
@@ -68,61 +69,48 @@ void GSRendererThread::run()
             if ( req.orientation % 2 )
                 qSwap( wantedWidth, wantedHeight );
 
-            spectre_page_render(req.spectrePage, m_renderContext, &data, &row_length);
-
-            // Qt needs the missing alpha of QImage::Format_RGB32 to be 0xff
-            if (data && data[3] != 0xff)
+            QSize imageSize(req.request->width(), req.request->height());
+            if (req.request->isTile())
             {
-                for (int i = 3; i < row_length * wantedHeight; i += 4)
-                    data[i] = 0xff;
-            }
-
-            QImage img;
-            if (row_length == wantedWidth * 4)
-            {
-                img = QImage(data, wantedWidth, wantedHeight, QImage::Format_RGB32);
+                // only the tile is rendered: its area on the page as shown
+                // is taken back to the unrotated page Ghostscript renders
+                const QRect tileRect = req.request->normalizedRect().geometry(req.request->width(), req.request->height());
+                const QRect sliceRect = Okular::Utils::rotateRect(tileRect, wantedWidth, wantedHeight, (4 - req.orientation) % 4);
+                spectre_page_render_slice(req.spectrePage, m_renderContext, sliceRect.x(), sliceRect.y(),
+                                          sliceRect.width(), sliceRect.height(), &data, &row_length);
+                wantedWidth = sliceRect.width();
+                wantedHeight = sliceRect.height();
+                imageSize = tileRect.size();
             }
             else
             {
-                // In case this ends up beign very slow we can try with some memmove
-                QImage aux(data, row_length / 4, wantedHeight, QImage::Format_RGB32);
-                img = QImage(aux.copy(0, 0, wantedWidth, wantedHeight));
+                spectre_page_render(req.spectrePage, m_renderContext, &data, &row_length);
             }
 
-            switch (req.orientation)
+            QImage img;
+            if (data)
             {
-                case Okular::Rotation90:
-                {
-                    QTransform m;
-                    m.rotate(90);
-                    img = img.transformed( m );
-                    break;
-                }
-
-                case Okular::Rotation180:
-                {
-                    QTransform m;
-                    m.rotate(180);
-                    img = img.transformed( m );
-                    break;
-                }
-                case Okular::Rotation270:
-                {
-                    QTransform m;
-                    m.rotate(270);
-                    img = img.transformed( m );
-                }
+                // Qt needs the missing alpha of QImage::Format_RGB32 to be 0xff
+                if (data[3] != 0xff)
+                    Okular::ImageKernels::setOpaque(reinterpret_cast<quint32 *>(data), row_length / 4 * wantedHeight);
+
+                // the data is freed below, so it is copied once: by the
+                // rotation if any, else as is (skipping the padding of the rows)
+                const QImage rendered(data, qMin(wantedWidth, row_length / 4), wantedHeight, row_length, QImage::Format_RGB32);
+                if (req.orientation != Okular::Rotation0)
+                    img = Okular::ImageKernels::rotatedImage(rendered, req.orientation * 90);
+                else
+                    img = rendered.copy();
             }
-
-            QImage *image = new QImage(img.copy());
             free(data);
 
-            if (image->width() != req.request->width() || image->height() != req.request->height())
+            QImage *image = new QImage(img);
+            if (image->size() != imageSize)
             {
                 kWarning(4711).nospace() << "Generated image does not match wanted size: "
                     << "[" << image->width() << "x" << image->height() << "] vs requested "
-                    << "[" << req.request->width() << "x" << req.request->height() << "]";
-                QImage aux = image->scaled(wantedWidth, wantedHeight);
+                    << "[" << imageSize.width() << "x" << imageSize.height() << "]";
+                QImage aux = image->scaled(imageSize);
                 delete image;
                 image = new QImage(aux);
             }
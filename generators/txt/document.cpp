@@ -40,7 +40,7 @@ Document::~Document()
 {
 }
 
-QString Document::toUnicode( const QByteArray &array )
+QByteArray Document::detectEncoding( const QByteArray &array )
 {
     QByteArray encoding;
     KEncodingProber prober(KEncodingProber::Universal);
@@ -60,12 +60,21 @@ QString Document::toUnicode( const QByteArray &array )
         }
     }
 
+    if ( !encoding.isEmpty() )
+    {
+        kDebug() << "Detected" << prober.encoding() << "encoding"
+                 << "based on" << charsFeeded << "chars";
+    }
+    return encoding;
+}
+
+QString Document::toUnicode( const QByteArray &array )
+{
+    const QByteArray encoding = detectEncoding( array );
     if ( encoding.isEmpty() )
     {
         return QString();
     }
 
-    kDebug() << "Detected" << prober.encoding() << "encoding"
-             << "based on" << charsFeeded << "chars";
     return QTextCodec::codecForName( encoding )->toUnicode( array );
 }
@@ -18,6 +18,12 @@ namespace Txt
             Document( const QString &fileName );
             ~Document();
 
+            /**
+             * Returns the name of the encoding of the text @p array, or an
+             * empty one if it cannot be detected.
+             */
+            static QByteArray detectEncoding( const QByteArray &array );
+
         private:
             QString toUnicode( const QByteArray &array );
     };
@@ -10,10 +10,20 @@
 
 #include "generator_txt.h"
 #include "converter.h"
+#include "largedocument.h"
+
+#include <QtGui/QFontInfo>
+#include <QtGui/QFontMetricsF>
+#include <QtGui/QPainter>
 
 #include <kaboutdata.h>
+#include <kglobalsettings.h>
 #include <KConfigDialog>
 
+#include <core/page.h>
+#include <core/textpage.h>
+#include <core/textdocumentsettings.h>
+
 static KAboutData createAboutData()
 {
     KAboutData aboutData(
@@ -32,8 +42,135 @@ static KAboutData createAboutData()
 OKULAR_EXPORT_PLUGIN( TxtGenerator, createAboutData() )
 
 TxtGenerator::TxtGenerator( QObject *parent, const QVariantList &args )
-    : Okular::TextDocumentGenerator( new Txt::Converter, "okular_txt_generator_settings", parent, args )
+    : Okular::TextDocumentGenerator( new Txt::Converter, "okular_txt_generator_settings", parent, args ),
+      m_largeDocument( 0 )
+{
+}
+
+TxtGenerator::~TxtGenerator()
 {
+    delete m_largeDocument;
+}
+
+Okular::Document::OpenResult TxtGenerator::loadDocumentWithPassword( const QString & fileName, QVector<Okular::Page*> & pagesVector, const QString &password )
+{
+    // laying out a QTextDocument takes ages and lots of memory for large
+    // files, so these are mapped and split in pages of fixed pitch rows
+    Txt::LargeDocument *largeDocument = new Txt::LargeDocument;
+    if ( !largeDocument->load( fileName ) )
+    {
+        delete largeDocument;
+        return Okular::TextDocumentGenerator::loadDocumentWithPassword( fileName, pagesVector, password );
+    }
+
+    QFont font = generalSettings()->font();
+    if ( !QFontInfo( font ).fixedPitch() )
+        font = KGlobalSettings::fixedFont();
+    largeDocument->paginate( QSizeF( 600, 800 ), 20, font );
+    m_largeDocument = largeDocument;
+    m_paperColor = documentMetaData( "PaperColor", true ).value< QColor >();
+
+    const QSize size = m_largeDocument->pageSize().toSize();
+    pagesVector.resize( m_largeDocument->pageCount() );
+    for ( int i = 0; i < pagesVector.count(); ++i )
+        pagesVector[ i ] = new Okular::Page( i, size.width(), size.height(), Okular::Rotation0 );
+
+    return Okular::Document::OpenSuccess;
+}
+
+bool TxtGenerator::doCloseDocument()
+{
+    if ( !m_largeDocument )
+        return Okular::TextDocumentGenerator::doCloseDocument();
+
+    delete m_largeDocument;
+    m_largeDocument = 0;
+    return true;
+}
+
+Okular::DocumentInfo TxtGenerator::generateDocumentInfo( const QSet<Okular::DocumentInfo::Key> &keys ) const
+{
+    if ( !m_largeDocument )
+        return Okular::TextDocumentGenerator::generateDocumentInfo( keys );
+
+    Okular::DocumentInfo info;
+    info.set( Okular::DocumentInfo::MimeType, "text/plain" );
+    return info;
+}
+
+QImage TxtGenerator::image( Okular::PixmapRequest *request )
+{
+    if ( !m_largeDocument )
+        return Okular::TextDocumentGenerator::image( request );
+
+    QImage image( request->width(), request->height(), QImage::Format_ARGB32_Premultiplied );
+    image.fill( m_paperColor.rgb() );
+
+    const QSizeF size = m_largeDocument->pageSize();
+    const double margin = m_largeDocument->margin();
+    const double lineSpacing = m_largeDocument->lineSpacing();
+
+    QPainter p( &image );
+    p.scale( request->width() / size.width(), request->height() / size.height() );
+    p.setFont( m_largeDocument->font() );
+    // a text readable on the paper of the settings
+    p.setPen( qGray( m_paperColor.rgb() ) < 128 ? Qt::white : Qt::black );
+    const double ascent = QFontMetricsF( m_largeDocument->font() ).ascent();
+    const QStringList rows = m_largeDocument->pageRows( request->pageNumber() );
+    for ( int i = 0; i < rows.count(); ++i )
+    {
+        QString row = rows.at( i );
+        if ( row.endsWith( QLatin1Char( '\n' ) ) )
+            row.chop( 1 );
+        p.drawText( QPointF( margin, margin + ascent + i * lineSpacing ), row );
+    }
+
+    return image;
+}
+
+bool TxtGenerator::reparseConfig()
+{
+    const bool changed = Okular::TextDocumentGenerator::reparseConfig();
+    if ( !m_largeDocument )
+        return changed;
+
+    // like the PDF pages, these ones are painted on the paper color
+    const QColor paperColor = documentMetaData( "PaperColor", true ).value< QColor >();
+    if ( paperColor == m_paperColor )
+        return changed;
+
+    m_paperColor = paperColor;
+    return true;
+}
+
+Okular::TextPage* TxtGenerator::textPage( Okular::Page *page )
+{
+    if ( !m_largeDocument )
+        return Okular::TextDocumentGenerator::textPage( page );
+
+    const QSizeF size = m_largeDocument->pageSize();
+    const double margin = m_largeDocument->margin();
+    const double charWidth = m_largeDocument->charWidth();
+    const double lineSpacing = m_largeDocument->lineSpacing();
+
+    // all the characters have the same width, so no layout is needed
+    Okular::TextPage *textPage = new Okular::TextPage;
+    const QStringList rows = m_largeDocument->pageRows( page->number() );
+    for ( int i = 0; i < rows.count(); ++i )
+    {
+        const QString &row = rows.at( i );
+        const double top = ( margin + i * lineSpacing ) / size.height();
+        const double bottom = ( margin + ( i + 1 ) * lineSpacing ) / size.height();
+        for ( int j = 0; j < row.length(); ++j )
+        {
+            const double x = margin + j * charWidth;
+            const double width = row.at( j ) == QLatin1Char( '\n' ) ? 3 : charWidth;
+            textPage->append( row.mid( j, 1 ), new Okular::NormalizedRect( x / size.width(), top,
+                                                                             ( x + width ) / size.width(), bottom ) );
+        }
+    }
+
+    return textPage;
 }
 
 void TxtGenerator::addPages( KConfigDialog* dlg )
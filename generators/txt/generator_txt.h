@@ -12,16 +12,38 @@
 #define _TXT_GENERATOR_H_
 
 
+#include <QtGui/QColor>
+
 #include <core/textdocumentgenerator.h>
 
+namespace Txt {
+class LargeDocument;
+}
+
 class TxtGenerator : public Okular::TextDocumentGenerator
 {
     public:
         TxtGenerator( QObject *parent, const QVariantList &args );
-        ~TxtGenerator() {}
+        ~TxtGenerator();
+
+        // [INHERITED] load a document and fill up the pagesVector
+        Okular::Document::OpenResult loadDocumentWithPassword( const QString & fileName, QVector<Okular::Page*> & pagesVector, const QString &password );
+
+        Okular::DocumentInfo generateDocumentInfo( const QSet<Okular::DocumentInfo::Key> &keys ) const;
 
         // [INHERITED] reparse configuration
+        bool reparseConfig();
         void addPages( KConfigDialog* dlg );
+
+    protected:
+        bool doCloseDocument();
+        QImage image( Okular::PixmapRequest *request );
+        Okular::TextPage* textPage( Okular::Page *page );
+
+    private:
+        // set while a file too large for a QTextDocument is open
+        Txt::LargeDocument *m_largeDocument;
+        QColor m_paperColor;
 };
 
-#endif
\ No newline at end of file
+#endif
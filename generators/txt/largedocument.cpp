@@ -0,0 +1,199 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include <string.h>
+
+#include <QFontMetricsF>
+#include <QTextCodec>
+
+#include <kdebug.h>
+
+#include "document.h"
+#include "largedocument.h"
+
+using namespace Txt;
+
+// the encodings where a byte below 0x80 is always an ASCII character, and
+// each character is either a single byte or (UTF-8) a lead byte followed by
+// continuation bytes
+static bool isRowSplittable( const QTextCodec *codec, bool *utf8 )
+{
+    const int mib = codec->mibEnum();
+    *utf8 = mib == 106;
+    return *utf8
+           || mib == 3                          // US-ASCII
+           || ( mib >= 4 && mib <= 12 )         // ISO-8859-1..9
+           || ( mib >= 109 && mib <= 112 )      // ISO-8859-13..16
+           || mib == 13                         // ISO-8859-10
+           || ( mib >= 2250 && mib <= 2258 )    // windows-1250..1258
+           || mib == 2084 || mib == 2088;       // KOI8-R, KOI8-U
+}
+
+LargeDocument::LargeDocument()
+    : m_codec( 0 ), m_utf8( false ), m_margin( 0 ), m_charWidth( 1 ), m_lineSpacing( 1 ),
+      m_columns( 1 ), m_rows( 1 )
+{
+}
+
+bool LargeDocument::load( const QString &fileName )
+{
+    if ( !m_file.load( fileName ) || m_file.size() < MinimumSize )
+        return false;
+
+    // the first megabyte is enough to recognize the encoding
+    const QByteArray encoding = Document::detectEncoding( m_file.data( 0, qMin( m_file.size(), qint64( 1024 * 1024 ) ) ) );
+    m_codec = encoding.isEmpty() ? 0 : QTextCodec::codecForName( encoding );
+    if ( !m_codec || !isRowSplittable( m_codec, &m_utf8 ) )
+    {
+        m_file.close();
+        return false;
+    }
+
+    m_data = m_file.data();
+    return true;
+}
+
+void LargeDocument::paginate( const QSizeF &size, double margin, const QFont &font )
+{
+    m_pageSize = size;
+    m_margin = margin;
+    m_font = font;
+
+    const QFontMetricsF metrics( font );
+    m_charWidth = qMax( metrics.width( QLatin1Char( 'M' ) ), qreal( 1 ) );
+    m_lineSpacing = qMax( metrics.lineSpacing(), qreal( 1 ) );
+    m_columns = qMax( int( ( size.width() - 2 * margin ) / m_charWidth ), 1 );
+    m_rows = qMax( int( ( size.height() - 2 * margin ) / m_lineSpacing ), 1 );
+
+    m_pageOffsets.clear();
+    const qint64 dataSize = m_data.size();
+    qint64 offset = 0, end;
+    for ( int row = 0; offset < dataSize; ++row )
+    {
+        if ( row % m_rows == 0 )
+            m_pageOffsets.append( offset );
+        offset = nextRow( offset, &end );
+    }
+    if ( m_pageOffsets.isEmpty() )
+        m_pageOffsets.append( 0 );
+
+    kDebug() << m_pageOffsets.count() << "pages of" << m_rows << "rows of" << m_columns << "characters";
+}
+
+int LargeDocument::pageCount() const
+{
+    return m_pageOffsets.count();
+}
+
+QSizeF LargeDocument::pageSize() const
+{
+    return m_pageSize;
+}
+
+double LargeDocument::margin() const
+{
+    return m_margin;
+}
+
+QFont LargeDocument::font() const
+{
+    return m_font;
+}
+
+double LargeDocument::charWidth() const
+{
+    return m_charWidth;
+}
+
+double LargeDocument::lineSpacing() const
+{
+    return m_lineSpacing;
+}
+
+QStringList LargeDocument::pageRows( int page ) const
+{
+    QStringList rows;
+    if ( page < 0 || page >= m_pageOffsets.count() )
+        return rows;
+
+    const qint64 size = m_data.size();
+    qint64 offset = m_pageOffsets.at( page ), end;
+    for ( int row = 0; row < m_rows && offset < size; ++row )
+    {
+        const qint64 next = nextRow( offset, &end );
+        QString text = expandTabs( m_codec->toUnicode( m_data.constData() + offset, end - offset ) );
+        if ( next > end )
+            text += QLatin1Char( '\n' );
+        rows.append( text );
+        offset = next;
+    }
+    return rows;
+}
+
+// Returns where the row after the one starting at @p offset starts, and in
+// @p end where the text of the row ends (without the line end)
+qint64 LargeDocument::nextRow( qint64 offset, qint64 *end ) const
+{
+    const char *data = m_data.constData();
+    const qint64 size = m_data.size();
+
+    // the common case, a line shorter than a row and without tabs, is found
+    // with the (vectorized) memchr(): no character is more than a byte
+    const qint64 window = qMin( size - offset, qint64( m_columns ) );
+    const char *newline = static_cast< const char * >( memchr( data + offset, '\n', window ) );
+    if ( newline && !memchr( data + offset, '\t', newline - data - offset ) )
+    {
+        *end = newline - data;
+        if ( *end > offset && data[ *end - 1 ] == '\r' )
+            --*end;
+        return newline - data + 1;
+    }
+
+    // else count the columns
+    int column = 0;
+    qint64 i = offset;
+    for ( ; i < size; ++i )
+    {
+        const uchar c = data[ i ];
+        if ( c == '\n' )
+        {
+            *end = ( i > offset && data[ i - 1 ] == '\r' ) ? i - 1 : i;
+            return i + 1;
+        }
+        // a continuation byte is part of the previous character, and the
+        // carriage return of a line end takes no room
+        if ( ( m_utf8 && ( c & 0xc0 ) == 0x80 )
+             || ( c == '\r' && i + 1 < size && data[ i + 1 ] == '\n' ) )
+            continue;
+
+        const int nextColumn = c == '\t' ? ( column / TabWidth + 1 ) * TabWidth : column + 1;
+        if ( nextColumn > m_columns && column > 0 )
+            break;
+        column = nextColumn;
+    }
+    *end = i;
+    return i;
+}
+
+QString LargeDocument::expandTabs( const QString &row ) const
+{
+    if ( !row.contains( QLatin1Char( '\t' ) ) )
+        return row;
+
+    QString expanded;
+    expanded.reserve( m_columns );
+    for ( int i = 0; i < row.length(); ++i )
+    {
+        if ( row.at( i ) == QLatin1Char( '\t' ) )
+            expanded += QString( TabWidth - expanded.length() % TabWidth, QLatin1Char( ' ' ) );
+        else
+            expanded += row.at( i );
+    }
+    return expanded;
+}
@@ -0,0 +1,83 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef _TXT_LARGEDOCUMENT_H_
+#define _TXT_LARGEDOCUMENT_H_
+
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+#include <QtGui/QFont>
+
+#include <core/mappedfile_p.h>
+
+class QTextCodec;
+
+namespace Txt
+{
+    /**
+     * A plain text file too large to be laid out as a QTextDocument.
+     *
+     * The file is mapped in memory, and split in rows of a fixed number of
+     * characters (a fixed pitch font is used) and in pages of a fixed number
+     * of rows; only the offset of each page is kept, so only the rows of the
+     * pages shown or searched are decoded.
+     */
+    class LargeDocument
+    {
+        public:
+            LargeDocument();
+
+            /**
+             * Maps the file @p fileName, and returns whether it is in an
+             * encoding which can be split in rows without decoding it.
+             */
+            bool load( const QString &fileName );
+
+            /**
+             * Splits the document in pages of @p size with @p margin,
+             * written with @p font (with a fixed pitch).
+             */
+            void paginate( const QSizeF &size, double margin, const QFont &font );
+
+            int pageCount() const;
+            QSizeF pageSize() const;
+            double margin() const;
+            QFont font() const;
+            double charWidth() const;
+            double lineSpacing() const;
+
+            /**
+             * Returns the decoded rows of the page @p page, with the tabs
+             * expanded; a row ending a line ends with a newline.
+             */
+            QStringList pageRows( int page ) const;
+
+            static const qint64 MinimumSize = 8 * 1024 * 1024;
+            static const int TabWidth = 8;
+
+        private:
+            qint64 nextRow( qint64 offset, qint64 *end ) const;
+            QString expandTabs( const QString &row ) const;
+
+            Okular::MappedFile m_file;
+            QByteArray m_data;
+            QTextCodec *m_codec;
+            bool m_utf8;
+            QSizeF m_pageSize;
+            double m_margin;
+            QFont m_font;
+            double m_charWidth;
+            double m_lineSpacing;
+            int m_columns;
+            int m_rows;
+            QVector< qint64 > m_pageOffsets;
+    };
+}
+
+#endif
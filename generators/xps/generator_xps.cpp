@@ -29,6 +29,7 @@
 #include <klocale.h>
 #include <kurl.h>
 #include <QBuffer>
+#include <QCryptographicHash>
 #include <QImageReader>
 #include <QMutex>
 
@@ -521,7 +522,7 @@ static QString absolutePath( const QString &path, const QString &location )
 
    \see XPS specification 10.1.2
 */
-static QByteArray readFileOrDirectoryParts( const KArchiveEntry *entry, QString *pathOfFile = 0 )
+static QByteArray readFileOrDirectoryParts( const Okular::MappedFile &mappedFile, const KArchiveEntry *entry, QString *pathOfFile = 0 )
 {
     QByteArray data;
     if ( entry->isDirectory() ) {
@@ -533,12 +534,17 @@ static QByteArray readFileOrDirectoryParts( const KArchiveEntry *entry, QString
             if ( !relSubEntry->isFile() )
                 continue;
 
+            // the pieces are joined, a single one is kept in place
             const KZipFileEntry* relSubFile = static_cast<const KZipFileEntry *>( relSubEntry );
-            data.append( relSubFile->data() );
+            if ( data.isEmpty() )
+                data = mappedFile.zipEntryData( relSubFile );
+            else
+                data.append( mappedFile.zipEntryData( relSubFile ) );
         }
     } else {
+        // the stored files are read in place
         const KZipFileEntry* relFile = static_cast<const KZipFileEntry *>( entry );
-        data.append( relFile->data() );
+        data = mappedFile.zipEntryData( relFile );
         if ( pathOfFile ) {
             *pathOfFile = entryPath( relFile );
         }
@@ -546,6 +552,32 @@ static QByteArray readFileOrDirectoryParts( const KArchiveEntry *entry, QString
     return data;
 }
 
+/**
+   Adds to \p hash the names, sizes and checksums of the files in \p dir
+   which are not pages nor lists of pages, nor the \p skipped ones
+*/
+static void hashResources( QCryptographicHash *hash, const KArchiveDirectory *dir, const QString &path, const QStringList &skipped )
+{
+    QStringList entries = dir->entries();
+    qSort( entries );
+    Q_FOREACH ( const QString &name, entries ) {
+        const KArchiveEntry *entry = dir->entry( name );
+        const QString entryName = path + name;
+        if ( entryName.endsWith( ".fpage", Qt::CaseInsensitive ) || entryName.endsWith( ".fdoc", Qt::CaseInsensitive )
+             || entryName.endsWith( ".fdseq", Qt::CaseInsensitive ) || entryName.endsWith( ".rels", Qt::CaseInsensitive )
+             || skipped.contains( entryName, Qt::CaseInsensitive ) ) {
+            continue;
+        }
+        if ( entry->isDirectory() ) {
+            hashResources( hash, static_cast<const KArchiveDirectory *>( entry ), entryName + '/', skipped );
+        } else {
+            const KZipFileEntry *file = static_cast<const KZipFileEntry *>( entry );
+            hash->addData( entryName.toUtf8() );
+            hash->addData( QByteArray::number( file->size() ) + ' ' + QByteArray::number( qulonglong( file->crc32() ) ) );
+        }
+    }
+}
+
 /**
    Load the resource \p fileName from the specified \p archive using the case sensitivity \p cs
 */
@@ -1409,8 +1441,11 @@ XpsPage::XpsPage(XpsFile *file, const QString &fileName): m_file( file ),
 
     const KZipFileEntry* pageFile = static_cast<const KZipFileEntry *>(m_file->xpsArchive()->directory()->entry( fileName ));
 
+    const QByteArray data = readFileOrDirectoryParts( m_file->mappedFile(), pageFile );
+    m_fingerprint = QCryptographicHash::hash( data, QCryptographicHash::Md5 );
+
     QXmlStreamReader xml;
-    xml.addData( readFileOrDirectoryParts( pageFile ) );
+    xml.addData( data );
     while ( !xml.atEnd() )
     {
         xml.readNext();
@@ -1433,6 +1468,11 @@ XpsPage::~XpsPage()
     delete m_pageImage;
 }
 
+QByteArray XpsPage::fingerprint() const
+{
+    return m_fingerprint;
+}
+
 bool XpsPage::renderToImage( QImage *p )
 {
 
@@ -1466,7 +1506,7 @@ bool XpsPage::renderToPainter( QPainter *painter )
     parser.setContentHandler( &handler );
     parser.setErrorHandler( &handler );
     const KZipFileEntry* pageFile = static_cast<const KZipFileEntry *>(m_file->xpsArchive()->directory()->entry( m_fileName ));
-    QByteArray data = readFileOrDirectoryParts( pageFile );
+    QByteArray data = readFileOrDirectoryParts( m_file->mappedFile(), pageFile );
     QBuffer buffer( &data );
     QXmlInputSource source( &buffer );
     bool ok = parser.parse( source );
@@ -1519,7 +1559,9 @@ int XpsFile::loadFontByName( const QString &fileName )
         return -1;
     }
 
-    QByteArray fontData = readFileOrDirectoryParts( fontFile ); // once per file, according to the docs
+    QByteArray fontData = readFileOrDirectoryParts( m_mappedFile, fontFile ); // once per file, according to the docs
+    // the font database keeps it after the file is closed
+    fontData.detach();
 
     int result = m_fontDatabase.addApplicationFontFromData( fontData );
     if (-1 == result) {
@@ -1556,10 +1598,19 @@ int XpsFile::loadFontByName( const QString &fileName )
     return result; // a font ID
 }
 
+QByteArray XpsFile::resourcesFingerprint() const
+{
+    return m_resourcesFingerprint;
+}
+
 KZip * XpsFile::xpsArchive() {
     return m_xpsArchive;
 }
 
+const Okular::MappedFile &XpsFile::mappedFile() const {
+    return m_mappedFile;
+}
+
 QImage XpsPage::loadImageFromFile( const QString &fileName )
 {
     // kDebug(XpsDebug) << "image file name: " << fileName;
@@ -1589,7 +1640,7 @@ QImage XpsPage::loadImageFromFile( const QString &fileName )
     */
 
     QImage image;
-    QByteArray data = imageFile->data();
+    QByteArray data = m_file->mappedFile().zipEntryData( imageFile );
 
     QBuffer buffer(&data);
     buffer.open(QBuffer::ReadOnly);
@@ -1615,7 +1666,7 @@ Okular::TextPage* XpsPage::textPage()
 
     const KZipFileEntry* pageFile = static_cast<const KZipFileEntry *>(m_file->xpsArchive()->directory()->entry( m_fileName ));
     QXmlStreamReader xml;
-    xml.addData( readFileOrDirectoryParts( pageFile ) );
+    xml.addData( readFileOrDirectoryParts( m_file->mappedFile(), pageFile ) );
 
     QTransform matrix = QTransform();
     QStack<QTransform> matrices;
@@ -1796,7 +1847,7 @@ XpsDocument::XpsDocument(XpsFile *file, const QString &fileName): m_file(file),
     const QString documentEntryPath = entryPath( fileName );
 
     QXmlStreamReader docXml;
-    docXml.addData( readFileOrDirectoryParts( documentEntry, &documentFilePath ) );
+    docXml.addData( readFileOrDirectoryParts( file->mappedFile(), documentEntry, &documentFilePath ) );
     while( !docXml.atEnd() ) {
         docXml.readNext();
         if ( docXml.isStartElement() ) {
@@ -1835,7 +1886,7 @@ XpsDocument::XpsDocument(XpsFile *file, const QString &fileName): m_file(file),
     QString documentStructureFile;
     if ( relFile ) {
         QXmlStreamReader xml;
-        xml.addData( readFileOrDirectoryParts( relFile ) );
+        xml.addData( readFileOrDirectoryParts( file->mappedFile(), relFile ) );
         while ( !xml.atEnd() )
         {
             xml.readNext();
@@ -1914,6 +1965,7 @@ bool XpsFile::loadDocument(const QString &filename)
         delete m_xpsArchive;
         return false;
     }
+    m_mappedFile.load( filename );
 
     // The only fixed entry in XPS is /_rels/.rels
     const KArchiveEntry* relEntry = m_xpsArchive->directory()->entry("_rels/.rels");
@@ -1923,7 +1975,7 @@ bool XpsFile::loadDocument(const QString &filename)
     }
 
     QXmlStreamReader relXml;
-    relXml.addData( readFileOrDirectoryParts( relEntry ) );
+    relXml.addData( readFileOrDirectoryParts( m_mappedFile, relEntry ) );
 
     QString fixedRepresentationFileName;
     // We work through the relationships document and pull out each element.
@@ -1967,7 +2019,7 @@ bool XpsFile::loadDocument(const QString &filename)
     QString fixedRepresentationFilePath = fixedRepresentationFileName;
 
     QXmlStreamReader fixedRepXml;
-    fixedRepXml.addData( readFileOrDirectoryParts( fixedRepEntry, &fixedRepresentationFileName ) );
+    fixedRepXml.addData( readFileOrDirectoryParts( m_mappedFile, fixedRepEntry, &fixedRepresentationFileName ) );
 
     while ( !fixedRepXml.atEnd() )
     {
@@ -1993,6 +2045,17 @@ bool XpsFile::loadDocument(const QString &filename)
         return false;
     }
 
+    // the metadata changes at every save, without changing the pages
+    QStringList skipped;
+    skipped << m_corePropertiesFileName << m_thumbnailFileName << m_signatureOrigin;
+    for ( int i = 0; i < skipped.count(); ++i ) {
+        if ( skipped.at( i ).startsWith( '/' ) )
+            skipped[ i ] = skipped.at( i ).mid( 1 );
+    }
+    QCryptographicHash hash( QCryptographicHash::Md5 );
+    hashResources( &hash, m_xpsArchive->directory(), QString(), skipped );
+    m_resourcesFingerprint = hash.result();
+
     return true;
 }
 
@@ -2056,6 +2119,7 @@ bool XpsFile::closeDocument()
     m_documents.clear();
 
     delete m_xpsArchive;
+    m_mappedFile.close();
 
     return true;
 }
@@ -2150,6 +2214,18 @@ Okular::TextPage* XpsGenerator::textPage( Okular::Page * page )
     return xpsPage->textPage();
 }
 
+QVariant XpsGenerator::metaData( const QString & key, const QVariant & option ) const
+{
+    if ( key == "PageFingerprint" )
+    {
+        const int pageNumber = option.toInt();
+        if ( pageNumber < 0 || pageNumber >= m_xpsFile->numPages() )
+            return QVariant();
+        return m_xpsFile->page( pageNumber )->fingerprint() + m_xpsFile->resourcesFingerprint();
+    }
+    return QVariant();
+}
+
 Okular::DocumentInfo XpsGenerator::generateDocumentInfo( const QSet<Okular::DocumentInfo::Key> &keys ) const
 {
     kDebug(XpsDebug) << "generating document metadata";
@@ -21,6 +21,7 @@
 #define _OKULAR_GENERATOR_XPS_H_
 
 #include <core/generator.h>
+#include <core/mappedfile_p.h>
 #include <core/textpage.h>
 
 #include <QColor>
@@ -159,11 +160,17 @@ public:
 
     QImage loadImageFromFile( const QString &filename );
 
+    /**
+       a hash of the page part, which changes with the page
+    */
+    QByteArray fingerprint() const;
+
 private:
     XpsFile *m_file;
     const QString m_fileName;
 
     QSizeF m_pageSize;
+    QByteArray m_fingerprint;
 
 
     QString m_thumbnailFileName;
@@ -274,6 +281,18 @@ public:
 
     KZip* xpsArchive();
 
+    /**
+       the contents of the archive, to read the parts stored without
+       compression in place
+    */
+    const Okular::MappedFile &mappedFile() const;
+
+    /**
+       a hash of the checksums of the parts shared by the pages (fonts,
+       images, ...), which are not part of the fingerprints of the pages
+    */
+    QByteArray resourcesFingerprint() const;
+
 
 private:
     int loadFontByName( const QString &fontName );
@@ -291,6 +310,8 @@ private:
     QString m_signatureOrigin;
 
     KZip * m_xpsArchive;
+    Okular::MappedFile m_mappedFile;
+    QByteArray m_resourcesFingerprint;
 
     QMap<QString, int> m_fontCache;
     QFontDatabase m_fontDatabase;
@@ -314,6 +335,8 @@ class XpsGenerator : public Okular::Generator
 
         bool print( QPrinter &printer );
 
+        QVariant metaData( const QString & key, const QVariant & option ) const;
+
     protected:
         bool doCloseDocument();
         QImage image( Okular::PixmapRequest *page );
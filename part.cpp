@@ -305,7 +305,8 @@ const QVariantList &args,
 KComponentData componentData )
 : KParts::ReadWritePart(parent),
 m_tempfile( 0 ), m_fileWasRemoved( false ), m_showMenuBarAction( 0 ), m_showFullScreenAction( 0 ), m_actionsSearched( false ),
-m_cliPresentation(false), m_cliPrint(false), m_embedMode(detectEmbedMode(parentWidget, parent, args)), m_generatorGuiClient(0), m_keeper( 0 )
+m_cliPresentation(false), m_cliPrint(false), m_embedMode(detectEmbedMode(parentWidget, parent, args)), m_generatorGuiClient(0), m_keeper( 0 ),
+m_openCompressedFile( false ), m_openingFile( false ), m_openFileOk( false ), m_reloading( false ), m_showSourceLocationGraphically( false )
 {
     // first, we check if a config file name has been specified
     QString configFileName = detectConfigFileName( args );
@@ -360,6 +361,7 @@ m_cliPresentation(false), m_cliPrint(false), m_embedMode(detectEmbedMode(parentW
     connect( m_document, SIGNAL(openUrl(KUrl)), this, SLOT(openUrlFromDocument(KUrl)) );
     connect( m_document->bookmarkManager(), SIGNAL(openUrl(KUrl)), this, SLOT(openUrlFromBookmarks(KUrl)) );
     connect( m_document, SIGNAL(close()), this, SLOT(close()) );
+    connect( m_document, SIGNAL(openDocumentFinished(Okular::Document::OpenResult)), this, SLOT(slotOpenDocumentFinished(Okular::Document::OpenResult)) );
 
     if ( parent && parent->metaObject()->indexOfSlot( QMetaObject::normalizedSignature( "slotQuit()" ) ) != -1 )
         connect( m_document, SIGNAL(quit()), parent, SLOT(slotQuit()) );
@@ -462,6 +464,7 @@ m_cliPresentation(false), m_cliPrint(false), m_embedMode(detectEmbedMode(parentW
     connect( m_document, SIGNAL(warning(QString,int)), this, SLOT(warningMessage(QString,int)) );
     connect( m_document, SIGNAL(notice(QString,int)), this, SLOT(noticeMessage(QString,int)) );
     connect( m_document, SIGNAL(sourceReferenceActivated(const QString&,int,int,bool*)), this, SLOT(slotHandleActivatedSourceReference(const QString&,int,int,bool*)) );
+    connect( m_document, SIGNAL(pendingSourceLocationShown(Okular::DocumentViewport)), this, SLOT(slotPendingSourceLocationShown(Okular::DocumentViewport)) );
     connect( m_pageView, SIGNAL(fitWindowToPage(QSize,QSize)), this, SIGNAL(fitWindowToPage(QSize,QSize)) );
     rightLayout->addWidget( m_pageView );
     m_layers->setPageView( m_pageView );
@@ -930,6 +933,7 @@ void Part::showSourceLocation(const QString& fileName, int line, int column, boo
 {
     const QString u = QString( "src:%1 %2" ).arg( line + 1 ).arg( fileName );
     GotoAction action( QString(), u );
+    m_showSourceLocationGraphically = showGraphically;
     m_document->processAction( &action );
     if( showGraphically )
     {
@@ -937,6 +941,15 @@ void Part::showSourceLocation(const QString& fileName, int line, int column, boo
     }
 }
 
+void Part::slotPendingSourceLocationShown(const Okular::DocumentViewport &viewport)
+{
+    // the SyncTeX file was still loading when showSourceLocation() was called
+    if( m_showSourceLocationGraphically )
+    {
+        m_pageView->setLastSourceLocationViewport( viewport );
+    }
+}
+
 void Part::clearLastShownSourceLocation()
 {
     m_pageView->clearLastSourceLocationViewport();
@@ -1219,107 +1232,111 @@ static void addFileToWatcher( KDirWatch *watcher, const QString &filePath)
     if ( fi.isSymLink() ) watcher->addFile( fi.readLink() );
 }
 
-Document::OpenResult Part::doOpenFile( const KMimeType::Ptr &mimeA, const QString &fileNameToOpenA, bool *isCompressedFile )
+void Part::openNextMimeType()
 {
-    Document::OpenResult openResult = Document::OpenError;
     bool uncompressOk = true;
-    KMimeType::Ptr mime = mimeA;
-    QString fileNameToOpen = fileNameToOpenA;
+    KMimeType::Ptr mime = m_openMimes.takeFirst();
+    m_openMime = mime;
+    QString fileNameToOpen = localFilePath();
     QString compressedMime = compressedMimeFor( mime->name() );
     if ( compressedMime.isEmpty() )
         compressedMime = compressedMimeFor( mime->parentMimeType() );
     if ( !compressedMime.isEmpty() )
     {
-        *isCompressedFile = true;
+        m_openCompressedFile = true;
         uncompressOk = handleCompressed( fileNameToOpen, localFilePath(), compressedMime );
         mime = KMimeType::findByPath( fileNameToOpen );
     }
     else
     {
-        *isCompressedFile = false;
+        m_openCompressedFile = false;
     }
+    m_openFileName = fileNameToOpen;
 
     isDocumentArchive = false;
-    if ( uncompressOk )
+    if ( !uncompressOk )
     {
-        if ( mime->is( "application/vnd.kde.okular-archive" ) )
-        {
-            openResult = m_document->openDocumentArchive( fileNameToOpen,  url() );
-            isDocumentArchive = true;
-        }
-        else
-        {
-            openResult = m_document->openDocument( fileNameToOpen,  url(), mime );
-        }
-
-        // if the file didn't open correctly it might be encrypted, so ask for a pass
-        QString walletName, walletFolder, walletKey;
-        m_document->walletDataForFile(fileNameToOpen, &walletName, &walletFolder, &walletKey);
-        bool firstInput = true;
-        bool triedWallet = false;
-        KWallet::Wallet * wallet = 0;
-        bool keep = true;
-        while ( openResult == Document::OpenNeedsPassword )
-        {
-            QString password;
+        slotOpenDocumentFinished( Document::OpenError );
+    }
+    else if ( mime->is( "application/vnd.kde.okular-archive" ) )
+    {
+        isDocumentArchive = true;
+        slotOpenDocumentFinished( m_document->openDocumentArchive( fileNameToOpen, url() ) );
+    }
+    else
+    {
+        // slotOpenDocumentFinished() is called once the document is loaded
+        m_document->openDocumentAsynchronously( fileNameToOpen, url(), mime );
+    }
+}
 
-            // 1.A. try to retrieve the first password from the kde wallet system
-            if ( !triedWallet && !walletKey.isNull() )
-            {
-                const WId parentwid = widget()->effectiveWinId();
-                wallet = KWallet::Wallet::openWallet( walletName, parentwid );
-                if ( wallet )
-                {
-                    // use the KPdf folder (and create if missing)
-                    if ( !wallet->hasFolder( walletFolder ) )
-                        wallet->createFolder( walletFolder );
-                    wallet->setFolder( walletFolder );
-
-                    // look for the pass in that folder
-                    QString retrievedPass;
-                    if ( !wallet->readPassword( walletKey, retrievedPass ) )
-                        password = retrievedPass;
-                }
-                triedWallet = true;
-            }
+Document::OpenResult Part::openWithPassword()
+{
+    Document::OpenResult openResult = Document::OpenNeedsPassword;
+    const QString fileNameToOpen = m_openFileName;
+    const KMimeType::Ptr mime = m_openCompressedFile ? KMimeType::findByPath( fileNameToOpen ) : m_openMime;
+    QString walletName, walletFolder, walletKey;
+    m_document->walletDataForFile(fileNameToOpen, &walletName, &walletFolder, &walletKey);
+    bool firstInput = true;
+    bool triedWallet = false;
+    KWallet::Wallet * wallet = 0;
+    bool keep = true;
+    while ( openResult == Document::OpenNeedsPassword )
+    {
+        QString password;
 
-            // 1.B. if not retrieved, ask the password using the kde password dialog
-            if ( password.isNull() )
+        // 1.A. try to retrieve the first password from the kde wallet system
+        if ( !triedWallet && !walletKey.isNull() )
+        {
+            const WId parentwid = widget()->effectiveWinId();
+            wallet = KWallet::Wallet::openWallet( walletName, parentwid );
+            if ( wallet )
             {
-                QString prompt;
-                if ( firstInput )
-                    prompt = i18n( "Please enter the password to read the document:" );
-                else
-                    prompt = i18n( "Incorrect password. Try again:" );
-                firstInput = false;
-
-                // if the user presses cancel, abort opening
-                KPasswordDialog dlg( widget(), wallet ? KPasswordDialog::ShowKeepPassword : KPasswordDialog::KPasswordDialogFlags() );
-                dlg.setCaption( i18n( "Document Password" ) );
-                dlg.setPrompt( prompt );
-                if( !dlg.exec() )
-                    break;
-                password = dlg.password();
-                if ( wallet )
-                    keep = dlg.keepPassword();
+                // use the KPdf folder (and create if missing)
+                if ( !wallet->hasFolder( walletFolder ) )
+                    wallet->createFolder( walletFolder );
+                wallet->setFolder( walletFolder );
+
+                // look for the pass in that folder
+                QString retrievedPass;
+                if ( !wallet->readPassword( walletKey, retrievedPass ) )
+                    password = retrievedPass;
             }
+            triedWallet = true;
+        }
 
-            // 2. reopen the document using the password
-            if ( mime->is( "application/vnd.kde.okular-archive" ) )
-            {
-                openResult = m_document->openDocumentArchive( fileNameToOpen,  url(), password );
-                isDocumentArchive = true;
-            }
+        // 1.B. if not retrieved, ask the password using the kde password dialog
+        if ( password.isNull() )
+        {
+            QString prompt;
+            if ( firstInput )
+                prompt = i18n( "Please enter the password to read the document:" );
             else
-            {
-                openResult = m_document->openDocument( fileNameToOpen,  url(), mime, password );
-            }
+                prompt = i18n( "Incorrect password. Try again:" );
+            firstInput = false;
+
+            // if the user presses cancel, abort opening
+            KPasswordDialog dlg( widget(), wallet ? KPasswordDialog::ShowKeepPassword : KPasswordDialog::KPasswordDialogFlags() );
+            dlg.setCaption( i18n( "Document Password" ) );
+            dlg.setPrompt( prompt );
+            if( !dlg.exec() )
+                break;
+            password = dlg.password();
+            if ( wallet )
+                keep = dlg.keepPassword();
+        }
 
-            // 3. if the password is correct and the user chose to remember it, store it to the wallet
-            if ( openResult == Document::OpenSuccess && wallet && /*safety check*/ wallet->isOpen() && keep )
-            {
-                wallet->writePassword( walletKey, password );
-            }
+        // 2. reopen the document using the password, waiting for it since
+        // the user is already waiting for the dialog
+        if ( isDocumentArchive )
+            openResult = m_document->openDocumentArchive( fileNameToOpen,  url(), password );
+        else
+            openResult = m_document->openDocument( fileNameToOpen,  url(), mime, password );
+
+        // 3. if the password is correct and the user chose to remember it, store it to the wallet
+        if ( openResult == Document::OpenSuccess && wallet && /*safety check*/ wallet->isOpen() && keep )
+        {
+            wallet->writePassword( walletKey, password );
         }
     }
 
@@ -1367,19 +1384,56 @@ bool Part::openFile()
         mimes << pathMime;
     }
 
-    KMimeType::Ptr mime;
-    Document::OpenResult openResult = Document::OpenError;
-    bool isCompressedFile = false;
-    while ( !mimes.isEmpty() && openResult == Document::OpenError ) {
-        mime = mimes.takeFirst();
-        openResult = doOpenFile( mime, fileNameToOpen, &isCompressedFile );
+    // the mimetypes are tried in turn until one opens the document
+    m_openMimes = mimes;
+    m_openingFile = true;
+    m_openFileOk = true;
+    openNextMimeType();
+    m_openingFile = false;
+
+    // the generators loading in a thread are not done yet, the rest
+    // happens in slotOpenDocumentFinished()
+    return m_openFileOk;
+}
+
+void Part::slotOpenDocumentFinished( Okular::Document::OpenResult openResult )
+{
+    // if the file didn't open correctly it might be encrypted, so ask for a pass
+    if ( openResult == Document::OpenNeedsPassword )
+        openResult = openWithPassword();
+
+    if ( openResult == Document::OpenError && !m_openMimes.isEmpty() )
+    {
+        openNextMimeType();
+        return;
+    }
+
+    const KUrl openedUrl = url();
+    const bool ok = documentOpened( openResult == Document::OpenSuccess );
+    if ( m_openingFile )
+    {
+        m_openFileOk = ok;
+        return;
     }
 
+    // openFile() returned before: finish what openUrl() (or the reload) does
+    // after it
+    if ( !ok )
+        emit canceled( QString() );
+    if ( m_reloading )
+        reloadFinished( ok );
+    else if ( ok )
+        setWindowTitleFromDocument();
+    else
+        KMessageBox::error( widget(), i18n("Could not open %1", openedUrl.pathOrUrl() ) );
+}
+
+bool Part::documentOpened( bool ok )
+{
     bool canSearch = m_document->supportsSearching();
-    emit mimeTypeChanged( mime );
+    emit mimeTypeChanged( m_openMime );
 
     // update one-time actions
-    const bool ok = openResult == Document::OpenSuccess;
     emit enableCloseAction( ok );
     m_find->setEnabled( ok && canSearch );
     m_findNext->setEnabled( ok && canSearch );
@@ -1427,13 +1481,13 @@ bool Part::openFile()
                 menu->addAction( actionForExportFormat( *it ) );
             }
         }
-        if ( isCompressedFile )
+        if ( m_openCompressedFile )
         {
             m_realUrl = url();
         }
 #ifdef OKULAR_KEEP_FILE_OPEN
         if ( keepFileOpen() )
-            m_keeper->open( fileNameToOpen );
+            m_keeper->open( localFilePath() );
 #endif
     }
     if ( m_exportAsText ) m_exportAsText->setEnabled( ok && m_document->canExportToText() );
@@ -1501,6 +1555,7 @@ bool Part::openUrl(const KUrl &_url)
     // Close current document if any
     if ( !closeUrl() )
         return false;
+    m_reloading = false;
 
     KUrl url( _url );
     if ( url.hasHTMLRef() )
@@ -1762,9 +1817,11 @@ void Part::slotDoFileDirty()
         m_pageView->displayMessage( i18n("Reloading the document...") );
     }
 
-    // close and (try to) reopen the document
+    // close and (try to) reopen the document, rendering again only the pages that changed
+    m_document->keepPagesForReload();
     if ( !closeUrl() )
     {
+        m_document->keepPagesForReload( false );
         m_viewportDirty.pageNumber = -1;
 
         if ( tocReloadPrepared ) 
@@ -1780,7 +1837,17 @@ void Part::slotDoFileDirty()
     // inform the user about the operation in progress
     m_pageView->displayMessage( i18n("Reloading the document...") );
 
-    if ( KParts::ReadWritePart::openUrl( m_oldUrl ) )
+    // the previous state is restored once the document is loaded
+    m_reloading = true;
+    const bool ok = KParts::ReadWritePart::openUrl( m_oldUrl );
+    if ( !ok || !m_document->isLoading() )
+        reloadFinished( ok );
+}
+
+void Part::reloadFinished( bool ok )
+{
+    m_reloading = false;
+    if ( ok )
     {
         // on successful opening, restore the previous viewport
         if ( m_viewportDirty.pageNumber >= (int) m_document->pages() )
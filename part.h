@@ -237,7 +237,10 @@ class OKULAR_PART_EXPORT Part : public KParts::ReadWritePart, public Okular::Doc
         void moveSplitter( const int sideWidgetSize );
 
     private:
-        Document::OpenResult doOpenFile(const KMimeType::Ptr &mime, const QString &fileNameToOpen, bool *isCompressedFile);
+        void openNextMimeType();
+        Document::OpenResult openWithPassword();
+        bool documentOpened( bool ok );
+        void reloadFinished( bool ok );
 
         void setupViewerActions();
         void setViewerShortcuts();
@@ -349,12 +352,26 @@ class OKULAR_PART_EXPORT Part : public KParts::ReadWritePart, public Okular::Doc
         KXMLGUIClient *m_generatorGuiClient;
         FileKeeper *m_keeper;
 
+        // the document being opened, see openFile()
+        QList<KMimeType::Ptr> m_openMimes;
+        KMimeType::Ptr m_openMime;
+        QString m_openFileName;
+        bool m_openCompressedFile;
+        bool m_openingFile;
+        bool m_openFileOk;
+        bool m_reloading;
+
+        // whether the last source location asked is marked in the page view
+        bool m_showSourceLocationGraphically;
+
         // Timer for m_infoMessage
         QTimer *m_infoTimer;
 
     private slots:
+        void slotOpenDocumentFinished( Okular::Document::OpenResult openResult );
         void slotAnnotationPreferences();
         void slotHandleActivatedSourceReference(const QString& absFileName, int line, int col, bool *handled);
+        void slotPendingSourceLocationShown(const Okular::DocumentViewport &viewport);
 };
 
 class PartFactory : public KPluginFactory
@@ -9,11 +9,18 @@
 
 #include <qtest_kde.h>
 
+#include <ktemporaryfile.h>
+#include <kzip.h>
 #include <threadweaver/ThreadWeaver.h>
+#include <QtXml/QDomDocument>
 
+#include "../core/annotations.h"
 #include "../core/document.h"
+#include "../core/document_p.h"
 #include "../core/generator.h"
 #include "../core/observer.h"
+#include "../core/page.h"
+#include "../core/page_p.h"
 #include "../core/rotationjob_p.h"
 #include "../settings_core.h"
 
@@ -24,6 +31,12 @@ class DocumentTest
 
     private slots:
         void testCloseDuringRotationJob();
+        void testDocdataRoundTrip();
+        void testCacheFileName();
+        void testBoundingBoxDocdata();
+        void testKeepPagesForReload();
+        void testDocumentArchive_data();
+        void testDocumentArchive();
 };
 
 // Test that we don't crash if the document is closed while a RotationJob
@@ -58,5 +71,234 @@ void DocumentTest::testCloseDuringRotationJob()
     qApp->processEvents();
 }
 
+// Test that the annotations saved in the docdata file when closing the
+// document are restored when opening it again
+void DocumentTest::testDocdataRoundTrip()
+{
+    Okular::SettingsCore::instance( "documenttest" );
+    const QString testFile = KDESRCDIR "data/file1.pdf";
+    const KUrl testUrl( testFile );
+    const KMimeType::Ptr mime = KMimeType::findByPath( testFile );
+    const QString docDataPath = Okular::DocumentPrivate::docDataFileName( testUrl, QFileInfo( testFile ).size() );
+    QFile::remove( docDataPath );
+
+    Okular::Document *m_document = new Okular::Document( 0 );
+    QCOMPARE( m_document->openDocument( testFile, testUrl, mime ), Okular::Document::OpenSuccess );
+
+    Okular::Annotation *annot = new Okular::TextAnnotation();
+    annot->setBoundingRectangle( Okular::NormalizedRect( 0.1, 0.1, 0.15, 0.15 ) );
+    annot->setContents( "<docdata> & \"contents\"" );
+    m_document->addPageAnnotation( 0, annot );
+    const QString annotName = annot->uniqueName();
+    m_document->closeDocument();
+
+    // the saved file is complete and well formed
+    QFile docData( docDataPath );
+    QVERIFY( docData.open( QIODevice::ReadOnly ) );
+    QDomDocument doc;
+    QVERIFY( doc.setContent( &docData ) );
+    docData.close();
+    QCOMPARE( doc.documentElement().tagName(), QString( "documentInfo" ) );
+    QCOMPARE( doc.documentElement().firstChildElement( "pageList" ).elementsByTagName( "annotation" ).count(), 1 );
+
+    QCOMPARE( m_document->openDocument( testFile, testUrl, mime ), Okular::Document::OpenSuccess );
+    QCOMPARE( m_document->page( 0 )->annotations().count(), 1 );
+    const Okular::Annotation *restored = m_document->page( 0 )->annotations().first();
+    QCOMPARE( restored->uniqueName(), annotName );
+    QCOMPARE( restored->contents(), QString( "<docdata> & \"contents\"" ) );
+    m_document->closeDocument();
+
+    delete m_document;
+    QFile::remove( docDataPath );
+}
+
+// Test that the cache files are next to the docdata file, only for local
+// documents
+void DocumentTest::testCacheFileName()
+{
+    Okular::SettingsCore::instance( "documenttest" );
+    const QString testFile = KDESRCDIR "data/file1.pdf";
+    const KUrl testUrl( testFile );
+    const KMimeType::Ptr mime = KMimeType::findByPath( testFile );
+    QString docDataPath = Okular::DocumentPrivate::docDataFileName( testUrl, QFileInfo( testFile ).size() );
+    docDataPath.chop( 4 );
+
+    Okular::Document *m_document = new Okular::Document( 0 );
+    QCOMPARE( m_document->cacheFileName( ".thumbnails" ), QString() );
+    QCOMPARE( m_document->openDocument( testFile, testUrl, mime ), Okular::Document::OpenSuccess );
+    QCOMPARE( m_document->cacheFileName( ".thumbnails" ), docDataPath + ".thumbnails" );
+    m_document->closeDocument();
+    QCOMPARE( m_document->cacheFileName( ".thumbnails" ), QString() );
+
+    delete m_document;
+}
+
+// Test that the bounding boxes are saved in the docdata file only when
+// Trim Margins needs them, and that a larger rendering finds them again
+void DocumentTest::testBoundingBoxDocdata()
+{
+    Okular::SettingsCore::instance( "documenttest" );
+    const QString testFile = KDESRCDIR "data/file1.pdf";
+    const KUrl testUrl( testFile );
+    const KMimeType::Ptr mime = KMimeType::findByPath( testFile );
+    const QString docDataPath = Okular::DocumentPrivate::docDataFileName( testUrl, QFileInfo( testFile ).size() );
+    QFile::remove( docDataPath );
+    const Okular::NormalizedRect bbox( 0.1, 0.2, 0.8, 0.9 );
+
+    Okular::Document *m_document = new Okular::Document( 0 );
+    QCOMPARE( m_document->openDocument( testFile, testUrl, mime ), Okular::Document::OpenSuccess );
+    Okular::Page *page = const_cast< Okular::Page * >( m_document->page( 0 ) );
+    page->setBoundingBox( bbox );
+    Okular::PagePrivate::get( page )->m_boundingBoxResolution = 200;
+    m_document->closeDocument();
+
+    QCOMPARE( m_document->openDocument( testFile, testUrl, mime ), Okular::Document::OpenSuccess );
+    QVERIFY( !m_document->page( 0 )->isBoundingBoxKnown() );
+    page = const_cast< Okular::Page * >( m_document->page( 0 ) );
+    page->setBoundingBox( bbox );
+    Okular::PagePrivate::get( page )->m_boundingBoxResolution = 200;
+    m_document->setBoundingBoxesNeeded( true );
+    m_document->closeDocument();
+    m_document->setBoundingBoxesNeeded( false );
+
+    QCOMPARE( m_document->openDocument( testFile, testUrl, mime ), Okular::Document::OpenSuccess );
+    page = const_cast< Okular::Page * >( m_document->page( 0 ) );
+    QVERIFY( page->isBoundingBoxKnown() );
+    QCOMPARE( page->boundingBox(), bbox );
+    QVERIFY( !Okular::PagePrivate::get( page )->needsBoundingBox( 250 ) );
+    QVERIFY( Okular::PagePrivate::get( page )->needsBoundingBox( 800 ) );
+    m_document->closeDocument();
+
+    delete m_document;
+    QFile::remove( docDataPath );
+}
+
+// writes a two pages XPS document, with a square of @p secondPageColor on
+// the second page
+static void writeXpsDocument( const QString &fileName, const QByteArray &secondPageColor )
+{
+    const QByteArray ns = "xmlns=\"http://schemas.microsoft.com/xps/2005/06\"";
+    const QByteArray contentTypes =
+        "<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">"
+        "<Default Extension=\"rels\" ContentType=\"application/vnd.openxmlformats-package.relationships+xml\"/>"
+        "<Default Extension=\"fdseq\" ContentType=\"application/vnd.ms-package.xps-fixeddocumentsequence+xml\"/>"
+        "<Default Extension=\"fdoc\" ContentType=\"application/vnd.ms-package.xps-fixeddocument+xml\"/>"
+        "<Default Extension=\"fpage\" ContentType=\"application/vnd.ms-package.xps-fixedpage+xml\"/>"
+        "</Types>";
+    const QByteArray rels =
+        "<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">"
+        "<Relationship Type=\"http://schemas.microsoft.com/xps/2005/06/fixedrepresentation\" Target=\"/FixedDocSeq.fdseq\" Id=\"R0\"/>"
+        "</Relationships>";
+    const QByteArray sequence = "<FixedDocumentSequence " + ns + "><DocumentReference Source=\"/Documents/1/FixedDoc.fdoc\"/></FixedDocumentSequence>";
+    const QByteArray document = "<FixedDocument " + ns + "><PageContent Source=\"Pages/1.fpage\"/><PageContent Source=\"Pages/2.fpage\"/></FixedDocument>";
+    const QByteArray page = "<FixedPage " + ns + " Width=\"816\" Height=\"1056\" xml:lang=\"en\">"
+                            "<Path Data=\"M 100,100 L 300,100 300,300 100,300 Z\" Fill=\"%1\"/></FixedPage>";
+    const QByteArray firstPage = QByteArray( page ).replace( "%1", "#FF000000" );
+    const QByteArray secondPage = QByteArray( page ).replace( "%1", secondPageColor );
+
+    KZip zip( fileName );
+    QVERIFY( zip.open( QIODevice::WriteOnly ) );
+    zip.writeFile( "[Content_Types].xml", "user", "group", contentTypes.constData(), contentTypes.size() );
+    zip.writeFile( "_rels/.rels", "user", "group", rels.constData(), rels.size() );
+    zip.writeFile( "FixedDocSeq.fdseq", "user", "group", sequence.constData(), sequence.size() );
+    zip.writeFile( "Documents/1/FixedDoc.fdoc", "user", "group", document.constData(), document.size() );
+    zip.writeFile( "Documents/1/Pages/1.fpage", "user", "group", firstPage.constData(), firstPage.size() );
+    zip.writeFile( "Documents/1/Pages/2.fpage", "user", "group", secondPage.constData(), secondPage.size() );
+    QVERIFY( zip.close() );
+}
+
+static void renderPages( Okular::Document *document, Okular::DocumentObserver *observer )
+{
+    QLinkedList< Okular::PixmapRequest * > requests;
+    for ( uint i = 0; i < document->pages(); ++i )
+        requests << new Okular::PixmapRequest( observer, i, 100, 130, 1, Okular::PixmapRequest::NoFeature );
+    document->requestPixmaps( requests );
+}
+
+// Test that reloading a changed document keeps the pixmaps of the pages
+// that did not change, unless keeping them was cancelled
+void DocumentTest::testKeepPagesForReload()
+{
+    Okular::SettingsCore::instance( "documenttest" );
+    KTemporaryFile xpsFile;
+    xpsFile.setSuffix( ".xps" );
+    QVERIFY( xpsFile.open() );
+    xpsFile.close();
+    const QString fileName = xpsFile.fileName();
+    const KUrl url( fileName );
+    writeXpsDocument( fileName, "#FF000000" );
+    const KMimeType::Ptr mime = KMimeType::findByPath( fileName );
+
+    Okular::Document *m_document = new Okular::Document( 0 );
+    Okular::DocumentObserver *observer = new Okular::DocumentObserver();
+    m_document->addObserver( observer );
+    QCOMPARE( m_document->openDocument( fileName, url, mime ), Okular::Document::OpenSuccess );
+    QCOMPARE( m_document->pages(), 2u );
+    renderPages( m_document, observer );
+    QVERIFY( m_document->page( 0 )->hasPixmap( observer, 100, 130 ) );
+    QVERIFY( m_document->page( 1 )->hasPixmap( observer, 100, 130 ) );
+    m_document->keepPagesForReload();
+    m_document->closeDocument();
+
+    writeXpsDocument( fileName, "#FFFF0000" );
+    QCOMPARE( m_document->openDocument( fileName, url, mime ), Okular::Document::OpenSuccess );
+    QVERIFY( m_document->page( 0 )->hasPixmap( observer, 100, 130 ) );
+    QVERIFY( !m_document->page( 1 )->hasPixmap( observer, 100, 130 ) );
+
+    renderPages( m_document, observer );
+    m_document->keepPagesForReload();
+    m_document->keepPagesForReload( false );
+    m_document->closeDocument();
+    QCOMPARE( m_document->openDocument( fileName, url, mime ), Okular::Document::OpenSuccess );
+    QVERIFY( !m_document->page( 0 )->hasPixmap( observer, 100, 130 ) );
+    m_document->closeDocument();
+
+    m_document->removeObserver( observer );
+    delete observer;
+    delete m_document;
+    QFile::remove( Okular::DocumentPrivate::docDataFileName( url, QFileInfo( fileName ).size() ) );
+}
+
+void DocumentTest::testDocumentArchive_data()
+{
+    QTest::addColumn<int>( "contents" );
+
+    QTest::newRow( "with document" ) << (int)Okular::Document::ArchiveWithDocument;
+    QTest::newRow( "with reference" ) << (int)Okular::Document::ArchiveWithReference;
+}
+
+// Test that an archive brings back the annotations, both when it contains
+// the document and when it only references it
+void DocumentTest::testDocumentArchive()
+{
+    QFETCH( int, contents );
+
+    Okular::SettingsCore::instance( "documenttest" );
+    const QString testFile = KDESRCDIR "data/file1.pdf";
+    const KUrl testUrl( testFile );
+    const QString docDataPath = Okular::DocumentPrivate::docDataFileName( testUrl, QFileInfo( testFile ).size() );
+    KTemporaryFile archiveFile;
+    archiveFile.setSuffix( ".okular" );
+    QVERIFY( archiveFile.open() );
+    archiveFile.close();
+
+    Okular::Document *m_document = new Okular::Document( 0 );
+    QCOMPARE( m_document->openDocument( testFile, testUrl, KMimeType::findByPath( testFile ) ), Okular::Document::OpenSuccess );
+    Okular::Annotation *annot = new Okular::TextAnnotation();
+    annot->setBoundingRectangle( Okular::NormalizedRect( 0.1, 0.1, 0.15, 0.15 ) );
+    annot->setContents( "archived contents" );
+    m_document->addPageAnnotation( 0, annot );
+    QVERIFY( m_document->saveDocumentArchive( archiveFile.fileName(), (Okular::Document::ArchiveContents)contents ) );
+    m_document->closeDocument();
+    QFile::remove( docDataPath );
+
+    QCOMPARE( m_document->openDocumentArchive( archiveFile.fileName(), KUrl( archiveFile.fileName() ) ), Okular::Document::OpenSuccess );
+    QCOMPARE( m_document->page( 0 )->annotations().count(), 1 );
+    QCOMPARE( m_document->page( 0 )->annotations().first()->contents(), QString( "archived contents" ) );
+    m_document->closeDocument();
+
+    delete m_document;
+}
+
 QTEST_KDEMAIN( DocumentTest, GUI )
 #include "documenttest.moc"
@@ -0,0 +1,127 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include <qtest_kde.h>
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QStringList>
+
+#include "../generators/dvi/dvi.h"
+#include "../generators/dvi/dviPageFingerprint.h"
+
+// a special command of less than 256 bytes
+static QByteArray special( const QByteArray &text )
+{
+    QByteArray command;
+    command += char( XXX1 );
+    command += char( text.size() );
+    command += text;
+    return command;
+}
+
+static QByteArray fingerprint( const QByteArray &page, QStringList *links = 0, QStringList *files = 0 )
+{
+    QCryptographicHash hash( QCryptographicHash::Md5 );
+    const quint8 *data = reinterpret_cast< const quint8 * >( page.constData() );
+    hashDVIPageCommands( &hash, data, data + page.size(), links, files );
+    return hash.result();
+}
+
+class DviPageFingerprintTest : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void testSourceSpecials();
+        void testCommandLengths_data();
+        void testCommandLengths();
+        void testLinksAndFiles();
+        void testTruncatedSpecial();
+};
+
+// the source specials change with each edit before them, not the page
+void DviPageFingerprintTest::testSourceSpecials()
+{
+    const QByteArray page = "ab" + special( "src:12 chapter.tex" ) + "cd" + char( EOP );
+    const QByteArray moved = "ab" + special( "src:15 chapter.tex" ) + "cd" + char( EOP );
+    const QByteArray changed = "ab" + special( "src:12 chapter.tex" ) + "ce" + char( EOP );
+
+    QCOMPARE( fingerprint( page ), fingerprint( moved ) );
+    QVERIFY( fingerprint( page ) != fingerprint( changed ) );
+    QVERIFY( fingerprint( page ) != fingerprint( "abcd" + QByteArray( 1, char( EOP ) ) + special( "src:1 x.tex" ) ) );
+}
+
+void DviPageFingerprintTest::testCommandLengths_data()
+{
+    QTest::addColumn<QByteArray>( "command" );
+
+    // the parameters are made of XXX1 bytes, which would start a special
+    // if the walker lost track of the commands
+    const QByteArray x( 16, char( XXX1 ) );
+    QTest::newRow( "set1" ) << char( SET1 ) + x.left( 1 );
+    QTest::newRow( "setrule" ) << char( SETRULE ) + x.left( 8 );
+    QTest::newRow( "put2" ) << char( PUT1 + 1 ) + x.left( 2 );
+    QTest::newRow( "putrule" ) << char( PUTRULE ) + x.left( 8 );
+    QTest::newRow( "right3" ) << char( RIGHT3 ) + x.left( 3 );
+    QTest::newRow( "w0 w4" ) << char( W0 ) + char( W4 ) + x.left( 4 );
+    QTest::newRow( "x1" ) << char( X1 ) + x.left( 1 );
+    QTest::newRow( "down2" ) << char( DOWN2 ) + x.left( 2 );
+    QTest::newRow( "y3" ) << char( Y3 ) + x.left( 3 );
+    QTest::newRow( "z4" ) << char( Z4 ) + x.left( 4 );
+    QTest::newRow( "fnt1" ) << char( FNT1 ) + x.left( 1 );
+    QTest::newRow( "fntnum" ) << QByteArray( 1, char( FNTNUM0 + 5 ) );
+    QTest::newRow( "push pop nop" ) << QByteArray() + char( PUSH ) + char( POP ) + char( NOP );
+    // four bytes of number, checksum, scale and design size, then the
+    // lengths of the area and of the name
+    QTest::newRow( "fntdef1" ) << char( FNTDEF1 ) + x.left( 1 ) + x.left( 12 ) + char( 0 ) + char( 5 ) + "cmr10";
+}
+
+// each command is skipped as a whole: the source special after it is found
+void DviPageFingerprintTest::testCommandLengths()
+{
+    QFETCH( QByteArray, command );
+
+    const QByteArray page = command + special( "src:1 a.tex" ) + "text" + char( EOP );
+    const QByteArray moved = command + special( "src:2 a.tex" ) + "text" + char( EOP );
+    QCOMPARE( fingerprint( page ), fingerprint( moved ) );
+}
+
+void DviPageFingerprintTest::testLinksAndFiles()
+{
+    const QByteArray page = special( "html:<A href=\"#section.2\">" ) + "see" + special( "html:</A>" )
+                            + special( "PSfile=\"figure.eps\" llx=0 lly=0 urx=72 ury=72" )
+                            + special( "header=macros.pro" ) + special( "psfile=plot.eps llx=0" ) + char( EOP );
+
+    QStringList links, files;
+    const QByteArray hash = fingerprint( page, &links, &files );
+    QCOMPARE( links, QStringList() << "#section.2" );
+    QCOMPARE( files, QStringList() << "figure.eps" << "macros.pro" << "plot.eps" );
+
+    // the lists do not change the hash
+    QCOMPARE( fingerprint( page ), hash );
+}
+
+// a special longer than the page does not go past its end
+void DviPageFingerprintTest::testTruncatedSpecial()
+{
+    QByteArray page = "ab" + special( "src:3 a.tex" );
+    page[ 3 ] = char( 200 );
+
+    QStringList files;
+    const QByteArray hash = fingerprint( page, 0, &files );
+    QVERIFY( files.isEmpty() );
+    QVERIFY( hash != fingerprint( "ab" ) );
+
+    // nor one cut in its length
+    QVERIFY( fingerprint( QByteArray( 1, char( XXX4 ) ) + char( 0 ) ) != fingerprint( QByteArray() ) );
+}
+
+QTEST_KDEMAIN_CORE( DviPageFingerprintTest )
+
+#include "dvipagefingerprinttest.moc"
@@ -0,0 +1,75 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include <qtest_kde.h>
+
+#include <QtCore/QBuffer>
+#include <QtGui/QColor>
+#include <QtGui/QImage>
+
+#include "../generators/epub/epubimage.h"
+
+class EpubImageTest : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void testLoadImage_data();
+        void testLoadImage();
+};
+
+static QByteArray encode( const QSize &size, const char *format )
+{
+    QImage image( size, QImage::Format_RGB32 );
+    image.fill( qRgb( 255, 0, 0 ) );
+
+    QByteArray data;
+    QBuffer buffer( &data );
+    buffer.open( QIODevice::WriteOnly );
+    image.save( &buffer, format );
+    return data;
+}
+
+void EpubImageTest::testLoadImage_data()
+{
+    QTest::addColumn<QByteArray>( "format" );
+    QTest::addColumn<QSize>( "size" );
+    QTest::addColumn<QSize>( "expected" );
+
+    const QList<QByteArray> formats = QList<QByteArray>() << "png" << "jpeg" << "bmp"
+        // its reader does not tell the size before decoding
+        << "xpm";
+    foreach ( const QByteArray &format, formats )
+    {
+        QTest::newRow( ( format + ", smaller" ).constData() ) << format << QSize( 100, 50 ) << QSize( 100, 50 );
+        QTest::newRow( ( format + ", wider" ).constData() ) << format << QSize( 1120, 100 ) << QSize( 560, 50 );
+        QTest::newRow( ( format + ", taller" ).constData() ) << format << QSize( 100, 1520 ) << QSize( 50, 760 );
+        QTest::newRow( ( format + ", larger" ).constData() ) << format << QSize( 2240, 1520 ) << QSize( 560, 380 );
+    }
+}
+
+void EpubImageTest::testLoadImage()
+{
+    QFETCH( QByteArray, format );
+    QFETCH( QSize, size );
+    QFETCH( QSize, expected );
+
+    const QByteArray data = encode( size, format.constData() );
+    if ( data.isEmpty() )
+        QSKIP( "The image format is not supported", SkipSingle );
+
+    // the images are never larger than the content of a page, and keep their aspect
+    const QImage image = Epub::loadImage( data, QSize( 560, 760 ) );
+    QCOMPARE( image.size(), expected );
+    QVERIFY( QColor( image.pixel( image.width() / 2, image.height() / 2 ) ).red() > 200 );
+}
+
+QTEST_KDEMAIN( EpubImageTest, GUI )
+
+#include "epubimagetest.moc"
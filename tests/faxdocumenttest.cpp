@@ -0,0 +1,391 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include <qtest_kde.h>
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+
+#include <ktempdir.h>
+
+#include "../generators/fax/faxdocument.h"
+#include "../generators/fax/faxexpand.h"
+
+// A code of the fax tables: the bits are lsb-first, as the decoder reads them
+struct FaxCode
+{
+    FaxCode( uint _code = 0, int _width = 0 ) : code( _code ), width( _width ) {}
+
+    uint code;
+    int width;
+};
+
+/**
+ * Writes G3 1-D (modified Huffman) fax data. The codes are taken from the
+ * tables of the decoder, looked up backwards.
+ */
+class G3Writer
+{
+    public:
+        // G4 data does not start with an EOL
+        explicit G3Writer( bool startEol = true )
+            : m_byte( 0 ), m_bits( 0 )
+        {
+            fax_init_tables();
+            addTable( WhiteTable, 12, S_TermW, S_MakeUpW, m_white );
+            addTable( BlackTable, 13, S_TermB, S_MakeUpB, m_black );
+            if ( startEol )
+                addEol();
+        }
+
+        // Adds a line of runs, alternately white and black, starting white
+        void addLine( const QVector<int> &runs )
+        {
+            for ( int i = 0; i < runs.count(); ++i )
+                addRun( runs.at( i ), i % 2 ? m_black : m_white );
+            addEol();
+        }
+
+        // Ends the page with the RTC, and starts the next one, at the start
+        // of a 16 bit word if @p wordAligned
+        void addPage( bool wordAligned = false )
+        {
+            addRtc();
+            while ( wordAligned && ( m_data.size() * 8 + m_bits ) % 16 )
+                addBits( 0, 1 );
+            addEol();
+        }
+
+        // Ends the page with the RTC, and returns the data written
+        QByteArray finish()
+        {
+            addRtc();
+            if ( m_bits )
+                addBits( 0, 8 - m_bits );
+            return m_data;
+        }
+
+    protected:
+        // the terminating codes are stored for their run, the make-up ones
+        // for their run plus 10000
+        static void addTable( const tabent *table, int bits, int termState, int makeUpState, QHash<int, FaxCode> &codes )
+        {
+            for ( int i = 0; i < ( 1 << bits ); ++i )
+            {
+                const tabent &entry = table[ i ];
+                const uint code = i & ( ( 1 << entry.Width ) - 1 );
+                if ( entry.State == termState )
+                    codes.insert( entry.Param, FaxCode( code, entry.Width ) );
+                else if ( entry.State == makeUpState || entry.State == S_MakeUp )
+                    codes.insert( 10000 + entry.Param, FaxCode( code, entry.Width ) );
+            }
+        }
+
+        void addRun( int run, const QHash<int, FaxCode> &codes )
+        {
+            while ( run >= 64 )
+            {
+                const int makeUp = qMin( run / 64 * 64, 2560 );
+                addCode( codes.value( 10000 + makeUp ) );
+                run -= makeUp;
+            }
+            addCode( codes.value( run ) );
+        }
+
+        void addEol()
+        {
+            addBits( 0x800, 12 );
+        }
+
+        // with the EOL ending the last line, six EOLs in a row
+        void addRtc()
+        {
+            for ( int i = 0; i < 5; ++i )
+                addEol();
+        }
+
+        void addCode( const FaxCode &code )
+        {
+            QVERIFY( code.width > 0 );
+            addBits( code.code, code.width );
+        }
+
+        // the files have the first bit in the msb of each byte
+        void addBits( uint code, int width )
+        {
+            for ( int i = 0; i < width; ++i )
+            {
+                m_byte = ( m_byte << 1 ) | ( ( code >> i ) & 1 );
+                if ( ++m_bits == 8 )
+                {
+                    m_data.append( char( m_byte ) );
+                    m_byte = 0;
+                    m_bits = 0;
+                }
+            }
+        }
+
+        QHash<int, FaxCode> m_white;
+        QHash<int, FaxCode> m_black;
+        QByteArray m_data;
+        uint m_byte;
+        int m_bits;
+};
+
+/**
+ * Writes G4 (2-D, no EOLs) fax data whose lines all have the same black
+ * run from @p x, of @p width pixels.
+ */
+class G4Writer : public G3Writer
+{
+    public:
+        G4Writer( int x, int width )
+            : G3Writer( false ), m_x( x ), m_width( width ), m_lines( 0 )
+        {
+        }
+
+        void addLine()
+        {
+            if ( m_lines++ == 0 )
+            {
+                // against the white line above: horizontal mode "001" for
+                // the two runs, then vertical mode "1" to the end
+                addBits( 0x4, 3 );
+                addRun( m_x, m_white );
+                addRun( m_width, m_black );
+                addBits( 0x1, 1 );
+            }
+            else
+            {
+                // each change right below the one above, vertical mode "1"
+                addBits( 0x7, 3 );
+            }
+        }
+
+        // Ends the data with the EOFB (two EOLs), and returns the data written
+        QByteArray finish()
+        {
+            addEol();
+            addEol();
+            if ( m_bits )
+                addBits( 0, 8 - m_bits );
+            return m_data;
+        }
+
+    private:
+        int m_x;
+        int m_width;
+        int m_lines;
+};
+
+class FaxDocumentTest : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void testG3Lines();
+        void testG3LowResolution();
+        void testG3Pages_data();
+        void testG3Pages();
+        void testG4();
+        void testScaledImage();
+        void benchmarkG3Expand();
+
+    private:
+        QString writeFile( const QByteArray &data, const QString &name = "page.g3" );
+
+        KTempDir m_tempDir;
+};
+
+QString FaxDocumentTest::writeFile( const QByteArray &data, const QString &name )
+{
+    const QString fileName = m_tempDir.name() + name;
+    QFile file( fileName );
+    if ( file.open( QIODevice::WriteOnly ) )
+        file.write( data );
+    return fileName;
+}
+
+void FaxDocumentTest::testG3Lines()
+{
+    // runs across the 32 bit words of the expanded lines
+    QVector<int> runs;
+    runs << 5 << 1 << 26 << 33 << 64 << 100 << 1 << 1 << 1497;
+    QVector<bool> black( 1728, false );
+    for ( int i = 0, x = 0; i < runs.count(); x += runs.at( i ), ++i )
+        for ( int j = 0; j < runs.at( i ); ++j )
+            black[ x + j ] = i % 2;
+
+    G3Writer writer;
+    for ( int i = 0; i < 10; ++i )
+        writer.addLine( runs );
+
+    FaxDocument document( writeFile( writer.finish() ), FaxDocument::G3 );
+    QVERIFY( document.load() );
+    QCOMPARE( document.pageCount(), 1 );
+    QCOMPARE( document.pageSize( 0 ), QSize( 1728, 15 ) );
+
+    const QImage image = document.pageImage( 0 );
+    QCOMPARE( image.format(), QImage::Format_MonoLSB );
+    QCOMPARE( image.width(), 1728 );
+    QCOMPARE( image.height(), 10 );
+    for ( int y = 0; y < image.height(); ++y )
+        for ( int x = 0; x < image.width(); ++x )
+            QCOMPARE( qGray( image.pixel( x, y ) ) == 0, bool( black.at( x ) ) );
+}
+
+// the low resolution lines are shown twice
+void FaxDocumentTest::testG3LowResolution()
+{
+    G3Writer writer;
+    for ( int i = 0; i < 10; ++i )
+        writer.addLine( QVector<int>() << 10 + i << 5 << 1713 - i );
+
+    // a ghostscript / PC Research file, whose header tells the resolution
+    QByteArray header( 64, 0 );
+    header.replace( 0, 18, QByteArray( "\0PC Research, Inc", 18 ) );
+    header[ 29 ] = 0;
+
+    FaxDocument document( writeFile( header + writer.finish() ), FaxDocument::G3 );
+    QVERIFY( document.load() );
+    QCOMPARE( document.pageCount(), 1 );
+    QCOMPARE( document.pageSize( 0 ), QSize( 1728, 30 ) );
+
+    const QImage image = document.pageImage( 0 );
+    QCOMPARE( image.height(), 20 );
+    for ( int y = 0; y < image.height(); ++y )
+        for ( int x = 0; x < image.width(); ++x )
+            QCOMPARE( qGray( image.pixel( x, y ) ) == 0, x >= 10 + y / 2 && x < 15 + y / 2 );
+}
+
+void FaxDocumentTest::testG3Pages_data()
+{
+    QTest::addColumn<bool>( "wordAligned" );
+
+    // a page starting in the word of the RTC, or after it
+    QTest::newRow( "packed" ) << false;
+    QTest::newRow( "word aligned" ) << true;
+}
+
+void FaxDocumentTest::testG3Pages()
+{
+    QFETCH( bool, wordAligned );
+
+    // page i has i + 1 lines, all with a black run of i + 1 pixels at i
+    G3Writer writer;
+    for ( int i = 0; i < 3; ++i )
+    {
+        if ( i )
+            writer.addPage( wordAligned );
+        for ( int j = 0; j <= i; ++j )
+            writer.addLine( QVector<int>() << i << i + 1 << 1728 - 2 * i - 1 );
+    }
+
+    FaxDocument document( writeFile( writer.finish() ), FaxDocument::G3 );
+    QVERIFY( document.load() );
+    QCOMPARE( document.pageCount(), 3 );
+
+    // decoded backwards, to not depend on the order
+    for ( int i = 2; i >= 0; --i )
+    {
+        const QImage image = document.pageImage( i );
+        QCOMPARE( image.height(), i + 1 );
+        for ( int y = 0; y < image.height(); ++y )
+            for ( int x = 0; x < image.width(); ++x )
+                QCOMPARE( qGray( image.pixel( x, y ) ) == 0, x >= i && x <= 2 * i );
+    }
+
+    // the pages are kept decoded
+    QCOMPARE( document.pageImage( 1 ).cacheKey(), document.pageImage( 1 ).cacheKey() );
+    QVERIFY( document.pageImage( 3 ).isNull() );
+}
+
+void FaxDocumentTest::testG4()
+{
+    G4Writer writer( 100, 28 );
+    for ( int i = 0; i < 7; ++i )
+        writer.addLine();
+
+    FaxDocument document( writeFile( writer.finish(), "page.g4" ), FaxDocument::G4 );
+    QVERIFY( document.load() );
+    QCOMPARE( document.pageCount(), 1 );
+    QCOMPARE( document.pageSize( 0 ), QSize( 1728, 10 ) );
+
+    const QImage image = document.pageImage( 0 );
+    QCOMPARE( image.height(), 7 );
+    for ( int y = 0; y < image.height(); ++y )
+        for ( int x = 0; x < image.width(); ++x )
+            QCOMPARE( qGray( image.pixel( x, y ) ) == 0, x >= 100 && x < 128 );
+}
+
+void FaxDocumentTest::testScaledImage()
+{
+    // a black square in the top left quarter
+    QImage image( 4, 4, QImage::Format_MonoLSB );
+    image.setColor( 0, qRgb( 255, 255, 255 ) );
+    image.setColor( 1, qRgb( 0, 0, 0 ) );
+    image.fill( 0 );
+    for ( int y = 0; y < 2; ++y )
+        for ( int x = 0; x < 2; ++x )
+            image.setPixel( x, y, 1 );
+
+    QImage scaled = FaxDocument::scaledImage( image, 2, 2 );
+    QCOMPARE( scaled.format(), QImage::Format_RGB32 );
+    QCOMPARE( scaled.pixel( 0, 0 ), qRgb( 0, 0, 0 ) );
+    QCOMPARE( scaled.pixel( 1, 0 ), qRgb( 255, 255, 255 ) );
+    QCOMPARE( scaled.pixel( 0, 1 ), qRgb( 255, 255, 255 ) );
+    QCOMPARE( scaled.pixel( 1, 1 ), qRgb( 255, 255, 255 ) );
+
+    // a quarter of the pixels are black
+    scaled = FaxDocument::scaledImage( image, 1, 1 );
+    QCOMPARE( scaled.pixel( 0, 0 ), qRgb( 192, 192, 192 ) );
+
+    // each pixel is repeated
+    scaled = FaxDocument::scaledImage( image, 8, 8 );
+    QCOMPARE( scaled.pixel( 3, 3 ), qRgb( 0, 0, 0 ) );
+    QCOMPARE( scaled.pixel( 4, 3 ), qRgb( 255, 255, 255 ) );
+    QCOMPARE( scaled.pixel( 3, 4 ), qRgb( 255, 255, 255 ) );
+}
+
+// the lines of a typical text page: short black runs on white
+void FaxDocumentTest::benchmarkG3Expand()
+{
+    qsrand( 1 );
+    G3Writer writer;
+    for ( int y = 0; y < 2200; ++y )
+    {
+        QVector<int> runs;
+        int x = 0;
+        while ( x < 1728 )
+        {
+            const int run = qMin( 1 + qrand() % ( runs.count() % 2 ? 12 : 60 ), 1728 - x );
+            runs << run;
+            x += run;
+        }
+        writer.addLine( runs );
+    }
+    const QByteArray data = writer.finish();
+    const QString fileName = writeFile( data );
+
+    QElapsedTimer timer;
+    timer.start();
+    int runs = 0;
+    QBENCHMARK {
+        FaxDocument document( fileName, FaxDocument::G3 );
+        QVERIFY( document.load() );
+        QVERIFY( !document.pageImage( 0 ).isNull() );
+        ++runs;
+    }
+    const double seconds = timer.elapsed() / 1000.0 / runs;
+    qDebug() << data.size() << "bytes of compressed input," << data.size() / seconds / ( 1024 * 1024 ) << "MB/s";
+}
+
+QTEST_KDEMAIN( FaxDocumentTest, GUI )
+
+#include "faxdocumenttest.moc"
@@ -0,0 +1,421 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include <qtest_kde.h>
+
+#include <QtGui/QImage>
+#include <QtGui/QPainter>
+#include <QtGui/QTransform>
+
+#include "../core/area.h"
+#include "../core/imagekernels_p.h"
+#include "../core/utils.h"
+#include "../settings_core.h"
+
+static inline uint div255( uint x ) { return ( x + ( x >> 8 ) + 0x80 ) >> 8; }
+
+// the stored value, without any (un)premultiplication done by QImage::pixel()
+static inline QRgb rawPixel( const QImage &image, int x, int y )
+{
+    return reinterpret_cast< const QRgb * >( image.constScanLine( y ) )[ x ];
+}
+
+// random premultiplied pixels, with some fully black ones
+static QImage randomImage( int width, int height )
+{
+    QImage image( width, height, QImage::Format_ARGB32_Premultiplied );
+    qsrand( 42 );
+    for ( int y = 0; y < height; ++y )
+    {
+        QRgb *line = reinterpret_cast< QRgb * >( image.scanLine( y ) );
+        for ( int x = 0; x < width; ++x )
+        {
+            const int a = qrand() % 256;
+            line[ x ] = ( qrand() % 5 == 0 ) ? qRgba( 0, 0, 0, a )
+                        : qRgba( qrand() % ( a + 1 ), qrand() % ( a + 1 ), qrand() % ( a + 1 ), a );
+        }
+    }
+    return image;
+}
+
+class ImageKernelsTest : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void initTestCase();
+        void testMultiplyRgb_data();
+        void testMultiplyRgb();
+        void testScaleAlpha();
+        void testSetOpaque();
+        void testMultiplyFill();
+        void testMultiplyRectClipping();
+        void testBlend_data();
+        void testBlend();
+        void testFindNotRgb();
+        void testRotatedImage_data();
+        void testRotatedImage();
+        void testImageBoundingBox();
+        void testImageBoundingBoxPixelScan();
+        void benchmarkMultiplyRect();
+        void benchmarkMultiplyFillRect();
+        void benchmarkScaleImageAlpha();
+        void benchmarkBlendRect();
+        void benchmarkRotatedImage();
+        void benchmarkImageBoundingBox_data();
+        void benchmarkImageBoundingBox();
+};
+
+// a white A4 page at @p dpi, with lines of "text" within one inch margins
+static QImage a4Page( int dpi )
+{
+    const int width = 210 * dpi / 25.4, height = 297 * dpi / 25.4;
+    QImage image( width, height, QImage::Format_RGB32 );
+    image.fill( 0xffffffff );
+    QPainter p( &image );
+    for ( int y = dpi; y < height - dpi; y += dpi / 6 )
+        for ( int x = dpi; x < width - dpi; x += dpi / 4 )
+            p.fillRect( x, y, dpi / 5, dpi / 10, Qt::black );
+    return image;
+}
+
+void ImageKernelsTest::initTestCase()
+{
+    Okular::SettingsCore::instance( "imagekernelstest" );
+    Okular::SettingsCore::setPaperColor( Qt::white );
+}
+
+void ImageKernelsTest::testMultiplyRgb_data()
+{
+    QTest::addColumn<bool>( "blackAsWhite" );
+
+    QTest::newRow( "plain" ) << false;
+    QTest::newRow( "blackAsWhite" ) << true;
+}
+
+void ImageKernelsTest::testMultiplyRgb()
+{
+    QFETCH( bool, blackAsWhite );
+
+    // odd sizes, so the non vectorized tails are covered as well
+    const QImage source = randomImage( 37, 5 );
+    const QColor color( 255, 200, 17 );
+    QImage image = source;
+    Okular::ImageKernels::multiplyRect( image, image.rect(), color, blackAsWhite );
+
+    for ( int y = 0; y < source.height(); ++y )
+    {
+        for ( int x = 0; x < source.width(); ++x )
+        {
+            QRgb val = rawPixel( source, x, y );
+            if ( blackAsWhite && ( val & 0x00ffffff ) == 0 )
+                val |= 0x00ffffff;
+            const QRgb expected = qRgba( div255( qRed( val ) * color.red() ),
+                                         div255( qGreen( val ) * color.green() ),
+                                         div255( qBlue( val ) * color.blue() ), 255 );
+            QCOMPARE( rawPixel( image, x, y ), expected );
+        }
+    }
+}
+
+void ImageKernelsTest::testScaleAlpha()
+{
+    QImage source = randomImage( 37, 5 ).convertToFormat( QImage::Format_ARGB32 );
+    QImage image = source;
+    Okular::ImageKernels::scaleImageAlpha( image, 100 );
+
+    for ( int y = 0; y < source.height(); ++y )
+    {
+        for ( int x = 0; x < source.width(); ++x )
+        {
+            const QRgb val = rawPixel( source, x, y );
+            const QRgb expected = ( val & 0x00ffffff ) | ( div255( qAlpha( val ) * 100 ) << 24 );
+            QCOMPARE( rawPixel( image, x, y ), expected );
+        }
+    }
+}
+
+void ImageKernelsTest::testSetOpaque()
+{
+    // in the vectorized part and in the tail
+    quint32 pixels[ 37 ];
+    for ( int i = 0; i < 37; ++i )
+        pixels[ i ] = qRgba( i, 2 * i, 3 * i, i );
+
+    Okular::ImageKernels::setOpaque( pixels + 1, 35 );
+    QCOMPARE( pixels[ 0 ], quint32( qRgba( 0, 0, 0, 0 ) ) );
+    for ( int i = 1; i < 36; ++i )
+        QCOMPARE( pixels[ i ], quint32( qRgb( i, 2 * i, 3 * i ) ) );
+    QCOMPARE( pixels[ 36 ], quint32( qRgba( 36, 72, 108, 36 ) ) );
+}
+
+void ImageKernelsTest::testMultiplyFill()
+{
+    const QImage source = randomImage( 37, 5 );
+
+    // compare with what QPainter does, allowing for rounding differences
+    const QColor color( 255, 255, 0, 150 );
+    QImage reference = source;
+    QPainter painter( &reference );
+    painter.setCompositionMode( QPainter::CompositionMode_Multiply );
+    painter.fillRect( reference.rect(), color );
+    painter.end();
+
+    QImage image = source;
+    Okular::ImageKernels::multiplyFillRect( image, image.rect(), color );
+
+    for ( int y = 0; y < source.height(); ++y )
+    {
+        for ( int x = 0; x < source.width(); ++x )
+        {
+            const QRgb a = rawPixel( image, x, y ), b = rawPixel( reference, x, y );
+            QVERIFY( qAbs( qRed( a ) - qRed( b ) ) <= 2 );
+            QVERIFY( qAbs( qGreen( a ) - qGreen( b ) ) <= 2 );
+            QVERIFY( qAbs( qBlue( a ) - qBlue( b ) ) <= 2 );
+            QVERIFY( qAbs( qAlpha( a ) - qAlpha( b ) ) <= 2 );
+        }
+    }
+}
+
+void ImageKernelsTest::testMultiplyRectClipping()
+{
+    const QImage source = randomImage( 16, 16 );
+    QImage image = source;
+    Okular::ImageKernels::multiplyRect( image, QRect( 10, -5, 20, 10 ), Qt::black, false );
+
+    for ( int y = 0; y < source.height(); ++y )
+    {
+        for ( int x = 0; x < source.width(); ++x )
+        {
+            if ( x >= 10 && y < 5 )
+                QCOMPARE( rawPixel( image, x, y ), qRgba( 0, 0, 0, 255 ) );
+            else
+                QCOMPARE( rawPixel( image, x, y ), rawPixel( source, x, y ) );
+        }
+    }
+}
+
+void ImageKernelsTest::testBlend_data()
+{
+    QTest::addColumn<int>( "t" );
+
+    QTest::newRow( "from" ) << 0;
+    QTest::newRow( "middle" ) << 128;
+    QTest::newRow( "almost to" ) << 254;
+    QTest::newRow( "to" ) << 255;
+}
+
+void ImageKernelsTest::testBlend()
+{
+    QFETCH( int, t );
+
+    const QImage from = randomImage( 37, 5 );
+    const QImage to = from.mirrored( true, true );
+    QImage image( from.size(), from.format() );
+    // only the inner area is blended, the border has to stay untouched
+    image.fill( 0x12345678 );
+    const QRect area( 1, 1, 35, 3 );
+    Okular::ImageKernels::blendRect( image, from, to, area, t );
+
+    for ( int y = 0; y < from.height(); ++y )
+    {
+        for ( int x = 0; x < from.width(); ++x )
+        {
+            if ( !area.contains( x, y ) )
+            {
+                QCOMPARE( rawPixel( image, x, y ), QRgb( 0x12345678 ) );
+                continue;
+            }
+            const QRgb a = rawPixel( from, x, y ), b = rawPixel( to, x, y );
+            const QRgb expected = qRgba( div255( qRed( a ) * ( 255 - t ) + qRed( b ) * t ),
+                                         div255( qGreen( a ) * ( 255 - t ) + qGreen( b ) * t ),
+                                         div255( qBlue( a ) * ( 255 - t ) + qBlue( b ) * t ),
+                                         div255( qAlpha( a ) * ( 255 - t ) + qAlpha( b ) * t ) );
+            QCOMPARE( rawPixel( image, x, y ), expected );
+        }
+    }
+}
+
+void ImageKernelsTest::testFindNotRgb()
+{
+    // paper colored pixels, the alpha is ignored
+    quint32 pixels[ 37 ];
+    for ( int i = 0; i < 37; ++i )
+        pixels[ i ] = qRgba( 255, 255, 250, i );
+    const QRgb paper = qRgb( 255, 255, 250 );
+
+    QCOMPARE( Okular::ImageKernels::findFirstNotRgb( pixels, 37, paper ), 37 );
+    QCOMPARE( Okular::ImageKernels::findLastNotRgb( pixels, 37, paper ), -1 );
+    QCOMPARE( Okular::ImageKernels::findFirstNotRgb( pixels, 0, paper ), 0 );
+    QCOMPARE( Okular::ImageKernels::findLastNotRgb( pixels, 0, paper ), -1 );
+
+    // in the vectorized part and in the tails
+    pixels[ 2 ] = pixels[ 9 ] = pixels[ 35 ] = qRgb( 255, 255, 251 );
+    QCOMPARE( Okular::ImageKernels::findFirstNotRgb( pixels, 37, paper ), 2 );
+    QCOMPARE( Okular::ImageKernels::findLastNotRgb( pixels, 37, paper ), 35 );
+    QCOMPARE( Okular::ImageKernels::findFirstNotRgb( pixels + 3, 34, paper ), 6 );
+    QCOMPARE( Okular::ImageKernels::findLastNotRgb( pixels, 35, paper ), 9 );
+}
+
+void ImageKernelsTest::testRotatedImage_data()
+{
+    QTest::addColumn<int>( "degrees" );
+
+    QTest::newRow( "90" ) << 90;
+    QTest::newRow( "180" ) << 180;
+    QTest::newRow( "270" ) << 270;
+}
+
+void ImageKernelsTest::testRotatedImage()
+{
+    QFETCH( int, degrees );
+
+    // larger than a tile, with partial tiles at the edges
+    const QImage source = randomImage( 77, 45 );
+    QTransform matrix;
+    matrix.rotate( degrees );
+    const QImage rotated = Okular::ImageKernels::rotatedImage( source, degrees );
+
+    QCOMPARE( rotated.size(), source.transformed( matrix ).size() );
+    QCOMPARE( rotated.format(), source.format() );
+    const int w = source.width(), h = source.height();
+    for ( int y = 0; y < h; ++y )
+    {
+        for ( int x = 0; x < w; ++x )
+        {
+            // clockwise, as QTransform::rotate() in the y-down coordinates
+            const QPoint dest = degrees == 90 ? QPoint( h - 1 - y, x )
+                              : degrees == 180 ? QPoint( w - 1 - x, h - 1 - y )
+                              : QPoint( y, w - 1 - x );
+            QCOMPARE( rawPixel( rotated, dest.x(), dest.y() ), rawPixel( source, x, y ) );
+        }
+    }
+}
+
+// a 4K page fully covered by highlights
+void ImageKernelsTest::benchmarkMultiplyRect()
+{
+    QImage image = randomImage( 3840, 2160 );
+    QBENCHMARK {
+        Okular::ImageKernels::multiplyRect( image, image.rect(), Qt::yellow, true );
+    }
+}
+
+void ImageKernelsTest::benchmarkMultiplyFillRect()
+{
+    QImage image = randomImage( 3840, 2160 );
+    QBENCHMARK {
+        Okular::ImageKernels::multiplyFillRect( image, image.rect(), QColor( 255, 255, 0, 128 ) );
+    }
+}
+
+void ImageKernelsTest::benchmarkScaleImageAlpha()
+{
+    QImage image = randomImage( 3840, 2160 ).convertToFormat( QImage::Format_ARGB32 );
+    QBENCHMARK {
+        Okular::ImageKernels::scaleImageAlpha( image, 254 );
+    }
+}
+
+// one step of a full screen fade on a 4K projector
+void ImageKernelsTest::benchmarkBlendRect()
+{
+    const QImage from = randomImage( 3840, 2160 );
+    const QImage to = from.mirrored( true, false );
+    QImage image( from.size(), from.format() );
+    QBENCHMARK {
+        Okular::ImageKernels::blendRect( image, from, to, image.rect(), 100 );
+    }
+}
+
+void ImageKernelsTest::testImageBoundingBox()
+{
+    // odd sizes, so the non vectorized tails are covered as well
+    QImage image( 37, 23, QImage::Format_RGB32 );
+    image.fill( 0xffffffff );
+    QCOMPARE( Okular::Utils::imageBoundingBox( &image ), Okular::NormalizedRect( 0, 0, 0, 0 ) );
+
+    image.setPixel( 5, 3, qRgb( 0, 0, 0 ) );
+    image.setPixel( 30, 19, qRgb( 255, 255, 254 ) );
+    image.setPixel( 1, 10, qRgb( 128, 0, 0 ) );
+    QCOMPARE( Okular::Utils::imageBoundingBox( &image ), Okular::NormalizedRect( QRect( 1, 3, 30, 17 ), 37, 23 ) );
+
+    // the other formats are converted (the almost white pixel becomes white)
+    const QImage image16 = image.convertToFormat( QImage::Format_RGB16 );
+    QCOMPARE( Okular::Utils::imageBoundingBox( &image16 ), Okular::NormalizedRect( QRect( 1, 3, 5, 8 ), 37, 23 ) );
+}
+
+// the bounding box found by the former scan, one QImage::pixel() at a time
+static QRect pixelScanBoundingBox( const QImage &image, QRgb paperColor )
+{
+    int left = image.width(), right = -1, top = image.height(), bottom = -1;
+    for ( int y = 0; y < image.height(); ++y )
+        for ( int x = 0; x < image.width(); ++x )
+            if ( ( image.pixel( x, y ) & 0xffffff ) != ( paperColor & 0xffffff ) )
+            {
+                left = qMin( left, x );
+                right = qMax( right, x );
+                top = qMin( top, y );
+                bottom = qMax( bottom, y );
+            }
+    return QRect( QPoint( left, top ), QPoint( right, bottom ) );
+}
+
+// the line scan finds the same box as the pixel scan, wherever the marks are
+void ImageKernelsTest::testImageBoundingBoxPixelScan()
+{
+    const QRgb paperColor = Okular::SettingsCore::paperColor().rgb();
+    qsrand( 7 );
+    for ( int i = 0; i < 200; ++i )
+    {
+        const int width = 1 + qrand() % 41, height = 1 + qrand() % 17;
+        QImage image( width, height, QImage::Format_RGB32 );
+        image.fill( paperColor );
+        const int marks = 1 + qrand() % 4;
+        for ( int m = 0; m < marks; ++m )
+            image.setPixel( qrand() % width, qrand() % height, qRgb( qrand() % 256, qrand() % 256, qrand() % 255 ) );
+
+        const QRect expected = pixelScanBoundingBox( image, paperColor );
+        if ( !expected.isValid() )
+            QCOMPARE( Okular::Utils::imageBoundingBox( &image ), Okular::NormalizedRect( 0, 0, 0, 0 ) );
+        else
+            QCOMPARE( Okular::Utils::imageBoundingBox( &image ), Okular::NormalizedRect( expected, width, height ) );
+    }
+}
+
+// rotating a page rendered for a 4K screen
+void ImageKernelsTest::benchmarkRotatedImage()
+{
+    const QImage image = randomImage( 3840, 2160 );
+    QBENCHMARK {
+        Okular::ImageKernels::rotatedImage( image, 90 );
+    }
+}
+
+void ImageKernelsTest::benchmarkImageBoundingBox_data()
+{
+    QTest::addColumn<int>( "dpi" );
+
+    QTest::newRow( "A4 150 dpi" ) << 150;
+    QTest::newRow( "A4 600 dpi" ) << 600;
+}
+
+void ImageKernelsTest::benchmarkImageBoundingBox()
+{
+    QFETCH( int, dpi );
+
+    const QImage image = a4Page( dpi );
+    QBENCHMARK {
+        Okular::Utils::imageBoundingBox( &image );
+    }
+}
+
+QTEST_KDEMAIN( ImageKernelsTest, GUI )
+
+#include "imagekernelstest.moc"
@@ -0,0 +1,134 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include <qtest_kde.h>
+
+#include <QtGui/QFont>
+
+#include <kglobalsettings.h>
+#include <ktemporaryfile.h>
+
+#include "../generators/txt/largedocument.h"
+
+class LargeDocumentTest : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void testCrLf();
+        void testTabs();
+        void testUtf8_data();
+        void testUtf8();
+};
+
+// Enough accented letters for the encoding to be recognized as UTF-8, in
+// a row of its own
+static const char header[] = "\xc3\xa9\xc3\xa9\xc3\xa9\xc3\xa0\xc3\xa0\xc3\xa0\xc3\xbc\xc3\xbc\xc3\xbc\xc3\xb6\n";
+
+// Writes @p lines repeated up to the size of a large document
+static bool writeLargeFile( KTemporaryFile *file, const QByteArray &lines )
+{
+    if ( !file->open() )
+        return false;
+    QByteArray data( header );
+    while ( data.size() < Txt::LargeDocument::MinimumSize )
+        data += lines;
+    const bool written = file->write( data ) == data.size();
+    file->close();
+    return written;
+}
+
+// Splits @p document in rows of @p columns characters, 20 rows a page
+static void paginate( Txt::LargeDocument *document, int columns )
+{
+    const QFont font = KGlobalSettings::fixedFont();
+    document->paginate( QSizeF( 1000, 1000 ), 0, font );
+    document->paginate( QSizeF( ( columns + 0.5 ) * document->charWidth(), 20.5 * document->lineSpacing() ), 0, font );
+}
+
+void LargeDocumentTest::testCrLf()
+{
+    // the carriage returns take no room, even after a full row
+    KTemporaryFile file;
+    QVERIFY( writeLargeFile( &file, "0123456789\r\nabc\r\n\r\n" ) );
+    Txt::LargeDocument document;
+    QVERIFY( document.load( file.fileName() ) );
+    paginate( &document, 10 );
+
+    const QStringList rows = document.pageRows( 0 );
+    QCOMPARE( rows.count(), 20 );
+    for ( int i = 1; i + 2 < rows.count(); i += 3 )
+    {
+        QCOMPARE( rows.at( i ), QString( "0123456789\n" ) );
+        QCOMPARE( rows.at( i + 1 ), QString( "abc\n" ) );
+        QCOMPARE( rows.at( i + 2 ), QString( "\n" ) );
+    }
+}
+
+void LargeDocumentTest::testTabs()
+{
+    KTemporaryFile file;
+    QVERIFY( writeLargeFile( &file, "a\tb\n\tab\tc\nabcdefgh\tX\n" ) );
+    Txt::LargeDocument document;
+    QVERIFY( document.load( file.fileName() ) );
+    paginate( &document, 10 );
+
+    const QStringList rows = document.pageRows( 0 );
+    QCOMPARE( rows.at( 1 ), QString( "a       b\n" ) );
+    // the second tab stop is past the end of the row
+    QCOMPARE( rows.at( 2 ), QString( "        ab" ) );
+    QCOMPARE( rows.at( 3 ), QString( "        c\n" ) );
+    QCOMPARE( rows.at( 4 ), QString( "abcdefgh" ) );
+    QCOMPARE( rows.at( 5 ), QString( "        X\n" ) );
+    QCOMPARE( rows.at( 6 ), QString( "a       b\n" ) );
+}
+
+void LargeDocumentTest::testUtf8_data()
+{
+    QTest::addColumn<QByteArray>( "lines" );
+    QTest::addColumn<QStringList>( "expected" );
+
+    const QString e = QString::fromUtf8( "\xc3\xa9" );
+    const QString euro = QString::fromUtf8( "\xe2\x82\xac" );
+
+    // the row ends in the middle of the bytes scanned for the line end
+    QTest::newRow( "two bytes" ) << QByteArray( "abcdefgh\xc3\xa9\n" )
+        << ( QStringList() << "abcdefgh" + e + "\n" );
+    QTest::newRow( "two bytes, full row" ) << QByteArray( "abcdefghi\xc3\xa9\n" )
+        << ( QStringList() << "abcdefghi" + e + "\n" );
+    QTest::newRow( "two bytes, wrapped" ) << QByteArray( "abcdefghij\xc3\xa9\xc3\xa9\n" )
+        << ( QStringList() << "abcdefghij" << e + e + "\n" );
+    QTest::newRow( "three bytes" ) << QByteArray( "\xe2\x82\xac\xe2\x82\xac\xe2\x82\xac\xe2\x82\xac\xe2\x82\xac"
+                                                  "\xe2\x82\xac\xe2\x82\xac\xe2\x82\xac\xe2\x82\xac\xe2\x82\xac\xe2\x82\xac\n" )
+        << ( QStringList() << QString( 10, euro.at( 0 ) ) << euro + "\n" );
+}
+
+void LargeDocumentTest::testUtf8()
+{
+    QFETCH( QByteArray, lines );
+    QFETCH( QStringList, expected );
+
+    KTemporaryFile file;
+    QVERIFY( writeLargeFile( &file, lines ) );
+    Txt::LargeDocument document;
+    QVERIFY( document.load( file.fileName() ) );
+    paginate( &document, 10 );
+
+    // the rows are split between characters, never inside one
+    const QStringList rows = document.pageRows( 0 );
+    QVERIFY( rows.count() > expected.count() );
+    for ( int i = 0; i < expected.count(); ++i )
+        QCOMPARE( rows.at( 1 + i ), expected.at( i ) );
+    foreach ( const QString &row, rows )
+        QVERIFY( !row.contains( QChar::ReplacementCharacter ) );
+}
+
+QTEST_KDEMAIN( LargeDocumentTest, GUI )
+
+#include "largedocumenttest.moc"
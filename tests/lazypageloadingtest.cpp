@@ -0,0 +1,233 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include <qtest_kde.h>
+
+#include <ktemporaryfile.h>
+#include <QSignalSpy>
+
+#include "../core/document.h"
+#include "../core/generator.h"
+#include "../core/observer.h"
+#include "../core/page.h"
+#include "../settings_core.h"
+#include "testingutils.h"
+
+static const int PageCount = 10000;
+
+// records the order of the annotation and pixmap notifications
+class LoadOrderObserver : public Okular::DocumentObserver
+{
+    public:
+        void notifyPageChanged( int page, int flags )
+        {
+            if ( flags & Okular::DocumentObserver::Annotations )
+                annotationPages.append( page );
+            if ( flags & Okular::DocumentObserver::Pixmap )
+                pixmapPages.append( page );
+        }
+
+        QList<int> annotationPages;
+        QList<int> pixmapPages;
+};
+
+class LazyPageLoadingTest : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void initTestCase();
+        void cleanupTestCase();
+        void testAnnotationsLoadedOnDemand();
+        void testAnnotationsLoadOrder();
+        void testOpenAsynchronously();
+        void testCloseWhileLoading();
+        void benchmarkOpenBigDocument();
+        void benchmarkTimeToFirstPixel();
+
+    private:
+        KTemporaryFile m_file;
+        KMimeType::Ptr m_mime;
+};
+
+void LazyPageLoadingTest::initTestCase()
+{
+    Okular::SettingsCore::instance( "lazypageloadingtest" );
+    qRegisterMetaType<Okular::Document::OpenResult>( "Okular::Document::OpenResult" );
+
+    m_file.setSuffix( ".pdf" );
+    QVERIFY( m_file.open() );
+    QVERIFY( TestingUtils::writeBigPdf( &m_file, PageCount ) );
+    m_file.close();
+    m_mime = KMimeType::findByPath( m_file.fileName() );
+}
+
+void LazyPageLoadingTest::cleanupTestCase()
+{
+    m_file.remove();
+}
+
+// The annotations of a page must be there once the page is shown, even if
+// the background loading did not reach it yet
+void LazyPageLoadingTest::testAnnotationsLoadedOnDemand()
+{
+    Okular::Document *document = new Okular::Document( 0 );
+    Okular::DocumentObserver *observer = new Okular::DocumentObserver();
+    document->addObserver( observer );
+
+    QCOMPARE( document->openDocument( m_file.fileName(), KUrl(), m_mime ), Okular::Document::OpenSuccess );
+    QCOMPARE( int( document->pages() ), PageCount );
+
+    const int farPage = PageCount / 2;
+    QVERIFY( document->page( farPage )->annotations().isEmpty() );
+
+    Okular::PixmapRequest *pixmapReq = new Okular::PixmapRequest(
+        observer, farPage, 100, 100, 1, Okular::PixmapRequest::NoFeature );
+    document->requestPixmaps( QLinkedList<Okular::PixmapRequest*>() << pixmapReq );
+    for ( int i = 0; i < 100 && !document->page( farPage )->hasPixmap( observer ); ++i )
+        QTest::qWait( 10 );
+    QCOMPARE( document->page( farPage )->annotations().count(), 1 );
+
+    // the pages around the current one are the first ones loaded in background
+    for ( int i = 0; i < 100 && document->page( 1 )->annotations().isEmpty(); ++i )
+        QTest::qWait( 10 );
+    QCOMPARE( document->page( 1 )->annotations().count(), 1 );
+
+    document->closeDocument();
+    delete document;
+    delete observer;
+}
+
+// The shown page gets its annotations first, then the background loading
+// goes through the pages around the current one and then all the others
+void LazyPageLoadingTest::testAnnotationsLoadOrder()
+{
+    Okular::Document *document = new Okular::Document( 0 );
+    LoadOrderObserver *observer = new LoadOrderObserver();
+    document->addObserver( observer );
+
+    QCOMPARE( document->openDocument( m_file.fileName(), KUrl(), m_mime ), Okular::Document::OpenSuccess );
+    // nothing is loaded while opening
+    QVERIFY( observer->annotationPages.isEmpty() );
+
+    const int currentPage = 100;
+    const int farPage = PageCount / 2;
+    document->setViewportPage( currentPage );
+    Okular::PixmapRequest *pixmapReq = new Okular::PixmapRequest(
+        observer, farPage, 100, 100, 1, Okular::PixmapRequest::NoFeature );
+    document->requestPixmaps( QLinkedList<Okular::PixmapRequest*>() << pixmapReq );
+    for ( int i = 0; i < 100 && observer->pixmapPages.isEmpty(); ++i )
+        QTest::qWait( 10 );
+    QCOMPARE( observer->pixmapPages, QList<int>() << farPage );
+
+    for ( int i = 0; i < 500 && observer->annotationPages.count() < 41; ++i )
+        QTest::qWait( 10 );
+    QVERIFY( observer->annotationPages.count() >= 41 );
+
+    // the requested page, before its pixmap
+    QList<int> expected;
+    expected << farPage;
+    // the pages around the current one
+    for ( int i = currentPage - 2; i <= currentPage + 2; ++i )
+        expected << i;
+    // then all the others in order
+    for ( int i = 0; expected.count() < 41; ++i )
+        expected << i;
+    QCOMPARE( observer->annotationPages.mid( 0, 41 ), expected );
+    QCOMPARE( observer->annotationPages.count( farPage ), 1 );
+    QCOMPARE( observer->annotationPages.count( currentPage ), 1 );
+
+    document->closeDocument();
+    delete document;
+    delete observer;
+}
+
+// The document is set up only once loaded, meanwhile the events go on
+void LazyPageLoadingTest::testOpenAsynchronously()
+{
+    Okular::Document *document = new Okular::Document( 0 );
+    QSignalSpy finishedSpy( document, SIGNAL(openDocumentFinished(Okular::Document::OpenResult)) );
+
+    document->openDocumentAsynchronously( m_file.fileName(), KUrl(), m_mime );
+    QVERIFY( document->isLoading() );
+    QVERIFY( !document->isOpened() );
+    QCOMPARE( int( document->pages() ), 0 );
+
+    QVERIFY( QTest::kWaitForSignal( document, SIGNAL(openDocumentFinished(Okular::Document::OpenResult)), 10000 ) );
+    QCOMPARE( finishedSpy.count(), 1 );
+    QVERIFY( !document->isLoading() );
+    QVERIFY( document->isOpened() );
+    QCOMPARE( int( document->pages() ), PageCount );
+
+    document->closeDocument();
+    delete document;
+}
+
+// Closing a document being loaded waits for the generator and drops what it
+// loaded, the document can be opened again right away
+void LazyPageLoadingTest::testCloseWhileLoading()
+{
+    Okular::Document *document = new Okular::Document( 0 );
+    QSignalSpy finishedSpy( document, SIGNAL(openDocumentFinished(Okular::Document::OpenResult)) );
+
+    document->openDocumentAsynchronously( m_file.fileName(), KUrl(), m_mime );
+    QVERIFY( document->isLoading() );
+    document->closeDocument();
+    QVERIFY( !document->isLoading() );
+    QVERIFY( !document->isOpened() );
+    QCOMPARE( int( document->pages() ), 0 );
+
+    // the completion of the cancelled loading is not reported
+    QTest::qWait( 100 );
+    QCOMPARE( finishedSpy.count(), 0 );
+
+    QCOMPARE( document->openDocument( m_file.fileName(), KUrl(), m_mime ), Okular::Document::OpenSuccess );
+    QCOMPARE( int( document->pages() ), PageCount );
+    document->closeDocument();
+    delete document;
+}
+
+void LazyPageLoadingTest::benchmarkOpenBigDocument()
+{
+    Okular::Document *document = new Okular::Document( 0 );
+    QBENCHMARK {
+        QCOMPARE( document->openDocument( m_file.fileName(), KUrl(), m_mime ), Okular::Document::OpenSuccess );
+        document->closeDocument();
+    }
+    delete document;
+}
+
+// From asking to open the document to having the first page rendered,
+// while the open still goes on: the annotations of the other pages are not
+// loaded yet
+void LazyPageLoadingTest::benchmarkTimeToFirstPixel()
+{
+    Okular::Document *document = new Okular::Document( 0 );
+    LoadOrderObserver *observer = new LoadOrderObserver();
+    document->addObserver( observer );
+    QBENCHMARK {
+        observer->annotationPages.clear();
+        document->openDocumentAsynchronously( m_file.fileName(), KUrl(), m_mime );
+        QVERIFY( QTest::kWaitForSignal( document, SIGNAL(openDocumentFinished(Okular::Document::OpenResult)), 10000 ) );
+        Okular::PixmapRequest *pixmapReq = new Okular::PixmapRequest(
+            observer, 0, 600, 800, 1, Okular::PixmapRequest::Asynchronous );
+        document->requestPixmaps( QLinkedList<Okular::PixmapRequest*>() << pixmapReq );
+        for ( int i = 0; i < 5000 && !document->page( 0 )->hasPixmap( observer ); ++i )
+            QTest::qWait( 1 );
+        QVERIFY( document->page( 0 )->hasPixmap( observer ) );
+        QVERIFY( observer->annotationPages.count() < PageCount );
+        document->closeDocument();
+    }
+    delete document;
+    delete observer;
+}
+
+QTEST_KDEMAIN( LazyPageLoadingTest, GUI )
+
+#include "lazypageloadingtest.moc"
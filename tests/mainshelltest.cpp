@@ -34,6 +34,11 @@ public:
     QWidget *presentationWidget(Okular::Part *part) const {
         return part->m_presentationWidget;
     }
+    // the PDF documents are loaded in a thread
+    void waitForLoading(Okular::Part *part) const {
+        for (int i = 0; part->m_document->isLoading() && i < 500; ++i)
+            QTest::qWait(10);
+    }
 };
 }
 
@@ -237,6 +242,7 @@ void MainShellTest::testShell()
         Okular::Part *part = s->findChild<Okular::Part*>();
         QVERIFY(part);
         QCOMPARE(part->url().url(), QString("file://%1").arg(paths[0]));
+        waitForLoading(part);
         QCOMPARE(partDocument(part)->currentPage(), expectedPage);
     }
     else if (paths.count() == 2)
@@ -251,7 +257,9 @@ void MainShellTest::testShell()
             QCOMPARE(s->m_tabs.count(), 2);
             QCOMPARE(part->url().url(), QString("file://%1").arg(paths[0]));
             QCOMPARE(part2->url().url(), QString("file://%1").arg(paths[1]));
+            waitForLoading(part);
             QCOMPARE(partDocument(part)->currentPage(), expectedPage);
+            waitForLoading(part2);
             QCOMPARE(partDocument(part2)->currentPage(), expectedPage);
         }
         else
@@ -262,6 +270,7 @@ void MainShellTest::testShell()
             QCOMPARE(s->m_tabs.count(), 1);
             Okular::Part *part = s->findChild<Okular::Part*>();
             QVERIFY(part);
+            waitForLoading(part);
             QCOMPARE(partDocument(part)->currentPage(), expectedPage);
             openUrls << part->url().url();
 
@@ -270,6 +279,7 @@ void MainShellTest::testShell()
             QCOMPARE(s2->m_tabs.count(), 1);
             Okular::Part *part2 = s2->findChild<Okular::Part*>();
             QVERIFY(part2);
+            waitForLoading(part2);
             QCOMPARE(partDocument(part2)->currentPage(), expectedPage);
             openUrls << part2->url().url();
 
@@ -313,6 +323,7 @@ void MainShellTest::testShell()
                 // It is unique so part got "overriten"
                 QCOMPARE(s->m_tabs.count(), 1);
                 QCOMPARE(part->url().url(), QString("file://%1").arg(externalProcessPath));
+                waitForLoading(part);
                 QCOMPARE(partDocument(part)->currentPage(), externalProcessExpectedPage);
             }
             else
@@ -321,6 +332,7 @@ void MainShellTest::testShell()
                 QCOMPARE(s->m_tabs.count(), 2);
                 Okular::Part *part2 = dynamic_cast<Okular::Part*>(s->m_tabs[1].part);
                 QCOMPARE(part2->url().url(), QString("file://%1").arg(externalProcessPath));
+                waitForLoading(part2);
                 QCOMPARE(partDocument(part2)->currentPage(), externalProcessExpectedPage);
             }
         }
@@ -337,6 +349,7 @@ void MainShellTest::testShell()
             // It opened on a new process, so no change for us
             QCOMPARE(s->m_tabs.count(), 1);
             QCOMPARE(part->url().url(), QString("file://%1").arg(paths[0]));
+            waitForLoading(part);
             QCOMPARE(partDocument(part)->currentPage(), externalProcessExpectedPage);
         }
     }
@@ -422,6 +435,7 @@ void MainShellTest::testFileRemembersPagePosition()
     Okular::Part *part = s->findChild<Okular::Part*>();
     QVERIFY(part);
     QCOMPARE(part->url().url(), QString("file://%1").arg(paths[0]));
+    waitForLoading(part);
     QCOMPARE(partDocument(part)->currentPage(), 0u);
     partDocument(part)->setViewportPage(3);
     QCOMPARE(partDocument(part)->currentPage(), 3u);
@@ -457,6 +471,7 @@ void MainShellTest::testFileRemembersPagePosition()
     part = s->findChild<Okular::Part*>();
     QVERIFY(part);
     QCOMPARE(part->url().url(), QString("file://%1").arg(paths[0]));
+    waitForLoading(part);
     QCOMPARE(partDocument(part)->currentPage(), 3u);
 }
 
@@ -0,0 +1,177 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include <qtest_kde.h>
+
+#include <QtCore/QBuffer>
+#include <QtCore/QFileInfo>
+#include <QtGui/QImage>
+
+#include <ktempdir.h>
+#include <kzip.h>
+
+#include "../core/mappedfile_p.h"
+#include "../core/page.h"
+#include "../generators/comicbook/document.h"
+
+class MappedFileTest : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void testData();
+        void testZipEntryData_data();
+        void testZipEntryData();
+        void testPeakMemory();
+};
+
+void MappedFileTest::testData()
+{
+    KTempDir tempDir;
+    const QString fileName = tempDir.name() + "data";
+    const QByteArray contents = "0123456789";
+    {
+        QFile file( fileName );
+        QVERIFY( file.open( QIODevice::WriteOnly ) );
+        file.write( contents );
+    }
+
+    Okular::MappedFile mapped;
+    QVERIFY( !mapped.load( tempDir.name() + "missing" ) );
+    QVERIFY( mapped.load( fileName ) );
+    QVERIFY( mapped.isMapped() );
+    QCOMPARE( mapped.size(), qint64( contents.size() ) );
+    QCOMPARE( mapped.data(), contents );
+    QCOMPARE( mapped.data( 3, 4 ), QByteArray( "3456" ) );
+    QCOMPARE( mapped.data( 10, 0 ), QByteArray() );
+    QVERIFY( mapped.data( 8, 3 ).isEmpty() );
+    QVERIFY( mapped.data( -1, 2 ).isEmpty() );
+
+    // the slices are not copies
+    QCOMPARE( mapped.data( 3, 4 ).constData(), mapped.data().constData() + 3 );
+
+    mapped.close();
+    QCOMPARE( mapped.size(), qint64( 0 ) );
+    QVERIFY( !mapped.isMapped() );
+}
+
+void MappedFileTest::testZipEntryData_data()
+{
+    QTest::addColumn<bool>( "compressed" );
+
+    QTest::newRow( "stored" ) << false;
+    QTest::newRow( "deflated" ) << true;
+}
+
+void MappedFileTest::testZipEntryData()
+{
+    QFETCH( bool, compressed );
+
+    KTempDir tempDir;
+    const QString fileName = tempDir.name() + "archive.zip";
+    const QByteArray contents( 4096, 'x' );
+    {
+        KZip zip( fileName );
+        QVERIFY( zip.open( QIODevice::WriteOnly ) );
+        zip.setCompression( compressed ? KZip::DeflateCompression : KZip::NoCompression );
+        QVERIFY( zip.writeFile( "first", "user", "group", "abc", 3 ) );
+        QVERIFY( zip.writeFile( "second", "user", "group", contents.constData(), contents.size() ) );
+    }
+
+    KZip zip( fileName );
+    QVERIFY( zip.open( QIODevice::ReadOnly ) );
+    Okular::MappedFile mapped;
+    QVERIFY( mapped.load( fileName ) );
+
+    const KZipFileEntry *first = static_cast< const KZipFileEntry * >( zip.directory()->entry( "first" ) );
+    const KZipFileEntry *second = static_cast< const KZipFileEntry * >( zip.directory()->entry( "second" ) );
+    QVERIFY( first && second );
+    QCOMPARE( mapped.zipEntryData( first ), QByteArray( "abc" ) );
+
+    const QByteArray data = mapped.zipEntryData( second );
+    QCOMPARE( data, contents );
+    const bool inPlace = data.constData() >= mapped.data().constData()
+                         && data.constData() < mapped.data().constData() + mapped.size();
+    QCOMPARE( inPlace, !compressed );
+}
+
+#ifdef Q_OS_LINUX
+// the peak resident memory of the process, in kB, since the last reset
+static qint64 peakResidentMemory()
+{
+    QFile status( "/proc/self/status" );
+    if ( !status.open( QIODevice::ReadOnly ) )
+        return -1;
+    foreach ( const QByteArray &line, status.readAll().split( '\n' ) )
+    {
+        if ( line.startsWith( "VmHWM:" ) )
+            return line.mid( 6 ).trimmed().split( ' ' ).first().toLongLong();
+    }
+    return -1;
+}
+
+static bool resetPeakResidentMemory()
+{
+    QFile clearRefs( "/proc/self/clear_refs" );
+    return clearRefs.open( QIODevice::WriteOnly ) && clearRefs.write( "5" ) == 1;
+}
+#endif
+
+void MappedFileTest::testPeakMemory()
+{
+#ifdef Q_OS_LINUX
+    // a comic book of 8 pages stored without compression, as they usually are
+    KTempDir tempDir;
+    const QString fileName = tempDir.name() + "book.cbz";
+    QImage image( 512, 512, QImage::Format_RGB32 );
+    {
+        KZip zip( fileName );
+        QVERIFY( zip.open( QIODevice::WriteOnly ) );
+        zip.setCompression( KZip::NoCompression );
+        for ( int i = 0; i < 8; ++i )
+        {
+            image.fill( qRgb( i * 32, 0, 0 ) );
+            QByteArray page;
+            QBuffer buffer( &page );
+            buffer.open( QIODevice::WriteOnly );
+            QVERIFY( image.save( &buffer, "BMP" ) );
+            const QString name = QString( "page%1.bmp" ).arg( i );
+            QVERIFY( zip.writeFile( name, "user", "group", page.constData(), page.size() ) );
+        }
+    }
+    const qint64 fileSize = QFileInfo( fileName ).size();
+    if ( !resetPeakResidentMemory() || peakResidentMemory() < 0 )
+        QSKIP( "the peak resident memory cannot be reset", SkipAll );
+
+    // open the book and read all its pages through the generator
+    const qint64 before = peakResidentMemory();
+    {
+        ComicBook::Document document;
+        QVERIFY( document.open( fileName ) );
+        QVector< Okular::Page * > pages;
+        document.pages( &pages );
+        QCOMPARE( pages.count(), 8 );
+        for ( int i = 0; i < pages.count(); ++i )
+            QCOMPARE( document.pageImage( i ).size(), image.size() );
+        qDeleteAll( pages );
+    }
+    const qint64 peak = peakResidentMemory() - before;
+
+    // the pages read in place from the mapping count once, and a decoded
+    // page at a time; a copy of the whole book would not fit
+    const qint64 imageSize = image.byteCount() / 1024;
+    QVERIFY( peak < fileSize / 1024 * 3 / 2 + imageSize );
+#else
+    QSKIP( "the peak resident memory is only measured on Linux", SkipAll );
+#endif
+}
+
+QTEST_KDEMAIN( MappedFileTest, GUI )
+
+#include "mappedfiletest.moc"
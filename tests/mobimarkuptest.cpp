@@ -0,0 +1,84 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include <qtest_kde.h>
+
+#include "../generators/mobipocket/mobimarkup.h"
+
+class MobiMarkupTest : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void testAnchorsInTag();
+        void testAnchorInText();
+        void testAnchorPastEnd();
+};
+
+// A file position of a fixed width, so the markup does not move with it
+static QString filePos( int pos )
+{
+    return QString( "%1" ).arg( pos, 4, 10, QChar( '0' ) );
+}
+
+static QString link( const QString &pos, const QString &text )
+{
+    return QString( "<a filepos=%1>%2</a>" ).arg( pos, text );
+}
+
+static QString fixedLink( const QString &pos, const QString &text )
+{
+    return QString( "<a href=\"#%1\">%2</a>" ).arg( pos, text );
+}
+
+static QString anchor( const QString &pos )
+{
+    return QString( "<a name=\"%1\">&nbsp;</a>" ).arg( pos );
+}
+
+void MobiMarkupTest::testAnchorsInTag()
+{
+    // two destinations inside the same tag get their anchors before it, in order
+    const QString target = "<p align=\"center\">Chapter</p>";
+    const int tagStart = link( filePos( 0 ), "one" ).length() + link( filePos( 0 ), "two" ).length();
+    const QString one = filePos( tagStart + 3 );
+    const QString two = filePos( tagStart + 10 );
+    const QString data = link( two, "two" ) + link( one, "one" ) + target;
+    QCOMPARE( data.indexOf( target ), tagStart );
+
+    QCOMPARE( Mobi::fixMobiMarkup( data ),
+              fixedLink( two, "two" ) + fixedLink( one, "one" ) + anchor( one ) + anchor( two ) + target );
+}
+
+void MobiMarkupTest::testAnchorInText()
+{
+    // a destination in the text gets its anchor right there
+    const QString start = link( filePos( 0 ), "go" ) + "<p>Some ";
+    const QString pos = filePos( start.length() );
+    const QString data = link( pos, "go" ) + "<p>Some text</p>";
+
+    QCOMPARE( Mobi::fixMobiMarkup( data ), fixedLink( pos, "go" ) + "<p>Some " + anchor( pos ) + "text</p>" );
+}
+
+void MobiMarkupTest::testAnchorPastEnd()
+{
+    // the links out of the document are kept, but nothing points to them
+    const QString text = "<p>Text</p>";
+    const int size = link( filePos( 0 ), "end" ).length() + link( filePos( 0 ), "out" ).length() + text.length();
+    const QString end = filePos( size );
+    const QString out = filePos( size + 100 );
+    const QString data = link( end, "end" ) + link( out, "out" ) + text;
+    QCOMPARE( data.length(), size );
+
+    QCOMPARE( Mobi::fixMobiMarkup( data ), fixedLink( end, "end" ) + fixedLink( out, "out" ) + text );
+}
+
+QTEST_KDEMAIN_CORE( MobiMarkupTest )
+
+#include "mobimarkuptest.moc"
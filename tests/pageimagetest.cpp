@@ -0,0 +1,51 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include <qtest_kde.h>
+
+#include <QtGui/QImage>
+#include <QtGui/QPixmap>
+
+#include "../core/observer.h"
+#include "../core/page.h"
+
+class PageImageTest : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void testSetImage();
+};
+
+void PageImageTest::testSetImage()
+{
+    Okular::DocumentObserver observer;
+    Okular::Page page( 0, 100, 200, Okular::Rotation0 );
+    QVERIFY( !page.hasPixmap( &observer ) );
+
+    QImage image( 100, 200, QImage::Format_ARGB32_Premultiplied );
+    image.fill( 0xffffffff );
+    page.setImage( &observer, image );
+    QVERIFY( page.hasPixmap( &observer ) );
+    QVERIFY( page.hasPixmap( &observer, 100, 200 ) );
+    QVERIFY( !page.hasPixmap( &observer, 50, 100 ) );
+
+    // a pixmap replaces the image, and the other way round
+    page.setPixmap( &observer, new QPixmap( 50, 100 ) );
+    QVERIFY( page.hasPixmap( &observer, 50, 100 ) );
+    page.setImage( &observer, image );
+    QVERIFY( page.hasPixmap( &observer, 100, 200 ) );
+
+    page.deletePixmap( &observer );
+    QVERIFY( !page.hasPixmap( &observer ) );
+}
+
+QTEST_KDEMAIN( PageImageTest, GUI )
+
+#include "pageimagetest.moc"
@@ -11,15 +11,22 @@
 #include <qtestmouse.h>
 
 #include "../core/page.h"
+#include "../core/page_p.h"
 #include "../part.h"
 #include "../ui/toc.h"
 #include "../ui/pageview.h"
+#include "../ui/presentationwidget.h"
+#include "../settings.h"
+#include "testingutils.h"
 
 #include <KConfigDialog>
 #include <KStandardDirs>
 #include <KTempDir>
+#include <KTemporaryFile>
 
 #include <QClipboard>
+#include <QScrollBar>
+#include <QSignalSpy>
 #include <QTreeView>
 
 namespace Okular
@@ -30,6 +37,8 @@ class PartTest
     Q_OBJECT
 
     private slots:
+        void init();
+        void cleanup();
         void testReload();
         void testCanceledReload();
         void testTOCReload();
@@ -38,6 +47,19 @@ class PartTest
         void testGeneratorPreferences();
         void testSelectText();
         void testClickInternalLink();
+        void testTransitionDroppedFrames();
+        void benchmarkDeliverPage_data();
+        void benchmarkDeliverPage();
+        void benchmarkScrollBigDocument();
+        void benchmarkRelayoutBigDocument();
+        void benchmarkRelayoutBigDocumentCold();
+
+    private:
+        static bool waitForLoading(Okular::Part &part);
+
+        // the global settings changed by the tests, restored after each one
+        bool m_slidesTransitionsEnabled;
+        int m_slidesTransition;
 };
 
 class PartThatHijacksQueryClose : public Okular::Part
@@ -67,14 +89,36 @@ class PartThatHijacksQueryClose : public Okular::Part
         Behavior behavior;
 };
 
+void PartTest::init()
+{
+    m_slidesTransitionsEnabled = Okular::Settings::slidesTransitionsEnabled();
+    m_slidesTransition = Okular::Settings::slidesTransition();
+}
+
+void PartTest::cleanup()
+{
+    Okular::Settings::setSlidesTransitionsEnabled(m_slidesTransitionsEnabled);
+    Okular::Settings::setSlidesTransition(m_slidesTransition);
+}
+
+// The PDF documents are loaded in a thread, the part is set up once they are
+bool PartTest::waitForLoading(Okular::Part &part)
+{
+    for (int i = 0; part.m_document->isLoading() && i < 500; ++i)
+        QTest::qWait(10);
+    return part.m_document->pages() > 0;
+}
+
 // Test that Okular doesn't crash after a successful reload
 void PartTest::testReload()
 {
     QVariantList dummyArgs;
     Okular::Part part(NULL, NULL, dummyArgs, KGlobal::mainComponent());
     part.openDocument(KDESRCDIR "data/file1.pdf");
+    QVERIFY(waitForLoading(part));
     part.reload();
     qApp->processEvents();
+    QVERIFY(waitForLoading(part));
 }
 
 // Test that Okular doesn't crash after a canceled reload
@@ -83,6 +127,7 @@ void PartTest::testCanceledReload()
     QVariantList dummyArgs;
     PartThatHijacksQueryClose part(NULL, NULL, dummyArgs, KGlobal::mainComponent());
     part.openDocument(KDESRCDIR "data/file1.pdf");
+    QVERIFY(waitForLoading(part));
 
     // When queryClose() returns false, the reload operation is canceled (as if
     // the user had chosen Cancel in the "Save changes?" message box)
@@ -98,11 +143,13 @@ void PartTest::testTOCReload()
     QVariantList dummyArgs;
     Okular::Part part(NULL, NULL, dummyArgs, KGlobal::mainComponent());
     part.openDocument(KDESRCDIR "data/tocreload.pdf");
+    QVERIFY(waitForLoading(part));
     QCOMPARE(part.m_toc->expandedNodes().count(), 0);
     part.m_toc->m_treeView->expandAll();
     QCOMPARE(part.m_toc->expandedNodes().count(), 3);
     part.reload();
     qApp->processEvents();
+    QVERIFY(waitForLoading(part));
     QCOMPARE(part.m_toc->expandedNodes().count(), 3);
 }
 
@@ -128,6 +175,7 @@ void PartTest::testFowardPDF()
     QVERIFY(QFile::exists(pdfResult));
     
     part.openDocument(pdfResult);
+    QVERIFY(waitForLoading(part));
     part.m_document->setViewportPage(0);
     QCOMPARE(part.m_document->currentPage(), 0u);
     part.closeUrl();
@@ -135,6 +183,16 @@ void PartTest::testFowardPDF()
     KUrl u(pdfResult);
     u.setHTMLRef("src:100" + texDestination);
     part.openUrl(u);
+    QVERIFY(waitForLoading(part));
+    // the SyncTeX file is loaded in background, the page changes once it is
+    for (int i = 0; part.m_document->currentPage() != 1 && i < 50; ++i) {
+        QTest::qWait(100);
+    }
+    QCOMPARE(part.m_document->currentPage(), 1u);
+
+    // a search asked once loaded is answered at once
+    part.m_document->setViewportPage(0);
+    part.showSourceLocation(texDestination, 99, 0, false);
     QCOMPARE(part.m_document->currentPage(), 1u);
 }
 
@@ -169,6 +227,7 @@ void PartTest::testSelectText()
     QVariantList dummyArgs;
     Okular::Part part(NULL, NULL, dummyArgs, KGlobal::mainComponent());
     part.openDocument(KDESRCDIR "data/file2.pdf");
+    QVERIFY(waitForLoading(part));
     part.widget()->show();
     QTest::qWaitForWindowShown(part.widget());
 
@@ -199,6 +258,7 @@ void PartTest::testClickInternalLink()
     QVariantList dummyArgs;
     Okular::Part part(NULL, NULL, dummyArgs, KGlobal::mainComponent());
     part.openDocument(KDESRCDIR "data/file2.pdf");
+    QVERIFY(waitForLoading(part));
     part.widget()->show();
     QTest::qWaitForWindowShown(part.widget());
 
@@ -218,6 +278,160 @@ void PartTest::testClickInternalLink()
     QCOMPARE(part.m_document->currentPage(), 1u);
 }
 
+// Test that the steps of a slide transition coming late are counted
+void PartTest::testTransitionDroppedFrames()
+{
+    Okular::Settings::setSlidesTransitionsEnabled(true);
+    Okular::Settings::setSlidesTransition(Okular::Settings::EnumSlidesTransition::WipeDown);
+
+    QVariantList dummyArgs;
+    Okular::Part part(NULL, NULL, dummyArgs, KGlobal::mainComponent());
+    part.openDocument(KDESRCDIR "data/file2.pdf");
+    QVERIFY(waitForLoading(part));
+    part.widget()->show();
+    QTest::qWaitForWindowShown(part.widget());
+
+    part.slotShowPresentation();
+    QVERIFY(part.m_presentationWidget);
+    QTest::qWaitForWindowShown(part.m_presentationWidget);
+    // let the transition to the first slide end
+    QTest::qWait(1500);
+
+    // the event loop is blocked for half of the one second transition
+    QSignalSpy spy(part.m_presentationWidget, SIGNAL(transitionFinished(int,int)));
+    QMetaObject::invokeMethod(part.m_presentationWidget, "slotNextPage");
+    QTest::qSleep(500);
+    QVERIFY(QTest::kWaitForSignal(part.m_presentationWidget, SIGNAL(transitionFinished(int,int)), 5000));
+    QCOMPARE(spy.count(), 1);
+    const int frames = spy.at(0).at(0).toInt();
+    const int droppedFrames = spy.at(0).at(1).toInt();
+    QVERIFY(frames > 0);
+    QVERIFY(droppedFrames > 0);
+
+    part.slotHidePresentation();
+}
+
+void PartTest::benchmarkDeliverPage_data()
+{
+    QTest::addColumn<bool>("asImage");
+
+    QTest::newRow("image") << true;
+    QTest::newRow("pixmap") << false;
+}
+
+// What the GUI thread does for each page rendered at about 4K: store it in
+// the page, then paint it in the page view
+void PartTest::benchmarkDeliverPage()
+{
+    QFETCH(bool, asImage);
+
+    QVariantList dummyArgs;
+    Okular::Part part(NULL, NULL, dummyArgs, KGlobal::mainComponent());
+    part.openDocument(KDESRCDIR "data/file2.pdf");
+    QVERIFY(waitForLoading(part));
+    part.widget()->resize(2200, 1200);
+    part.widget()->show();
+    QTest::qWaitForWindowShown(part.widget());
+
+    part.m_document->setViewportPage(0);
+
+    // wait for pixmap
+    while (!part.m_document->page(0)->hasPixmap(part.m_pageView))
+        QTest::qWait(100);
+
+    Okular::Page *page = const_cast<Okular::Page *>(part.m_document->page(0));
+    const QSize size = Okular::PagePrivate::get(page)->m_pixmaps.value(part.m_pageView).size();
+    QVERIFY(!size.isEmpty());
+    QImage rendered(size, QImage::Format_ARGB32_Premultiplied);
+    rendered.fill(0xffffffff);
+
+    QBENCHMARK {
+        if (asImage)
+            page->setImage(part.m_pageView, rendered);
+        else
+            page->setPixmap(part.m_pageView, new QPixmap(QPixmap::fromImage(rendered)));
+        part.m_pageView->viewport()->repaint();
+    }
+}
+
+// Scrolling must cost the same no matter how many pages the document has
+void PartTest::benchmarkScrollBigDocument()
+{
+    KTemporaryFile file;
+    file.setSuffix(".pdf");
+    QVERIFY(file.open());
+    QVERIFY(TestingUtils::writeBigPdf(&file, 10000));
+    file.close();
+
+    QVariantList dummyArgs;
+    Okular::Part part(NULL, NULL, dummyArgs, KGlobal::mainComponent());
+    part.openDocument(file.fileName());
+    QVERIFY(waitForLoading(part));
+    part.widget()->resize(800, 600);
+    part.widget()->show();
+    QTest::qWaitForWindowShown(part.widget());
+    // let the delayed relayout happen
+    qApp->processEvents();
+
+    QScrollBar *scrollBar = part.m_pageView->verticalScrollBar();
+    QVERIFY(scrollBar->maximum() > 0);
+    int step = 0;
+    QBENCHMARK {
+        // jump around the whole document, a page at a time
+        scrollBar->setValue((++step * 7 * scrollBar->pageStep()) % scrollBar->maximum());
+    }
+}
+
+void PartTest::benchmarkRelayoutBigDocument()
+{
+    KTemporaryFile file;
+    file.setSuffix(".pdf");
+    QVERIFY(file.open());
+    QVERIFY(TestingUtils::writeBigPdf(&file, 10000));
+    file.close();
+
+    QVariantList dummyArgs;
+    Okular::Part part(NULL, NULL, dummyArgs, KGlobal::mainComponent());
+    part.openDocument(file.fileName());
+    QVERIFY(waitForLoading(part));
+    part.widget()->resize(800, 600);
+    part.widget()->show();
+    QTest::qWaitForWindowShown(part.widget());
+    qApp->processEvents();
+
+    int step = 0;
+    QBENCHMARK {
+        // what happens while the window is being resized
+        part.widget()->resize(800 + (++step % 2), 600);
+        QMetaObject::invokeMethod(part.m_pageView, "slotRelayoutPages", Qt::DirectConnection);
+    }
+}
+
+// Same, with a new width each time, so no item size computed before applies
+void PartTest::benchmarkRelayoutBigDocumentCold()
+{
+    KTemporaryFile file;
+    file.setSuffix(".pdf");
+    QVERIFY(file.open());
+    QVERIFY(TestingUtils::writeBigPdf(&file, 10000));
+    file.close();
+
+    QVariantList dummyArgs;
+    Okular::Part part(NULL, NULL, dummyArgs, KGlobal::mainComponent());
+    part.openDocument(file.fileName());
+    QVERIFY(waitForLoading(part));
+    part.widget()->resize(800, 600);
+    part.widget()->show();
+    QTest::qWaitForWindowShown(part.widget());
+    qApp->processEvents();
+
+    int step = 0;
+    QBENCHMARK {
+        part.widget()->resize(600 + (++step % 1000), 600);
+        QMetaObject::invokeMethod(part.m_pageView, "slotRelayoutPages", Qt::DirectConnection);
+    }
+}
+
 }
 
 int main(int argc, char *argv[])
@@ -36,6 +36,43 @@ namespace TestingUtils
         return !it1.hasNext() && !it2.hasNext();
     }
 
+    bool writeBigPdf( QIODevice *device, int pageCount )
+    {
+        QByteArray data = "%PDF-1.4\n";
+        QVector<int> offsets;
+
+        const int objectCount = 2 + 2 * pageCount;
+        offsets.append( data.size() );
+        data += "1 0 obj\n<< /Type /Catalog /Pages 2 0 R >>\nendobj\n";
+
+        offsets.append( data.size() );
+        data += "2 0 obj\n<< /Type /Pages /Count " + QByteArray::number( pageCount ) + " /Kids [";
+        for ( int i = 0; i < pageCount; ++i )
+            data += ' ' + QByteArray::number( 3 + 2 * i ) + " 0 R";
+        data += " ] >>\nendobj\n";
+
+        for ( int i = 0; i < pageCount; ++i )
+        {
+            const QByteArray pageObject = QByteArray::number( 3 + 2 * i );
+            const QByteArray annotObject = QByteArray::number( 4 + 2 * i );
+            offsets.append( data.size() );
+            data += pageObject + " 0 obj\n<< /Type /Page /Parent 2 0 R /MediaBox [ 0 0 612 792 ] /Annots [ "
+                    + annotObject + " 0 R ] >>\nendobj\n";
+            offsets.append( data.size() );
+            data += annotObject + " 0 obj\n<< /Type /Annot /Subtype /Text /Rect [ 100 100 120 120 ] /Contents (Page "
+                    + QByteArray::number( i ) + ") >>\nendobj\n";
+        }
+
+        const int xrefOffset = data.size();
+        data += "xref\n0 " + QByteArray::number( objectCount + 1 ) + "\n0000000000 65535 f \n";
+        foreach ( int offset, offsets )
+            data += QByteArray::number( offset ).rightJustified( 10, '0' ) + " 00000 n \n";
+        data += "trailer\n<< /Size " + QByteArray::number( objectCount + 1 ) + " /Root 1 0 R >>\n";
+        data += "startxref\n" + QByteArray::number( xrefOffset ) + "\n%%EOF\n";
+
+        return device->write( data ) == data.size();
+    }
+
     QString AnnotationDisposeWatcher::m_disposedAnnotationName = QString();
 
     QString AnnotationDisposeWatcher::disposedAnnotationName() {
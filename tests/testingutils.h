@@ -12,6 +12,7 @@
 
 template<class T >
 class QLinkedList;
+class QIODevice;
 class QString;
 
 namespace Okular {
@@ -32,6 +33,12 @@ namespace TestingUtils
      */
     bool pointListsAlmostEqual( QLinkedList< Okular::NormalizedPoint > points1, QLinkedList< Okular::NormalizedPoint > points2 );
 
+    /**
+     * Writes to @p device a PDF file with @p pageCount empty pages, each one
+     * with a text annotation, to test how big documents are handled
+     */
+    bool writeBigPdf( QIODevice *device, int pageCount );
+
     /*
      * The AnnotationDisposeWatcher class provides a static disposeAnnotation function
      * that may be assigned to an annotation with Annotation::setDisposeDataFunction in order to
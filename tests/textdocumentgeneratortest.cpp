@@ -0,0 +1,281 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include <qtest_kde.h>
+
+#include <QtGui/QAbstractTextDocumentLayout>
+#include <QtGui/QImage>
+#include <QtGui/QPainter>
+#include <QtGui/QTextCursor>
+#include <QtGui/QTextDocument>
+
+#include <kconfigskeleton.h>
+
+#include "../core/generator.h"
+#include "../core/page.h"
+#include "../core/textpage.h"
+#include "../core/textdocumentgenerator.h"
+#include "../core/textdocumentgenerator_p.h"
+
+// Converts the given HTML, with a red image named "red.png"
+class HtmlConverter : public Okular::TextDocumentConverter
+{
+    public:
+        HtmlConverter( const QString &html )
+            : m_html( html )
+        {
+        }
+
+        QTextDocument *convert( const QString & )
+        {
+            QImage red( 50, 50, QImage::Format_RGB32 );
+            red.fill( qRgb( 255, 0, 0 ) );
+
+            QTextDocument *document = new QTextDocument;
+            document->setPageSize( QSizeF( 300, 400 ) );
+            document->addResource( QTextDocument::ImageResource, QUrl( "red.png" ), red );
+            document->setHtml( m_html );
+            return document;
+        }
+
+    private:
+        QString m_html;
+};
+
+class HtmlGenerator : public Okular::TextDocumentGenerator
+{
+    public:
+        HtmlGenerator( const QString &html )
+            : Okular::TextDocumentGenerator( new HtmlConverter( html ), "textdocumentgeneratortest", 0, QVariantList() )
+        {
+        }
+
+        QImage renderPage( int page, int width, int height )
+        {
+            Okular::PixmapRequest request( 0, page, width, height, 1, Okular::PixmapRequest::NoFeature );
+            return image( &request );
+        }
+
+        bool hasDisplayList( int page )
+        {
+            return static_cast< Okular::TextDocumentGeneratorPrivate * >( d_ptr )->mPageDisplayLists.contains( page );
+        }
+
+        QTextDocument *textDocument()
+        {
+            return static_cast< Okular::TextDocumentGeneratorPrivate * >( d_ptr )->mDocument;
+        }
+
+        Okular::TextPage *createTextPage( Okular::Page *page )
+        {
+            return textPage( page );
+        }
+};
+
+class TextDocumentGeneratorTest : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void testDisplayList();
+        void testPageWithImage();
+        void testFontChange();
+        void testTextPage();
+};
+
+// Draws a page straight from the layout, as it was done before the display lists
+static QImage layoutImage( QTextDocument *document, int page )
+{
+    const QSize size = document->pageSize().toSize();
+    const QRect rect( 0, page * size.height(), size.width(), size.height() );
+
+    QImage image( size, QImage::Format_ARGB32 );
+    image.fill( Qt::white );
+    QPainter p( &image );
+    p.translate( QPoint( 0, page * size.height() * -1 ) );
+    p.setClipRect( rect );
+    QAbstractTextDocumentLayout::PaintContext context;
+    context.palette.setColor( QPalette::Text, Qt::black );
+    context.clip = rect;
+    document->documentLayout()->draw( &p, context );
+    p.end();
+    return image;
+}
+
+// Builds a text page with a cursor selecting each character, as it was done
+// before the text pages were built line by line
+static Okular::TextPage *cursorTextPage( QTextDocument *document, int pageNumber )
+{
+    Okular::TextPage *textPage = new Okular::TextPage;
+
+    int start, end;
+    Okular::TextDocumentUtils::calculatePositions( document, pageNumber, start, end );
+
+    QTextCursor cursor( document );
+    for ( int i = start; i < end - 1; ++i ) {
+        cursor.setPosition( i );
+        cursor.setPosition( i + 1, QTextCursor::KeepAnchor );
+
+        QString text = cursor.selectedText();
+        if ( text.length() == 1 ) {
+            QRectF rect;
+            int page;
+            Okular::TextDocumentUtils::calculateBoundingRect( document, i, i + 1, rect, page );
+            if ( page == -1 )
+                text = "\n";
+
+            textPage->append( text, new Okular::NormalizedRect( rect.left(), rect.top(), rect.right(), rect.bottom() ) );
+        }
+    }
+    return textPage;
+}
+
+static bool fuzzyCompare( double a, double b )
+{
+    return qAbs( a - b ) < 1e-9;
+}
+
+static QString longText()
+{
+    QString html;
+    for ( int i = 0; i < 100; ++i )
+        html += QString( "<p>Paragraph number %1 of a text long enough for a few pages.</p>" ).arg( i );
+    return html;
+}
+
+static bool hasPixel( const QImage &image, QRgb color )
+{
+    for ( int y = 0; y < image.height(); ++y )
+        for ( int x = 0; x < image.width(); ++x )
+            if ( image.pixel( x, y ) == color )
+                return true;
+    return false;
+}
+
+static bool hasRedPixel( const QImage &image )
+{
+    return hasPixel( image, qRgb( 255, 0, 0 ) );
+}
+
+void TextDocumentGeneratorTest::testDisplayList()
+{
+    HtmlGenerator generator( longText() );
+    QVector< Okular::Page * > pages;
+    QCOMPARE( generator.loadDocumentWithPassword( "text.html", pages, QString() ), Okular::Document::OpenSuccess );
+    QVERIFY( pages.count() > 2 );
+
+    // the recording replays as the layout draws
+    for ( int page = 0; page < 3; ++page )
+    {
+        QVERIFY( !generator.hasDisplayList( page ) );
+        const QImage expected = layoutImage( generator.textDocument(), page );
+        QCOMPARE( generator.renderPage( page, expected.width(), expected.height() ), expected );
+        QVERIFY( generator.hasDisplayList( page ) );
+        // again from the recording
+        QCOMPARE( generator.renderPage( page, expected.width(), expected.height() ), expected );
+    }
+
+    // at another size too
+    const QImage big = generator.renderPage( 1, 600, 800 );
+    QCOMPARE( big.size(), QSize( 600, 800 ) );
+    QVERIFY( hasPixel( big, qRgb( 0, 0, 0 ) ) );
+
+    generator.closeDocument();
+    qDeleteAll( pages );
+}
+
+void TextDocumentGeneratorTest::testPageWithImage()
+{
+    HtmlGenerator generator( "<p>Before</p><p><img src=\"red.png\"></p><p>After</p>" + longText() );
+    QVector< Okular::Page * > pages;
+    QCOMPARE( generator.loadDocumentWithPassword( "image.html", pages, QString() ), Okular::Document::OpenSuccess );
+    QVERIFY( pages.count() > 1 );
+
+    // the page with the image is drawn from the layout, and not recorded
+    const QImage expected = layoutImage( generator.textDocument(), 0 );
+    QVERIFY( hasRedPixel( expected ) );
+    QCOMPARE( generator.renderPage( 0, expected.width(), expected.height() ), expected );
+    QVERIFY( !generator.hasDisplayList( 0 ) );
+
+    // the next ones are
+    const QImage next = generator.renderPage( 1, expected.width(), expected.height() );
+    QVERIFY( !hasRedPixel( next ) );
+    QVERIFY( generator.hasDisplayList( 1 ) );
+
+    generator.closeDocument();
+    qDeleteAll( pages );
+}
+
+void TextDocumentGeneratorTest::testFontChange()
+{
+    HtmlGenerator generator( longText() );
+    QVector< Okular::Page * > pages;
+    QCOMPARE( generator.loadDocumentWithPassword( "text.html", pages, QString() ), Okular::Document::OpenSuccess );
+
+    const QImage before = generator.renderPage( 0, 300, 400 );
+    QVERIFY( generator.hasDisplayList( 0 ) );
+
+    // a new font drops the recordings, made with the old layout
+    QFont font = generator.textDocument()->defaultFont();
+    font.setPointSizeF( qMax( font.pointSizeF(), 8.0 ) * 2 );
+    generator.generalSettings()->findItem( "Font" )->setProperty( font );
+    QVERIFY( generator.reparseConfig() );
+    QVERIFY( !generator.hasDisplayList( 0 ) );
+
+    const QImage after = generator.renderPage( 0, 300, 400 );
+    QCOMPARE( after, layoutImage( generator.textDocument(), 0 ) );
+    QVERIFY( after != before );
+
+    generator.closeDocument();
+    qDeleteAll( pages );
+}
+
+void TextDocumentGeneratorTest::testTextPage()
+{
+    // wrapped lines, empty paragraphs, line breaks, indented and centered text
+    QString html = "<p>Before</p><p></p><p>A line<br>broken</p><blockquote>" + longText() + "</blockquote>"
+                   "<p align=\"center\">Centered text, long enough to wrap in the middle of the page once or twice</p>"
+                   "<ul><li>First item</li><li></li><li>Third item</li></ul>";
+    html += longText();
+    HtmlGenerator generator( html );
+    QVector< Okular::Page * > pages;
+    QCOMPARE( generator.loadDocumentWithPassword( "text.html", pages, QString() ), Okular::Document::OpenSuccess );
+    QVERIFY( pages.count() > 2 );
+
+    // the characters and their rectangles are the ones of the cursor
+    for ( int page = 0; page < pages.count(); ++page )
+    {
+        Okular::TextPage *textPage = generator.createTextPage( pages.at( page ) );
+        Okular::TextPage *expectedPage = cursorTextPage( generator.textDocument(), page );
+        const Okular::TextEntity::List words = textPage->words( 0, Okular::TextPage::AnyPixelTextAreaInclusionBehaviour );
+        const Okular::TextEntity::List expected = expectedPage->words( 0, Okular::TextPage::AnyPixelTextAreaInclusionBehaviour );
+        QCOMPARE( words.count(), expected.count() );
+        QCOMPARE( textPage->text(), expectedPage->text() );
+        for ( int i = 0; i < words.count(); ++i )
+        {
+            const Okular::NormalizedRect &area = *words.at( i )->area();
+            const Okular::NormalizedRect &expectedArea = *expected.at( i )->area();
+            QCOMPARE( words.at( i )->text(), expected.at( i )->text() );
+            QVERIFY2( fuzzyCompare( area.left, expectedArea.left ) && fuzzyCompare( area.top, expectedArea.top ) &&
+                      fuzzyCompare( area.right, expectedArea.right ) && fuzzyCompare( area.bottom, expectedArea.bottom ),
+                      qPrintable( QString( "page %1, character %2" ).arg( page ).arg( i ) ) );
+        }
+        qDeleteAll( words );
+        qDeleteAll( expected );
+        delete textPage;
+        delete expectedPage;
+    }
+
+    generator.closeDocument();
+    qDeleteAll( pages );
+}
+
+QTEST_KDEMAIN( TextDocumentGeneratorTest, GUI )
+
+#include "textdocumentgeneratortest.moc"
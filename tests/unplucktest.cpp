@@ -0,0 +1,241 @@
+/***************************************************************************
+ *   Copyright (C) 2015 by the Okular developers                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include <qtest_kde.h>
+
+#include <QtCore/QFile>
+
+#include <ktemporaryfile.h>
+
+#include "../generators/plucker/unpluck/unpluck.h"
+#include "../generators/plucker/unpluck/unpluckint.h"
+
+class UnpluckTest : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void testRecordCache();
+        void testUncompress_data();
+        void testUncompress();
+        void testCorrupted_data();
+        void testCorrupted();
+};
+
+static void appendShort( QByteArray &data, int value )
+{
+    data += char( ( value >> 8 ) & 0xFF );
+    data += char( value & 0xFF );
+}
+
+static void appendLong( QByteArray &data, int value )
+{
+    appendShort( data, ( value >> 16 ) & 0xFFFF );
+    appendShort( data, value & 0xFFFF );
+}
+
+// DOC compression of @p text, as runs of literal bytes
+static QByteArray docCompress( const QByteArray &text )
+{
+    QByteArray data;
+    for ( int i = 0; i < text.size(); i += 8 )
+    {
+        const QByteArray run = text.mid( i, 8 );
+        data += char( run.size() );
+        data += run;
+    }
+    return data;
+}
+
+static QByteArray zlibCompress( const QByteArray &text )
+{
+    // without the size put first by qCompress
+    return qCompress( text ).mid( 4 );
+}
+
+// A compressed text record of one paragraph
+static QByteArray textRecord( int uid, const QByteArray &text, const QByteArray &compressed )
+{
+    QByteArray record;
+    appendShort( record, uid );
+    appendShort( record, 1 );
+    appendShort( record, text.size() );
+    record += char( PLKR_DRTYPE_TEXT_COMPRESSED );
+    record += char( 0 );
+    appendShort( record, text.size() );
+    appendShort( record, 0 );
+    return record + compressed;
+}
+
+// A Plucker database of @p records, whose uids start at 2, the first one being the home
+static bool writeDocument( KTemporaryFile *file, int compression, const QList<QByteArray> &records )
+{
+    QByteArray index;
+    appendShort( index, 1 );
+    appendShort( index, compression );
+    appendShort( index, 1 );
+    appendShort( index, PLKR_HOME_NAME );
+    appendShort( index, 2 );
+    const QList<QByteArray> all = QList<QByteArray>() << index << records;
+
+    QByteArray data( 78, '\0' );
+    data.replace( 0, 4, "test" );
+    data[ 35 ] = 1;
+    data.replace( 60, 8, "DataPlkr" );
+    data[ 76 ] = char( all.count() >> 8 );
+    data[ 77 ] = char( all.count() & 0xFF );
+
+    int offset = data.size() + 8 * all.count();
+    foreach ( const QByteArray &record, all )
+    {
+        appendLong( data, offset );
+        appendLong( data, 0 );
+        offset += record.size();
+    }
+    foreach ( const QByteArray &record, all )
+        data += record;
+
+    if ( !file->open() )
+        return false;
+    const bool written = file->write( data ) == data.size();
+    file->close();
+    return written;
+}
+
+static plkr_DataRecord *findRecord( plkr_Document *doc, int uid )
+{
+    for ( int i = 0; i < doc->nrecords; ++i )
+        if ( doc->records[ i ].uid == uid )
+            return doc->records + i;
+    return 0;
+}
+
+// The text of record @p uid, without the headers
+static QByteArray recordText( plkr_Document *doc, int uid )
+{
+    int size = 0;
+    plkr_DataRecordType type;
+    unsigned char *bytes = plkr_GetRecordBytes( doc, uid, &size, &type );
+    if ( !bytes )
+        return QByteArray();
+    return QByteArray( reinterpret_cast<char *>( bytes ) + 12, size - 12 );
+}
+
+void UnpluckTest::testRecordCache()
+{
+    const QList<QByteArray> texts = QList<QByteArray>() << "the first page" << "the second page, a bit longer" << "third";
+    QList<QByteArray> records;
+    for ( int i = 0; i < texts.count(); ++i )
+        records << textRecord( 2 + i, texts.at( i ), docCompress( texts.at( i ) ) );
+    KTemporaryFile file;
+    QVERIFY( writeDocument( &file, PLKR_COMPRESSION_DOC, records ) );
+
+    plkr_Document *doc = plkr_OpenDBFile( QFile::encodeName( file.fileName() ).data() );
+    QVERIFY( doc );
+    plkr_DataRecord *first = findRecord( doc, 2 );
+    plkr_DataRecord *second = findRecord( doc, 3 );
+    plkr_DataRecord *third = findRecord( doc, 4 );
+    QVERIFY( first && second && third );
+    QCOMPARE( doc->lru_size, 0 );
+
+    // the records read are kept, the last one first
+    for ( int i = 0; i < texts.count(); ++i )
+        QCOMPARE( recordText( doc, 2 + i ), texts.at( i ) );
+    QCOMPARE( doc->lru_size, first->cached_size + second->cached_size + third->cached_size );
+    QCOMPARE( doc->lru_first, third );
+    QCOMPARE( doc->lru_last, first );
+
+    // reading one again makes it the most recent, from the cache
+    unsigned char *cached = first->cache;
+    QCOMPARE( recordText( doc, 2 ), texts.at( 0 ) );
+    QCOMPARE( first->cache, cached );
+    QCOMPARE( doc->lru_first, first );
+    QCOMPARE( first->lru_next, third );
+    QCOMPARE( doc->lru_last, second );
+
+    // trimming frees the least recently used
+    plkr_TrimRecordCache( doc, first->cached_size + third->cached_size );
+    QVERIFY( !second->cache );
+    QVERIFY( first->cache && third->cache );
+    QCOMPARE( doc->lru_size, first->cached_size + third->cached_size );
+    QCOMPARE( doc->lru_last, third );
+
+    // and read again when needed
+    QCOMPARE( recordText( doc, 3 ), texts.at( 1 ) );
+    QCOMPARE( doc->lru_first, second );
+
+    plkr_TrimRecordCache( doc, 0 );
+    QCOMPARE( doc->lru_size, 0 );
+    QVERIFY( !doc->lru_first && !doc->lru_last );
+    QVERIFY( !first->cache && !second->cache && !third->cache );
+
+    plkr_CloseDoc( doc );
+}
+
+void UnpluckTest::testUncompress_data()
+{
+    QTest::addColumn<int>( "compression" );
+    QTest::addColumn<QByteArray>( "text" );
+    QTest::addColumn<QByteArray>( "compressed" );
+
+    const QByteArray text = "a text long enough for a few runs of literal bytes";
+    QTest::newRow( "DOC literals" ) << int( PLKR_COMPRESSION_DOC ) << text << docCompress( text );
+    // three literal bytes, a copy of 6 bytes from 3 before, a space and a character, a byte
+    QTest::newRow( "DOC tokens" ) << int( PLKR_COMPRESSION_DOC ) << QByteArray( "abcabcabc A!" )
+        << QByteArray( "\x03" "abc" "\x80\x1b" "\xc1" "!" );
+    QTest::newRow( "zlib" ) << int( PLKR_COMPRESSION_ZLIB ) << text << zlibCompress( text );
+}
+
+void UnpluckTest::testUncompress()
+{
+    QFETCH( int, compression );
+    QFETCH( QByteArray, text );
+    QFETCH( QByteArray, compressed );
+
+    KTemporaryFile file;
+    QVERIFY( writeDocument( &file, compression, QList<QByteArray>() << textRecord( 2, text, compressed ) ) );
+    plkr_Document *doc = plkr_OpenDBFile( QFile::encodeName( file.fileName() ).data() );
+    QVERIFY( doc );
+    QCOMPARE( recordText( doc, 2 ), text );
+    plkr_CloseDoc( doc );
+}
+
+void UnpluckTest::testCorrupted_data()
+{
+    QTest::addColumn<int>( "compression" );
+    QTest::addColumn<QByteArray>( "compressed" );
+
+    const QByteArray text = "abcabcabc A!";
+    QTest::newRow( "DOC copy before the start" ) << int( PLKR_COMPRESSION_DOC ) << QByteArray( "\x80\x1b" "abcabcabc A!" );
+    QTest::newRow( "DOC too long" ) << int( PLKR_COMPRESSION_DOC ) << docCompress( text + "more" );
+    QTest::newRow( "DOC too short" ) << int( PLKR_COMPRESSION_DOC ) << docCompress( text.left( 5 ) );
+    QTest::newRow( "DOC literals past the end" ) << int( PLKR_COMPRESSION_DOC ) << QByteArray( "\x08" "abc" );
+    QTest::newRow( "zlib too long" ) << int( PLKR_COMPRESSION_ZLIB ) << zlibCompress( text + "more" );
+    QTest::newRow( "zlib truncated" ) << int( PLKR_COMPRESSION_ZLIB ) << zlibCompress( text ).left( 6 );
+}
+
+void UnpluckTest::testCorrupted()
+{
+    QFETCH( int, compression );
+    QFETCH( QByteArray, compressed );
+
+    // the record is rejected, without reading or writing out of the buffers
+    KTemporaryFile file;
+    QVERIFY( writeDocument( &file, compression, QList<QByteArray>() << textRecord( 2, "abcabcabc A!", compressed ) ) );
+    plkr_Document *doc = plkr_OpenDBFile( QFile::encodeName( file.fileName() ).data() );
+    QVERIFY( doc );
+    int size = 0;
+    plkr_DataRecordType type;
+    QVERIFY( !plkr_GetRecordBytes( doc, 2, &size, &type ) );
+    plkr_CloseDoc( doc );
+}
+
+QTEST_KDEMAIN_CORE( UnpluckTest )
+
+#include "unplucktest.moc"
@@ -35,6 +35,7 @@
 #include "core/tile.h"
 #include "settings_core.h"
 #include "core/document_p.h"
+#include "core/imagekernels_p.h"
 
 K_GLOBAL_STATIC_WITH_ARGS( QPixmap, busyPixmap, ( KIconLoader::global()->loadIcon("okular", KIconLoader::NoGroup, 32, KIconLoader::DefaultState, QStringList(), 0, true) ) )
 
@@ -90,18 +91,19 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
     destPainter->fillRect( limits, backgroundColor );
 
     const bool hasTilesManager = page->hasTilesManager( observer );
-    const QPixmap *pixmap = 0;
+    QImage pageImage;
 
     if ( !hasTilesManager )
     {
         /** 1 - RETRIEVE THE 'PAGE+ID' PIXMAP OR A SIMILAR 'PAGE' ONE **/
-        pixmap = page->_o_nearestPixmap( observer, scaledWidth, scaledHeight );
+        // the image the page was rendered to, shared and not converted
+        pageImage = page->_o_nearestImage( observer, scaledWidth, scaledHeight );
 
         /** 1B - IF NO PIXMAP, DRAW EMPTY PAGE **/
-        double pixmapRescaleRatio = pixmap ? scaledWidth / (double)pixmap->width() : -1;
-        long pixmapPixels = pixmap ? (long)pixmap->width() * (long)pixmap->height() : 0;
-        if ( !pixmap || pixmapRescaleRatio > 20.0 || pixmapRescaleRatio < 0.25 ||
-             (scaledWidth > pixmap->width() && pixmapPixels > 60000000L) )
+        double pixmapRescaleRatio = !pageImage.isNull() ? scaledWidth / (double)pageImage.width() : -1;
+        long pixmapPixels = (long)pageImage.width() * (long)pageImage.height();
+        if ( pageImage.isNull() || pixmapRescaleRatio > 20.0 || pixmapRescaleRatio < 0.25 ||
+             (scaledWidth > pageImage.width() && pixmapPixels > 60000000L) )
         {
             // draw something on the blank page: the okular icon or a cross (as a fallback)
             if ( !busyPixmap->isNull() )
@@ -235,7 +237,7 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
     /** 3 - ENABLE BACKBUFFERING IF DIRECT IMAGE MANIPULATION IS NEEDED **/
     bool bufferAccessibility = (flags & Accessibility) && Okular::SettingsCore::changeColors() && (Okular::SettingsCore::renderMode() != Okular::SettingsCore::EnumRenderMode::Paper);
     bool useBackBuffer = bufferAccessibility || bufferedHighlights || bufferedAnnotations || viewPortPoint;
-    QPixmap * backPixmap = 0;
+    QImage backImage;
     QPainter * mixedPainter = 0;
     QRect limitsInPixmap = limits.translated( scaledCrop.topLeft() );
         // limits within full (scaled but uncropped) pixmap
@@ -266,15 +268,16 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
         }
         else
         {
-            // 4A.1. if size is ok, draw the page pixmap using painter
-            if ( pixmap->width() == scaledWidth && pixmap->height() == scaledHeight )
-                destPainter->drawPixmap( limits.topLeft(), *pixmap, limitsInPixmap );
+            // 4A.1. if size is ok, draw the page image using painter (it
+            // converts to a native pixmap only the painted part, if needed)
+            if ( pageImage.width() == scaledWidth && pageImage.height() == scaledHeight )
+                destPainter->drawImage( limits.topLeft(), pageImage, limitsInPixmap );
 
-            // else draw a scaled portion of the magnified pixmap
+            // else draw a scaled portion of the magnified image
             else
             {
                 QImage destImage;
-                scalePixmapOnImage( destImage, pixmap, scaledWidth, scaledHeight, limitsInPixmap );
+                scaleImageOnImage( destImage, pageImage, scaledWidth, scaledHeight, limitsInPixmap );
                 destPainter->drawImage( limits.left(), limits.top(), destImage, 0, 0,
                                          limits.width(),limits.height() );
             }
@@ -286,12 +289,9 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
     /** 4B -- BUFFERED FLOW. IMAGE PAINTING + OPERATIONS. QPAINTER OVER PIXMAP  **/
     else
     {
-        // the image over which we are going to draw
-        QImage backImage;
-
         bool has_alpha;
-        if ( pixmap )
-            has_alpha = pixmap->hasAlpha();
+        if ( !pageImage.isNull() )
+            has_alpha = pageImage.hasAlphaChannel();
         else
             has_alpha = true;
 
@@ -334,10 +334,10 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
         else
         {
             // 4B.1. draw the page pixmap: normal or scaled
-            if ( pixmap->width() == scaledWidth && pixmap->height() == scaledHeight )
-                cropPixmapOnImage( backImage, pixmap, limitsInPixmap );
+            if ( pageImage.width() == scaledWidth && pageImage.height() == scaledHeight )
+                cropImageOnImage( backImage, pageImage, limitsInPixmap );
             else
-                scalePixmapOnImage( backImage, pixmap, scaledWidth, scaledHeight, limitsInPixmap );
+                scaleImageOnImage( backImage, pageImage, scaledWidth, scaledHeight, limitsInPixmap );
         }
 
         // 4B.2. modify pixmap following accessibility settings
@@ -391,41 +391,8 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
                 highlightRect.translate( -limits.left(), -limits.top() );
 
                 // highlight composition (product: highlight color * destcolor)
-                unsigned int * data = (unsigned int *)backImage.bits();
-                int val, newR, newG, newB,
-                    rh = (*hIt).first.red(),
-                    gh = (*hIt).first.green(),
-                    bh = (*hIt).first.blue(),
-                    offset = highlightRect.top() * backImage.width();
-                for( int y = highlightRect.top(); y <= highlightRect.bottom(); ++y )
-                {
-                    for( int x = highlightRect.left(); x <= highlightRect.right(); ++x )
-                    {
-                        val = data[ x + offset ];
-                        //for odt or epub
-                        if(has_alpha)
-                        {
-                            newR = qRed(val);
-                            newG = qGreen(val);
-                            newB = qBlue(val);
-
-                            if(newR == newG && newG == newB && newR == 0)
-                                newR = newG = newB = 255;
-
-                            newR = (newR * rh) / 255;
-                            newG = (newG * gh) / 255;
-                            newB = (newB * bh) / 255;
-                        }
-                        else
-                        {
-                            newR = (qRed(val) * rh) / 255;
-                            newG = (qGreen(val) * gh) / 255;
-                            newB = (qBlue(val) * bh) / 255;
-                        }
-                        data[ x + offset ] = qRgba( newR, newG, newB, 255 );
-                    }
-                    offset += backImage.width();
-                }
+                // for odt or epub the transparent background is highlighted as white
+                Okular::ImageKernels::multiplyRect( backImage, highlightRect, (*hIt).first, has_alpha );
             }
         }
         // 4B.4. paint annotations [COMPOSITED ONES]
@@ -648,11 +615,8 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
 */
         }
 
-        // 4B.5. create the back pixmap converting from the local image
-        backPixmap = new QPixmap( QPixmap::fromImage( backImage ) );
-
-        // 4B.6. create a painter over the pixmap and set it as the active one
-        mixedPainter = new QPainter( backPixmap );
+        // 4B.5. create a painter over the image and set it as the active one
+        mixedPainter = new QPainter( &backImage );
         mixedPainter->translate( -limits.left(), -limits.top() );
     }
 
@@ -730,7 +694,7 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
                     QRect annotRect2 = annotBoundary2.intersect( limits );
                     QRect innerRect2( annotRect2.left() - annotBoundary2.left(), annotRect2.top() -
                     annotBoundary2.top(), annotRect2.width(), annotRect2.height() );
-                    scalePixmapOnImage( scaledImage, &pixmap,
+                    scaleImageOnImage( scaledImage, pixmap.toImage(),
                                         TEXTANNOTATION_ICONSIZE, TEXTANNOTATION_ICONSIZE,
                                         innerRect2, QImage::Format_ARGB32 );
                     // if the annotation color is valid (ie it was set), then
@@ -755,10 +719,10 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
                 if ( !pixmap.isNull() ) // should never happen but can happen on huge sizes
                 {
                     QImage scaledImage;
-                    scalePixmapOnImage( scaledImage, &pixmap, annotBoundary.width(),
+                    scaleImageOnImage( scaledImage, pixmap.toImage(), annotBoundary.width(),
                                         annotBoundary.height(), innerRect, QImage::Format_ARGB32 );
                     if ( opacity < 255 )
-                        changeImageAlpha( scaledImage, opacity );
+                        Okular::ImageKernels::scaleImageAlpha( scaledImage, opacity );
                     pixmap = QPixmap::fromImage( scaledImage );
 
                     // draw the scaled and al
@@ -846,12 +810,11 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
         mixedPainter->restore();
     }
 
-    /** 7 -- BUFFERED FLOW. Copy BACKPIXMAP on DESTINATION PAINTER **/
+    /** 7 -- BUFFERED FLOW. Copy BACKIMAGE on DESTINATION PAINTER **/
     if ( useBackBuffer )
     {
         delete mixedPainter;
-        destPainter->drawPixmap( limits.left(), limits.top(), *backPixmap );
-        delete backPixmap;
+        destPainter->drawImage( limits.left(), limits.top(), backImage );
     }
 
     // delete object containers
@@ -861,32 +824,28 @@ void PagePainter::paintCroppedPageOnPainter( QPainter * destPainter, const Okula
 }
 
 
-/** Private Helpers :: Pixmap conversion **/
-void PagePainter::cropPixmapOnImage( QImage & dest, const QPixmap * src, const QRect & r )
+/** Private Helpers :: Image conversion **/
+void PagePainter::cropImageOnImage( QImage & dest, const QImage & src, const QRect & r )
 {
-    // handle quickly the case in which the whole pixmap has to be converted
-    if ( r == QRect( 0, 0, src->width(), src->height() ) )
+    // handle quickly the case in which the whole image is used: it is
+    // shared until modified, and converted only if it has to
+    if ( r == src.rect() )
     {
-        dest = src->toImage();
-        dest = dest.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        dest = src.convertToFormat(QImage::Format_ARGB32_Premultiplied);
     }
-    // else copy a portion of the src to an internal pixmap (smaller) and convert it
+    // else copy a portion of the src
     else
     {
-        QImage croppedImage( r.width(), r.height(), QImage::Format_ARGB32_Premultiplied );
-        QPainter p( &croppedImage );
-        p.drawPixmap( 0, 0, *src, r.left(), r.top(), r.width(), r.height() );
-        p.end();
-        dest = croppedImage;
+        dest = src.copy( r ).convertToFormat(QImage::Format_ARGB32_Premultiplied);
     }
 }
 
-void PagePainter::scalePixmapOnImage ( QImage & dest, const QPixmap * src,
+void PagePainter::scaleImageOnImage ( QImage & dest, const QImage & src,
     int scaledWidth, int scaledHeight, const QRect & cropRect, QImage::Format format )
 {
     // {source, destination, scaling} params
-    int srcWidth = src->width(),
-        srcHeight = src->height(),
+    int srcWidth = src.width(),
+        srcHeight = src.height(),
         destLeft = cropRect.left(),
         destTop = cropRect.top(),
         destWidth = cropRect.width(),
@@ -896,9 +855,9 @@ void PagePainter::scalePixmapOnImage ( QImage & dest, const QPixmap * src,
     dest = QImage( destWidth, destHeight, format );
     unsigned int * destData = (unsigned int *)dest.bits();
 
-    // source image (1:1 conversion from pixmap)
-    QImage srcImage = src->toImage().convertToFormat(format);
-    unsigned int * srcData = (unsigned int *)srcImage.bits();
+    // source image, converted only if not already in the right format
+    const QImage srcImage = src.convertToFormat(format);
+    const unsigned int * srcData = (const unsigned int *)srcImage.constBits();
 
     // precalc the x correspondancy conversion in a lookup table
     QVarLengthArray<unsigned int> xOffset( destWidth );
@@ -916,31 +875,27 @@ void PagePainter::scalePixmapOnImage ( QImage & dest, const QPixmap * src,
 }
 
 /** Private Helpers :: Image Drawing **/
-// from Arthur - qt4
-static inline int qt_div_255(int x) { return (x + (x>>8) + 0x80) >> 8; }
-
-void PagePainter::changeImageAlpha( QImage & image, unsigned int destAlpha )
+// returns true and fills 'rect' if the closed path is an axis aligned rectangle
+static bool pathToImageRect( const QList< Okular::NormalizedPoint > & normPath, int imageWidth, int imageHeight, QRect & rect )
 {
-    // iterate over all pixels changing the alpha component value
-    unsigned int * data = (unsigned int *)image.bits();
-    unsigned int pixels = image.width() * image.height();
-
-    int source, sourceAlpha;
-    for( register unsigned int i = 0; i < pixels; ++i )
-    {   // optimize this loop keeping byte order into account
-        source = data[i];
-        if ( (sourceAlpha = qAlpha( source )) == 255 )
-        {
-            // use destAlpha
-            data[i] = qRgba( qRed(source), qGreen(source), qBlue(source), destAlpha );
-        }
-        else
-        {
-            // use destAlpha * sourceAlpha product
-            sourceAlpha = qt_div_255( destAlpha * sourceAlpha );
-            data[i] = qRgba( qRed(source), qGreen(source), qBlue(source), sourceAlpha );
-        }
+    if ( normPath.size() != 4 )
+        return false;
+
+    static const double eps = 1e-6;
+    for ( int i = 0; i < 4; ++i )
+    {
+        const Okular::NormalizedPoint & a = normPath[ i ];
+        const Okular::NormalizedPoint & b = normPath[ ( i + 1 ) % 4 ];
+        if ( fabs( a.x - b.x ) > eps && fabs( a.y - b.y ) > eps )
+            return false;
     }
+
+    const double left = qMin( normPath[ 0 ].x, normPath[ 2 ].x ), right = qMax( normPath[ 0 ].x, normPath[ 2 ].x );
+    const double top = qMin( normPath[ 0 ].y, normPath[ 2 ].y ), bottom = qMax( normPath[ 0 ].y, normPath[ 2 ].y );
+    const int x1 = qRound( left * imageWidth ), x2 = qRound( right * imageWidth );
+    const int y1 = qRound( top * imageHeight ), y2 = qRound( bottom * imageHeight );
+    rect = QRect( x1, y1, x2 - x1, y2 - y1 );
+    return true;
 }
 
 void PagePainter::drawShapeOnImage(
@@ -964,6 +919,17 @@ void PagePainter::drawShapeOnImage(
     double fImageWidth = (double)imageWidth;
     double fImageHeight = (double)imageHeight;
 
+    // fast path: multiply-filled rectangles (highlight annotations) are
+    // composited directly on the image bits
+    QRect fillRect;
+    if ( op == Multiply && closeShape && pen.style() == Qt::NoPen && brush.style() == Qt::SolidPattern &&
+         image.format() == QImage::Format_ARGB32_Premultiplied &&
+         pathToImageRect( normPath, imageWidth, imageHeight, fillRect ) )
+    {
+        Okular::ImageKernels::multiplyFillRect( image, fillRect, brush.color() );
+        return;
+    }
+
     // stroke outline
     double penWidth = (double)pen.width() * penWidthMultiplier;
     QPainter painter(&image);
@@ -53,17 +53,14 @@ class PagePainter
             const Okular::NormalizedRect & crop, Okular::NormalizedPoint *viewPortPoint );
 
     private:
-        static void cropPixmapOnImage( QImage & dest, const QPixmap * src, const QRect & r );
+        static void cropImageOnImage( QImage & dest, const QImage & src, const QRect & r );
 
         // create an image taking the 'cropRect' portion of an image scaled
         // to 'scaledWidth' by 'scaledHeight' pixels. cropRect must be inside
         // the QRect(0,0, scaledWidth,scaledHeight)
-        static void scalePixmapOnImage( QImage & dest, const QPixmap *src,
+        static void scaleImageOnImage( QImage & dest, const QImage & src,
             int scaledWidth, int scaledHeight, const QRect & cropRect, QImage::Format format = QImage::Format_ARGB32_Premultiplied );
 
-        // set the alpha component of the image to a given value
-        static void changeImageAlpha( QImage & image, unsigned int alpha );
-
         // my pretty dear raster function
         typedef QList< Okular::NormalizedPoint > NormalizedPath;
         enum RasterOperation { Normal, Multiply };
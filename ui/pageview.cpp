@@ -110,6 +110,46 @@ TableSelectionPart::TableSelectionPart(  PageViewItem * item_p, const Okular::No
 {
 }
 
+// what the size of a PageViewItem depends on: pages with the same size,
+// crop and rotation laid out in cells of the same size get the same size
+struct ItemSizeKey
+{
+    double pageWidth;
+    double pageHeight;
+    int rotation;
+    int cropMode;               // 0: none, 1: trim margins, 2: trim to selection
+    Okular::NormalizedRect cropSource;
+    int colWidth;
+    int rowHeight;
+    int zoomMode;
+    double zoomFactor;          // only meaningful for the fixed zoom
+    bool continuous;
+
+    bool operator==( const ItemSizeKey &other ) const
+    {
+        return pageWidth == other.pageWidth && pageHeight == other.pageHeight
+               && rotation == other.rotation && cropMode == other.cropMode
+               && ( cropMode == 0 || cropSource == other.cropSource )
+               && colWidth == other.colWidth && rowHeight == other.rowHeight
+               && zoomMode == other.zoomMode && zoomFactor == other.zoomFactor
+               && continuous == other.continuous;
+    }
+};
+
+inline uint qHash( const ItemSizeKey &key )
+{
+    return ::qHash( (int)key.pageWidth ) ^ ( ::qHash( (int)key.pageHeight ) << 8 )
+           ^ ( key.colWidth << 4 ) ^ ( key.rowHeight << 12 ) ^ ( key.rotation << 28 ) ^ key.cropMode;
+}
+
+struct ItemSize
+{
+    int width;
+    int height;
+    double zoom;
+    Okular::NormalizedRect crop;
+};
+
 // structure used internally by PageView for data storage
 class PageViewPrivate
 {
@@ -119,12 +159,33 @@ public:
     FormWidgetsController* formWidgetsController();
     OkularTTS* tts();
     QString selectedText() const;
+    void addVideoWidgets( PageViewItem *item, const QLinkedList< Okular::Annotation * > &annotations );
+    bool itemsInRect( const QRect &rect, int *firstItem, int *lastItem ) const;
+    void moveItemWidgets( PageViewItem *item, const QRect &viewportRect );
 
     // the document, pageviewItems and the 'visible cache'
     PageView *q;
     Okular::Document * document;
     QVector< PageViewItem * > items;
     QLinkedList< PageViewItem * > visibleItems;
+
+    // the rows of the layout (top to bottom) with the range of items in
+    // each of them, to find the items in an area without checking them all
+    struct LayoutRow
+    {
+        int top;
+        int bottom;
+        int firstItem;
+        int lastItem;
+    };
+    QVector< LayoutRow > layoutRows;
+    // the items having form or video widgets, and whether all of those
+    // widgets need to be moved (after a relayout) or just the visible ones
+    QVector< PageViewItem * > itemsWithWidgets;
+    bool moveAllItemWidgets;
+    // the item sizes computed by the previous relayouts, so documents made
+    // of pages alike do not compute the same size over and over
+    QHash< ItemSizeKey, ItemSize > itemSizes;
     MagnifierView *magnifierView;
 
     // view layout (columns and continuous in Settings), zoom and mouse
@@ -235,7 +296,7 @@ public:
 };
 
 PageViewPrivate::PageViewPrivate( PageView *qq )
-    : q( qq )
+    : q( qq ), moveAllItemWidgets( true )
 {
 }
 
@@ -270,6 +331,87 @@ OkularTTS* PageViewPrivate::tts()
     return m_tts;
 }
 
+void PageViewPrivate::addVideoWidgets( PageViewItem *item, const QLinkedList< Okular::Annotation * > &annotations )
+{
+    QLinkedList< Okular::Annotation * >::const_iterator aIt = annotations.constBegin(), aEnd = annotations.constEnd();
+    for ( ; aIt != aEnd; ++aIt )
+    {
+        Okular::Annotation * a = *aIt;
+        if ( a->subType() == Okular::Annotation::AMovie )
+        {
+            Okular::MovieAnnotation * movieAnn = static_cast< Okular::MovieAnnotation * >( a );
+            if ( item->videoWidgets().contains( movieAnn->movie() ) )
+                continue;
+            VideoWidget * vw = new VideoWidget( movieAnn, movieAnn->movie(), document, q->viewport() );
+            item->videoWidgets().insert( movieAnn->movie(), vw );
+            vw->pageInitialized();
+            moveAllItemWidgets = true;
+        }
+        else if ( a->subType() == Okular::Annotation::AScreen )
+        {
+            const Okular::ScreenAnnotation * screenAnn = static_cast< Okular::ScreenAnnotation * >( a );
+            Okular::Movie *movie = GuiUtils::renditionMovieFromScreenAnnotation( screenAnn );
+            if ( movie && !item->videoWidgets().contains( movie ) )
+            {
+                VideoWidget * vw = new VideoWidget( screenAnn, movie, document, q->viewport() );
+                item->videoWidgets().insert( movie, vw );
+                vw->pageInitialized();
+                moveAllItemWidgets = true;
+            }
+        }
+    }
+
+    if ( !item->videoWidgets().isEmpty() && !itemsWithWidgets.contains( item ) )
+        itemsWithWidgets.append( item );
+}
+
+bool PageViewPrivate::itemsInRect( const QRect &rect, int *firstItem, int *lastItem ) const
+{
+    // binary search of the first row ending below the top of the rect
+    int lo = 0, hi = layoutRows.count();
+    while ( lo < hi )
+    {
+        const int mid = ( lo + hi ) / 2;
+        if ( layoutRows[ mid ].bottom <= rect.top() )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if ( lo == layoutRows.count() || layoutRows[ lo ].top > rect.bottom() )
+        return false;
+
+    int last = lo;
+    while ( last + 1 < layoutRows.count() && layoutRows[ last + 1 ].top <= rect.bottom() )
+        ++last;
+    *firstItem = layoutRows[ lo ].firstItem;
+    *lastItem = layoutRows[ last ].lastItem;
+    return true;
+}
+
+void PageViewPrivate::moveItemWidgets( PageViewItem *item, const QRect &viewportRect )
+{
+    const QRect viewportRectAtZeroZero( 0, 0, viewportRect.width(), viewportRect.height() );
+    foreach( FormWidgetIface *fwi, item->formWidgets() )
+    {
+        Okular::NormalizedRect r = fwi->rect();
+        fwi->moveTo(
+            qRound( item->uncroppedGeometry().left() + item->uncroppedWidth() * r.left ) + 1 - viewportRect.left(),
+            qRound( item->uncroppedGeometry().top() + item->uncroppedHeight() * r.top ) + 1 - viewportRect.top() );
+    }
+    Q_FOREACH ( VideoWidget *vw, item->videoWidgets() )
+    {
+        const Okular::NormalizedRect r = vw->normGeometry();
+        vw->move(
+            qRound( item->uncroppedGeometry().left() + item->uncroppedWidth() * r.left ) + 1 - viewportRect.left(),
+            qRound( item->uncroppedGeometry().top() + item->uncroppedHeight() * r.top ) + 1 - viewportRect.top() );
+
+        if ( vw->isPlaying() && viewportRectAtZeroZero.intersect( vw->geometry() ).isEmpty() ) {
+            vw->stop();
+            vw->pageLeft();
+        }
+    }
+}
+
 
 /* PageView. What's in this file? -> quick overview.
  * Code weight (in rows) and meaning:
@@ -379,6 +521,8 @@ PageView::PageView( QWidget *parent, Okular::Document *document )
     d->delayResizeEventTimer->setSingleShot( true );
     connect( d->delayResizeEventTimer, SIGNAL(timeout()), this, SLOT(delayedResizeEvent()) );
 
+    d->document->setBoundingBoxesNeeded( Okular::Settings::trimMargins() );
+
     setFrameStyle(QFrame::NoFrame);
 
     setAttribute( Qt::WA_StaticContents );
@@ -936,6 +1080,10 @@ void PageView::notifySetup( const QVector< Okular::Page * > & pageSet, int setup
         delete *dIt;
     d->items.clear();
     d->visibleItems.clear();
+    d->layoutRows.clear();
+    d->itemsWithWidgets.clear();
+    d->itemSizes.clear();
+    d->moveAllItemWidgets = true;
     d->pagesWithTextSelection.clear();
     toggleFormWidgets( false );
     if ( d->formsWidgetController )
@@ -968,30 +1116,9 @@ void PageView::notifySetup( const QVector< Okular::Page * > & pageSet, int setup
                 hasformwidgets = true;
             }
         }
-        const QLinkedList< Okular::Annotation * > annotations = (*setIt)->annotations();
-        QLinkedList< Okular::Annotation * >::const_iterator aIt = annotations.constBegin(), aEnd = annotations.constEnd();
-        for ( ; aIt != aEnd; ++aIt )
-        {
-            Okular::Annotation * a = *aIt;
-            if ( a->subType() == Okular::Annotation::AMovie )
-            {
-                Okular::MovieAnnotation * movieAnn = static_cast< Okular::MovieAnnotation * >( a );
-                VideoWidget * vw = new VideoWidget( movieAnn, movieAnn->movie(), d->document, viewport() );
-                item->videoWidgets().insert( movieAnn->movie(), vw );
-                vw->pageInitialized();
-            }
-            else if ( a->subType() == Okular::Annotation::AScreen )
-            {
-                const Okular::ScreenAnnotation * screenAnn = static_cast< Okular::ScreenAnnotation * >( a );
-                Okular::Movie *movie = GuiUtils::renditionMovieFromScreenAnnotation( screenAnn );
-                if ( movie )
-                {
-                    VideoWidget * vw = new VideoWidget( screenAnn, movie, d->document, viewport() );
-                    item->videoWidgets().insert( movie, vw );
-                    vw->pageInitialized();
-                }
-            }
-        }
+        if ( !item->formWidgets().isEmpty() )
+            d->itemsWithWidgets.append( item );
+        d->addVideoWidgets( item, (*setIt)->annotations() );
     }
 
     // invalidate layout so relayout/repaint will happen on next viewport change
@@ -1177,14 +1304,10 @@ void PageView::slotRealNotifyViewportChanged( bool smoothMove )
 
     // find PageViewItem matching the viewport description
     const Okular::DocumentViewport & vp = d->document->viewport();
-    PageViewItem * item = 0;
-    QVector< PageViewItem * >::const_iterator iIt = d->items.constBegin(), iEnd = d->items.constEnd();
-    for ( ; iIt != iEnd; ++iIt )
-        if ( (*iIt)->pageNumber() == vp.pageNumber )
-        {
-            item = *iIt;
-            break;
-        }
+    // (the items are in page order)
+    PageViewItem * item = d->items.value( vp.pageNumber );
+    if ( item && item->pageNumber() != vp.pageNumber )
+        item = 0;
     if ( !item )
     {
         kWarning() << "viewport for page" << vp.pageNumber << "has no matching item!";
@@ -1268,6 +1391,9 @@ void PageView::notifyPageChanged( int pageNumber, int changedFlags )
     if ( changedFlags & DocumentObserver::Annotations )
     {
         const QLinkedList< Okular::Annotation * > annots = d->document->page( pageNumber )->annotations();
+        // the annotations may have been loaded after the setup
+        if ( pageNumber < d->items.count() )
+            d->addVideoWidgets( d->items[ pageNumber ], annots );
         const QLinkedList< Okular::Annotation * >::ConstIterator annItEnd = annots.end();
         QHash< Okular::Annotation*, AnnotWindow * >::Iterator it = d->m_annowindows.begin();
         for ( ; it != d->m_annowindows.end(); )
@@ -1295,10 +1421,10 @@ void PageView::notifyPageChanged( int pageNumber, int changedFlags )
 #ifdef PAGEVIEW_DEBUG
         kDebug() << "BoundingBox change on page" << pageNumber;
 #endif
-        slotRelayoutPages();
-        slotRequestVisiblePixmaps(); // TODO: slotRelayoutPages() may have done this already!
-        // Repaint the whole widget since layout may have changed
-        viewport()->update();
+        // the bounding boxes computed in background come in bursts, relayout
+        // once for all of them
+        if ( Okular::Settings::trimMargins() && !d->delayResizeEventTimer->isActive() )
+            d->delayResizeEventTimer->start( 100 );
         return;
     }
 
@@ -2747,10 +2873,11 @@ void PageView::mouseReleaseEvent( QMouseEvent * e )
             {
                 // grab text in selection by extracting it from all intersected pages
                 const Okular::Page * okularPage=0;
-                QVector< PageViewItem * >::const_iterator iIt = d->items.constBegin(), iEnd = d->items.constEnd();
-                for ( ; iIt != iEnd; ++iIt )
+                int firstItem = 0, lastItem = -1;
+                d->itemsInRect( selectionRect, &firstItem, &lastItem );
+                for ( int itemIndex = firstItem; itemIndex <= lastItem; ++itemIndex )
                 {
-                    PageViewItem * item = *iIt;
+                    PageViewItem * item = d->items[ itemIndex ];
                     if ( !item->isVisible() )
                         continue;
 
@@ -2893,10 +3020,11 @@ void PageView::mouseReleaseEvent( QMouseEvent * e )
                 // break up the selection into page-relative pieces
                 d->tableSelectionParts.clear();
                 const Okular::Page * okularPage=0;
-                QVector< PageViewItem * >::const_iterator iIt = d->items.constBegin(), iEnd = d->items.constEnd();
-                for ( ; iIt != iEnd; ++iIt )
+                int firstItem = 0, lastItem = -1;
+                d->itemsInRect( selectionRect, &firstItem, &lastItem );
+                for ( int itemIndex = firstItem; itemIndex <= lastItem; ++itemIndex )
                 {
-                    PageViewItem * item = *iIt;
+                    PageViewItem * item = d->items[ itemIndex ];
                     if ( !item->isVisible() )
                         continue;
 
@@ -3361,8 +3489,11 @@ QList< Okular::RegularAreaRect * > PageView::textSelections( const QPoint& start
     QList< Okular::RegularAreaRect * > ret;
     QSet< int > affectedItemsSet;
     QRect selectionRect = QRect( start, end ).normalized();
-    foreach( PageViewItem * item, d->items )
+    int firstItem = 0, lastItem = -1;
+    d->itemsInRect( selectionRect, &firstItem, &lastItem );
+    for ( int itemIndex = firstItem; itemIndex <= lastItem; ++itemIndex )
     {
+        PageViewItem * item = d->items[ itemIndex ];
         if ( item->isVisible() && selectionRect.intersects( item->croppedGeometry() ) )
             affectedItemsSet.insert( item->pageNumber() );
     }
@@ -3446,16 +3577,17 @@ void PageView::drawDocumentOnPainter( const QRect & contentsRect, QPainter * p )
     // create a region from which we'll subtract painted rects
     QRegion remainingArea( contentsRect );
 
-    // iterate over all items painting the ones intersecting contentsRect
-    QVector< PageViewItem * >::const_iterator iIt = d->items.constBegin(), iEnd = d->items.constEnd();
-    for ( ; iIt != iEnd; ++iIt )
+    // iterate over the items of the rows in contentsRect, painting the ones intersecting it
+    int firstItem = 0, lastItem = -1;
+    d->itemsInRect( checkRect, &firstItem, &lastItem );
+    for ( int itemIndex = firstItem; itemIndex <= lastItem; ++itemIndex )
     {
+        PageViewItem * item = d->items[ itemIndex ];
         // check if a piece of the page intersects the contents rect
-        if ( !(*iIt)->isVisible() || !(*iIt)->croppedGeometry().intersects( checkRect ) )
+        if ( !item->isVisible() || !item->croppedGeometry().intersects( checkRect ) )
             continue;
 
-        // get item and item's outline geometries
-        PageViewItem * item = *iIt;
+        // get item's outline geometries
         QRect itemGeometry = item->croppedGeometry(),
               outlineGeometry = itemGeometry;
         outlineGeometry.adjust( -1, -1, 3, 3 );
@@ -3526,12 +3658,31 @@ void PageView::updateItemSize( PageViewItem * item, int colWidth, int rowHeight
     Okular::NormalizedRect crop( 0., 0., 1., 1. );
 
     // Handle cropping, due to either "Trim Margin" or "Trim to Selection" cases
+    int cropMode = 0;
     if (( Okular::Settings::trimMargins() && okularPage->isBoundingBoxKnown()
          && !okularPage->boundingBox().isNull() ) ||
         ( d->aTrimToSelection && d->aTrimToSelection->isChecked() &&  !d->trimBoundingBox.isNull()))
+        cropMode = Okular::Settings::trimMargins() ? 1 : 2;
+
+    // look for an already computed item of the same size
+    const ItemSizeKey key = { width, height, okularPage->rotation(), cropMode,
+                              cropMode == 1 ? okularPage->boundingBox() : d->trimBoundingBox,
+                              colWidth, rowHeight, d->zoomMode,
+                              d->zoomMode == ZoomFixed ? d->zoomFactor : 0.0,
+                              d->zoomMode == ZoomFitAuto && Okular::Settings::viewContinuous() };
+    QHash< ItemSizeKey, ItemSize >::const_iterator cached = d->itemSizes.constFind( key );
+    if ( cached != d->itemSizes.constEnd() )
+    {
+        item->setWHZC( cached->width, cached->height, cached->zoom, cached->crop );
+        if ( d->zoomMode != ZoomFixed && (uint)item->pageNumber() == d->document->currentPage() )
+            d->zoomFactor = cached->zoom;
+        return;
+    }
+
+    if ( cropMode != 0 )
     {
 
-        crop = Okular::Settings::trimMargins() ? okularPage->boundingBox() : d->trimBoundingBox;
+        crop = cropMode == 1 ? okularPage->boundingBox() : d->trimBoundingBox;
 
         // Rotate the bounding box
         for ( int i = okularPage->rotation(); i > 0; --i )
@@ -3640,26 +3791,36 @@ void PageView::updateItemSize( PageViewItem * item, int colWidth, int rowHeight
     }
 #ifndef NDEBUG
     else
+    {
         kDebug() << "calling updateItemSize with unrecognized d->zoomMode!";
+        return;
+    }
 #endif
+
+    // the cache is bounded, documents with so many different sizes are rare
+    if ( d->itemSizes.count() >= 4096 )
+        d->itemSizes.clear();
+    const ItemSize size = { item->croppedWidth(), item->croppedHeight(), item->zoomFactor(), crop };
+    d->itemSizes.insert( key, size );
 }
 
 PageViewItem * PageView::pickItemOnPoint( int x, int y )
 {
-    PageViewItem * item = 0;
-    QLinkedList< PageViewItem * >::const_iterator iIt = d->visibleItems.constBegin(), iEnd = d->visibleItems.constEnd();
-    for ( ; iIt != iEnd; ++iIt )
+    int firstItem = 0, lastItem = -1;
+    if ( !d->itemsInRect( QRect( x, y, 1, 1 ), &firstItem, &lastItem ) )
+        return 0;
+
+    // only the items in the viewport can be picked
+    const QRect viewportRect( horizontalScrollBar()->value(), verticalScrollBar()->value(),
+                              viewport()->width(), viewport()->height() );
+    for ( int itemIndex = firstItem; itemIndex <= lastItem; ++itemIndex )
     {
-        PageViewItem * i = *iIt;
+        PageViewItem * i = d->items[ itemIndex ];
         const QRect & r = i->croppedGeometry();
-        if ( x < r.right() && x > r.left() && y < r.bottom() )
-        {
-            if ( y > r.top() )
-                item = i;
-            break;
-        }
+        if ( x < r.right() && x > r.left() && y < r.bottom() && y > r.top() )
+            return i->isVisible() && viewportRect.intersects( r ) ? i : 0;
     }
-    return item;
+    return 0;
 }
 
 void PageView::textSelectionClear()
@@ -4393,11 +4554,32 @@ void PageView::slotRelayoutPages()
 
         // 1) find the maximum columns width and rows height for a grid in
         // which each page must well-fit inside a cell
+        // a page like the previous one in a cell like the previous one gets
+        // its size, so a document made of pages alike is sized in a single
+        // pass; not with trimmed margins, the crop depends on the contents
+        const bool sizesRepeat = !Okular::Settings::trimMargins();
+        const PageViewItem * sizedItem = 0;
+        int sizedColWidth = 0;
         for ( iIt = d->items.constBegin(); iIt != iEnd; ++iIt )
         {
             PageViewItem * item = *iIt;
-            // update internal page size (leaving a little margin in case of Fit* modes)
-            updateItemSize( item, colWidth[ cIdx ] - kcolWidthMargin, viewportHeight - krowHeightMargin );
+            const int cellWidth = colWidth[ cIdx ] - kcolWidthMargin;
+            if ( sizesRepeat && sizedItem && cellWidth == sizedColWidth
+                 && item->page()->width() == sizedItem->page()->width()
+                 && item->page()->height() == sizedItem->page()->height()
+                 && item->page()->rotation() == sizedItem->page()->rotation() )
+            {
+                item->setWHZC( sizedItem->croppedWidth(), sizedItem->croppedHeight(), sizedItem->zoomFactor(), sizedItem->crop() );
+                if ( d->zoomMode != ZoomFixed && item == currentItem )
+                    d->zoomFactor = item->zoomFactor();
+            }
+            else
+            {
+                // update internal page size (leaving a little margin in case of Fit* modes)
+                updateItemSize( item, cellWidth, viewportHeight - krowHeightMargin );
+                sizedItem = item;
+                sizedColWidth = cellWidth;
+            }
             // find row's maximum height and column's max width
             if ( item->croppedWidth() + kcolWidthMargin > colWidth[ cIdx ] )
                 colWidth[ cIdx ] = item->croppedWidth() + kcolWidthMargin;
@@ -4437,7 +4619,11 @@ void PageView::slotRelayoutPages()
             for ( int i = 0; i < cIdx; ++i )
                 insertX += colWidth[ i ];
         }
-        for ( iIt = d->items.constBegin(); iIt != iEnd; ++iIt )
+        d->layoutRows.clear();
+        d->layoutRows.reserve( continuousView ? nRows : 1 );
+        int itemIndex = 0,
+            rowFirstItem = 0;
+        for ( iIt = d->items.constBegin(); iIt != iEnd; ++iIt, ++itemIndex )
         {
             PageViewItem * item = *iIt;
             int cWidth = colWidth[ cIdx ],
@@ -4474,6 +4660,17 @@ void PageView::slotRelayoutPages()
                 item->setVisible( false );
             }
             item->setFormWidgetsVisible( d->m_formsVisible );
+            // add the displayed rows to the index
+            if ( cIdx + 1 == nCols || itemIndex + 1 == pageCount )
+            {
+                if ( continuousView || rIdx == pageRowIdx )
+                {
+                    const int rowTop = continuousView ? insertY : origInsertY;
+                    const PageViewPrivate::LayoutRow row = { rowTop, rowTop + rHeight, rowFirstItem, itemIndex };
+                    d->layoutRows.append( row );
+                }
+                rowFirstItem = itemIndex + 1;
+            }
             // advance col/row index
             insertX += cWidth;
             if ( ++cIdx == nCols )
@@ -4493,6 +4690,7 @@ void PageView::slotRelayoutPages()
 
     // 3) reset dirty state
     d->dirtyLayout = false;
+    d->moveAllItemWidgets = true;
 
     // 4) update scrollview's contents size and recenter view
     bool wasUpdatesEnabled = viewport()->updatesEnabled();
@@ -4581,7 +4779,6 @@ void PageView::slotRequestVisiblePixmaps( int newValue )
     const QRect viewportRect( horizontalScrollBar()->value(),
                               verticalScrollBar()->value(),
                               viewport()->width(), viewport()->height() );
-    const QRect viewportRectAtZeroZero( 0, 0, viewport()->width(), viewport()->height() );
 
     // some variables used to determine the viewport
     int nearPageNumber = -1;
@@ -4593,33 +4790,27 @@ void PageView::slotRequestVisiblePixmaps( int newValue )
     // Margin (in pixels) around the viewport to preload
     const int pixelsToExpand = 512;
 
-    // iterate over all items
+    // move the form and video widgets: after a relayout all of them, else
+    // only the ones of the items entering or leaving the viewport, as the
+    // others are out of it anyway
+    const QLinkedList< PageViewItem * > previousVisibleItems = d->visibleItems;
+    if ( d->moveAllItemWidgets )
+    {
+        foreach( PageViewItem * i, d->itemsWithWidgets )
+            d->moveItemWidgets( i, viewportRect );
+        d->moveAllItemWidgets = false;
+    }
+
+    // iterate over the items of the rows in the viewport
     d->visibleItems.clear();
     QLinkedList< Okular::PixmapRequest * > requestedPixmaps;
     QVector< Okular::VisiblePageRect * > visibleRects;
-    QVector< PageViewItem * >::const_iterator iIt = d->items.constBegin(), iEnd = d->items.constEnd();
-    for ( ; iIt != iEnd; ++iIt )
+    int firstItem = 0, lastItem = -1;
+    d->itemsInRect( viewportRect, &firstItem, &lastItem );
+    for ( int itemIndex = firstItem; itemIndex <= lastItem; ++itemIndex )
     {
-        PageViewItem * i = *iIt;
-        foreach( FormWidgetIface *fwi, i->formWidgets() )
-        {
-            Okular::NormalizedRect r = fwi->rect();
-            fwi->moveTo(
-                qRound( i->uncroppedGeometry().left() + i->uncroppedWidth() * r.left ) + 1 - viewportRect.left(),
-                qRound( i->uncroppedGeometry().top() + i->uncroppedHeight() * r.top ) + 1 - viewportRect.top() );
-        }
-        Q_FOREACH ( VideoWidget *vw, i->videoWidgets() )
-        {
-            const Okular::NormalizedRect r = vw->normGeometry();
-            vw->move(
-                qRound( i->uncroppedGeometry().left() + i->uncroppedWidth() * r.left ) + 1 - viewportRect.left(),
-                qRound( i->uncroppedGeometry().top() + i->uncroppedHeight() * r.top ) + 1 - viewportRect.top() );
-
-            if ( vw->isPlaying() && viewportRectAtZeroZero.intersect( vw->geometry() ).isEmpty() ) {
-                vw->stop();
-                vw->pageLeft();
-            }
-        }
+        PageViewItem * i = d->items[ itemIndex ];
+        d->moveItemWidgets( i, viewportRect );
 
         if ( !i->isVisible() )
             continue;
@@ -4691,6 +4882,12 @@ void PageView::slotRequestVisiblePixmaps( int newValue )
         }
     }
 
+    foreach( PageViewItem * i, previousVisibleItems )
+    {
+        if ( !d->visibleItems.contains( i ) )
+            d->moveItemWidgets( i, viewportRect );
+    }
+
     // if preloading is enabled, add the pages before and after in preloading
     if ( !d->visibleItems.isEmpty() &&
          Okular::SettingsCore::memoryLevel() != Okular::SettingsCore::EnumMemoryLevel::Low )
@@ -5168,6 +5365,7 @@ void PageView::slotTrimMarginsToggled( bool on )
     {
         Okular::Settings::setTrimMargins( on );
         Okular::Settings::self()->writeConfig();
+        d->document->setBoundingBoxesNeeded( on );
         if ( d->document->pages() > 0 )
         {
             slotRelayoutPages();
@@ -45,6 +45,7 @@
 
 // system includes
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 // local includes
@@ -59,6 +60,7 @@
 #include "core/audioplayer.h"
 #include "core/document.h"
 #include "core/generator.h"
+#include "core/imagekernels_p.h"
 #include "core/movie.h"
 #include "core/page.h"
 #include "settings.h"
@@ -102,7 +104,11 @@ struct PresentationFrame
     const Okular::Page * page;
     QRect geometry;
     QHash< Okular::Movie *, VideoWidget * > videoWidgets;
+    // the annotations whose opening actions ran since the page is shown
+    QSet< const Okular::Annotation * > openedAnnotations;
     QLinkedList< SmoothPath > drawings;
+    // the whole screen ready to be shown (page and margins), if composed
+    QPixmap composed;
 };
 
 
@@ -231,6 +237,9 @@ PresentationWidget::PresentationWidget( QWidget * parent, Okular::Document * doc
     m_nextPageTimer = new QTimer( this ); 
     m_nextPageTimer->setSingleShot( true );
     connect( m_nextPageTimer, SIGNAL(timeout()), this, SLOT(slotNextPage()) ); 
+    m_precomposeTimer = new QTimer( this );
+    m_precomposeTimer->setSingleShot( true );
+    connect( m_precomposeTimer, SIGNAL(timeout()), this, SLOT(slotPrecomposeFrames()) );
 
     connect( m_document, SIGNAL(processMovieAction(const Okular::MovieAction*)), this, SLOT(slotProcessMovieAction(const Okular::MovieAction*)) );
     connect( m_document, SIGNAL(processRenditionAction(const Okular::RenditionAction*)), this, SLOT(slotProcessRenditionAction(const Okular::RenditionAction*)) );
@@ -321,30 +330,7 @@ void PresentationWidget::notifySetup( const QVector< Okular::Page * > & pageSet,
     {
         PresentationFrame * frame = new PresentationFrame();
         frame->page = *setIt;
-        const QLinkedList< Okular::Annotation * > annotations = (*setIt)->annotations();
-        QLinkedList< Okular::Annotation * >::const_iterator aIt = annotations.begin(), aEnd = annotations.end();
-        for ( ; aIt != aEnd; ++aIt )
-        {
-            Okular::Annotation * a = *aIt;
-            if ( a->subType() == Okular::Annotation::AMovie )
-            {
-                Okular::MovieAnnotation * movieAnn = static_cast< Okular::MovieAnnotation * >( a );
-                VideoWidget * vw = new VideoWidget( movieAnn, movieAnn->movie(), m_document, this );
-                frame->videoWidgets.insert( movieAnn->movie(), vw );
-                vw->pageInitialized();
-            }
-            else if ( a->subType() == Okular::Annotation::AScreen )
-            {
-                const Okular::ScreenAnnotation * screenAnn = static_cast< Okular::ScreenAnnotation * >( a );
-                Okular::Movie *movie = GuiUtils::renditionMovieFromScreenAnnotation( screenAnn );
-                if ( movie )
-                {
-                    VideoWidget * vw = new VideoWidget( screenAnn, movie, m_document, this );
-                    frame->videoWidgets.insert( movie, vw );
-                    vw->pageInitialized();
-                }
-            }
-        }
+        addVideoWidgets( frame, (*setIt)->annotations() );
         frame->recalcGeometry( m_width, m_height, screenRatio );
         // add the frame to the vector
         m_frames.push_back( frame );
@@ -378,9 +364,35 @@ void PresentationWidget::notifyPageChanged( int pageNumber, int changedFlags )
     if ( m_blockNotifications )
         return;
 
+    if ( !( changedFlags & ( DocumentObserver::Pixmap | DocumentObserver::Annotations | DocumentObserver::Highlights ) ) )
+        return;
+
+    // the pre-composed frame of the page is outdated now
+    if ( pageNumber >= 0 && pageNumber < m_frames.count() )
+        m_frames[ pageNumber ]->composed = QPixmap();
+
+    // the annotations may have been loaded after the setup
+    if ( ( changedFlags & DocumentObserver::Annotations ) && pageNumber >= 0 && pageNumber < m_frames.count() )
+    {
+        PresentationFrame * frame = m_frames[ pageNumber ];
+        const QList< VideoWidget * > newVideoWidgets = addVideoWidgets( frame, frame->page->annotations() );
+        if ( !newVideoWidgets.isEmpty() )
+            frame->recalcGeometry( m_width, m_height, (float)m_height / (float)m_width );
+
+        if ( pageNumber == m_frameIndex )
+        {
+            performAnnotationsOpeningActions( frame );
+            Q_FOREACH ( VideoWidget *vw, newVideoWidgets )
+                vw->pageEntered();
+        }
+    }
+
     // check if it's the last requested pixmap. if so update the widget.
-    if ( (changedFlags & ( DocumentObserver::Pixmap | DocumentObserver::Annotations | DocumentObserver::Highlights ) ) && pageNumber == m_frameIndex )
+    if ( pageNumber == m_frameIndex )
         generatePage( changedFlags & ( DocumentObserver::Annotations | DocumentObserver::Highlights ) );
+    // a neighbour page got its pixmap: compose its frame before it is needed
+    else if ( qAbs( pageNumber - m_frameIndex ) == 1 && m_frameIndex != -1 )
+        m_precomposeTimer->start( 0 );
 }
 
 void PresentationWidget::notifyCurrentPageChanged( int previousPage, int currentPage )
@@ -402,6 +414,7 @@ void PresentationWidget::notifyCurrentPageChanged( int previousPage, int current
             m_document->processAction( m_document->page( previousPage )->pageAction( Okular::Page::Closing ) );
 
         // perform the additional actions of the page's annotations, if any
+        m_frames[ previousPage ]->openedAnnotations.clear();
         Q_FOREACH ( const Okular::Annotation *annotation, m_document->page( previousPage )->annotations() )
         {
             Okular::Action *action = 0;
@@ -447,18 +460,7 @@ void PresentationWidget::notifyCurrentPageChanged( int previousPage, int current
             m_document->processAction( m_document->page( m_frameIndex )->pageAction( Okular::Page::Opening ) );
 
         // perform the additional actions of the page's annotations, if any
-        Q_FOREACH ( const Okular::Annotation *annotation, m_document->page( m_frameIndex )->annotations() )
-        {
-            Okular::Action *action = 0;
-
-            if ( annotation->subType() == Okular::Annotation::AScreen )
-                action = static_cast<const Okular::ScreenAnnotation*>( annotation )->additionalAction( Okular::Annotation::PageOpening );
-            else if ( annotation->subType() == Okular::Annotation::AWidget )
-                action = static_cast<const Okular::WidgetAnnotation*>( annotation )->additionalAction( Okular::Annotation::PageOpening );
-
-            if ( action )
-                m_document->processAction( action );
-        }
+        performAnnotationsOpeningActions( frame );
 
         // start autoplay video playback
         Q_FOREACH ( VideoWidget *vw, m_frames[ m_frameIndex ]->videoWidgets )
@@ -466,6 +468,61 @@ void PresentationWidget::notifyCurrentPageChanged( int previousPage, int current
     }
 }
 
+QList< VideoWidget * > PresentationWidget::addVideoWidgets( PresentationFrame *frame, const QLinkedList< Okular::Annotation * > &annotations )
+{
+    QList< VideoWidget * > newVideoWidgets;
+    QLinkedList< Okular::Annotation * >::const_iterator aIt = annotations.begin(), aEnd = annotations.end();
+    for ( ; aIt != aEnd; ++aIt )
+    {
+        Okular::Annotation * a = *aIt;
+        if ( a->subType() == Okular::Annotation::AMovie )
+        {
+            Okular::MovieAnnotation * movieAnn = static_cast< Okular::MovieAnnotation * >( a );
+            if ( frame->videoWidgets.contains( movieAnn->movie() ) )
+                continue;
+            VideoWidget * vw = new VideoWidget( movieAnn, movieAnn->movie(), m_document, this );
+            frame->videoWidgets.insert( movieAnn->movie(), vw );
+            vw->pageInitialized();
+            newVideoWidgets.append( vw );
+        }
+        else if ( a->subType() == Okular::Annotation::AScreen )
+        {
+            const Okular::ScreenAnnotation * screenAnn = static_cast< Okular::ScreenAnnotation * >( a );
+            Okular::Movie *movie = GuiUtils::renditionMovieFromScreenAnnotation( screenAnn );
+            if ( movie && !frame->videoWidgets.contains( movie ) )
+            {
+                VideoWidget * vw = new VideoWidget( screenAnn, movie, m_document, this );
+                frame->videoWidgets.insert( movie, vw );
+                vw->pageInitialized();
+                newVideoWidgets.append( vw );
+            }
+        }
+    }
+    return newVideoWidgets;
+}
+
+void PresentationWidget::performAnnotationsOpeningActions( PresentationFrame *frame )
+{
+    // only once per annotation while the page is shown, as the annotations
+    // loaded lazily by the generator arrive after the page was opened
+    Q_FOREACH ( const Okular::Annotation *annotation, frame->page->annotations() )
+    {
+        if ( frame->openedAnnotations.contains( annotation ) )
+            continue;
+        frame->openedAnnotations.insert( annotation );
+
+        Okular::Action *action = 0;
+
+        if ( annotation->subType() == Okular::Annotation::AScreen )
+            action = static_cast<const Okular::ScreenAnnotation*>( annotation )->additionalAction( Okular::Annotation::PageOpening );
+        else if ( annotation->subType() == Okular::Annotation::AWidget )
+            action = static_cast<const Okular::WidgetAnnotation*>( annotation )->additionalAction( Okular::Annotation::PageOpening );
+
+        if ( action )
+            m_document->processAction( action );
+    }
+}
+
 bool PresentationWidget::canUnloadPixmap( int pageNumber ) const
 {
     if ( Okular::SettingsCore::memoryLevel() == Okular::SettingsCore::EnumMemoryLevel::Low ||
@@ -746,6 +803,9 @@ void PresentationWidget::paintEvent( QPaintEvent * pe )
         return;
     }
 
+    // while fading, the frames come from the compositor image
+    const bool fading = !m_fadeFrame.isNull();
+
     // blit the pixmap to the screen
     QVector<QRect> allRects = pe->region().rects();
     uint numRects = allRects.count();
@@ -763,7 +823,10 @@ void PresentationWidget::paintEvent( QPaintEvent * pe )
             QPainter pixPainter( &backPixmap );
 
             // first draw the background on the backbuffer
-            pixPainter.drawPixmap( QPoint(0,0), m_lastRenderedPixmap, r );
+            if ( fading )
+                pixPainter.drawImage( QPoint(0,0), m_fadeFrame, r );
+            else
+                pixPainter.drawPixmap( QPoint(0,0), m_lastRenderedPixmap, r );
 
             // then blend the overlay (a piece of) over the background
             QRect ovr = m_overlayGeometry.intersect( r );
@@ -777,7 +840,10 @@ void PresentationWidget::paintEvent( QPaintEvent * pe )
         } else
 #endif
         // copy the rendered pixmap to the screen
-        painter.drawPixmap( r.topLeft(), m_lastRenderedPixmap, r );
+        if ( fading )
+            painter.drawImage( r.topLeft(), m_fadeFrame, r );
+        else
+            painter.drawPixmap( r.topLeft(), m_lastRenderedPixmap, r );
     }
 
     // paint drawings
@@ -923,26 +989,35 @@ void PresentationWidget::changePage( int newPage )
 
 void PresentationWidget::generatePage( bool disableTransition )
 {
-    if ( m_lastRenderedPixmap.isNull() )
+    PresentationFrame * frame = ( m_frameIndex >= 0 && m_frameIndex < (int)m_document->pages() ) ? m_frames[ m_frameIndex ] : 0;
+
+    m_previousPagePixmap = m_lastRenderedPixmap;
+    if ( frame && frame->composed.size() == QSize( m_width, m_height ) )
     {
-        m_lastRenderedPixmap = QPixmap( m_width, m_height );
-        m_previousPagePixmap = QPixmap();
+        // composed while the previous slide was on screen
+        m_lastRenderedPixmap = frame->composed;
     }
     else
     {
-        m_previousPagePixmap = m_lastRenderedPixmap;
-    }
+        if ( m_lastRenderedPixmap.isNull() )
+            m_lastRenderedPixmap = QPixmap( m_width, m_height );
 
-    // opens the painter over the pixmap
-    QPainter pixmapPainter;
-    pixmapPainter.begin( &m_lastRenderedPixmap );
-    // generate welcome page
-    if ( m_frameIndex == -1 )
-        generateIntroPage( pixmapPainter );
-    // generate a normal pixmap with extended margin filling
-    if ( m_frameIndex >= 0 && m_frameIndex < (int)m_document->pages() )
-        generateContentsPage( m_frameIndex, pixmapPainter );
-    pixmapPainter.end();
+        // opens the painter over the pixmap
+        QPainter pixmapPainter;
+        pixmapPainter.begin( &m_lastRenderedPixmap );
+        // generate welcome page
+        if ( !frame )
+            generateIntroPage( pixmapPainter );
+        // generate a normal pixmap with extended margin filling
+        else
+            generateContentsPage( m_frameIndex, pixmapPainter );
+        pixmapPainter.end();
+
+        // keep the frame for when we come back to this slide
+        if ( frame && Okular::SettingsCore::memoryLevel() != Okular::SettingsCore::EnumMemoryLevel::Low
+             && frame->page->hasPixmap( this, frame->geometry.width(), frame->geometry.height() ) )
+            frame->composed = m_lastRenderedPixmap;
+    }
 
     // generate the top-right corner overlay
 #ifdef ENABLE_PROGRESS_OVERLAY
@@ -974,6 +1049,10 @@ void PresentationWidget::generatePage( bool disableTransition )
         QPoint p = mapFromGlobal( QCursor::pos() );
         testCursorOnLink( p.x(), p.y() );
     }
+
+    // prepare the neighbour slides
+    if ( frame )
+        m_precomposeTimer->start( 0 );
 }
 
 void PresentationWidget::generateIntroPage( QPainter & p )
@@ -1383,7 +1462,7 @@ void PresentationWidget::slotNextPage()
 #endif
         if ( m_transitionTimer->isActive() )
         {
-            m_transitionTimer->stop();
+            stopTransition();
             m_lastRenderedPixmap = m_currentPagePixmap;
             update();
         }
@@ -1410,7 +1489,7 @@ void PresentationWidget::slotPrevPage()
 #endif
         if ( m_transitionTimer->isActive() )
         {
-            m_transitionTimer->stop();
+            stopTransition();
             m_lastRenderedPixmap = m_currentPagePixmap;
             update();
         }
@@ -1436,23 +1515,32 @@ void PresentationWidget::slotHideOverlay()
 
 void PresentationWidget::slotTransitionStep()
 {
+    // frame time accounting: a step coming much later than scheduled means
+    // the previous frame stayed on screen for too long
+    const qint64 now = m_transitionClock.elapsed();
+    if ( m_transitionFrames > 0 && m_transitionDelay > 0 && now - m_lastTransitionStep > m_transitionDelay * 3 / 2 )
+        m_droppedTransitionFrames += qMax( 1, (int)( ( now - m_lastTransitionStep ) / m_transitionDelay ) - 1 );
+    m_lastTransitionStep = now;
+    ++m_transitionFrames;
+
     switch( m_currentTransition.type() )
     {
         case Okular::PageTransition::Fade:
         {
-            QPainter pixmapPainter;
             m_currentPixmapOpacity += 1.0 / m_transitionSteps;
-            m_lastRenderedPixmap = QPixmap( m_lastRenderedPixmap.size() );
-            m_lastRenderedPixmap.fill( Qt::transparent );
-            pixmapPainter.begin( &m_lastRenderedPixmap );
-            pixmapPainter.setCompositionMode( QPainter::CompositionMode_Source );
-            pixmapPainter.setOpacity( 1 - m_currentPixmapOpacity );
-            pixmapPainter.drawPixmap( 0, 0, m_previousPagePixmap );
-            pixmapPainter.setOpacity( m_currentPixmapOpacity );
-            pixmapPainter.drawPixmap( 0, 0, m_currentPagePixmap );
-            update();
-            if( m_currentPixmapOpacity >= 1 )
+            if ( m_currentPixmapOpacity >= 1 )
+            {
+                // the last frame is the new page itself
+                m_fadeFrame = QImage();
+                m_fadeFrom = QImage();
+                m_fadeTo = QImage();
+                update( m_fadeRect );
+                finishTransition();
                 return;
+            }
+            // only the area where the two pages differ changes
+            Okular::ImageKernels::blendRect( m_fadeFrame, m_fadeFrom, m_fadeTo, m_fadeRect, qRound( m_currentPixmapOpacity * 255 ) );
+            update( m_fadeRect );
         } break;
         default:
         {
@@ -1461,6 +1549,7 @@ void PresentationWidget::slotTransitionStep()
                 // it's better to fix the transition to cover the whole screen than
                 // enabling the following line that wastes cpu for nothing
                 //update();
+                finishTransition();
                 return;
             }
 
@@ -1474,6 +1563,36 @@ void PresentationWidget::slotTransitionStep()
     m_transitionTimer->start( m_transitionDelay );
 }
 
+void PresentationWidget::slotPrecomposeFrames()
+{
+    // do not steal time from a running transition
+    if ( m_transitionTimer->isActive() )
+    {
+        m_precomposeTimer->start( m_transitionDelay + 1 );
+        return;
+    }
+
+    const bool keepFrames = Okular::SettingsCore::memoryLevel() != Okular::SettingsCore::EnumMemoryLevel::Low;
+    for ( int i = 0; i < m_frames.count(); ++i )
+    {
+        PresentationFrame * frame = m_frames[ i ];
+        if ( !keepFrames || m_frameIndex == -1 || qAbs( i - m_frameIndex ) > 1 )
+        {
+            frame->composed = QPixmap();
+            continue;
+        }
+        if ( i == m_frameIndex || !frame->composed.isNull()
+             || !frame->page->hasPixmap( this, frame->geometry.width(), frame->geometry.height() ) )
+            continue;
+
+        QPixmap composed( m_width, m_height );
+        QPainter pixmapPainter( &composed );
+        generateContentsPage( i, pixmapPainter );
+        pixmapPainter.end();
+        frame->composed = composed;
+    }
+}
+
 void PresentationWidget::slotDelayedEvents()
 {
     recalcGeometry();
@@ -1596,6 +1715,7 @@ void PresentationWidget::applyNewScreenSize( const QSize & oldSize )
     for ( ; fIt != fEnd; ++fIt )
     {
         (*fIt)->recalcGeometry( m_width, m_height, screenRatio );
+        (*fIt)->composed = QPixmap();
     }
 
     if ( m_frameIndex != -1 )
@@ -1610,7 +1730,7 @@ void PresentationWidget::applyNewScreenSize( const QSize & oldSize )
     }
     if ( m_transitionTimer->isActive() )
     {
-        m_transitionTimer->stop();
+        stopTransition();
     }
     generatePage( true /* no transitions */ );
 }
@@ -1830,9 +1950,57 @@ const Okular::PageTransition PresentationWidget::defaultTransition( int type ) c
     return Okular::PageTransition();
 }
 
+// the smallest rect containing all the pixels that differ between the
+// two 32 bit images of the same size
+static QRect differingRect( const QImage &a, const QImage &b )
+{
+    const int width = a.width();
+    const int lineBytes = width * 4;
+    int top = 0, bottom = a.height() - 1;
+    while ( top <= bottom && memcmp( a.constScanLine( top ), b.constScanLine( top ), lineBytes ) == 0 )
+        ++top;
+    if ( top > bottom )
+        return QRect();
+    while ( memcmp( a.constScanLine( bottom ), b.constScanLine( bottom ), lineBytes ) == 0 )
+        --bottom;
+
+    int left = width, right = -1;
+    for ( int y = top; y <= bottom; ++y )
+    {
+        const quint32 * la = reinterpret_cast< const quint32 * >( a.constScanLine( y ) );
+        const quint32 * lb = reinterpret_cast< const quint32 * >( b.constScanLine( y ) );
+        int x = 0;
+        while ( x < left && la[ x ] == lb[ x ] )
+            ++x;
+        left = x;
+        x = width - 1;
+        while ( x > right && la[ x ] == lb[ x ] )
+            --x;
+        right = x;
+    }
+    return QRect( QPoint( left, top ), QPoint( right, bottom ) );
+}
+
+void PresentationWidget::stopTransition()
+{
+    m_transitionTimer->stop();
+    m_fadeFrame = QImage();
+    m_fadeFrom = QImage();
+    m_fadeTo = QImage();
+}
+
+void PresentationWidget::finishTransition()
+{
+    kDebug() << "Transition done:" << m_transitionFrames << "frames in" << m_transitionClock.elapsed() << "ms,"
+             << m_droppedTransitionFrames << "dropped";
+    emit transitionFinished( m_transitionFrames, m_droppedTransitionFrames );
+}
+
 /** ONLY the TRANSITIONS GENERATION function from here on **/
 void PresentationWidget::initTransition( const Okular::PageTransition *transition )
 {
+    stopTransition();
+
     // if it's just a 'replace' transition, repaint the screen
     if ( transition->type() == Okular::PageTransition::Replace )
     {
@@ -2181,20 +2349,33 @@ void PresentationWidget::initTransition( const Okular::PageTransition *transitio
         case Okular::PageTransition::Fade:
         {
             enum {FADE_TRANSITION_FPS = 20};
-            const int steps = totalTime * FADE_TRANSITION_FPS;
+            const int steps = qMax( 1, (int)( totalTime * FADE_TRANSITION_FPS ) );
             m_transitionSteps = steps;
-            QPainter pixmapPainter;
             m_currentPixmapOpacity = (double) 1 / steps;
             m_transitionDelay = (int)( totalTime * 1000 ) / steps;
-            m_lastRenderedPixmap = QPixmap( m_lastRenderedPixmap.size() );
-            m_lastRenderedPixmap.fill( Qt::transparent );
-            pixmapPainter.begin( &m_lastRenderedPixmap );
-            pixmapPainter.setCompositionMode( QPainter::CompositionMode_Source );
-            pixmapPainter.setOpacity( 1 - m_currentPixmapOpacity );
-            pixmapPainter.drawPixmap( 0, 0, m_previousPagePixmap );
-            pixmapPainter.setOpacity( m_currentPixmapOpacity );
-            pixmapPainter.drawPixmap( 0, 0, m_currentPagePixmap );
-            pixmapPainter.end();
+
+            // the frames are blended on the cpu: get both pages as images
+            // once, and restrict the work to the area where they differ
+            m_fadeTo = m_currentPagePixmap.toImage().convertToFormat( QImage::Format_RGB32 );
+            if ( m_previousPagePixmap.size() == m_currentPagePixmap.size() )
+            {
+                m_fadeFrom = m_previousPagePixmap.toImage().convertToFormat( QImage::Format_RGB32 );
+            }
+            else
+            {
+                m_fadeFrom = QImage( m_fadeTo.size(), QImage::Format_RGB32 );
+                m_fadeFrom.fill( Okular::Settings::slidesBackgroundColor().rgb() );
+            }
+            m_fadeRect = differingRect( m_fadeFrom, m_fadeTo );
+            if ( m_fadeRect.isEmpty() )
+            {
+                m_fadeFrom = QImage();
+                m_fadeTo = QImage();
+                update();
+                return;
+            }
+            m_fadeFrame = m_fadeFrom;
+            Okular::ImageKernels::blendRect( m_fadeFrame, m_fadeFrom, m_fadeTo, m_fadeRect, qRound( m_currentPixmapOpacity * 255 ) );
             update();
         } break;
         // implement missing transitions (a binary raster engine needed here)
@@ -2212,6 +2393,10 @@ void PresentationWidget::initTransition( const Okular::PageTransition *transitio
     }
 
     // send the first start to the timer
+    m_transitionClock.start();
+    m_lastTransitionStep = 0;
+    m_transitionFrames = 0;
+    m_droppedTransitionFrames = 0;
     m_transitionTimer->start( 0 );
 }
 
@@ -10,6 +10,9 @@
 #ifndef _OKULAR_PRESENTATIONWIDGET_H_
 #define _OKULAR_PRESENTATIONWIDGET_H_
 
+#include <qelapsedtimer.h>
+#include <qimage.h>
+#include <qlinkedlist.h>
 #include <qlist.h>
 #include <qpixmap.h>
 #include <qstringlist.h>
@@ -24,6 +27,7 @@ class QTimer;
 class KActionCollection;
 class KSelectAction;
 class SmoothPathEngine;
+class VideoWidget;
 struct PresentationFrame;
 class PresentationSearchBar;
 
@@ -55,6 +59,13 @@ class PresentationWidget : public QWidget, public Okular::DocumentObserver
         bool canUnloadPixmap( int pageNumber ) const;
         void notifyCurrentPageChanged( int previous, int current );
 
+    signals:
+        /**
+         * A transition ended after @p frames steps; @p droppedFrames is the
+         * number of steps that were skipped because they came late.
+         */
+        void transitionFinished( int frames, int droppedFrames );
+
     public slots:
         void slotFind();
 
@@ -78,10 +89,14 @@ class PresentationWidget : public QWidget, public Okular::DocumentObserver
         void overlayClick( const QPoint & position );
         void changePage( int newPage );
         void generatePage( bool disableTransition = false );
+        QList< VideoWidget * > addVideoWidgets( PresentationFrame *frame, const QLinkedList< Okular::Annotation * > &annotations );
+        void performAnnotationsOpeningActions( PresentationFrame *frame );
         void generateIntroPage( QPainter & p );
         void generateContentsPage( int page, QPainter & p );
         void generateOverlay();
         void initTransition( const Okular::PageTransition *transition );
+        void stopTransition();
+        void finishTransition();
         const Okular::PageTransition defaultTransition() const;
         const Okular::PageTransition defaultTransition( int ) const;
         QRect routeMouseDrawingEvent( QMouseEvent * );
@@ -124,6 +139,15 @@ class PresentationWidget : public QWidget, public Okular::DocumentObserver
         QPixmap m_currentPagePixmap;
         QPixmap m_previousPagePixmap;
         double m_currentPixmapOpacity;
+        QImage m_fadeFrom;
+        QImage m_fadeTo;
+        QImage m_fadeFrame;
+        QRect m_fadeRect;
+        QElapsedTimer m_transitionClock;
+        qint64 m_lastTransitionStep;
+        int m_transitionFrames;
+        int m_droppedTransitionFrames;
+        QTimer * m_precomposeTimer;
 
         // misc stuff
         QWidget * m_parentWidget;
@@ -149,6 +173,7 @@ class PresentationWidget : public QWidget, public Okular::DocumentObserver
         void slotLastPage();
         void slotHideOverlay();
         void slotTransitionStep();
+        void slotPrecomposeFrames();
         void slotDelayedEvents();
         void slotPageChanged();
         void togglePencilMode( bool );
@@ -10,7 +10,13 @@
 #include "thumbnaillist.h"
 
 // qt/kde includes
+#include <qbuffer.h>
+#include <qcache.h>
+#include <qdatastream.h>
 #include <qevent.h>
+#include <qfile.h>
+#include <qhash.h>
+#include <qimage.h>
 #include <qtimer.h>
 #include <qpainter.h>
 #include <qscrollbar.h>
@@ -23,6 +29,9 @@
 #include <kactioncollection.h>
 #include <kicon.h>
 #include <kglobalsettings.h>
+#include <ksavefile.h>
+#include <threadweaver/Job.h>
+#include <threadweaver/ThreadWeaver.h>
 
 // local includes
 #include "pagepainter.h"
@@ -36,6 +45,34 @@
 
 class ThumbnailWidget;
 
+// Encodes a thumbnail to JPEG, out of the GUI thread
+class ThumbnailEncodingJob : public ThreadWeaver::Job
+{
+    public:
+        ThumbnailEncodingJob( int pageNumber, const QImage & image )
+            : m_pageNumber( pageNumber ), m_image( image )
+        {
+        }
+
+        int pageNumber() const { return m_pageNumber; }
+        qint64 imageKey() const { return m_image.cacheKey(); }
+        QByteArray data() const { return m_data; }
+
+    protected:
+        void run()
+        {
+            QBuffer buffer( &m_data );
+            buffer.open( QIODevice::WriteOnly );
+            if ( !m_image.save( &buffer, "JPG", 85 ) )
+                m_data.clear();
+        }
+
+    private:
+        const int m_pageNumber;
+        const QImage m_image;
+        QByteArray m_data;
+};
+
 class ThumbnailListPrivate : public QWidget
 {
     public:
@@ -63,6 +100,23 @@ class ThumbnailListPrivate : public QWidget
         QPoint m_mouseGrabPos;
         ThumbnailWidget *m_mouseGrabItem;
         int m_pageCurrentlyGrabbed;
+        // thumbnails saved for the document, shown until the real pixmaps arrive
+        QString m_storedThumbnailsFile;
+        QHash<int, QByteArray> m_storedThumbnails;
+        QCache<int, QImage> m_decodedThumbnails;
+        bool m_storedThumbnailsChanged;
+        // the image being encoded for each page
+        QHash<int, qint64> m_encodingThumbnails;
+
+        // switch the stored thumbnails to the ones of the given file
+        void setStoredThumbnailsFile( const QString & fileName );
+        void loadStoredThumbnails();
+        void saveStoredThumbnails();
+        // keep a copy of the pixmap just generated for the thumbnail, once
+        // it is encoded
+        void storeThumbnail( const ThumbnailWidget * t );
+        // the stored thumbnail of the given page, or 0 if not available
+        const QImage * storedThumbnail( const ThumbnailWidget * t );
 
         // resize thumbnails to fit the width
         void viewportResizeEvent( QResizeEvent * );
@@ -79,6 +133,8 @@ class ThumbnailListPrivate : public QWidget
         void slotRequestVisiblePixmaps( int newContentsY = -1 );
         // delay timeout: resize overlays and requests pixmaps
         void slotDelayTimeout();
+        // a thumbnail to store has been encoded
+        void slotThumbnailEncoded( ThreadWeaver::Job * job );
         ThumbnailWidget* getPageByNumber( int page ) const;
         int getNewPageOffset( int n, ThumbnailListPrivate::ChangePageDirection dir ) const;
         ThumbnailWidget *getThumbnailbyOffset( int current, int offset ) const;
@@ -143,7 +199,8 @@ class ThumbnailWidget
 
 ThumbnailListPrivate::ThumbnailListPrivate( ThumbnailList *qq, Okular::Document *document )
     : QWidget(), q( qq ), m_document( document ), m_selected( 0 ),
-    m_delayTimer( 0 ), m_bookmarkOverlay( 0 ), m_vectorIndex( 0 )
+    m_delayTimer( 0 ), m_bookmarkOverlay( 0 ), m_vectorIndex( 0 ),
+    m_decodedThumbnails( 64 ), m_storedThumbnailsChanged( false )
 {
     setMouseTracking( true );
     m_mouseGrabItem = 0;
@@ -163,6 +220,127 @@ ThumbnailWidget* ThumbnailListPrivate::getPageByNumber( int page ) const
 
 ThumbnailListPrivate::~ThumbnailListPrivate()
 {
+    saveStoredThumbnails();
+}
+
+static const quint32 storedThumbnailsMagic = 0x4f6b5468; // "OkTh"
+static const qint32 storedThumbnailsVersion = 1;
+
+void ThumbnailListPrivate::setStoredThumbnailsFile( const QString & fileName )
+{
+    if ( fileName == m_storedThumbnailsFile )
+        return;
+
+    saveStoredThumbnails();
+    m_storedThumbnails.clear();
+    m_decodedThumbnails.clear();
+    // the thumbnails still being encoded are of the previous document
+    m_encodingThumbnails.clear();
+    m_storedThumbnailsFile = fileName;
+    loadStoredThumbnails();
+}
+
+void ThumbnailListPrivate::loadStoredThumbnails()
+{
+    if ( m_storedThumbnailsFile.isEmpty() )
+        return;
+
+    QFile file( m_storedThumbnailsFile );
+    if ( !file.open( QIODevice::ReadOnly ) )
+        return;
+
+    QDataStream stream( &file );
+    quint32 magic;
+    qint32 version, pageCount;
+    stream >> magic >> version >> pageCount;
+    if ( magic != storedThumbnailsMagic || version != storedThumbnailsVersion || pageCount != (int)m_document->pages() )
+        return;
+
+    QHash<int, QByteArray> thumbnails;
+    stream >> thumbnails;
+    if ( stream.status() == QDataStream::Ok )
+        m_storedThumbnails = thumbnails;
+}
+
+void ThumbnailListPrivate::saveStoredThumbnails()
+{
+    if ( !m_storedThumbnailsChanged || m_storedThumbnailsFile.isEmpty() )
+        return;
+
+    m_storedThumbnailsChanged = false;
+    KSaveFile file( m_storedThumbnailsFile );
+    if ( !file.open() )
+        return;
+
+    QDataStream stream( &file );
+    stream << storedThumbnailsMagic << storedThumbnailsVersion << (qint32)m_document->pages();
+    stream << m_storedThumbnails;
+    if ( stream.status() != QDataStream::Ok || !file.finalize() )
+        file.abort();
+}
+
+void ThumbnailListPrivate::storeThumbnail( const ThumbnailWidget * t )
+{
+    if ( m_storedThumbnailsFile.isEmpty() )
+        return;
+
+    // the plain page, without highlights and annotations
+    QImage image( t->pixmapWidth(), t->pixmapHeight(), QImage::Format_RGB32 );
+    image.fill( Qt::white );
+    QPainter p( &image );
+    PagePainter::paintPageOnPainter( &p, t->page(), q, 0, t->pixmapWidth(), t->pixmapHeight(), image.rect() );
+    p.end();
+
+    // a newer image of the page replaces the one being encoded
+    m_encodingThumbnails.insert( t->pageNumber(), image.cacheKey() );
+    ThumbnailEncodingJob * job = new ThumbnailEncodingJob( t->pageNumber(), image );
+    QObject::connect( job, SIGNAL(done(ThreadWeaver::Job*)),
+                      q, SLOT(slotThumbnailEncoded(ThreadWeaver::Job*)) );
+    QObject::connect( job, SIGNAL(done(ThreadWeaver::Job*)), job, SLOT(deleteLater()) );
+    ThreadWeaver::Weaver::instance()->enqueue( job );
+}
+
+void ThumbnailListPrivate::slotThumbnailEncoded( ThreadWeaver::Job * j )
+{
+    const ThumbnailEncodingJob * job = static_cast< ThumbnailEncodingJob * >( j );
+
+    QHash<int, qint64>::iterator it = m_encodingThumbnails.find( job->pageNumber() );
+    if ( it == m_encodingThumbnails.end() || it.value() != job->imageKey() )
+        return;
+
+    m_encodingThumbnails.erase( it );
+    if ( job->data().isEmpty() )
+        return;
+
+    m_storedThumbnails.insert( job->pageNumber(), job->data() );
+    m_decodedThumbnails.remove( job->pageNumber() );
+    m_storedThumbnailsChanged = true;
+}
+
+const QImage * ThumbnailListPrivate::storedThumbnail( const ThumbnailWidget * t )
+{
+    QImage * image = m_decodedThumbnails.object( t->pageNumber() );
+    if ( !image )
+    {
+        QHash<int, QByteArray>::const_iterator it = m_storedThumbnails.constFind( t->pageNumber() );
+        if ( it == m_storedThumbnails.constEnd() )
+            return 0;
+
+        image = new QImage( QImage::fromData( it.value(), "JPG" ) );
+        if ( image->isNull() )
+        {
+            delete image;
+            return 0;
+        }
+        m_decodedThumbnails.insert( t->pageNumber(), image );
+    }
+
+    // discard thumbnails of a different orientation (e.g. rotated document)
+    const double ratio = (double)image->height() / image->width();
+    if ( qAbs( ratio - t->page()->ratio() ) > 0.05 * t->page()->ratio() )
+        return 0;
+
+    return image;
 }
 
 ThumbnailWidget* ThumbnailListPrivate::itemFor( const QPoint & p ) const
@@ -246,6 +424,9 @@ void ThumbnailList::notifySetup( const QVector< Okular::Page * > & pages, int se
     d->m_selected = 0;
     d->m_mouseGrabItem = 0;
 
+    if ( setupFlags & Okular::DocumentObserver::DocumentChanged )
+        d->setStoredThumbnailsFile( pages.isEmpty() ? QString() : d->m_document->cacheFileName( QLatin1String( ".thumbnails" ) ) );
+
     if ( pages.count() < 1 )
     {
         widget()->resize( 0, 0 );
@@ -348,7 +529,10 @@ void ThumbnailList::notifyPageChanged( int pageNumber, int changedFlags )
     for ( ; vIt != vEnd; ++vIt )
         if ( (*vIt)->pageNumber() == pageNumber )
         {
-            (*vIt)->update();
+            ThumbnailWidget * t = *vIt;
+            if ( ( changedFlags & DocumentObserver::Pixmap ) && t->page()->hasPixmap( this, t->pixmapWidth(), t->pixmapHeight() ) )
+                d->storeThumbnail( t );
+            t->update();
             break;
         }
 }
@@ -623,7 +807,7 @@ void ThumbnailListPrivate::slotRequestVisiblePixmaps( int /*newContentsY*/ )
         // if pixmap not present add it to requests
         if ( !t->page()->hasPixmap( q, t->pixmapWidth(), t->pixmapHeight() ) )
         {
-            Okular::PixmapRequest * p = new Okular::PixmapRequest( q, t->pageNumber(), t->pixmapWidth(), t->pixmapHeight(), THUMBNAILS_PRIO, Okular::PixmapRequest::Asynchronous );
+            Okular::PixmapRequest * p = new Okular::PixmapRequest( q, t->pageNumber(), t->pixmapWidth(), t->pixmapHeight(), THUMBNAILS_PRIO, Okular::PixmapRequest::Asynchronous | Okular::PixmapRequest::ReuseLargerPixmap );
             requestedPixmaps.push_back( p );
         }
     }
@@ -942,9 +1126,18 @@ void ThumbnailWidget::paint( QPainter &p, const QRect &_clipRect )
         clipRect = clipRect.intersect( QRect( 0, 0, m_pixmapWidth, m_pixmapHeight ) );
         if ( clipRect.isValid() )
         {
-            int flags = PagePainter::Accessibility | PagePainter::Highlights |
-                        PagePainter::Annotations;
-            PagePainter::paintPageOnPainter( &p, m_page, m_parent->q, flags, m_pixmapWidth, m_pixmapHeight, clipRect );
+            // until the pixmap arrives show the thumbnail stored for the document
+            const QImage * stored = m_page->hasPixmap( m_parent->q ) ? 0 : m_parent->storedThumbnail( this );
+            if ( stored )
+            {
+                p.drawImage( QRect( 0, 0, m_pixmapWidth, m_pixmapHeight ), *stored );
+            }
+            else
+            {
+                int flags = PagePainter::Accessibility | PagePainter::Highlights |
+                            PagePainter::Annotations;
+                PagePainter::paintPageOnPainter( &p, m_page, m_parent->q, flags, m_pixmapWidth, m_pixmapHeight, clipRect );
+            }
         }
 
         if ( !m_visibleRect.isNull() )
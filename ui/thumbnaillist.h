@@ -23,6 +23,10 @@ namespace Okular {
 class Document;
 }
 
+namespace ThreadWeaver {
+class Job;
+}
+
 /**
  * @short A scrollview that displays page pixmap previews (aka thumbnails).
  *
@@ -71,6 +75,7 @@ Q_OBJECT
 
         Q_PRIVATE_SLOT( d, void slotRequestVisiblePixmaps( int newContentsY = -1 ) )
         Q_PRIVATE_SLOT( d, void slotDelayTimeout() )
+        Q_PRIVATE_SLOT( d, void slotThumbnailEncoded( ThreadWeaver::Job * ) )
 };
 
 /**